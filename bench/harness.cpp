@@ -0,0 +1,146 @@
+#include "harness.h"
+
+#include <math/simd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+
+// ----- Allocation Counting -----
+
+// Every heap allocation in the benchmark program goes through these. The benchmarks run on one
+// thread, so a plain counter is enough.
+static std::int64_t allocated = 0;
+
+static void* allocate(std::size_t bytes, std::size_t alignment)
+{
+  allocated++;
+
+  bytes = (bytes + alignment - 1) / alignment * alignment;
+  void* memory = alignment > alignof(std::max_align_t) ? std::aligned_alloc(alignment, bytes)
+                                                       : std::malloc(bytes ? bytes : 1);
+  if (!memory)
+    throw std::bad_alloc();
+
+  return memory;
+}
+
+void* operator new(std::size_t bytes)
+{
+  return allocate(bytes, alignof(std::max_align_t));
+}
+
+void* operator new(std::size_t bytes, std::align_val_t alignment)
+{
+  return allocate(bytes, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept { std::free(memory); }
+
+namespace flexor::bench
+{
+
+std::int64_t allocations() { return allocated; }
+
+// ----- Inputs -----
+
+float random(float low, float high)
+{
+  static std::mt19937 generator(5489u);
+  return std::uniform_real_distribution<float>(low, high)(generator);
+}
+
+// ----- Helper Functions -----
+
+static const char* backendName()
+{
+#if defined(FLEXOR_SIMD_AVX2)
+  return "avx2";
+#elif defined(FLEXOR_SIMD_SSE)
+  return "sse";
+#else
+  return "scalar";
+#endif
+}
+
+// Writes a string as a JSON string, quotes and all.
+static void writeString(std::ostream& out, std::string_view text)
+{
+  out << '"';
+  for (char c : text)
+  {
+    if (c == '"' || c == '\\')
+      out << '\\';
+    out << c;
+  }
+  out << '"';
+}
+
+// ----- Runner -----
+
+bool runner::selected(std::string_view name) const
+{
+  return name.find(config.filter) != std::string_view::npos;
+}
+
+void runner::report(result measurement)
+{
+  if (config.table)
+  {
+    char row[128];
+    if (measured.empty())
+    {
+      std::snprintf(row, sizeof(row), "%-32s %8s %14s %12s %10s\n", "benchmark", "size", "ns/op",
+                    "allocs/op", "GFLOP/s");
+      *config.table << row;
+    }
+
+    std::snprintf(row, sizeof(row), "%-32s %8d %14.2f %12.2f %10.3f\n", measurement.name.c_str(),
+                  measurement.size, measurement.nsPerOp, measurement.allocationsPerOp,
+                  measurement.gflops());
+    *config.table << row << std::flush;
+  }
+
+  measured.push_back(std::move(measurement));
+}
+
+void runner::writeJson(std::ostream& out) const
+{
+  out << "{\n";
+  out << "  \"backend\": \"" << backendName() << "\",\n";
+  out << "  \"wide_lanes\": " << simd::wideLanes << ",\n";
+#ifdef NDEBUG
+  out << "  \"assertions\": false,\n";
+#else
+  out << "  \"assertions\": true,\n";
+#endif
+  out << "  \"min_time\": " << config.minTime << ",\n";
+  out << "  \"samples\": " << config.samples << ",\n";
+  out << "  \"benchmarks\": [";
+
+  char number[64];
+  for (std::size_t i = 0; i < measured.size(); i++)
+  {
+    const result& measurement = measured[i];
+    out << (i > 0 ? ",\n" : "\n") << "    {\"name\": ";
+    writeString(out, measurement.name);
+    out << ", \"size\": " << measurement.size << ", \"iterations\": " << measurement.iterations;
+
+    std::snprintf(number, sizeof(number), "%.4f", measurement.nsPerOp);
+    out << ", \"ns_per_op\": " << number;
+    std::snprintf(number, sizeof(number), "%.4f", measurement.allocationsPerOp);
+    out << ", \"allocations_per_op\": " << number;
+    std::snprintf(number, sizeof(number), "%.1f", measurement.flopsPerOp);
+    out << ", \"flops_per_op\": " << number;
+    std::snprintf(number, sizeof(number), "%.4f", measurement.gflops());
+    out << ", \"gflops\": " << number << "}";
+  }
+
+  out << (measured.empty() ? "]\n" : "\n  ]\n") << "}\n";
+}
+
+} // namespace flexor::bench
\ No newline at end of file
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace flexor::bench
+{
+
+// ----- Optimization Barriers -----
+
+/**
+ * Makes the compiler believe a value is read, so the work that produced it can't be thrown away.
+ * The value is forced into a register or memory, but nothing is actually done with it. It also
+ * acts as if all of memory were read, so results written in place, such as a vector assigned an
+ * expression, are really written.
+ */
+template <typename T> inline void keep(const T& value)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+  static const void* volatile sink;
+  sink = &value;
+  _ReadWriteBarrier();
+#else
+  asm volatile("" : : "r,m"(value) : "memory");
+#endif
+}
+
+// ----- Allocation Counting -----
+
+/**
+ * The number of heap allocations the program has made so far. Every operator new in the benchmark
+ * program is replaced to count them.
+ */
+std::int64_t allocations();
+
+// ----- Inputs -----
+
+/**
+ * Returns a number in [low, high). The numbers come from a fixed seed, so every run of the same
+ * benchmarks works on the same inputs.
+ */
+float random(float low = -1.0f, float high = 1.0f);
+
+// ----- Runner -----
+
+struct settings
+{
+  // How long each sample of a benchmark runs for. The number of operations per sample is picked to
+  // fill it.
+  double minTime = 0.02;
+  // The number of samples, which must be at least one.
+  int samples = 5;
+
+  // Only benchmarks whose name contains the filter are run.
+  std::string filter;
+
+  // Where each result is written as a row of a table as soon as it is measured, if anywhere, so a
+  // long run shows its progress.
+  std::ostream* table = nullptr;
+};
+
+/**
+ * What one benchmark measured. The time per operation is the best of the samples, which is the one
+ * least disturbed by the rest of the machine.
+ */
+struct result
+{
+  std::string name;
+  int size;
+  std::int64_t iterations;
+  double nsPerOp;
+  double allocationsPerOp;
+  double flopsPerOp;
+
+  double gflops() const { return nsPerOp > 0.0 ? flopsPerOp / nsPerOp : 0.0; }
+};
+
+/**
+ * Times operations and collects what they measured. A benchmark is an operation that is called
+ * over and over with the number of the call, which it can use to cycle through its inputs.
+ *
+ * The floating point operations of an operation are the adds, multiplies, divides and square roots
+ * of its textbook formula. Factorizations and inverses use the usual dense counts (2/3 n^3 for LU,
+ * and so on) whatever shortcuts the code takes, so that GFLOP/s compares against the same yardstick
+ * from one size or backend to the next. Operations that only move data count none.
+ */
+class runner
+{
+public:
+  runner(const settings& config)
+    : config(config)
+  {
+  }
+
+  /**
+   * Runs a benchmark, unless the filter leaves it out. The name is the operation, and is reported
+   * along with the size, which is the dimension or number of elements it works on.
+   */
+  template <typename Op> void run(std::string_view name, int size, double flopsPerOp, Op&& op);
+
+  /**
+   * Returns whether a benchmark would run, so that a suite can skip setting up its inputs.
+   */
+  bool selected(std::string_view name) const;
+
+  const std::vector<result>& results() const { return measured; }
+
+  /**
+   * Writes every result as JSON, for tools that track them from one build to the next.
+   */
+  void writeJson(std::ostream& out) const;
+
+private:
+  template <typename Op> static double time(Op& op, std::int64_t iterations);
+
+  void report(result measurement);
+
+  settings config;
+  std::vector<result> measured;
+};
+
+template <typename Op>
+void runner::run(std::string_view name, int size, double flopsPerOp, Op&& op)
+{
+  if (!selected(name))
+    return;
+
+  // Grow the number of operations until a sample takes long enough to time well. The first pass
+  // also warms up the caches and whatever memory the operation keeps around.
+  std::int64_t iterations = 1;
+  double seconds = time(op, iterations);
+  while (seconds < config.minTime && iterations < (std::int64_t(1) << 40))
+  {
+    double scale = seconds > 0.0 ? config.minTime * 1.2 / seconds : 100.0;
+    iterations = static_cast<std::int64_t>(iterations * std::clamp(scale, 2.0, 100.0));
+    seconds = time(op, iterations);
+  }
+
+  double best = seconds;
+  std::int64_t before = allocations();
+  for (int sample = 0; sample < config.samples; sample++)
+  {
+    double sampleSeconds = time(op, iterations);
+    best = sampleSeconds < best ? sampleSeconds : best;
+  }
+  std::int64_t allocated = allocations() - before;
+
+  std::int64_t total = iterations * config.samples;
+  report({std::string(name), size, iterations, best * 1e9 / iterations,
+          static_cast<double>(allocated) / total, flopsPerOp});
+}
+
+template <typename Op> double runner::time(Op& op, std::int64_t iterations)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (std::int64_t i = 0; i < iterations; i++)
+    op(static_cast<std::size_t>(i));
+  auto end = std::chrono::steady_clock::now();
+
+  return std::chrono::duration<double>(end - start).count();
+}
+
+} // namespace flexor::bench
+
+// ----- Suites -----
+
+// Each suite benchmarks the operators of one header, and lives in the file named after it.
+void math_vector(flexor::bench::runner& runner);
+void math_matrix(flexor::bench::runner& runner);
+void math_quaternion(flexor::bench::runner& runner);
+void math_solver(flexor::bench::runner& runner);
\ No newline at end of file
@@ -0,0 +1,76 @@
+#include "harness.h"
+using namespace flexor;
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+static int usage()
+{
+  std::cerr << "usage: flexor-bench [--filter text] [--json path] [--min-time seconds] "
+               "[--samples count]\n"
+               "\n"
+               "  --filter    only run benchmarks whose name contains the text\n"
+               "  --json      write the results as JSON to a file, or to stdout for -\n"
+               "  --min-time  how long each sample of a benchmark runs (default 0.02)\n"
+               "  --samples   how many samples to take the best of (default 5)\n";
+  return 1;
+}
+
+int main(int argc, char** argv)
+{
+  bench::settings config;
+  const char* jsonPath = nullptr;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (i + 1 >= argc)
+      return usage();
+
+    if (std::strcmp(argv[i], "--filter") == 0)
+      config.filter = argv[++i];
+    else if (std::strcmp(argv[i], "--json") == 0)
+      jsonPath = argv[++i];
+    else if (std::strcmp(argv[i], "--min-time") == 0)
+      config.minTime = std::atof(argv[++i]);
+    else if (std::strcmp(argv[i], "--samples") == 0)
+      config.samples = std::atoi(argv[++i]);
+    else
+      return usage();
+  }
+
+  if (config.minTime <= 0.0 || config.samples < 1)
+    return usage();
+
+  // JSON on stdout moves the table to stderr, so the two can be piped apart.
+  bool jsonToStdout = jsonPath && std::strcmp(jsonPath, "-") == 0;
+  config.table = jsonToStdout ? &std::cerr : &std::cout;
+
+#ifndef NDEBUG
+  *config.table << "warning: assertions are enabled, so the numbers include them. Build with "
+                   "-DCMAKE_BUILD_TYPE=Release for numbers worth comparing.\n\n";
+#endif
+
+  bench::runner runner(config);
+  math_vector(runner);
+  math_matrix(runner);
+  math_quaternion(runner);
+  math_solver(runner);
+
+  if (jsonToStdout)
+    runner.writeJson(std::cout);
+  else if (jsonPath)
+  {
+    std::ofstream file(jsonPath);
+    if (!file)
+    {
+      std::cerr << "flexor-bench: can't write " << jsonPath << "\n";
+      return 1;
+    }
+
+    runner.writeJson(file);
+  }
+
+  return 0;
+}
\ No newline at end of file
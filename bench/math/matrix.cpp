@@ -0,0 +1,161 @@
+#include "harness.h"
+
+#include <math/matrix.h>
+#include <math/small_matrix.h>
+using namespace flexor;
+
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// The small benchmarks cycle through this many inputs, which all fit in the L1 cache.
+static constexpr std::size_t inputCount = 256;
+static constexpr std::size_t inputMask = inputCount - 1;
+
+// ----- Small Matrices -----
+
+// Returns random symmetric positive definite matrices, which every operation here accepts, from
+// inverses down to cholesky factorizations.
+template <typename T> static std::vector<T> randomMatrices()
+{
+  constexpr int n = T::rows();
+
+  std::vector<T> values(inputCount, T(0.0f));
+  for (T& value : values)
+  {
+    T random(0.0f);
+    for (int c = 0; c < n; c++)
+      for (int r = 0; r < n; r++)
+        random[c][r] = bench::random();
+
+    value = random * transpose(random) + T(static_cast<float>(n));
+  }
+
+  return values;
+}
+
+template <typename T> static void smallMatrix(bench::runner& runner, const std::string& type)
+{
+  constexpr int n = T::rows();
+  using column = std::remove_cvref_t<decltype(T()[0])>;
+
+  std::vector<T> a = randomMatrices<T>();
+  std::vector<T> b = randomMatrices<T>();
+  std::vector<column> x(inputCount, column(0.0f));
+  for (column& vec : x)
+    for (int i = 0; i < n; i++)
+      vec[i] = bench::random();
+
+  float scales[2] = {bench::random(1.5f, 2.0f), 0.0f};
+  scales[1] = 1.0f / scales[0];
+
+  std::vector<T> lower(inputCount);
+  std::vector<decltype(ldlt(T()))> factors(inputCount);
+  for (std::size_t i = 0; i < inputCount; i++)
+  {
+    lower[i] = cholesky(a[i]);
+    factors[i] = ldlt(a[i]);
+  }
+
+  runner.run(type + "/add", n, n * n,
+             [&](std::size_t i) { bench::keep(a[i & inputMask] + b[i & inputMask]); });
+  runner.run(type + "/subtract", n, n * n,
+             [&](std::size_t i) { bench::keep(a[i & inputMask] - b[i & inputMask]); });
+  runner.run(type + "/negate", n, 0, [&](std::size_t i) { bench::keep(-a[i & inputMask]); });
+  runner.run(type + "/scale", n, n * n,
+             [&](std::size_t i) { bench::keep(a[i & inputMask] * scales[i & 1]); });
+  runner.run(type + "/divide", n, n * n,
+             [&](std::size_t i) { bench::keep(a[i & inputMask] / scales[i & 1]); });
+  runner.run(type + "/multiply", n, n * n * (2 * n - 1),
+             [&](std::size_t i) { bench::keep(a[i & inputMask] * b[i & inputMask]); });
+  runner.run(type + "/multiply_vector", n, n * (2 * n - 1),
+             [&](std::size_t i) { bench::keep(a[i & inputMask] * x[i & inputMask]); });
+
+  T accumulator(0.0f);
+  runner.run(type + "/add_assign", n, n * n,
+             [&](std::size_t i) { bench::keep(accumulator += a[i & inputMask]); });
+  runner.run(type + "/subtract_assign", n, n * n,
+             [&](std::size_t i) { bench::keep(accumulator -= a[i & inputMask]); });
+  runner.run(type + "/multiply_assign", n, n * n * (2 * n - 1),
+             [&](std::size_t i) { bench::keep(T(a[i & inputMask]) *= b[i & inputMask]); });
+
+  runner.run(type + "/transpose", n, 0,
+             [&](std::size_t i) { bench::keep(transpose(a[i & inputMask])); });
+  runner.run(type + "/determinant", n, 2.0 * n * n * n / 3.0,
+             [&](std::size_t i) { bench::keep(determinant(a[i & inputMask])); });
+  runner.run(type + "/inverse", n, 2.0 * n * n * n,
+             [&](std::size_t i) { bench::keep(inverse(a[i & inputMask])); });
+  runner.run(type + "/cholesky", n, n * n * n / 3.0,
+             [&](std::size_t i) { bench::keep(cholesky(a[i & inputMask])); });
+  runner.run(type + "/cholesky_solve", n, 2 * n * n,
+             [&](std::size_t i)
+             { bench::keep(choleskySolve(lower[i & inputMask], x[i & inputMask])); });
+  runner.run(type + "/ldlt", n, n * n * n / 3.0,
+             [&](std::size_t i) { bench::keep(ldlt(a[i & inputMask])); });
+  runner.run(type + "/ldlt_solve", n, 2 * n * n + n,
+             [&](std::size_t i)
+             { bench::keep(ldltSolve(factors[i & inputMask], x[i & inputMask])); });
+}
+
+// ----- Dynamic Matrices -----
+
+static void dynamicMatrix(bench::runner& runner, int n)
+{
+  matrix a(n, n), b(n, n), c(n, n);
+  vector x(n);
+  for (int col = 0; col < n; col++)
+  {
+    x[col] = bench::random();
+    for (int row = 0; row < n; row++)
+    {
+      a(row, col) = bench::random();
+      b(row, col) = bench::random();
+    }
+  }
+
+  float scales[2] = {bench::random(1.5f, 2.0f), 0.0f};
+  scales[1] = 1.0f / scales[0];
+
+  double squared = static_cast<double>(n) * n;
+  double cubed = squared * n;
+
+  // Assigning into a matrix of the right size evaluates the expression in place, so none of these
+  // should allocate.
+  runner.run("matrix/copy", n, 0, [&](std::size_t) { bench::keep(c = a); });
+  runner.run("matrix/add", n, squared, [&](std::size_t) { bench::keep(c = a + b); });
+  runner.run("matrix/subtract", n, squared, [&](std::size_t) { bench::keep(c = a - b); });
+  runner.run("matrix/negate", n, 0, [&](std::size_t) { bench::keep(c = -a); });
+  runner.run("matrix/scale", n, squared,
+             [&](std::size_t i) { bench::keep(c = a * scales[i & 1]); });
+  runner.run("matrix/divide", n, squared,
+             [&](std::size_t i) { bench::keep(c = a / scales[i & 1]); });
+
+  runner.run("matrix/add_assign", n, squared, [&](std::size_t) { bench::keep(c += a); });
+  runner.run("matrix/subtract_assign", n, squared, [&](std::size_t) { bench::keep(c -= a); });
+  runner.run("matrix/scale_assign", n, squared,
+             [&](std::size_t i) { bench::keep(c *= scales[i & 1]); });
+  runner.run("matrix/divide_assign", n, squared,
+             [&](std::size_t i) { bench::keep(c /= scales[i & 1]); });
+  // Equal matrices are compared all the way through.
+  matrix same = a;
+  runner.run("matrix/equal", n, 0, [&](std::size_t) { bench::keep(a == same); });
+
+  // These build a new matrix or vector for the result, which costs an allocation each.
+  runner.run("matrix/transpose", n, 0, [&](std::size_t) { bench::keep(transpose(a)); });
+  runner.run("matrix/gemv", n, 2.0 * squared, [&](std::size_t) { bench::keep(a * x); });
+  runner.run("matrix/gemm", n, 2.0 * cubed, [&](std::size_t) { bench::keep(a * b); });
+
+  // Multiplying in place would grow without bound, so each one starts from a fresh copy.
+  runner.run("matrix/multiply_assign", n, 2.0 * cubed,
+             [&](std::size_t) { bench::keep((c = a) *= b); });
+}
+
+void math_matrix(bench::runner& runner)
+{
+  smallMatrix<matrix2>(runner, "matrix2");
+  smallMatrix<matrix3>(runner, "matrix3");
+  smallMatrix<matrix4>(runner, "matrix4");
+
+  for (int n : {4, 16, 64, 256})
+    dynamicMatrix(runner, n);
+}
\ No newline at end of file
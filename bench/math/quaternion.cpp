@@ -0,0 +1,85 @@
+#include "harness.h"
+
+#include <math/quaternion.h>
+using namespace flexor;
+
+#include <vector>
+
+// The single quaternion benchmarks cycle through this many inputs, which all fit in the L1 cache.
+static constexpr std::size_t inputCount = 256;
+static constexpr std::size_t inputMask = inputCount - 1;
+
+// Returns count random unit quaternions.
+static std::vector<quaternion> randomRotations(int count)
+{
+  std::vector<quaternion> values(count);
+  for (quaternion& value : values)
+    value = normalize(quaternion(bench::random(), bench::random(), bench::random(),
+                                 bench::random(0.5f, 1.0f)));
+
+  return values;
+}
+
+static std::vector<vector3> randomVectors(int count)
+{
+  std::vector<vector3> values(count);
+  for (vector3& value : values)
+    value = vector3(bench::random(), bench::random(), bench::random());
+
+  return values;
+}
+
+void math_quaternion(bench::runner& runner)
+{
+  std::vector<quaternion> a = randomRotations(inputCount);
+  std::vector<quaternion> b = randomRotations(inputCount);
+  std::vector<vector3> v = randomVectors(inputCount);
+
+  // The product is 16 multiplies and 12 adds. A rotation is two cross products, a doubling and a
+  // multiply-add, and operator* also divides by the squared magnitude. The matrix normalizes first.
+  runner.run("quaternion/multiply", 4, 28,
+             [&](std::size_t i) { bench::keep(a[i & inputMask] * b[i & inputMask]); });
+  runner.run("quaternion/multiply_assign", 4, 28,
+             [&](std::size_t i)
+             { bench::keep(quaternion(a[i & inputMask]) *= b[i & inputMask]); });
+  runner.run("quaternion/multiply_vector", 4, 38,
+             [&](std::size_t i) { bench::keep(a[i & inputMask] * v[i & inputMask]); });
+  runner.run("quaternion/rotate", 4, 30,
+             [&](std::size_t i) { bench::keep(rotate(a[i & inputMask], v[i & inputMask])); });
+  runner.run("quaternion/equal", 4, 0,
+             [&](std::size_t i) { bench::keep(a[i & inputMask] == b[i & inputMask]); });
+  runner.run("quaternion/magnitude", 4, 8,
+             [&](std::size_t i) { bench::keep(magnitude(a[i & inputMask])); });
+  runner.run("quaternion/normalize", 4, 13,
+             [&](std::size_t i) { bench::keep(normalize(a[i & inputMask])); });
+  runner.run("quaternion/conjugate", 4, 0,
+             [&](std::size_t i) { bench::keep(conjugate(a[i & inputMask])); });
+  runner.run("quaternion/inverse", 4, 12,
+             [&](std::size_t i) { bench::keep(inverse(a[i & inputMask])); });
+  runner.run("quaternion/matrix", 4, 52,
+             [&](std::size_t i) { bench::keep(quaternion::matrix(a[i & inputMask])); });
+
+  // Rotating spans of vectors in place, once with a quaternion each and once all by the same one.
+  // Rounding would slowly grow or shrink vectors that are rotated over and over, so every other
+  // pass rotates them back.
+  for (int count : {16, 256, 4096})
+  {
+    std::vector<quaternion> rotations[2] = {randomRotations(count), {}};
+    for (const quaternion& rotation : rotations[0])
+      rotations[1].push_back(conjugate(rotation));
+    std::vector<vector3> vecs = randomVectors(count);
+
+    runner.run("quaternion/rotate_each", count, 30.0 * count,
+               [&](std::size_t i)
+               {
+                 rotate(rotations[i & 1], vecs);
+                 bench::keep(vecs[0]);
+               });
+    runner.run("quaternion/rotate_all", count, 52.0 + 15.0 * count,
+               [&](std::size_t i)
+               {
+                 rotate(rotations[i & 1][0], vecs);
+                 bench::keep(vecs[0]);
+               });
+  }
+}
\ No newline at end of file
@@ -0,0 +1,289 @@
+#include "harness.h"
+
+#include <math/solver.h>
+using namespace flexor;
+
+#include <cmath>
+#include <vector>
+
+// ----- Helper Functions -----
+
+// A random matrix with a heavy diagonal, which keeps it well away from singular.
+static matrix randomSystem(int n)
+{
+  matrix A(n, n);
+  for (int col = 0; col < n; col++)
+    for (int row = 0; row < n; row++)
+      A(row, col) = bench::random() + (row == col ? static_cast<float>(n) : 0.0f);
+
+  return A;
+}
+
+static vector randomVector(int n)
+{
+  vector values(n);
+  for (int i = 0; i < n; i++)
+    values[i] = bench::random();
+
+  return values;
+}
+
+// The 5 point laplacian on a side by side grid, shifted slightly to keep it away from singular.
+static csr_matrix laplacian(int side)
+{
+  std::vector<triplet> entries;
+  for (int y = 0; y < side; y++)
+    for (int x = 0; x < side; x++)
+    {
+      int row = x + y * side;
+      entries.push_back({row, row, 4.1f});
+      if (x > 0)
+        entries.push_back({row, row - 1, -1.0f});
+      if (x < side - 1)
+        entries.push_back({row, row + 1, -1.0f});
+      if (y > 0)
+        entries.push_back({row, row - side, -1.0f});
+      if (y < side - 1)
+        entries.push_back({row, row + side, -1.0f});
+    }
+
+  return csr_matrix(side * side, side * side, entries);
+}
+
+// ----- Dense Systems -----
+
+static void denseSolvers(bench::runner& runner, int n)
+{
+  matrix A = randomSystem(n);
+  matrix B = randomSystem(n);
+  matrix X = B;
+  vector b = randomVector(n);
+  vector x = b;
+
+  double cubed = static_cast<double>(n) * n * n;
+
+  solver::lu factorization(A);
+  runner.run("solver/gauss_jordan", n, cubed,
+             [&](std::size_t) { bench::keep(solver::gaussJordan(A, b)); });
+  runner.run("solver/lu_factor", n, 2.0 * cubed / 3.0,
+             [&](std::size_t) { bench::keep(factorization.factor(A)); });
+  runner.run("solver/lu_determinant", n, n,
+             [&](std::size_t) { bench::keep(factorization.determinant()); });
+  runner.run("solver/lu_solve", n, 2.0 * n * n,
+             [&](std::size_t) { bench::keep(factorization.solve(b)); });
+
+  // Solving in place would keep applying the inverse, so each one starts from a fresh copy.
+  runner.run("solver/lu_solve_in_place", n, 2.0 * n * n,
+             [&](std::size_t)
+             {
+               x = b;
+               factorization.solveInPlace(x);
+               bench::keep(x);
+             });
+  runner.run("solver/lu_solve_matrix", n, 2.0 * cubed,
+             [&](std::size_t)
+             {
+               X = B;
+               factorization.solveInPlace(X);
+               bench::keep(X);
+             });
+}
+
+// ----- Constraint Solvers -----
+
+// Solves a stack of bodies that rest on each other, with a contact and a friction row between each
+// body and the one below, the same kind of problem the contact solver hands over each step.
+static void constraintSolvers(bench::runner& runner, int bodies)
+{
+  block_jacobian J(bodies);
+  std::vector<float> lower, upper;
+  std::vector<int> friction;
+  for (int body = 0; body < bodies; body++)
+  {
+    vector3 arm(bench::random(), -0.5f, bench::random());
+    vector3 normal(0.0f, 1.0f, 0.0f);
+    vector3 tangent(1.0f, 0.0f, 0.0f);
+
+    int below = body - 1;
+    int normalRow = J.addRow(body, {normal, cross(arm, normal)}, below,
+                             {-normal, -cross(-arm, normal)});
+    J.addRow(body, {tangent, cross(arm, tangent)}, below, {-tangent, -cross(-arm, tangent)});
+
+    lower.insert(lower.end(), {0.0f, 0.0f});
+    upper.insert(upper.end(), {INFINITY, 0.5f});
+    friction.insert(friction.end(), {-1, normalRow});
+  }
+
+  int rows = J.rows();
+  std::vector<float> inverseMasses(bodies, 1.0f);
+  std::vector<matrix3> inverseInertias(bodies, matrix3(6.0f));
+  std::vector<vector3> linear(bodies), angular(bodies);
+  for (int body = 0; body < bodies; body++)
+  {
+    linear[body] = vector3(bench::random(), -1.0f, bench::random());
+    angular[body] = vector3(bench::random(), bench::random(), bench::random());
+  }
+
+  std::vector<float> target(rows, 0.0f);
+  std::vector<float> lambda(rows, 0.0f);
+  solver::lcp_bounds bounds = {lower.data(), upper.data(), friction.data()};
+  solver::pgs_settings settings;
+
+  // Each row of a sweep is a dot product with its row of the system and a clamp. Sequential
+  // impulses read and write the velocities of both bodies of a row instead, after weighting every
+  // row by the inverse masses once up front.
+  csr_matrix system = assembleSystem(J, inverseMasses.data(), inverseInertias.data());
+  double sweep = 2.0 * system.nonZeros() + 4.0 * rows;
+  runner.run("solver/projected_gauss_seidel", rows, sweep * settings.iterations,
+             [&](std::size_t)
+             {
+               bench::keep(solver::projectedGaussSeidel(system, target.data(), bounds,
+                                                        lambda.data(), settings));
+             });
+
+  std::fill(lambda.begin(), lambda.end(), 0.0f);
+  runner.run("solver/sequential_impulse", rows, (60.0 + 50.0 * settings.iterations) * rows,
+             [&](std::size_t)
+             {
+               bench::keep(solver::sequentialImpulse(J, inverseMasses.data(),
+                                                     inverseInertias.data(), target.data(),
+                                                     bounds, lambda.data(), linear.data(),
+                                                     angular.data(), settings));
+             });
+}
+
+// ----- Conjugate Gradient -----
+
+static void conjugateGradients(bench::runner& runner, int side)
+{
+  csr_matrix A = laplacian(side);
+  int n = A.rows();
+  vector b = randomVector(n);
+  vector x(n);
+
+  // A tolerance of zero runs every iteration, so each solve does the same amount of work.
+  solver::cg_settings settings;
+  settings.tolerance = 0.0f;
+  settings.maxIterations = 25;
+
+  // The flops of a solve, given how much applying the preconditioner costs. The solves are run
+  // once up front to find out how many iterations they take.
+  auto flops = [&](int iterations, double preconditioner)
+  {
+    double product = 2.0 * A.nonZeros();
+    return product + 7.0 * n + preconditioner +
+           iterations * (product + 12.0 * n + preconditioner);
+  };
+
+  auto multiply = [&A](const float* in, float* out) { A.multiply(in, out); };
+  auto plain = [&]()
+  { return solver::conjugateGradient(n, multiply, b.data(), x.data(), settings); };
+
+  solver::jacobi_preconditioner jacobiPreconditioner(A);
+  auto jacobi = [&]()
+  { return solver::conjugateGradient(A, b, x, jacobiPreconditioner, settings); };
+
+  solver::incomplete_cholesky choleskyPreconditioner(A);
+  auto cholesky = [&]()
+  { return solver::conjugateGradient(A, b, x, choleskyPreconditioner, settings); };
+
+  // Forward and backward substitution each touch the lower triangle once.
+  double triangle = (A.nonZeros() + n) / 2.0;
+  std::fill(x.data(), x.data() + n, 0.0f);
+  runner.run("solver/conjugate_gradient", n, flops(plain().iterations, 0.0),
+             [&](std::size_t)
+             {
+               std::fill(x.data(), x.data() + n, 0.0f);
+               bench::keep(plain());
+             });
+
+  std::fill(x.data(), x.data() + n, 0.0f);
+  runner.run("solver/conjugate_gradient_jacobi", n, flops(jacobi().iterations, n),
+             [&](std::size_t)
+             {
+               std::fill(x.data(), x.data() + n, 0.0f);
+               bench::keep(jacobi());
+             });
+
+  std::fill(x.data(), x.data() + n, 0.0f);
+  runner.run("solver/conjugate_gradient_ic", n, flops(cholesky().iterations, 4.0 * triangle),
+             [&](std::size_t)
+             {
+               std::fill(x.data(), x.data() + n, 0.0f);
+               bench::keep(cholesky());
+             });
+}
+
+// ----- Batched Small Systems -----
+
+template <int N> static void batchedSolves(bench::runner& runner, int count)
+{
+  // Every system is M * M^T + N * I for a random M, which is symmetric positive definite.
+  std::vector<float> A(N * N * count), b(N * count), x(N * count);
+  for (int k = 0; k < count; k++)
+  {
+    float M[N][N];
+    for (int r = 0; r < N; r++)
+      for (int c = 0; c < N; c++)
+        M[r][c] = bench::random();
+
+    for (int c = 0; c < N; c++)
+      for (int r = 0; r < N; r++)
+      {
+        float sum = r == c ? static_cast<float>(N) : 0.0f;
+        for (int i = 0; i < N; i++)
+          sum += M[r][i] * M[c][i];
+        A[(c * N + r) * count + k] = sum;
+      }
+
+    for (int r = 0; r < N; r++)
+      b[r * count + k] = bench::random();
+  }
+
+  // Elimination without pivoting, followed by back substitution.
+  double flops = (2.0 * N * N * N / 3.0 + 2.0 * N * N) * count;
+  runner.run(N == 3 ? "solver/solve_batch3" : "solver/solve_batch6", count, flops,
+             [&](std::size_t)
+             {
+               solver::solveBatch<N>(count, A.data(), b.data(), x.data());
+               bench::keep(x.data()[0]);
+             });
+
+  if constexpr (N == 3)
+  {
+    std::vector<matrix3> matrices(count, matrix3(0.0f));
+    std::vector<vector3> rhs(count), solutions(count);
+    for (int k = 0; k < count; k++)
+    {
+      for (int c = 0; c < 3; c++)
+        for (int r = 0; r < 3; r++)
+          matrices[k][c][r] = A[(c * 3 + r) * count + k];
+      rhs[k] = vector3(b[k], b[count + k], b[2 * count + k]);
+    }
+
+    runner.run("solver/solve_batch_matrix3", count, flops,
+               [&](std::size_t)
+               {
+                 solver::solveBatch(count, matrices.data(), rhs.data(), solutions.data());
+                 bench::keep(solutions[0]);
+               });
+  }
+}
+
+void math_solver(bench::runner& runner)
+{
+  for (int n : {4, 16, 64, 128})
+    denseSolvers(runner, n);
+
+  for (int bodies : {8, 64, 512})
+    constraintSolvers(runner, bodies);
+
+  for (int side : {8, 16, 32, 64})
+    conjugateGradients(runner, side);
+
+  for (int count : {8, 64, 512, 4096})
+  {
+    batchedSolves<3>(runner, count);
+    batchedSolves<6>(runner, count);
+  }
+}
\ No newline at end of file
@@ -0,0 +1,134 @@
+#include "harness.h"
+
+#include <math/vector.h>
+using namespace flexor;
+
+#include <string>
+#include <vector>
+
+// The small benchmarks cycle through this many inputs, which all fit in the L1 cache.
+static constexpr std::size_t inputCount = 256;
+static constexpr std::size_t inputMask = inputCount - 1;
+
+template <typename T> static std::vector<T> randomVectors()
+{
+  std::vector<T> values(inputCount, T(0.0f));
+  for (T& value : values)
+    for (int i = 0; i < T::length(); i++)
+      value[i] = bench::random();
+
+  return values;
+}
+
+// ----- Small Vectors -----
+
+template <typename T> static void smallVector(bench::runner& runner, const std::string& type)
+{
+  constexpr int n = T::length();
+  std::vector<T> a = randomVectors<T>();
+  std::vector<T> b = randomVectors<T>();
+
+  // Scaling in place alternates between a factor and its inverse on each pass through the inputs,
+  // so the values stay put.
+  float scales[2] = {bench::random(1.5f, 2.0f), 0.0f};
+  scales[1] = 1.0f / scales[0];
+
+  runner.run(type + "/add", n, n,
+             [&](std::size_t i) { bench::keep(a[i & inputMask] + b[i & inputMask]); });
+  runner.run(type + "/subtract", n, n,
+             [&](std::size_t i) { bench::keep(a[i & inputMask] - b[i & inputMask]); });
+  runner.run(type + "/negate", n, 0, [&](std::size_t i) { bench::keep(-a[i & inputMask]); });
+  runner.run(type + "/scale", n, n,
+             [&](std::size_t i) { bench::keep(a[i & inputMask] * scales[i & 1]); });
+  runner.run(type + "/divide", n, n,
+             [&](std::size_t i) { bench::keep(a[i & inputMask] / scales[i & 1]); });
+
+  T accumulator(0.0f);
+  runner.run(type + "/add_assign", n, n,
+             [&](std::size_t i) { bench::keep(accumulator += a[i & inputMask]); });
+  runner.run(type + "/subtract_assign", n, n,
+             [&](std::size_t i) { bench::keep(accumulator -= a[i & inputMask]); });
+  runner.run(type + "/scale_assign", n, n,
+             [&](std::size_t i) { bench::keep(a[i & inputMask] *= scales[i / inputCount & 1]); });
+  runner.run(type + "/divide_assign", n, n,
+             [&](std::size_t i) { bench::keep(a[i & inputMask] /= scales[i / inputCount & 1]); });
+
+  runner.run(type + "/equal", n, 0,
+             [&](std::size_t i) { bench::keep(a[i & inputMask] == b[i & inputMask]); });
+  runner.run(type + "/dot", n, 2 * n - 1,
+             [&](std::size_t i) { bench::keep(dot(a[i & inputMask], b[i & inputMask])); });
+  runner.run(type + "/magnitude", n, 2 * n,
+             [&](std::size_t i) { bench::keep(magnitude(a[i & inputMask])); });
+  runner.run(type + "/normalize", n, 3 * n,
+             [&](std::size_t i) { bench::keep(normalize(a[i & inputMask])); });
+
+  if constexpr (std::is_same_v<T, vector3>)
+  {
+    runner.run(type + "/cross", n, 9,
+               [&](std::size_t i) { bench::keep(cross(a[i & inputMask], b[i & inputMask])); });
+    runner.run(type + "/min", n, 0,
+               [&](std::size_t i) { bench::keep(min(a[i & inputMask], b[i & inputMask])); });
+    runner.run(type + "/max", n, 0,
+               [&](std::size_t i) { bench::keep(max(a[i & inputMask], b[i & inputMask])); });
+  }
+}
+
+// ----- Dynamic Vectors -----
+
+static void dynamicVector(bench::runner& runner, int n)
+{
+  vector a(n), b(n), c(n);
+  for (int i = 0; i < n; i++)
+  {
+    a[i] = bench::random();
+    b[i] = bench::random();
+  }
+
+  float scales[2] = {bench::random(1.5f, 2.0f), 0.0f};
+  scales[1] = 1.0f / scales[0];
+
+  // Assigning into a vector of the right length evaluates the expression in place, so none of
+  // these should allocate.
+  runner.run("vector/copy", n, 0, [&](std::size_t) { bench::keep(c = a); });
+  runner.run("vector/add", n, n, [&](std::size_t) { bench::keep(c = a + b); });
+  runner.run("vector/subtract", n, n, [&](std::size_t) { bench::keep(c = a - b); });
+  runner.run("vector/negate", n, 0, [&](std::size_t) { bench::keep(c = -a); });
+  runner.run("vector/scale", n, n, [&](std::size_t i) { bench::keep(c = a * scales[i & 1]); });
+  runner.run("vector/divide", n, n, [&](std::size_t i) { bench::keep(c = a / scales[i & 1]); });
+  runner.run("vector/fused", n, 3 * n,
+             [&](std::size_t i) { bench::keep(c = a + (b - a) * scales[i & 1]); });
+
+  runner.run("vector/add_assign", n, n, [&](std::size_t) { bench::keep(c += a); });
+  runner.run("vector/subtract_assign", n, n, [&](std::size_t) { bench::keep(c -= a); });
+  runner.run("vector/scale_assign", n, n, [&](std::size_t i) { bench::keep(c *= scales[i & 1]); });
+  runner.run("vector/divide_assign", n, n,
+             [&](std::size_t i) { bench::keep(c /= scales[i & 1]); });
+
+  // Equal vectors are compared all the way through.
+  vector same = a;
+  runner.run("vector/equal", n, 0, [&](std::size_t) { bench::keep(a == same); });
+  runner.run("vector/dot", n, 2 * n - 1, [&](std::size_t) { bench::keep(dot(a, b)); });
+  runner.run("vector/magnitude", n, 2 * n, [&](std::size_t) { bench::keep(magnitude(a)); });
+
+  // These build a new vector, which costs an allocation each.
+  runner.run("vector/construct", n, n, [&](std::size_t) { bench::keep(vector(a + b)); });
+  runner.run("vector/normalize", n, 3 * n, [&](std::size_t) { bench::keep(normalize(a)); });
+
+  // Views write straight into memory they don't own, such as the column of a matrix.
+  std::vector<float> storage(n);
+  vector_view<float> view(storage.data(), n);
+  runner.run("vector_view/add", n, n, [&](std::size_t) { bench::keep(view = a + b); });
+  runner.run("vector_view/add_assign", n, n, [&](std::size_t) { bench::keep(view += a); });
+  runner.run("vector_view/scale_assign", n, n,
+             [&](std::size_t i) { bench::keep(view *= scales[i & 1]); });
+}
+
+void math_vector(bench::runner& runner)
+{
+  smallVector<vector2>(runner, "vector2");
+  smallVector<vector3>(runner, "vector3");
+  smallVector<vector4>(runner, "vector4");
+
+  for (int n : {4, 16, 64, 256, 1024, 4096})
+    dynamicVector(runner, n);
+}
\ No newline at end of file
@@ -17,6 +17,10 @@ demo::~demo()
 
 void demo::OnUpdate(float timestep)
 {
+  // The frame time varies, but the world only ever moves in fixed steps, and carries the rest over
+  // to the next frame.
+  physicsWorld->update(timestep);
+
   if (Vision::Input::KeyDown(SDL_SCANCODE_ESCAPE))
     Stop();
 }
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "math/quaternion.h"
+#include "math/vector3.h"
+
+namespace flexor
+{
+
+// ----- Axis Aligned Bounding Box -----
+
+/**
+ * An axis aligned bounding box, given by its smallest and largest corners. These are what the
+ * broadphase works with, since two of them can be tested for overlap with a handful of
+ * comparisons.
+ */
+struct aabb
+{
+  // Fields
+
+  vector3 min = vector3(0.0f);
+  vector3 max = vector3(0.0f);
+
+  // Constructors
+
+  aabb() = default;
+
+  aabb(const vector3& min, const vector3& max)
+    : min(min), max(max)
+  {
+  }
+
+  // Methods
+
+  vector3 center() const { return (min + max) * 0.5f; }
+  vector3 extents() const { return (max - min) * 0.5f; }
+
+  /**
+   * The surface area of the box. The dynamic tree uses this as the cost of a node, since the chance
+   * of a random ray or box hitting a node grows with its surface area.
+   */
+  float surfaceArea() const
+  {
+    vector3 size = max - min;
+    return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+  }
+
+  /**
+   * Returns whether this box entirely contains another.
+   */
+  bool contains(const aabb& other) const
+  {
+    return min.x <= other.min.x && min.y <= other.min.y && min.z <= other.min.z &&
+           other.max.x <= max.x && other.max.y <= max.y && other.max.z <= max.z;
+  }
+
+  /**
+   * Grows the box by the given margin on every side.
+   */
+  aabb fatten(float margin) const { return aabb(min - vector3(margin), max + vector3(margin)); }
+};
+
+// ----- AABB Operations -----
+
+inline bool overlaps(const aabb& lhs, const aabb& rhs)
+{
+  return lhs.min.x <= rhs.max.x && rhs.min.x <= lhs.max.x && lhs.min.y <= rhs.max.y &&
+         rhs.min.y <= lhs.max.y && lhs.min.z <= rhs.max.z && rhs.min.z <= lhs.max.z;
+}
+
+/**
+ * Returns the smallest box containing both boxes.
+ */
+inline aabb combine(const aabb& lhs, const aabb& rhs)
+{
+  return aabb(min(lhs.min, rhs.min), max(lhs.max, rhs.max));
+}
+
+/**
+ * Computes the world space bounds of a box given in body space. The center is transformed like a
+ * point, and the half extents are transformed by the absolute value of the rotation matrix, which
+ * gives the extents of the rotated box along each world axis.
+ */
+inline aabb transform(const aabb& local, const vector3& position, const quaternion& orientation)
+{
+  matrix3 rotation = quaternion::matrix(orientation);
+  vector3 center = position + rotation * local.center();
+  vector3 half = local.extents();
+
+  vector3 extents(0.0f);
+  for (int col = 0; col < 3; col++)
+  {
+    vector3 axis = rotation[col];
+    extents += max(axis, -axis) * half[col];
+  }
+
+  return aabb(center - extents, center + extents);
+}
+
+} // namespace flexor
\ No newline at end of file
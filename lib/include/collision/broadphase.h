@@ -0,0 +1,130 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "collision/aabb.h"
+#include "core/snapshot.h"
+
+namespace flexor
+{
+
+// ----- Body Pair -----
+
+/**
+ * A pair of bodies whose bounds overlap, which the narrowphase still has to test for contact. The
+ * smaller index always comes first, so each pair has exactly one representation.
+ */
+struct body_pair
+{
+  int a = -1;
+  int b = -1;
+};
+
+inline bool operator==(const body_pair& lhs, const body_pair& rhs)
+{
+  return lhs.a == rhs.a && lhs.b == rhs.b;
+}
+
+inline bool operator<(const body_pair& lhs, const body_pair& rhs)
+{
+  return lhs.a < rhs.a || (lhs.a == rhs.a && lhs.b < rhs.b);
+}
+
+// ----- Broadphase -----
+
+/**
+ * Finds the pairs of bodies whose bounds overlap, so that the narrowphase only has to look at
+ * bodies that are close to each other. Different worlds favor different strategies, so the engine
+ * talks to its broadphase through this interface and each world picks the one that fits it.
+ *
+ * Static bodies are tracked like any other body, but two static bodies are never paired.
+ */
+class broadphase
+{
+public:
+  virtual ~broadphase() = default;
+
+  // Bodies
+
+  /**
+   * Starts tracking a body with the given world bounds. Bodies are expected to be added in order,
+   * but may skip indices that the broadphase shouldn't know about. The index of a removed body may
+   * be added again, which is how the engine moves a body into the place of a removed one.
+   */
+  virtual void add(int body, const aabb& bounds, bool isStatic) = 0;
+
+  /**
+   * Updates the bounds of a body that moved by the given displacement this step.
+   */
+  virtual void move(int body, const aabb& bounds, const vector3& displacement) = 0;
+
+  /**
+   * Stops tracking a body. Its pairs are dropped by the next update.
+   */
+  virtual void remove(int body) = 0;
+
+  // Pairs
+
+  /**
+   * Rebuilds the list of overlapping pairs after the bodies have been moved.
+   */
+  virtual void updatePairs() = 0;
+
+  /**
+   * The overlapping pairs found by the last update. Each pair shows up once. The order is the same
+   * every time the same sequence of adds, removes and moves is replayed, however many threads do
+   * the work, and is otherwise unspecified. Depending on the broadphase, this may include pairs
+   * whose bounds only nearly overlap.
+   */
+  const std::vector<body_pair>& pairs() const { return pairList; }
+
+  // Snapshots
+
+  /**
+   * Writes everything the broadphase keeps between updates into a snapshot, and reads it back. A
+   * restored broadphase finds the same pairs in the same order as the one that was saved.
+   */
+  virtual void save(world_snapshot& snapshot) const = 0;
+  virtual void restore(const snapshot_view& snapshot) = 0;
+
+protected:
+  /**
+   * Returns whether the saved pairs are all ordered pairs of indices below the given size. Each
+   * broadphase checks this before it can be restored.
+   */
+  static bool canRestorePairs(const snapshot_view& snapshot, int size);
+
+  std::vector<body_pair> pairList;
+};
+
+// ----- Broadphase Selection -----
+
+enum class broadphase_type
+{
+  // A dynamic AABB tree, which is best for large worlds that are mostly static or slow moving.
+  tree,
+
+  // Sweep and prune, which is best for dense piles where nearly every body moves every step.
+  sweepAndPrune,
+
+  // A spatial hash grid, which is best for swarms of bodies that are all about the same size.
+  grid
+};
+
+class thread_pool;
+
+/**
+ * Creates a broadphase of the given type. Broadphases that can find pairs in parallel do so on the
+ * given thread pool, which has to outlive them.
+ */
+std::unique_ptr<broadphase> createBroadphase(broadphase_type type, thread_pool* pool = nullptr);
+
+/**
+ * Returns whether a snapshot holds a broadphase of the given type that tracks exactly the given
+ * number of bodies, and whose arrays only point inside themselves. A type that isn't listed above
+ * never passes, so restoring can check the whole broadphase before replacing the old one.
+ */
+bool canRestoreBroadphase(broadphase_type type, const snapshot_view& snapshot, int bodies);
+
+} // namespace flexor
\ No newline at end of file
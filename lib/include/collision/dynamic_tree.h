@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cassert>
+#include <span>
+#include <vector>
+
+#include "collision/aabb.h"
+#include "core/snapshot.h"
+
+namespace flexor
+{
+
+// ----- Dynamic AABB Tree -----
+
+/**
+ * A bounding volume hierarchy of axis aligned boxes that supports inserting, removing, and moving
+ * boxes one at a time. Each leaf (a proxy) stores a fattened copy of the box it was given, so a
+ * proxy only has to be reinserted once its box leaves the fat box. Internal nodes bound both of
+ * their children, and the tree is kept balanced with rotations as leaves come and go.
+ *
+ * The nodes live in a single array and refer to each other by index, so the tree can grow without
+ * invalidating proxies, and freed nodes are recycled through a free list. This follows the dynamic
+ * tree from Box2D.
+ */
+class dynamic_tree
+{
+public:
+  constexpr static int nullNode = -1;
+
+  // Constructors
+
+  /**
+   * Creates an empty tree. Boxes are grown by margin on every side when they are inserted, and by
+   * displacementScale times the displacement of a move in the direction it moved.
+   */
+  dynamic_tree(float margin = 0.1f, float displacementScale = 2.0f);
+
+  // Proxies
+
+  /**
+   * Inserts a box into the tree and returns its proxy. The user data is handed back by queries.
+   */
+  int createProxy(const aabb& bounds, int userData);
+
+  void destroyProxy(int proxy);
+
+  /**
+   * Updates the box of a proxy after it moved by the given displacement. Returns true if the proxy
+   * left its fat box and had to be reinserted, and false if the tree didn't change.
+   */
+  bool moveProxy(int proxy, const aabb& bounds, const vector3& displacement);
+
+  const aabb& fatBounds(int proxy) const { return nodes[proxy].bounds; }
+  int userData(int proxy) const { return nodes[proxy].userData; }
+
+  // Queries
+
+  /**
+   * Calls callback(proxy) for every proxy whose fat box overlaps the given box. The callback
+   * returns false to stop the query early.
+   */
+  template <typename Callback> void query(const aabb& bounds, Callback&& callback) const;
+
+  /**
+   * The height of the tree, where a single leaf has height zero.
+   */
+  int height() const { return root == nullNode ? 0 : nodes[root].height; }
+
+  /**
+   * Returns whether the parent links, heights, and bounds of every node are consistent. This walks
+   * the whole tree, so it is meant for tests and debugging.
+   */
+  bool validate() const;
+
+  // Snapshots
+
+  /**
+   * Writes the nodes of the tree into a snapshot, and reads them back. The proxies of a restored
+   * tree are the same as those of the saved one.
+   */
+  void save(world_snapshot& snapshot) const;
+  void restore(const snapshot_view& snapshot);
+
+  /**
+   * Returns whether a snapshot holds a tree whose nodes are each either free or reached from the
+   * root exactly once, with heights that add up and stay within what a query can walk. The leaves
+   * have to be exactly the given proxies, indexed by their user data.
+   */
+  static bool canRestore(const snapshot_view& snapshot, std::span<const int> proxies);
+
+private:
+  // The stack of a query never holds more than one node per level of the tree, and the rotations
+  // keep the tree far shallower than this.
+  constexpr static int maxDepth = 256;
+
+  struct tree_node
+  {
+    aabb bounds;
+
+    // While the node is free, this is the next node in the free list instead.
+    int parent = nullNode;
+    int child1 = nullNode;
+    int child2 = nullNode;
+
+    // Leaves have height zero, and free nodes have height -1.
+    int height = -1;
+    int userData = -1;
+
+    bool isLeaf() const { return child1 == nullNode; }
+  };
+
+  int allocateNode();
+  void freeNode(int node);
+
+  void insertLeaf(int leaf);
+  void removeLeaf(int leaf);
+
+  /**
+   * Walks from a node up to the root, rotating any unbalanced node and refitting the bounds and
+   * heights along the way.
+   */
+  void refit(int node);
+
+  /**
+   * Rotates the subtree rooted at a node if one child is more than one level taller than the other,
+   * and returns the new root of the subtree.
+   */
+  int balance(int node);
+
+  bool validate(int node) const;
+
+  // Fields
+
+  std::vector<tree_node> nodes;
+  int root = nullNode;
+  int freeList = nullNode;
+
+  float margin;
+  float displacementScale;
+};
+
+template <typename Callback> void dynamic_tree::query(const aabb& bounds, Callback&& callback) const
+{
+  if (root == nullNode)
+    return;
+
+  int stack[maxDepth];
+  int count = 0;
+  stack[count++] = root;
+
+  while (count > 0)
+  {
+    const tree_node& node = nodes[stack[--count]];
+    if (!overlaps(node.bounds, bounds))
+      continue;
+
+    if (node.isLeaf())
+    {
+      if (!callback(static_cast<int>(&node - nodes.data())))
+        return;
+    }
+    else
+    {
+      assert(count + 2 <= maxDepth);
+      stack[count++] = node.child1;
+      stack[count++] = node.child2;
+    }
+  }
+}
+
+} // namespace flexor
\ No newline at end of file
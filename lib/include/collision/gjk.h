@@ -0,0 +1,98 @@
+#pragma once
+
+#include "collision/shape.h"
+
+namespace flexor
+{
+
+// ----- Convex Proxy -----
+
+/**
+ * A shape placed in the world, as GJK and EPA see it. The support point can either include the
+ * radius of the shape, or only cover its core.
+ */
+struct convex_proxy
+{
+  const shape* geometry = nullptr;
+  rigid_transform transform;
+  bool core = false;
+
+  /**
+   * Returns the point of the placed shape that is farthest along a world space direction.
+   */
+  vector3 support(const vector3& dir) const
+  {
+    vector3 local = transform.inverseRotate(dir);
+    vector3 point = core ? coreSupport(*geometry, local) : flexor::support(*geometry, local);
+    return transform.toWorld(point);
+  }
+};
+
+// ----- GJK -----
+
+/**
+ * A vertex of the Minkowski difference A - B, along with the points of A and B that produced it.
+ */
+struct support_point
+{
+  vector3 w;
+  vector3 a;
+  vector3 b;
+};
+
+/**
+ * The simplex GJK builds, which EPA starts from when the shapes overlap. The weights are the
+ * barycentric coordinates of the point closest to the origin.
+ */
+struct gjk_simplex
+{
+  support_point vertices[4];
+  float weights[4] = {};
+  int count = 0;
+};
+
+struct gjk_output
+{
+  bool overlap = false;
+
+  // The distance between the shapes, and the closest point on each. These are only meaningful
+  // when the shapes don't overlap.
+  float distance = 0.0f;
+  vector3 pointA = vector3(0.0f);
+  vector3 pointB = vector3(0.0f);
+
+  int iterations = 0;
+};
+
+/**
+ * Finds the distance between two convex shapes with the Gilbert-Johnson-Keerthi algorithm. GJK
+ * walks a simplex of at most four points of the Minkowski difference A - B toward the origin, and
+ * the shapes overlap exactly when the difference contains the origin. The final simplex is left
+ * in the given simplex for EPA.
+ */
+gjk_output gjkDistance(const convex_proxy& a, const convex_proxy& b, gjk_simplex& simplex);
+
+// ----- EPA -----
+
+struct epa_output
+{
+  // The direction from A to B along which the shapes overlap the least, and how deep they overlap
+  // along it. Moving B by depth along the normal would separate the shapes.
+  vector3 normal = vector3(0.0f, 1.0f, 0.0f);
+  float depth = 0.0f;
+
+  // The deepest point of each shape inside the other.
+  vector3 pointA = vector3(0.0f);
+  vector3 pointB = vector3(0.0f);
+};
+
+/**
+ * Finds how deep two overlapping shapes penetrate with the expanding polytope algorithm. EPA grows
+ * a polytope inside the Minkowski difference, starting from the final GJK simplex, until the face
+ * closest to the origin lies on the surface of the difference. Returns false if the polytope
+ * can't be built, which only happens for flat or degenerate shapes.
+ */
+bool epaPenetration(const convex_proxy& a, const convex_proxy& b, const gjk_simplex& simplex,
+                    epa_output& output);
+
+} // namespace flexor
\ No newline at end of file
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "collision/broadphase.h"
+#include "core/thread_pool.h"
+
+namespace flexor
+{
+
+// ----- Grid Broadphase -----
+
+/**
+ * Finds the pairs of bodies whose bounds overlap by binning them into a uniform grid. This is made
+ * for particle-like worlds (debris, granular material) where every body is about the same size,
+ * and beats the tree and sweep and prune there because the grid is rebuilt from scratch in linear
+ * time every update.
+ *
+ * Each body lives in the one cell that holds the minimum corner of its box. The cells are at least
+ * as large as the largest box in the grid, so two boxes can only overlap when their cells are
+ * neighbours. The bodies are binned into buckets with a counting sort. A packed world gets one
+ * bucket per cell of its bounds, and a sparse one has its cells hashed into a table with a couple
+ * of buckets per body, so the grid never has to be bounded ahead of time.
+ *
+ * Static bodies and bodies several times larger than the average moving body stay out of the
+ * grid, since one large floor would otherwise blow the cells up until everything shares a few of
+ * them. Each of them is tested on its own against the cells its box can reach, or against every
+ * body in the grid if that is fewer, and against the other bodies left out.
+ *
+ * Each body searches its own cell and the 13 neighbouring cells that come after it, so every pair
+ * of cells is searched from exactly one side, and every pair of bodies is found exactly once
+ * without any shared state. This lets the search run in parallel on a thread pool. The bodies are
+ * split into fixed chunks that each append to their own list, and the lists are joined in order,
+ * so the pairs come out in the same order no matter how many threads there are.
+ */
+class grid_broadphase : public broadphase
+{
+public:
+  /**
+   * Creates a grid with cells of the given size. The cells always grow to fit the largest box in
+   * the grid, so a negative size simply fits them to the boxes at every update. Without a thread
+   * pool, everything runs on the calling thread.
+   */
+  grid_broadphase(float cellSize = -1.0f, thread_pool* pool = nullptr);
+
+  /**
+   * A body this many times larger than the average moving body is left out of the grid.
+   */
+  static constexpr float oversizeRatio = 4.0f;
+
+  // Bodies
+
+  void add(int body, const aabb& bounds, bool isStatic) override;
+  void move(int body, const aabb& bounds, const vector3& displacement) override;
+  void remove(int body) override;
+
+  // Pairs
+
+  void updatePairs() override;
+
+  /**
+   * The size of the cells at the last update.
+   */
+  float cellSize() const { return 1.0f / inverseCellSize; }
+
+  // Snapshots
+
+  void save(world_snapshot& snapshot) const override;
+  void restore(const snapshot_view& snapshot) override;
+
+  /**
+   * Returns whether a snapshot holds a grid that tracks exactly the given number of bodies, each in
+   * the active list once at the slot it says. Bodies removed since the last update may still have
+   * entries past them.
+   */
+  static bool canRestore(const snapshot_view& snapshot, int bodies);
+
+private:
+  bool tracked(int body) const
+  {
+    return body >= 0 && body < static_cast<int>(slots.size()) && slots[body];
+  }
+
+  struct cell_coord
+  {
+    int x, y, z;
+
+    bool operator==(const cell_coord&) const = default;
+  };
+
+  // A copy of the bounds travels with each entry, so that searching a bucket only reads
+  // contiguous memory.
+  struct grid_entry
+  {
+    aabb bounds;
+    cell_coord cell;
+    int body;
+  };
+
+  cell_coord cellOf(const vector3& point) const;
+  std::uint32_t bucketOf(const cell_coord& cell) const;
+
+  void binBodies();
+  void findPairs(int index, std::vector<body_pair>& pairs) const;
+  void findOverflowPairs(int index, std::vector<body_pair>& pairs) const;
+
+  // Fields
+
+  float minimumCellSize;
+  thread_pool* pool;
+
+  // Every array here is indexed by body.
+  std::vector<aabb> bounds;
+  std::vector<bool> statics;
+  std::vector<bool> slots;
+
+  // The index of each tracked body in the active list, so it can be swapped out in constant time.
+  std::vector<int> activeSlots;
+
+  // The bodies that are currently tracked.
+  std::vector<int> active;
+
+  // The tracked bodies split at the last update into the ones in the grid, with the bucket of
+  // each, and the static and oversized ones that are left out.
+  std::vector<int> gridded;
+  std::vector<std::uint32_t> griddedBuckets;
+  std::vector<int> overflow;
+
+  // The grid, as a table of buckets. The bodies in bucket b are binned[bucketStarts[b]] through
+  // binned[bucketStarts[b + 1] - 1]. When the bodies are packed closely enough, every cell they
+  // cover gets its own bucket, and otherwise the cells are hashed into a power of two buckets.
+  float inverseCellSize = 1.0f;
+  bool dense = false;
+  cell_coord origin = {0, 0, 0};
+  cell_coord dimensions = {0, 0, 0};
+  // The range of cells that hold a body.
+  cell_coord occupiedLow = {0, 0, 0};
+  cell_coord occupiedHigh = {-1, -1, -1};
+  int bucketBits = 1;
+  int buckets = 0;
+  std::vector<int> bucketStarts;
+  std::vector<grid_entry> binned;
+
+  std::vector<std::vector<body_pair>> chunkPairs;
+};
+
+} // namespace flexor
\ No newline at end of file
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "collision/narrowphase.h"
+#include "core/snapshot.h"
+#include "dynamics/body_store.h"
+
+namespace flexor
+{
+
+// ----- Manifold Cache -----
+
+/**
+ * Keeps the contact manifolds of a world from one step to the next. The solver converges much
+ * faster when it starts from the impulses it found for the same contact last step (warm starting),
+ * so every freshly found manifold looks up the manifold of its pair from the last step and takes
+ * over the impulses of the points it shares with it.
+ *
+ * The manifolds are looked up in an open addressing hash table keyed by body pair, which is
+ * rebuilt in linear time whenever the manifolds are replaced. Points are matched by their feature
+ * id. GJK and EPA only give one point per step, so their manifolds also keep the points from the
+ * last step that are still touching, which builds up a full manifold over a few steps.
+ */
+class manifold_cache
+{
+public:
+  /**
+   * Carries the impulses of the kept manifold for the same pair of bodies over to a freshly found
+   * manifold, and fills out the points of manifolds found by GJK and EPA. This only reads from the
+   * cache, so chunks of manifolds can be merged on separate threads.
+   */
+  void merge(contact_manifold& manifold, const body_store& bodies) const;
+
+  /**
+   * Replaces the kept manifolds with the given ones, which are taken out of the vector. The
+   * manifolds should have been merged first.
+   */
+  void store(std::vector<contact_manifold>& found, const body_store& bodies);
+
+  /**
+   * Renames the bodies of the kept manifolds after bodies were removed from the store. The new
+   * index of every old body is given, or -1 for a removed body, whose manifolds are dropped.
+   */
+  void remap(std::span<const int> newIndices);
+
+  void clear();
+
+  /**
+   * Writes the kept manifolds into a snapshot with their impulses, anchors and lookup table, and
+   * reads them back.
+   */
+  void save(world_snapshot& snapshot) const;
+  void restore(const snapshot_view& snapshot);
+
+  /**
+   * Returns whether a snapshot holds a cache whose manifolds are all between the given number of
+   * bodies, with an anchor for each manifold and a table that only points at them.
+   */
+  static bool canRestore(const snapshot_view& snapshot, int bodies);
+
+  /**
+   * The kept manifolds. The solver writes its impulses straight into these.
+   */
+  std::vector<contact_manifold>& manifolds() { return kept; }
+  const std::vector<contact_manifold>& manifolds() const { return kept; }
+
+  /**
+   * Returns the index of the kept manifold between two bodies, or -1 if they had no contact.
+   */
+  int find(int bodyA, int bodyB) const;
+
+private:
+  // The points of a manifold on the surface of each body, in the local space of that body. This is
+  // how a point from GJK and EPA is followed as the bodies move.
+  struct point_anchors
+  {
+    vector3 localA[contact_manifold::maxPoints];
+    vector3 localB[contact_manifold::maxPoints];
+  };
+
+  struct table_slot
+  {
+    std::uint64_t key;
+    int manifold;
+  };
+
+  void buildTable();
+
+  static std::uint64_t keyOf(int bodyA, int bodyB)
+  {
+    return (static_cast<std::uint64_t>(bodyA) << 32) | static_cast<std::uint32_t>(bodyB);
+  }
+
+  // Fields
+
+  std::vector<contact_manifold> kept;
+  std::vector<point_anchors> anchors;
+
+  // The table has a power of two slots, at least twice as many as there are manifolds, so probe
+  // sequences stay short. An empty slot has a negative manifold.
+  std::vector<table_slot> table;
+  int tableBits = 0;
+};
+
+} // namespace flexor
\ No newline at end of file
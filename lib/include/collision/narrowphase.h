@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+
+#include "collision/shape.h"
+
+namespace flexor
+{
+
+// ----- Contact Manifold -----
+
+/**
+ * A single point where two shapes touch.
+ */
+struct contact_point
+{
+  // The point halfway between the two surfaces, in world space.
+  vector3 position = vector3(0.0f);
+
+  // How far the shapes overlap at this point along the manifold normal. Points a little apart
+  // have a negative depth.
+  float depth = 0.0f;
+
+  // Names the pair of features (faces, edges, and vertices) that produced the point. The same
+  // features give the same id every step, which is how a point is recognized from one step to the
+  // next. Points from GJK and EPA have no features to name, and use zero.
+  std::uint32_t id = 0;
+
+  // The impulses the solver applied at this point along the normal and the two tangents of the
+  // manifold. These carry over to the next step to warm start the solver.
+  float normalImpulse = 0.0f;
+  float tangentImpulse[2] = {0.0f, 0.0f};
+};
+
+/**
+ * The contact between two bodies. Every point shares the same normal, which points from body A to
+ * body B.
+ */
+struct contact_manifold
+{
+  static constexpr int maxPoints = 4;
+
+  int bodyA = -1;
+  int bodyB = -1;
+
+  vector3 normal = vector3(0.0f, 1.0f, 0.0f);
+  contact_point points[maxPoints];
+  int count = 0;
+};
+
+/**
+ * Picks at most four of the given points, which all lie roughly on a plane with the given normal,
+ * and moves them to the front of the array. The deepest point is always kept, and the others are
+ * picked to cover as much area as possible, since the area of the manifold is what keeps a
+ * resting body from rocking. Returns the number of points kept.
+ */
+int reducePoints(const vector3& normal, contact_point* points, int count);
+
+/**
+ * Swaps the bodies of a manifold, which turns its normal around. The points and their normal
+ * impulses stay as they are, but the friction impulses are dropped, since the tangents they were
+ * applied along are built from the normal.
+ */
+void flipManifold(contact_manifold& manifold);
+
+// ----- Collision Functions -----
+
+/**
+ * Tests two placed shapes for contact, and fills in the normal and points of the manifold if they
+ * touch. The bodies of the manifold are left for the caller.
+ */
+using collide_function = bool (*)(const shape& a, const rigid_transform& transformA,
+                                  const shape& b, const rigid_transform& transformB,
+                                  contact_manifold& manifold);
+
+// These find contacts in closed form for the most common pairs of shapes.
+
+bool collideSpheres(const shape& a, const rigid_transform& transformA, const shape& b,
+                    const rigid_transform& transformB, contact_manifold& manifold);
+
+bool collideSphereBox(const shape& a, const rigid_transform& transformA, const shape& b,
+                      const rigid_transform& transformB, contact_manifold& manifold);
+
+/**
+ * Finds the axis of least overlap among the 15 separating axes of two boxes. Face contacts clip the
+ * most anti-parallel face of one box against the sides of the face of the other, which gives up to
+ * four points for a box resting on another, and edge contacts give the closest points between the
+ * two edges.
+ */
+bool collideBoxes(const shape& a, const rigid_transform& transformA, const shape& b,
+                  const rigid_transform& transformB, contact_manifold& manifold);
+
+/**
+ * Finds the contact between any two convex shapes with GJK and EPA, which gives a single point.
+ * GJK first runs on the cores of the shapes, and only when the cores overlap does EPA have to run
+ * on the full shapes.
+ */
+bool collideConvex(const shape& a, const rigid_transform& transformA, const shape& b,
+                   const rigid_transform& transformB, contact_manifold& manifold);
+
+// ----- Dispatch -----
+
+/**
+ * Tests two placed shapes for contact with the collision function for their pair of types. The
+ * function is looked up in a table indexed by both types, so there is no virtual call per pair.
+ */
+bool collide(const shape& a, const rigid_transform& transformA, const shape& b,
+             const rigid_transform& transformB, contact_manifold& manifold);
+
+} // namespace flexor
\ No newline at end of file
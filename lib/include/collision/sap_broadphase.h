@@ -0,0 +1,101 @@
+#pragma once
+
+#include <vector>
+
+#include "collision/broadphase.h"
+
+namespace flexor
+{
+
+// ----- Sweep and Prune Broadphase -----
+
+/**
+ * Finds the pairs of bodies whose bounds overlap by sorting the boxes along one axis and sweeping
+ * over them. Each box only has to be tested against the boxes that start before it ends, which
+ * prunes away everything that is far apart along the sweep axis.
+ *
+ * The sorted order is kept from one update to the next. Bodies only move a little each step, so
+ * the order is almost sorted already, and insertion sort puts it back in order in close to linear
+ * time. After sorting, the bounds are gathered into arrays in sorted order so that the sweep can
+ * test a box against a whole register of its neighbours on the other two axes at once.
+ *
+ * Unlike the tree, this finds exactly the pairs whose bounds overlap, and every update finds all
+ * of them again, so it does the same work whether one body moved or all of them did.
+ */
+class sap_broadphase : public broadphase
+{
+public:
+  /**
+   * Creates a broadphase that sweeps along the given axis. The sweep prunes best along the axis
+   * over which the bodies are most spread out.
+   */
+  sap_broadphase(int axis = 0);
+
+  // Bodies
+
+  void add(int body, const aabb& bounds, bool isStatic) override;
+  void move(int body, const aabb& bounds, const vector3& displacement) override;
+  void remove(int body) override;
+
+  // Pairs
+
+  void updatePairs() override;
+
+  // Snapshots
+
+  void save(world_snapshot& snapshot) const override;
+  void restore(const snapshot_view& snapshot) override;
+
+  /**
+   * Returns whether a snapshot holds a sweep that tracks exactly the given number of bodies, with
+   * one endpoint for every listed body and a sorted prefix inside the list. Bodies removed since
+   * the last update may still have entries past them.
+   */
+  static bool canRestore(const snapshot_view& snapshot, int bodies);
+
+private:
+  struct endpoint
+  {
+    float value;
+    int body;
+  };
+
+  bool tracked(int body) const
+  {
+    return body >= 0 && body < static_cast<int>(slots.size()) && slots[body];
+  }
+
+  void sortEndpoints();
+  void gatherBounds();
+
+  // Fields
+
+  int axis;
+  int otherAxis1;
+  int otherAxis2;
+
+  // Every array here is indexed by body.
+  std::vector<aabb> bounds;
+  std::vector<bool> statics;
+  std::vector<bool> slots;
+
+  // Whether a body has an endpoint in the list. A removed body keeps its endpoint until the next
+  // update, and a body added at its index before then takes the endpoint over.
+  std::vector<bool> listed;
+
+  // The minimum endpoint of every body along the sweep axis, in sorted order. Bodies added since
+  // the last update are appended to the end and merged in by the next update.
+  std::vector<endpoint> endpoints;
+  int sortedCount = 0;
+  bool removedAny = false;
+
+  // The bounds of every body gathered in sorted order, padded by a register of empty boxes.
+  std::vector<float> sweepMin;
+  std::vector<float> sweepMax;
+  std::vector<float> min1;
+  std::vector<float> max1;
+  std::vector<float> min2;
+  std::vector<float> max2;
+};
+
+} // namespace flexor
\ No newline at end of file
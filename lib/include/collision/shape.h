@@ -0,0 +1,240 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <span>
+
+#include "collision/aabb.h"
+#include "math/quaternion.h"
+#include "math/simd.h"
+#include "math/small_matrix.h"
+#include "math/vector3.h"
+
+namespace flexor
+{
+
+// ----- Rigid Transform -----
+
+/**
+ * The placement of a shape in the world. The orientation is kept as a rotation matrix, since the
+ * narrowphase rotates many directions and points by the same orientation, and a matrix does that
+ * with three multiply-adds instead of two cross products.
+ */
+struct rigid_transform
+{
+  // Fields
+
+  vector3 position = vector3(0.0f);
+  matrix3 rotation = matrix3(1.0f);
+
+  // Constructors
+
+  rigid_transform() = default;
+
+  rigid_transform(const vector3& position, const quaternion& orientation)
+    : position(position), rotation(quaternion::matrix(orientation))
+  {
+  }
+
+  // Methods
+
+  vector3 toWorld(const vector3& point) const { return position + rotation * point; }
+  vector3 toLocal(const vector3& point) const { return inverseRotate(point - position); }
+
+  vector3 rotate(const vector3& dir) const { return rotation * dir; }
+
+  /**
+   * Rotates a world space direction into local space. The inverse of a rotation is its transpose,
+   * so each component is just the dot product with a column.
+   */
+  vector3 inverseRotate(const vector3& dir) const
+  {
+    return vector3(dot(rotation[0], dir), dot(rotation[1], dir), dot(rotation[2], dir));
+  }
+};
+
+// ----- Shapes -----
+
+enum class shape_type : std::uint8_t
+{
+  sphere,
+  box,
+  capsule,
+  hull,
+
+  // The number of shape types, which sizes the collision dispatch table.
+  count
+};
+
+/**
+ * A convex collision shape, given in the local space of the body it belongs to. The narrowphase
+ * only ever asks a shape for its support point, the point farthest along a direction, so any
+ * convex shape with a support function can collide with any other.
+ *
+ * Spheres and capsules are stored as a core (a point or a segment) inflated by a radius. The
+ * narrowphase runs GJK on the cores and adds the radii afterwards, which is exact for rounded
+ * shapes and avoids running EPA on curved surfaces, where it converges slowly.
+ *
+ * A shape is a small value type. The vertices of a convex hull are not copied, so they must
+ * outlive the shape.
+ */
+struct shape
+{
+  // Fields
+
+  shape_type type = shape_type::box;
+
+  // The radius of a sphere or capsule.
+  float radius = 0.0f;
+
+  // Half the length of the core segment of a capsule, which runs along the local y axis.
+  float halfHeight = 0.0f;
+
+  // The half extents of a box along each local axis.
+  vector3 halfExtents = vector3(0.5f);
+
+  // The vertices of a convex hull. Vertices inside the hull are harmless but slow down support
+  // queries.
+  std::span<const vector3> vertices;
+
+  // Constructors
+
+  static shape sphere(float radius)
+  {
+    assert(radius > 0.0f);
+
+    shape res;
+    res.type = shape_type::sphere;
+    res.radius = radius;
+    return res;
+  }
+
+  static shape box(const vector3& halfExtents)
+  {
+    assert(halfExtents.x > 0.0f && halfExtents.y > 0.0f && halfExtents.z > 0.0f);
+
+    shape res;
+    res.type = shape_type::box;
+    res.halfExtents = halfExtents;
+    return res;
+  }
+
+  static shape capsule(float halfHeight, float radius)
+  {
+    assert(halfHeight >= 0.0f && radius > 0.0f);
+
+    shape res;
+    res.type = shape_type::capsule;
+    res.halfHeight = halfHeight;
+    res.radius = radius;
+    return res;
+  }
+
+  static shape hull(std::span<const vector3> vertices)
+  {
+    assert(!vertices.empty());
+
+    shape res;
+    res.type = shape_type::hull;
+    res.vertices = vertices;
+    return res;
+  }
+
+  // Methods
+
+  /**
+   * The radius the core of the shape is inflated by, which is zero for boxes and hulls.
+   */
+  float coreRadius() const
+  {
+    return type == shape_type::sphere || type == shape_type::capsule ? radius : 0.0f;
+  }
+};
+
+// ----- Support Functions -----
+
+/**
+ * Returns the point of the core of a shape that is farthest along a local direction. The
+ * direction doesn't need to be normalized.
+ */
+inline vector3 coreSupport(const shape& geometry, const vector3& dir)
+{
+  switch (geometry.type)
+  {
+  case shape_type::sphere:
+    return vector3(0.0f);
+
+  case shape_type::box:
+    // The corner in the octant of the direction, which copies the sign of each component.
+    return vector3::fromSimd(simd::flipSign(geometry.halfExtents.toSimd(), dir.toSimd()));
+
+  case shape_type::capsule:
+    return vector3(0.0f, dir.y < 0.0f ? -geometry.halfHeight : geometry.halfHeight, 0.0f);
+
+  case shape_type::hull:
+  default:
+  {
+    const vector3* best = &geometry.vertices[0];
+    float bestDot = dot(*best, dir);
+    for (const vector3& vertex : geometry.vertices)
+    {
+      float d = dot(vertex, dir);
+      if (d > bestDot)
+      {
+        bestDot = d;
+        best = &vertex;
+      }
+    }
+
+    return *best;
+  }
+  }
+}
+
+/**
+ * Returns the point of a shape that is farthest along a local direction, including the radius.
+ */
+inline vector3 support(const shape& geometry, const vector3& dir)
+{
+  vector3 point = coreSupport(geometry, dir);
+
+  float radius = geometry.coreRadius();
+  float length = magnitude(dir);
+  if (radius > 0.0f && length > 0.0f)
+    point += dir * (radius / length);
+
+  return point;
+}
+
+/**
+ * Computes the bounds of a shape in its local space.
+ */
+inline aabb bounds(const shape& geometry)
+{
+  switch (geometry.type)
+  {
+  case shape_type::sphere:
+    return aabb(vector3(-geometry.radius), vector3(geometry.radius));
+
+  case shape_type::box:
+    return aabb(-geometry.halfExtents, geometry.halfExtents);
+
+  case shape_type::capsule:
+  {
+    vector3 extents(geometry.radius, geometry.halfHeight + geometry.radius, geometry.radius);
+    return aabb(-extents, extents);
+  }
+
+  case shape_type::hull:
+  default:
+  {
+    aabb res(geometry.vertices[0], geometry.vertices[0]);
+    for (const vector3& vertex : geometry.vertices)
+      res = combine(res, aabb(vertex, vertex));
+
+    return res;
+  }
+  }
+}
+
+} // namespace flexor
\ No newline at end of file
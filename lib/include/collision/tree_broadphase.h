@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+
+#include "collision/broadphase.h"
+#include "collision/dynamic_tree.h"
+
+namespace flexor
+{
+
+// ----- Tree Broadphase -----
+
+/**
+ * Finds the pairs of bodies whose bounds overlap using a dynamic AABB tree. Only the bodies whose
+ * fat boxes changed since the last update are queried against the tree, so a mostly resting world
+ * costs close to nothing, and the pairs of bodies that didn't move are carried over from the
+ * previous update.
+ *
+ * Pairs are found from the fat boxes, so they include some bodies that are merely close.
+ */
+class tree_broadphase : public broadphase
+{
+public:
+  tree_broadphase() = default;
+
+  // Bodies
+
+  void add(int body, const aabb& bounds, bool isStatic) override;
+  void move(int body, const aabb& bounds, const vector3& displacement) override;
+  void remove(int body) override;
+
+  // Pairs
+
+  void updatePairs() override;
+
+  // Snapshots
+
+  void save(world_snapshot& snapshot) const override;
+  void restore(const snapshot_view& snapshot) override;
+
+  /**
+   * Returns whether a snapshot holds a tree broadphase that tracks exactly the given number of
+   * bodies in a well formed tree. Bodies removed since the last update may still have entries past
+   * them.
+   */
+  static bool canRestore(const snapshot_view& snapshot, int bodies);
+
+  const dynamic_tree& tree() const { return bvh; }
+
+private:
+  bool tracked(int body) const
+  {
+    return body >= 0 && body < static_cast<int>(proxies.size()) &&
+           proxies[body] != dynamic_tree::nullNode;
+  }
+
+  void markMoved(int body);
+
+  // Fields
+
+  dynamic_tree bvh;
+
+  // Every array is indexed by body.
+  std::vector<int> proxies;
+  std::vector<bool> statics;
+  std::vector<bool> moved;
+
+  std::vector<int> moveBuffer;
+};
+
+} // namespace flexor
\ No newline at end of file
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+namespace flexor
+{
+
+// ----- Frame Arena -----
+
+/**
+ * A monotonic allocator for data that only lives for one step. Allocating moves a cursor along a
+ * block of memory, and nothing is freed on its own. Resetting the arena takes everything back at
+ * once.
+ *
+ * When a step needs more than the block holds, the arena spills into extra blocks, and the next
+ * reset replaces all of them with one block big enough for the whole step. From then on a step of
+ * the same size never touches the heap. An arena must only be used by one thread at a time.
+ */
+class frame_arena
+{
+public:
+  /**
+   * Creates an arena with a first block of the given size in bytes, or none at all for zero.
+   */
+  explicit frame_arena(std::size_t capacity = 0);
+
+  frame_arena(frame_arena&&) = default;
+  frame_arena& operator=(frame_arena&&) = default;
+
+  /**
+   * Returns room for count objects of type T. The objects are left uninitialized, so only types
+   * that can be brought to life by writing to them are allowed.
+   */
+  template <typename T> std::span<T> allocate(int count);
+
+  /**
+   * Returns the given number of bytes, aligned to the given power of two.
+   */
+  void* allocate(std::size_t bytes, std::size_t alignment);
+
+  /**
+   * Takes back everything that was allocated. Anything allocated before must not be used again.
+   */
+  void reset();
+
+  /**
+   * The bytes handed out since the last reset (including padding for alignment), and the bytes the
+   * arena can hand out before it has to spill into another block.
+   */
+  std::size_t used() const;
+  std::size_t capacity() const { return blockSize; }
+
+private:
+  struct block_deleter
+  {
+    void operator()(std::byte* memory) const;
+  };
+
+  using block = std::unique_ptr<std::byte[], block_deleter>;
+
+  static block allocateBlock(std::size_t bytes);
+
+  // The first block, the blocks it spilled into since the last reset, and the size of all of them
+  // together.
+  block first;
+  std::size_t blockSize = 0;
+  std::vector<block> spills;
+  std::size_t reserved = 0;
+
+  // The block being allocated from, its size, and the cursor into it.
+  std::byte* current = nullptr;
+  std::size_t currentSize = 0;
+  std::size_t offset = 0;
+
+  // The bytes used in the blocks before the current one.
+  std::size_t spilled = 0;
+};
+
+template <typename T> std::span<T> frame_arena::allocate(int count)
+{
+  static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>,
+                "frame arenas never run constructors or destructors");
+
+  if (count <= 0)
+    return {};
+
+  void* memory = allocate(sizeof(T) * static_cast<std::size_t>(count), alignof(T));
+  return std::span<T>(static_cast<T*>(memory), count);
+}
+
+} // namespace flexor
\ No newline at end of file
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "core/snapshot.h"
+
+namespace flexor
+{
+
+// ----- Handle -----
+
+/**
+ * A 32-bit reference to an object in a handle pool. The low bits pick a slot of the pool and the
+ * high bits hold the generation of the slot when the handle was given out. Removing the object
+ * bumps the generation, so a handle that outlives its object is recognized as stale instead of
+ * quietly pointing at whatever took its place.
+ *
+ * The tag keeps handles of different pools from being mixed up.
+ */
+template <typename Tag> struct handle
+{
+  static constexpr int indexBits = 20;
+  static constexpr int generationBits = 12;
+  static constexpr std::uint32_t indexMask = (1u << indexBits) - 1;
+  static constexpr std::uint32_t generationMask = (1u << generationBits) - 1;
+
+  static constexpr std::uint32_t invalid = 0xFFFFFFFF;
+
+  std::uint32_t id = invalid;
+
+  int slot() const { return static_cast<int>(id & indexMask); }
+  int generation() const { return static_cast<int>(id >> indexBits); }
+  bool valid() const { return id != invalid; }
+
+  bool operator==(const handle&) const = default;
+};
+
+// ----- Handle Pool -----
+
+/**
+ * Hands out handles to objects that are kept packed in dense arrays. The pool only keeps track of
+ * which dense index each handle refers to, and the owner keeps the objects themselves, in as many
+ * arrays as it likes.
+ *
+ * Objects are always added at the end of the dense arrays, and removing one moves the last object
+ * into its place, which the owner has to mirror in every one of its arrays. That keeps the arrays
+ * free of holes however objects come and go, so walking them stays a linear scan, while the
+ * handles stay valid until their own object is removed.
+ *
+ * Freed slots are reused in the order they were freed, so a slot goes through as many other
+ * objects as possible before its generation comes around again.
+ */
+template <typename Tag> class handle_pool
+{
+public:
+  using handle_type = handle<Tag>;
+
+  // One slot is left out, so that no slot and generation ever make up the invalid handle.
+  static constexpr int maxSize = static_cast<int>(handle_type::indexMask);
+
+  /**
+   * Returns a handle to a new object at the end of the dense arrays, which is at index size() - 1
+   * once this returns.
+   */
+  handle_type add();
+
+  /**
+   * Forgets the object of a handle. The last object moves into the dense index it leaves behind,
+   * unless it was the last object itself.
+   */
+  void remove(handle_type object);
+
+  void clear();
+
+  /**
+   * Writes the pool into a snapshot, and reads it back, which keeps every handle valid across a
+   * restore. The pool takes up three sections in a row, starting at the given one.
+   */
+  void save(world_snapshot& snapshot, snapshot_section first) const;
+  void restore(const snapshot_view& snapshot, snapshot_section first);
+
+  /**
+   * Returns whether a snapshot holds a pool of the given number of objects, whose handles and free
+   * list only point at slots it has. Restoring doesn't check this itself, so that an owner can
+   * check everything it restores before touching any of it.
+   */
+  static bool canRestore(const snapshot_view& snapshot, snapshot_section first, int count);
+
+  /**
+   * Returns whether a handle refers to an object that is still in the pool.
+   */
+  bool contains(handle_type object) const
+  {
+    int slot = object.slot();
+    return object.valid() && slot < static_cast<int>(slots.size()) &&
+           slots[slot].generation == static_cast<std::uint32_t>(object.generation()) &&
+           slots[slot].dense >= 0;
+  }
+
+  /**
+   * The dense index of the object of a handle, which only holds until the next removal.
+   */
+  int indexOf(handle_type object) const
+  {
+    assert(contains(object));
+    return slots[object.slot()].dense;
+  }
+
+  /**
+   * The handle of the object at a dense index.
+   */
+  handle_type handleAt(int index) const
+  {
+    assert(index >= 0 && index < size());
+    return dense[index];
+  }
+
+  int size() const { return static_cast<int>(dense.size()); }
+
+private:
+  struct slot_entry
+  {
+    // The dense index of the object in the slot, or -1 if the slot is free.
+    int dense = -1;
+    std::uint32_t generation = 0;
+
+    // The next free slot after this one, while the slot is free.
+    int nextFree = -1;
+  };
+
+  std::vector<slot_entry> slots;
+  std::vector<handle_type> dense;
+
+  // The free slots, oldest first.
+  int freeHead = -1;
+  int freeTail = -1;
+};
+
+template <typename Tag> typename handle_pool<Tag>::handle_type handle_pool<Tag>::add()
+{
+  int slot = freeHead;
+  if (slot >= 0)
+  {
+    freeHead = slots[slot].nextFree;
+    if (freeHead < 0)
+      freeTail = -1;
+  }
+  else
+  {
+    assert(static_cast<int>(slots.size()) < maxSize);
+    slot = static_cast<int>(slots.size());
+    slots.emplace_back();
+  }
+
+  slot_entry& entry = slots[slot];
+  entry.dense = size();
+  entry.nextFree = -1;
+
+  handle_type object;
+  object.id = (entry.generation << handle_type::indexBits) | static_cast<std::uint32_t>(slot);
+  dense.push_back(object);
+
+  return object;
+}
+
+template <typename Tag> void handle_pool<Tag>::remove(handle_type object)
+{
+  assert(contains(object));
+
+  int slot = object.slot();
+  int index = slots[slot].dense;
+
+  handle_type last = dense.back();
+  dense[index] = last;
+  slots[last.slot()].dense = index;
+  dense.pop_back();
+
+  slot_entry& entry = slots[slot];
+  entry.dense = -1;
+  entry.generation = (entry.generation + 1) & handle_type::generationMask;
+
+  if (freeTail >= 0)
+    slots[freeTail].nextFree = slot;
+  else
+    freeHead = slot;
+  freeTail = slot;
+}
+
+template <typename Tag> void handle_pool<Tag>::clear()
+{
+  // The generations are kept, so handles from before the clear stay stale.
+  dense.clear();
+  freeHead = -1;
+  freeTail = -1;
+  for (int slot = 0; slot < static_cast<int>(slots.size()); slot++)
+  {
+    if (slots[slot].dense >= 0)
+      slots[slot].generation = (slots[slot].generation + 1) & handle_type::generationMask;
+
+    slots[slot].dense = -1;
+    slots[slot].nextFree = -1;
+    if (freeTail >= 0)
+      slots[freeTail].nextFree = slot;
+    else
+      freeHead = slot;
+    freeTail = slot;
+  }
+}
+
+template <typename Tag>
+void handle_pool<Tag>::save(world_snapshot& snapshot, snapshot_section first) const
+{
+  auto section = static_cast<std::uint32_t>(first);
+  int freeList[2] = {freeHead, freeTail};
+
+  snapshot.write(first, slots);
+  snapshot.write(static_cast<snapshot_section>(section + 1), dense);
+  snapshot.write(static_cast<snapshot_section>(section + 2), std::span<const int>(freeList));
+}
+
+template <typename Tag>
+bool handle_pool<Tag>::canRestore(const snapshot_view& snapshot, snapshot_section first, int count)
+{
+  auto section = static_cast<std::uint32_t>(first);
+  std::span<const slot_entry> savedSlots = snapshot.array<slot_entry>(first);
+  std::span<const handle_type> savedDense =
+    snapshot.array<handle_type>(static_cast<snapshot_section>(section + 1));
+  std::span<const int> freeList = snapshot.array<int>(static_cast<snapshot_section>(section + 2));
+
+  if (savedDense.size() != static_cast<std::size_t>(count) || freeList.size() != 2)
+    return false;
+
+  int slotCount = static_cast<int>(savedSlots.size());
+  for (int index = 0; index < count; index++)
+  {
+    int slot = savedDense[index].slot();
+    if (!savedDense[index].valid() || slot >= slotCount || savedSlots[slot].dense != index)
+      return false;
+  }
+
+  return freeList[0] >= -1 && freeList[0] < slotCount && freeList[1] >= -1 &&
+         freeList[1] < slotCount;
+}
+
+template <typename Tag>
+void handle_pool<Tag>::restore(const snapshot_view& snapshot, snapshot_section first)
+{
+  auto section = static_cast<std::uint32_t>(first);
+  snapshot.read(first, slots);
+  snapshot.read(static_cast<snapshot_section>(section + 1), dense);
+
+  std::span<const int> freeList = snapshot.array<int>(static_cast<snapshot_section>(section + 2));
+  freeHead = freeList.size() == 2 ? freeList[0] : -1;
+  freeTail = freeList.size() == 2 ? freeList[1] : -1;
+}
+
+} // namespace flexor
\ No newline at end of file
@@ -0,0 +1,295 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+namespace flexor
+{
+
+// ----- Snapshot Sections -----
+
+/**
+ * Names every array a snapshot can hold. The values are part of the format, so new sections only
+ * ever go at the end, and changing what a section holds means bumping the snapshot version.
+ */
+enum class snapshot_section : std::uint32_t
+{
+  // The engine
+  engineState,
+  previousPositions,
+  previousOrientations,
+  savedBodies,
+
+  // The body store and its handles
+  positions,
+  orientations,
+  linearVelocities,
+  angularVelocities,
+  forces,
+  torques,
+  inverseMasses,
+  inverseInertias,
+  worldInverseInertias,
+  shapes,
+  hullVertices,
+  localBounds,
+  handleSlots,
+  handleDense,
+  handleFreeList,
+
+  // The manifold cache
+  manifolds,
+  manifoldAnchors,
+  manifoldTable,
+
+  // The island manager
+  islandStates,
+  islandRestFrames,
+  islandSleeperOf,
+  islandParents,
+  islandOf,
+  awakeBodies,
+  islandBodies,
+  islandBodyStarts,
+  islandManifolds,
+  islandManifoldStarts,
+  sleeperBodyStarts,
+  sleeperBodies,
+  sleeperManifoldStarts,
+  sleeperManifolds,
+  freeSleepers,
+  restoredManifolds,
+  islandDirty,
+
+  // The broadphase
+  broadphasePairs,
+  broadphaseBounds,
+  broadphaseStatics,
+  broadphaseSlots,
+  treeNodes,
+  treeRoot,
+  treeProxies,
+  treeMoved,
+  treeMoveBuffer,
+  sweepListed,
+  sweepEndpoints,
+  sweepCounts,
+  gridActiveSlots,
+  gridActive,
+
+  // The number of sections, which isn't a section itself.
+  count
+};
+
+// ----- Snapshot Format -----
+
+/**
+ * A snapshot is one flat block of little-endian data, made to be mapped straight from a file and
+ * read in place. It starts with this header, which is followed by the sections, each holding an
+ * array of plain values and starting on a 64 byte boundary. The table of sections comes last, and
+ * the header says where to find it.
+ *
+ * The values are laid out exactly as they are in memory, so a snapshot can only be read by a build
+ * of the engine with the same layout, which the layout signature checks.
+ */
+struct snapshot_header
+{
+  // "FLXS" as a little-endian number.
+  static constexpr std::uint32_t magicNumber = 0x53584C46;
+  static constexpr std::uint32_t currentVersion = 1;
+
+  std::uint32_t magic = magicNumber;
+  std::uint32_t version = currentVersion;
+  std::uint32_t layout = 0;
+  std::uint32_t sectionCount = 0;
+  std::uint64_t tableOffset = 0;
+  std::uint64_t size = 0;
+};
+
+struct snapshot_entry
+{
+  snapshot_section id;
+  std::uint32_t elementSize;
+  std::uint64_t offset;
+  std::uint64_t count;
+};
+
+// Sections start on cache lines, which is enough for any value a section holds.
+constexpr std::size_t snapshotAlignment = 64;
+
+// ----- Snapshot View -----
+
+/**
+ * Reads a snapshot in place from a block of memory, which can be a world snapshot or a mapped file.
+ * Nothing is copied or parsed beyond checking the header and the table, so a view is cheap to make,
+ * and the memory must outlive it and start on a 64 byte boundary.
+ */
+class snapshot_view
+{
+public:
+  snapshot_view() = default;
+  explicit snapshot_view(std::span<const std::byte> bytes);
+
+  /**
+   * Returns whether the memory holds a whole snapshot of the current version, whose sections all
+   * lie inside it.
+   */
+  bool valid() const { return data != nullptr; }
+
+  /**
+   * The layout signature of the engine that wrote the snapshot.
+   */
+  std::uint32_t layout() const;
+
+  /**
+   * The array a section holds, which is empty if the snapshot doesn't have the section or holds
+   * values of a different size in it.
+   */
+  template <typename T> std::span<const T> array(snapshot_section id) const;
+
+  /**
+   * The single value a section holds, or the given fallback if the snapshot doesn't have it.
+   */
+  template <typename T> T value(snapshot_section id, const T& fallback = T()) const;
+
+  /**
+   * Copies the array a section holds into a vector, which keeps its memory if it is large enough.
+   */
+  template <typename T> void read(snapshot_section id, std::vector<T>& values) const;
+  void readFlags(snapshot_section id, std::vector<bool>& flags) const;
+
+private:
+  const std::byte* data = nullptr;
+  // The table entry of every section, or null for sections the snapshot doesn't have.
+  static constexpr std::size_t sectionCount = static_cast<std::size_t>(snapshot_section::count);
+  std::array<const snapshot_entry*, sectionCount> entries = {};
+};
+
+template <typename T> std::span<const T> snapshot_view::array(snapshot_section id) const
+{
+  static_assert(std::is_trivially_copyable_v<T>, "snapshots only hold plain values");
+
+  const snapshot_entry* entry = valid() ? entries[static_cast<std::size_t>(id)] : nullptr;
+  if (!entry || entry->elementSize != sizeof(T))
+    return {};
+
+  return std::span<const T>(reinterpret_cast<const T*>(data + entry->offset), entry->count);
+}
+
+template <typename T> T snapshot_view::value(snapshot_section id, const T& fallback) const
+{
+  std::span<const T> values = array<T>(id);
+  return values.empty() ? fallback : values[0];
+}
+
+template <typename T> void snapshot_view::read(snapshot_section id, std::vector<T>& values) const
+{
+  std::span<const T> source = array<T>(id);
+  values.assign(source.begin(), source.end());
+}
+
+// ----- World Snapshot -----
+
+/**
+ * A snapshot held in memory, which is how a world is saved, and how a world is rolled back to an
+ * earlier step. The memory is kept from one save to the next, so a snapshot that a world is saved
+ * into every step only grows until it fits the world. The bytes can be written to a file as they
+ * are.
+ */
+class world_snapshot
+{
+public:
+  world_snapshot() = default;
+
+  world_snapshot(world_snapshot&&) = default;
+  world_snapshot& operator=(world_snapshot&&) = default;
+
+  /**
+   * Starts a new snapshot in place of the old one.
+   */
+  void begin(std::uint32_t layout);
+
+  /**
+   * Adds a section with room for count values and returns it, to be filled right away. The room
+   * is only good until the next section is added.
+   */
+  template <typename T> std::span<T> add(snapshot_section id, int count);
+
+  /**
+   * Adds a section that holds a copy of an array, or of a single value.
+   */
+  template <typename T> void write(snapshot_section id, std::span<const T> values);
+  template <typename T> void write(snapshot_section id, const std::vector<T>& values);
+  template <typename T> void writeValue(snapshot_section id, const T& value);
+  void writeFlags(snapshot_section id, const std::vector<bool>& flags);
+
+  /**
+   * Writes the table of sections, after which the snapshot can be read.
+   */
+  void finish();
+
+  std::span<const std::byte> bytes() const
+  {
+    return std::span<const std::byte>(buffer.get(), size);
+  }
+
+  snapshot_view view() const { return snapshot_view(bytes()); }
+
+private:
+  struct buffer_deleter
+  {
+    void operator()(std::byte* memory) const;
+  };
+
+  // Grows the buffer to hold at least the given number of bytes, keeping what it holds.
+  void reserve(std::size_t bytes);
+
+  std::unique_ptr<std::byte[], buffer_deleter> buffer;
+  std::size_t capacity = 0;
+  std::size_t size = 0;
+
+  std::vector<snapshot_entry> sections;
+};
+
+template <typename T> std::span<T> world_snapshot::add(snapshot_section id, int count)
+{
+  static_assert(std::is_trivially_copyable_v<T>, "snapshots only hold plain values");
+  assert(count >= 0);
+
+  std::size_t offset = (size + snapshotAlignment - 1) & ~(snapshotAlignment - 1);
+  std::size_t bytes = sizeof(T) * static_cast<std::size_t>(count);
+  reserve(offset + bytes);
+
+  // The padding is zeroed, so that nothing left over from an earlier snapshot ends up in a file.
+  std::memset(buffer.get() + size, 0, offset - size);
+  size = offset + bytes;
+
+  sections.push_back({id, sizeof(T), offset, static_cast<std::uint64_t>(count)});
+  return std::span<T>(reinterpret_cast<T*>(buffer.get() + offset), count);
+}
+
+template <typename T> void world_snapshot::write(snapshot_section id, std::span<const T> values)
+{
+  std::span<T> target = add<T>(id, static_cast<int>(values.size()));
+  if (!values.empty())
+    std::memcpy(target.data(), values.data(), values.size_bytes());
+}
+
+template <typename T> void world_snapshot::write(snapshot_section id, const std::vector<T>& values)
+{
+  write(id, std::span<const T>(values));
+}
+
+template <typename T> void world_snapshot::writeValue(snapshot_section id, const T& value)
+{
+  write(id, std::span<const T>(&value, 1));
+}
+
+} // namespace flexor
\ No newline at end of file
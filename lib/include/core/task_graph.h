@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace flexor
+{
+
+class thread_pool;
+
+// ----- Task Graph -----
+
+/**
+ * A set of tasks with dependencies between them, which a thread pool runs as soon as everything
+ * each task depends on has finished. Tasks that don't depend on each other run at the same time,
+ * and a task may start parallel loops of its own.
+ *
+ * A graph is meant to be built once and run many times. Adding tasks allocates, but running the
+ * graph doesn't.
+ */
+class task_graph
+{
+public:
+  /**
+   * Adds a task that calls fn(thread) and returns its index. The thread is the index of the pool
+   * thread that runs the task.
+   */
+  template <typename Fn> int add(Fn&& fn);
+
+  /**
+   * Makes the task after wait for the task before to finish.
+   */
+  void precede(int before, int after);
+
+  int size() const { return static_cast<int>(tasks.size()); }
+
+  void clear();
+
+private:
+  friend class thread_pool;
+
+  struct task
+  {
+    std::function<void(int)> fn;
+    std::vector<int> successors;
+    int dependencies = 0;
+  };
+
+  std::vector<task> tasks;
+
+  // How many dependencies of each task are still running, and how many tasks haven't finished,
+  // while the graph runs.
+  std::unique_ptr<std::atomic<int>[]> waiting;
+  std::atomic<int> unfinished = 0;
+};
+
+template <typename Fn> int task_graph::add(Fn&& fn)
+{
+  tasks.push_back({std::function<void(int)>(std::forward<Fn>(fn)), {}, 0});
+  waiting.reset();
+
+  return size() - 1;
+}
+
+inline void task_graph::precede(int before, int after)
+{
+  assert(before >= 0 && before < size() && after >= 0 && after < size() && before != after);
+
+  tasks[before].successors.push_back(after);
+  tasks[after].dependencies++;
+}
+
+inline void task_graph::clear()
+{
+  tasks.clear();
+  waiting.reset();
+}
+
+} // namespace flexor
\ No newline at end of file
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "core/task_graph.h"
+
+namespace flexor
+{
+
+// ----- Thread Pool -----
+
+/**
+ * A fixed set of worker threads that run loops and task graphs with work stealing. Every thread
+ * has a deque of jobs of its own. It pushes and pops jobs at the bottom of it, and when it runs out
+ * it steals from the top of someone else's, which is where the largest and oldest jobs are.
+ *
+ * A thread that starts a loop or a graph works on it too, and returns once all of it has run, so a
+ * loop behaves just like a serial one that happens to finish sooner. While it waits, it helps with
+ * whatever else is queued, which lets loops start loops of their own, and lets the tasks of a graph
+ * run loops.
+ *
+ * Each loop chunk and task is told which thread runs it, which lets it write into per-thread
+ * buffers without any locking. The pool should only be driven from one outside thread at a time,
+ * since every outside thread counts as thread zero.
+ */
+class thread_pool
+{
+public:
+  /**
+   * Creates a pool that runs loops on the given number of threads, including the calling thread.
+   * A negative count uses every hardware thread.
+   */
+  explicit thread_pool(int threads = -1);
+  ~thread_pool();
+
+  thread_pool(const thread_pool&) = delete;
+  thread_pool& operator=(const thread_pool&) = delete;
+
+  /**
+   * The number of threads that work on a loop, including the calling thread. Thread indices given
+   * to loops are always in the range [0, size()), and threads outside the pool are thread zero.
+   */
+  int size() const { return threadCount; }
+
+  /**
+   * Calls fn(begin, end, thread) once for each chunk of grain iterations (the last one may be
+   * shorter) until [0, count) has been covered, and waits for every chunk to finish. Chunks always
+   * start at a multiple of grain. A grain of zero or less picks one from the count and the number
+   * of threads.
+   *
+   * The chunks aren't handed out one by one. A thread takes a whole range of them and splits half
+   * of what it has left off for the others only when its own deque has run dry, so a loop is split
+   * finely when threads are idle, and hardly at all when they are busy.
+   */
+  template <typename Fn> void parallelFor(int count, int grain, Fn&& fn);
+
+  /**
+   * Runs every task of a graph, each once all of its dependencies have finished, and waits for the
+   * last of them.
+   */
+  void run(task_graph& graph);
+
+private:
+  struct job;
+  using execute_fn = void (*)(thread_pool& pool, const job& work, int thread);
+
+  /**
+   * A range of chunks of a loop, or a task of a graph. Jobs are small enough to be copied into
+   * the deques, so queueing one never allocates.
+   */
+  struct job
+  {
+    execute_fn execute = nullptr;
+    void* context = nullptr;
+    int begin = 0;
+    int end = 0;
+  };
+
+  struct loop
+  {
+    void (*invoke)(const void* fn, int begin, int end, int thread) = nullptr;
+    const void* fn = nullptr;
+    int count = 0;
+    int grain = 1;
+
+    // The chunks that haven't finished yet.
+    std::atomic<int> remaining = 0;
+  };
+
+  /**
+   * A fixed ring of jobs behind a spin lock. The lock is only held for a handful of instructions,
+   * and an owner and a thief only meet when the deque is nearly empty.
+   */
+  struct alignas(64) job_deque
+  {
+    static constexpr int capacity = 256;
+
+    bool push(const job& work);
+    bool pop(job& work);
+    bool steal(job& work);
+    bool empty() const;
+
+    void lock();
+    void unlock() { locked.store(false, std::memory_order_release); }
+
+    job jobs[capacity];
+    std::atomic<int> top = 0;
+    std::atomic<int> bottom = 0;
+    std::atomic<bool> locked = false;
+  };
+
+  void runLoop(loop& work);
+  static void executeLoop(thread_pool& pool, const job& work, int thread);
+  static void executeTask(thread_pool& pool, const job& work, int thread);
+
+  /**
+   * Queues a job on a thread's deque, or runs it right away if the deque is full.
+   */
+  void submit(const job& work, int thread);
+
+  /**
+   * Runs one job from the thread's own deque, or one stolen from another thread. Returns false if
+   * there was nothing to run.
+   */
+  bool runOne(int thread);
+
+  /**
+   * Helps with queued jobs until the counter reaches zero.
+   */
+  void waitFor(const std::atomic<int>& counter, int thread);
+
+  int currentThread() const;
+  void workerMain(int thread);
+
+  // Fields
+
+  // The count is set before any worker starts, since they read it while the rest are started.
+  int threadCount = 1;
+  std::vector<std::thread> workers;
+  std::unique_ptr<job_deque[]> deques;
+
+  // Jobs sitting in any deque, and workers asleep waiting for some.
+  std::atomic<int> queued = 0;
+  std::atomic<int> sleepers = 0;
+  std::atomic<bool> stopping = false;
+
+  std::mutex mutex;
+  std::condition_variable wake;
+};
+
+template <typename Fn> void thread_pool::parallelFor(int count, int grain, Fn&& fn)
+{
+  if (count <= 0)
+    return;
+
+  // Eight chunks per thread leaves enough to even out threads that run slower than others.
+  if (grain <= 0)
+    grain = count / (8 * size()) > 1 ? count / (8 * size()) : 1;
+
+  // Small loops aren't worth waking the workers for.
+  if (threadCount == 1 || count <= grain)
+  {
+    for (int begin = 0; begin < count; begin += grain)
+      fn(begin, begin + grain < count ? begin + grain : count, currentThread());
+
+    return;
+  }
+
+  // The loop body is passed by address with a function that knows its type, which avoids the
+  // allocation a std::function could make.
+  loop work;
+  work.invoke = [](const void* fn, int begin, int end, int thread)
+  { (*static_cast<std::remove_reference_t<Fn>*>(const_cast<void*>(fn)))(begin, end, thread); };
+  work.fn = &fn;
+  work.count = count;
+  work.grain = grain;
+
+  runLoop(work);
+}
+
+} // namespace flexor
\ No newline at end of file
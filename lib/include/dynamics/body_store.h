@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "collision/aabb.h"
+#include "collision/shape.h"
+#include "core/snapshot.h"
+#include "math/quaternion.h"
+#include "math/small_matrix.h"
+#include "math/vector3.h"
+
+namespace flexor
+{
+
+// ----- Body Definition -----
+
+/**
+ * Describes the initial state of a rigid body when it is added to an engine. A body with zero mass
+ * is static, and will never be moved by the integrator.
+ */
+struct body_def
+{
+  vector3 position = vector3(0.0f);
+  quaternion orientation = quaternion();
+  vector3 linearVelocity = vector3(0.0f);
+  vector3 angularVelocity = vector3(0.0f);
+
+  float mass = 1.0f;
+
+  // The principal moments of inertia in body space. We only store the diagonal, so bodies are
+  // expected to be defined along their principal axes.
+  vector3 inertia = vector3(1.0f);
+
+  // The collision shape of the body in body space, centered on the center of mass. This defaults to
+  // a unit cube. The vertices of a convex hull are not copied, so they must outlive the body.
+  shape geometry = shape::box(vector3(0.5f));
+};
+
+// ----- Body Store -----
+
+/**
+ * Stores every rigid body of a world as a structure of arrays. Each property of a body lives in its
+ * own contiguous array, and a body is simply an index into all of them. This lets each pass of the
+ * simulation stream through only the properties it needs instead of dragging whole body objects
+ * through the cache.
+ */
+struct body_store
+{
+  // Fields
+
+  std::vector<vector3> positions;
+  std::vector<quaternion> orientations;
+  std::vector<vector3> linearVelocities;
+  std::vector<vector3> angularVelocities;
+
+  std::vector<vector3> forces;
+  std::vector<vector3> torques;
+
+  std::vector<float> inverseMasses;
+  std::vector<vector3> inverseInertias;
+  std::vector<matrix3> worldInverseInertias;
+
+  std::vector<shape> shapes;
+  std::vector<aabb> localBounds;
+
+  // The vertices of the hulls restored from a snapshot, which the restored shapes point into.
+  std::vector<vector3> hullVertices;
+
+  // A hull as saving finds it, by where its vertices are and how many there are. Two shapes only
+  // share a hull in the snapshot if both match.
+  struct hull_key
+  {
+    const vector3* vertices;
+    std::size_t count;
+
+    bool operator==(const hull_key&) const = default;
+  };
+
+  struct hull_key_hash
+  {
+    std::size_t operator()(const hull_key& key) const
+    {
+      return std::hash<const vector3*>()(key.vertices) ^ (key.count * 0x9e3779b97f4a7c15ull);
+    }
+  };
+
+  // The offset of each hull written by the last save. It is only kept so that saving every step
+  // reuses the same table.
+  mutable std::unordered_map<hull_key, int, hull_key_hash> savedHulls;
+
+  // Methods
+
+  /**
+   * Adds a body to the store and returns its index.
+   */
+  int add(const body_def& def);
+
+  /**
+   * Removes a body by moving the last body into its place, which keeps every array packed.
+   */
+  void swapRemove(int body);
+
+  /**
+   * Reserves space for the given number of bodies in every array.
+   */
+  void reserve(int capacity);
+
+  /**
+   * Removes every body from the store.
+   */
+  void clear();
+
+  /**
+   * Writes every body into a snapshot, and reads them back. The vertices of each distinct hull go
+   * into the snapshot once, and the restored hulls point into a copy the store keeps of its own.
+   * Restoring returns false and leaves the store as it was if any array of the snapshot misses a
+   * body, a shape has an unknown type, or a hull reaches past the saved vertices.
+   */
+  void save(world_snapshot& snapshot) const;
+  bool restore(const snapshot_view& snapshot);
+
+  /**
+   * Computes the world space bounds of a body from its local bounds and current transform.
+   */
+  aabb worldBounds(int body) const
+  {
+    return transform(localBounds[body], positions[body], orientations[body]);
+  }
+
+  /**
+   * Builds the world transform of a body, which places its shape for the narrowphase.
+   */
+  rigid_transform worldTransform(int body) const
+  {
+    return rigid_transform(positions[body], orientations[body]);
+  }
+
+  int size() const { return static_cast<int>(positions.size()); }
+};
+
+} // namespace flexor
\ No newline at end of file
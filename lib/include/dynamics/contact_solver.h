@@ -0,0 +1,181 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "collision/narrowphase.h"
+#include "core/frame_arena.h"
+#include "dynamics/body_store.h"
+#include "math/simd.h"
+
+namespace flexor
+{
+
+// ----- Solver Settings -----
+
+struct solver_settings
+{
+  // The number of passes the solver makes over every contact each step. Warm starting lets a
+  // handful of passes hold up a stack.
+  int iterations = 4;
+
+  // Starts each step from the impulses of the last one. Without it, stacks need several times as
+  // many iterations to stay still.
+  bool warmStarting = true;
+
+  // The coefficient of friction between every pair of bodies.
+  float friction = 0.6f;
+
+  // The fraction of the overlap beyond the slop that is pushed apart each step.
+  float baumgarte = 0.2f;
+  float slop = 0.005f;
+};
+
+// ----- Contact Solver -----
+
+/**
+ * Solves the contacts of a world with sequential impulses, as described in Catto's Iterative
+ * Dynamics with Temporal Coherence. Each point of each manifold has a non-penetration constraint
+ * along the normal and two friction constraints along the tangents, and the solver makes several
+ * passes over them, applying the impulse that fixes the relative velocity of each one in turn. The
+ * accumulated impulses are clamped rather than the individual ones, which is what lets them carry
+ * over to the next step.
+ *
+ * A plain pass is serial, since neighbouring manifolds share bodies. Instead, the manifolds are
+ * graph colored so that no two manifolds of a color share a dynamic body, and each color is cut
+ * into batches of wideLanes manifolds. A batch is solved with one manifold per SIMD lane, gathering
+ * the velocities of its bodies from the body store and scattering them back afterwards.
+ */
+class contact_solver
+{
+public:
+  static constexpr int lanes = simd::wideLanes;
+
+  // Manifolds that don't fit in any of the colors are solved one at a time, each in a batch (and a
+  // color) of its own.
+  static constexpr int maxColors = 32;
+
+  /**
+   * Colors the manifolds and builds the batches for them from the current state of the bodies.
+   * The second form only solves the listed manifolds, which lets separate solvers work on separate
+   * islands of the same manifolds at once. It takes the batches from the given arena, which has to
+   * keep them until the impulses are stored, while the first form uses an arena of the solver's
+   * own.
+   */
+  void prepare(const body_store& bodies, const std::vector<contact_manifold>& manifolds,
+               const solver_settings& settings, float dt);
+  void prepare(const body_store& bodies, const std::vector<contact_manifold>& manifolds,
+               std::span<const int> list, const solver_settings& settings, float dt,
+               frame_arena& arena);
+
+  /**
+   * Applies the impulses the constraints start from, which are the impulses of the last step when
+   * warm starting, and zero otherwise.
+   */
+  void warmStart(body_store& bodies);
+
+  /**
+   * Makes one pass over every batch, one color after another.
+   */
+  void solve(body_store& bodies);
+
+  /**
+   * Writes the accumulated impulses back into the manifolds, for the next step to start from.
+   */
+  void storeImpulses(std::vector<contact_manifold>& manifolds) const;
+
+  /**
+   * The number of colors the manifolds were split into by the last prepare.
+   */
+  int colors() const { return colorCount; }
+
+  /**
+   * The number of batches, and the manifold solved by each lane of a batch (with -1 for an empty
+   * lane). The batches of a color are contiguous, and follow the batches of the color before it.
+   */
+  int batches() const { return static_cast<int>(batchList.size()); }
+  const int* batchManifolds(int batch) const { return batchList[batch].manifolds; }
+
+private:
+  // One float for every lane of a batch, laid out so that it loads straight into a wide register.
+  struct alignas(32) lane_floats
+  {
+    float lane[lanes];
+  };
+
+  // The per point part of a batch. A manifold with fewer points than the others in its batch fills
+  // the rest with zero masses, which makes their impulses zero.
+  struct batch_point
+  {
+    // The contact point relative to the center of each body.
+    lane_floats armA[3];
+    lane_floats armB[3];
+
+    // The inverse of the effective mass along the normal and the tangents.
+    lane_floats normalMass;
+    lane_floats tangentMass[2];
+
+    // The velocity along the normal the constraint aims for, which pushes overlapping bodies apart
+    // and lets separated ones close the gap.
+    lane_floats bias;
+
+    lane_floats normalImpulse;
+    lane_floats tangentImpulse[2];
+  };
+
+  struct contact_batch
+  {
+    int manifolds[lanes];
+    int bodyA[lanes];
+    int bodyB[lanes];
+
+    // The lanes whose body is dynamic. Static bodies and empty lanes are gathered but never
+    // scattered, so batches that share a static body don't write to it.
+    int writeA;
+    int writeB;
+    int pointCount;
+
+    lane_floats normal[3];
+    lane_floats tangents[2][3];
+    lane_floats friction;
+
+    // The inverse mass and the upper triangle of the world inverse inertia (xx, yy, zz, xy, xz, yz)
+    // of each body.
+    lane_floats inverseMassA;
+    lane_floats inverseMassB;
+    lane_floats inertiaA[6];
+    lane_floats inertiaB[6];
+
+    batch_point points[contact_manifold::maxPoints];
+  };
+
+  /**
+   * Greedily gives each listed manifold the first color none of its dynamic bodies are in yet, and
+   * fills colorOrder with the manifolds of each color in turn.
+   */
+  void color(const body_store& bodies, const std::vector<contact_manifold>& manifolds,
+             std::span<const int> list, frame_arena& arena);
+
+  /**
+   * Fills one lane of a batch with a manifold.
+   */
+  void fillLane(contact_batch& batch, int lane, const body_store& bodies,
+                const std::vector<contact_manifold>& manifolds, int manifold,
+                const solver_settings& settings, float dt) const;
+
+  // The batches live in an arena, since they are rebuilt every step.
+  std::span<contact_batch> batchList;
+  int colorCount = 0;
+  frame_arena ownArena;
+
+  // Scratch space for coloring. Each body has a bit for every color it is in, which is cleared
+  // again once the coloring is done, so the masks are kept from one step to the next. The order of
+  // the manifolds by color is only needed for one step.
+  std::vector<std::uint32_t> bodyColors;
+  std::span<int> colorOrder;
+  std::array<int, maxColors + 2> colorOffsets = {};
+};
+
+} // namespace flexor
\ No newline at end of file
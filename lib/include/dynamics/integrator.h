@@ -0,0 +1,50 @@
+#pragma once
+
+#include <span>
+
+#include "body_store.h"
+#include "math/vector3.h"
+
+namespace flexor::integrator
+{
+
+// ----- Integration Passes -----
+
+// Each pass works on the range of bodies [begin, end), where a negative end means every body in
+// the store. This lets a pass be split into chunks across threads.
+
+/**
+ * Applies gravity and the accumulated forces and torques to the velocities of every dynamic body.
+ * Static bodies (zero inverse mass) keep their velocities.
+ */
+void integrateVelocities(body_store& bodies, const vector3& gravity, float dt, int begin = 0,
+                         int end = -1);
+
+/**
+ * Advances the positions and orientations of every body using their current velocities. The
+ * orientations are renormalized to keep numerical drift from accumulating.
+ */
+void integratePositions(body_store& bodies, float dt, int begin = 0, int end = -1);
+
+/**
+ * Recomputes the world space inverse inertia tensor of every body from its orientation.
+ */
+void updateInertia(body_store& bodies, int begin = 0, int end = -1);
+
+/**
+ * Resets the force and torque accumulators of every body.
+ */
+void clearForces(body_store& bodies, int begin = 0, int end = -1);
+
+// ----- Listed Passes -----
+
+// The same passes over a list of bodies instead of a range, which lets the engine skip the bodies
+// that are asleep. No body may be listed twice.
+
+void integrateVelocities(body_store& bodies, std::span<const int> list, const vector3& gravity,
+                         float dt);
+void integratePositions(body_store& bodies, std::span<const int> list, float dt);
+void updateInertia(body_store& bodies, std::span<const int> list);
+void clearForces(body_store& bodies, std::span<const int> list);
+
+} // namespace flexor::integrator
\ No newline at end of file
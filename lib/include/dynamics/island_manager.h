@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "collision/manifold_cache.h"
+#include "core/snapshot.h"
+#include "dynamics/body_store.h"
+
+namespace flexor
+{
+
+// ----- Sleep Settings -----
+
+struct sleep_settings
+{
+  // Lets islands that have come to rest fall asleep.
+  bool enabled = true;
+
+  // An island falls asleep once every one of its bodies has stayed slower than these speeds (in
+  // meters and radians per second) for this many steps in a row.
+  float linearThreshold = 0.05f;
+  float angularThreshold = 0.05f;
+  int frames = 30;
+};
+
+// ----- Island Manager -----
+
+/**
+ * Splits the awake dynamic bodies of a world into islands, which are the groups of bodies that are
+ * connected through their contacts. Static bodies don't connect anything, since nothing that
+ * happens on one side of a static body can reach the other. The islands are rebuilt every step with
+ * union-find, and since no contact crosses from one island to another, each island can be solved
+ * on its own thread.
+ *
+ * An island whose bodies have all been at rest for a while falls asleep. Its bodies are taken out
+ * of the awake list, and its manifolds are taken out of the manifold cache and kept with it, so a
+ * sleeping island costs nothing per step. It wakes up again when an awake body touches it or a
+ * force is applied to it, and its manifolds go back into the cache with their impulses.
+ */
+class island_manager
+{
+public:
+  /**
+   * Starts tracking a body, which starts out awake unless it is static. Bodies are expected to be
+   * added in order.
+   */
+  void add(int body, bool isStatic);
+
+  /**
+   * Renames the bodies after bodies were removed from the store. The new index of every old body
+   * is given, or -1 for a removed body. Islands that touched a removed body are woken, since they
+   * may no longer be at rest without it, and the islands are rebuilt on the next update or
+   * refresh.
+   */
+  void remap(std::span<const int> newIndices, int count);
+
+  void clear();
+
+  /**
+   * Writes the islands into a snapshot, along with the sleeping islands and their manifolds, and
+   * reads them back.
+   */
+  void save(world_snapshot& snapshot) const;
+  void restore(const snapshot_view& snapshot);
+
+  /**
+   * Returns whether a snapshot holds islands for the given number of bodies, whose lists and
+   * offsets all stay inside the bodies, the cached manifolds and each other.
+   */
+  static bool canRestore(const snapshot_view& snapshot, int bodies);
+
+  // Sleeping
+
+  /**
+   * Returns whether a body is dynamic and awake.
+   */
+  bool awake(int body) const { return states[body] == body_state::awake; }
+
+  /**
+   * Wakes the island a body sleeps in, if it is asleep. The island's manifolds go back into the
+   * cache on the next update or refresh.
+   */
+  void wake(int body);
+
+  /**
+   * Returns whether islands were woken (or bodies added) since the islands were last built.
+   */
+  bool pending() const { return dirty; }
+
+  // Islands
+
+  /**
+   * Puts the manifolds of woken islands back into the cache, rebuilds the islands from the
+   * manifolds in the cache, and puts the islands that have been at rest long enough to sleep.
+   */
+  void update(body_store& bodies, manifold_cache& cache, const sleep_settings& settings);
+
+  /**
+   * The same as update, but without putting anything to sleep. This brings the islands up to date
+   * after bodies were woken or added between steps.
+   */
+  void refresh(body_store& bodies, manifold_cache& cache);
+
+  /**
+   * The awake dynamic bodies, grouped by island.
+   */
+  const std::vector<int>& awakeBodies() const { return awakeList; }
+
+  int islands() const { return static_cast<int>(bodyStarts.size()) - 1; }
+  int sleepingIslands() const { return static_cast<int>(sleepers.size() - freeSleepers.size()); }
+
+  /**
+   * The bodies of an island, and the indices of the cached manifolds of the islands in
+   * [begin, end). The manifolds of consecutive islands are contiguous, so several small islands can
+   * be handed to one solver together.
+   */
+  std::span<const int> islandBodies(int island) const;
+  std::span<const int> islandManifolds(int begin, int end) const;
+
+private:
+  enum class body_state : std::uint8_t
+  {
+    isStatic,
+    awake,
+    asleep
+  };
+
+  // The bodies and manifolds of an island that is asleep.
+  struct sleeping_island
+  {
+    std::vector<int> bodies;
+    std::vector<contact_manifold> manifolds;
+  };
+
+  /**
+   * Restores woken manifolds and runs union-find over the awake bodies and the cached manifolds.
+   */
+  void build(const body_store& bodies, manifold_cache& cache);
+
+  int findRoot(int body);
+
+  // Fields
+
+  // Every array is indexed by body.
+  std::vector<body_state> states;
+  std::vector<int> restFrames;
+  std::vector<int> sleeperOf;
+  std::vector<int> parents;
+  std::vector<int> islandOf;
+
+  std::vector<int> awakeList;
+
+  // The bodies and manifolds of each awake island, with the offsets of each island (and one past
+  // the last) into them.
+  std::vector<int> islandBodyList;
+  std::vector<int> bodyStarts = {0};
+  std::vector<int> islandManifoldList;
+  std::vector<int> manifoldStarts = {0};
+
+  std::vector<sleeping_island> sleepers;
+  std::vector<int> freeSleepers;
+
+  // The manifolds of woken islands, which go back into the cache on the next build.
+  std::vector<contact_manifold> restored;
+  std::vector<contact_manifold> scratch;
+  bool dirty = false;
+};
+
+} // namespace flexor
\ No newline at end of file
@@ -1,8 +1,53 @@
 #pragma once
 
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include "collision/broadphase.h"
+#include "collision/manifold_cache.h"
+#include "collision/narrowphase.h"
+#include "core/frame_arena.h"
+#include "core/handle_pool.h"
+#include "core/snapshot.h"
+#include "core/task_graph.h"
+#include "core/thread_pool.h"
+#include "dynamics/body_store.h"
+#include "dynamics/contact_solver.h"
+#include "dynamics/island_manager.h"
+#include "math/quaternion.h"
+#include "math/vector3.h"
+
 namespace flexor
 {
 
+// ----- Body Handles -----
+
+/**
+ * Refers to a body of an engine for as long as the body is in it. The bodies themselves are kept
+ * packed in the body store, where they move around as others are removed, so their indices are
+ * only good until the next removal.
+ */
+using body_handle = handle<struct body_tag>;
+
+// ----- Timestep Settings -----
+
+struct timestep_settings
+{
+  // The length of each fixed step in seconds.
+  float fixedStep = 1.0f / 60.0f;
+
+  // Each fixed step is split into this many smaller steps. Substeps make stiff contacts converge
+  // far better than extra solver iterations do, so a few substeps with a few iterations each is
+  // usually both cheaper and steadier than many iterations at one large step.
+  int substeps = 1;
+
+  // The most fixed steps a single update takes. Whatever time is left beyond that is dropped, so a
+  // slow frame can't make the next one slower still.
+  int maxSteps = 4;
+};
+
 // ----- Flexor Engine -----
 
 /**
@@ -11,8 +56,278 @@ namespace flexor
 class engine
 {
 public:
-  engine();
+  /**
+   * Creates an empty world that finds overlapping bodies with the given kind of broadphase. The
+   * world runs its steps on the given thread pool, which has to outlive it, or on a pool of its own
+   * with a thread for every hardware thread if there is none.
+   */
+  engine(broadphase_type broadphaseType = broadphase_type::tree, thread_pool* pool = nullptr);
   ~engine() = default;
+
+  // The phases of a step hold on to the world, so it can't be copied or moved.
+  engine(const engine&) = delete;
+  engine& operator=(const engine&) = delete;
+
+  // Bodies
+
+  /**
+   * Adds a rigid body to the world and returns a handle to it. The body goes at the end of the
+   * body store.
+   */
+  body_handle addBody(const body_def& def);
+
+  /**
+   * Takes bodies out of the world. The last bodies of the store move into the places they leave,
+   * so the store stays packed, and the indices of the moved bodies change while their handles
+   * don't. Islands that touched a removed body are woken, and its contacts are dropped.
+   *
+   * Removing many bodies at once is much cheaper than removing them one by one, since the islands
+   * and the contacts are renamed only once.
+   */
+  void removeBody(body_handle body) { removeBodies(std::span<const body_handle>(&body, 1)); }
+  void removeBodies(std::span<const body_handle> bodies);
+
+  /**
+   * Returns whether a handle refers to a body that is still in the world.
+   */
+  bool contains(body_handle body) const { return handles.contains(body); }
+
+  /**
+   * The index of a body in the body store, which only holds until the next removal, and the handle
+   * of the body at an index. Contacts and pairs refer to bodies by index.
+   */
+  int indexOf(body_handle body) const { return handles.indexOf(body); }
+  body_handle handleOf(int index) const { return handles.handleAt(index); }
+
+  /**
+   * Accumulates a force (and optionally a torque) on a body, which will be applied during the next
+   * step and then cleared. This wakes the body if it is asleep.
+   */
+  void applyForce(body_handle body, const vector3& force, const vector3& torque = vector3(0.0f));
+
+  /**
+   * Wakes the island a body sleeps in. Anything that changes a body behind the engine's back (like
+   * setting its velocity) should wake it first.
+   */
+  void wake(body_handle body) { islands.wake(indexOf(body)); }
+  bool awake(body_handle body) const { return islands.awake(indexOf(body)); }
+
+  body_store& bodies() { return store; }
+  const body_store& bodies() const { return store; }
+
+  // Collision
+
+  /**
+   * The pairs of bodies whose bounds overlapped at the end of the last step. Removing bodies
+   * leaves these as they were until the next step.
+   */
+  const std::vector<body_pair>& pairs() const { return broad->pairs(); }
+
+  /**
+   * The contacts between bodies whose shapes touched at the end of the last step, in the same
+   * order as their pairs. The impulses of each point are the ones the solver will start from.
+   * Contacts between bodies that are asleep are kept with their islands, and aren't listed here.
+   */
+  const std::vector<contact_manifold>& contacts() const { return cache.manifolds(); }
+
+  // Simulation
+
+  /**
+   * Advances the simulation by the given timestep in seconds.
+   */
+  void step(float dt);
+
+  /**
+   * Advances the simulation by a frame of any length in whole fixed steps, and returns how many it
+   * took. Time that doesn't make up a whole step is carried over to the next update. Before each
+   * fixed step, the transforms of the bodies are saved, and once the steps are done, the last two
+   * states are copied out along with the interpolation alpha for interpolateTransforms to read.
+   */
+  int update(float frameTime);
+
+  /**
+   * How far the leftover time of the last update reaches into the next fixed step, from zero to
+   * one.
+   */
+  float interpolationAlpha() const { return accumulator / timestepConfig.fixedStep; }
+
+  /**
+   * Fills the arrays with the transform of every body as of the end of the last update, blended
+   * from the state before its last fixed step to the state after it by its interpolation alpha,
+   * and returns how many bodies there were. A renderer that draws these moves smoothly however its
+   * frames line up with the fixed steps, at the cost of lagging up to one step behind. Both arrays
+   * must have a slot for every body.
+   *
+   * The transforms are read from copies that the update swaps in when it is done, so a renderer on
+   * another thread can call this at any time, even while an update is running, and only ever waits
+   * for a swap.
+   */
+  int interpolateTransforms(std::span<vector3> positions,
+                            std::span<quaternion> orientations) const;
+
+  void setTimestepSettings(const timestep_settings& settings);
+  const timestep_settings& timestepSettings() const { return timestepConfig; }
+
+  void setGravity(const vector3& gravity) { gravityVector = gravity; }
+  const vector3& gravity() const { return gravityVector; }
+
+  void setSolverSettings(const solver_settings& settings) { solverConfig = settings; }
+  const solver_settings& solverSettings() const { return solverConfig; }
+
+  void setSleepSettings(const sleep_settings& settings) { sleepConfig = settings; }
+  const sleep_settings& sleepSettings() const { return sleepConfig; }
+
+  // Snapshots
+
+  /**
+   * Writes the whole state of the world into a snapshot: the bodies and their shapes and handles,
+   * the cached contacts with their impulses, the islands, the broadphase, and the settings. A world
+   * restored from it steps exactly like the saved one would have, which is what rollback needs.
+   */
+  void save(world_snapshot& snapshot) const;
+
+  /**
+   * Replaces the state of the world with the one in a snapshot, which can be read straight from a
+   * mapped file. The world takes on the broadphase of the snapshot. Returns false, leaving the
+   * world as it was, if the snapshot isn't valid, was written by a build with a different layout,
+   * or has sections that don't agree on the bodies, such as a hull that reaches past the saved
+   * vertices, a shape or broadphase of an unknown type, or a broadphase index out of range.
+   */
+  bool restore(const snapshot_view& snapshot);
+
+  /**
+   * The islands of awake bodies from the end of the last step.
+   */
+  const island_manager& islandManager() const { return islands; }
+
+  thread_pool& threadPool() { return *workers; }
+
+private:
+  /**
+   * Saves the transforms the next fixed step starts from. Only bodies that can move are copied,
+   * along with the ones that fell asleep during the last step, which still moved in it.
+   */
+  void saveTransforms();
+
+  /**
+   * Copies the transforms before and after the last fixed step into the back frame, along with
+   * the interpolation alpha, and swaps it to the front for interpolateTransforms.
+   */
+  void publishTransforms();
+
+  /**
+   * Builds the graph of step phases. Most phases need the one before them, but finishing the bodies
+   * runs alongside the broadphase and the narrowphase, and each phase splits its own work between
+   * the threads.
+   */
+  void buildStep();
+
+  // Phases, in the order they run
+
+  // The integration passes split the awake bodies into chunks.
+  void integrateVelocities();
+  void integratePositions();
+
+  /**
+   * Brings the inertia of the awake bodies up to date with their orientations, and clears their
+   * forces.
+   */
+  void finishBodies();
+
+  /**
+   * Applies the contact impulses that keep the bodies from moving into each other. Islands are
+   * independent, so they are handed out to the workers in groups, each with a solver of its own.
+   */
+  void solveContacts(int thread);
+
+  /**
+   * Refreshes the bounds of the awake bodies and finds the pairs that overlap.
+   */
+  void updateBroadphase();
+
+  /**
+   * Runs the narrowphase over every pair from the broadphase, and merges the contacts it finds
+   * with the ones from the last step.
+   */
+  void findContacts();
+
+  /**
+   * Joins the contacts of every chunk into the cache, wakes the islands they touch, and rebuilds
+   * the islands.
+   */
+  void writeBack();
+
+  body_store store;
+  handle_pool<body_tag> handles;
+
+  // The new index of every body during a removal, or -1 for a removed body, and the old index of
+  // the body at each index.
+  std::vector<int> newIndices;
+  std::vector<int> oldIndices;
+
+  std::unique_ptr<thread_pool> ownedWorkers;
+  thread_pool* workers;
+  broadphase_type broadType;
+  std::unique_ptr<broadphase> broad;
+
+  task_graph stepGraph;
+  float stepDt = 0.0f;
+
+  // Everything that only lives for one step comes from the arena of the thread that makes it, and
+  // the arenas are reset at the start of every step. Once the arenas have grown to fit a step, a
+  // step doesn't touch the heap at all.
+  std::vector<frame_arena> arenas;
+
+  // Each chunk of pairs writes its contacts (and the sleeping bodies they touch) to its own lists,
+  // and the lists are joined in order.
+  struct chunk_output
+  {
+    std::span<contact_manifold> contacts;
+    std::span<int> wakes;
+  };
+
+  std::vector<chunk_output> chunkOutputs;
+  std::vector<contact_manifold> contactList;
+
+  manifold_cache cache;
+  island_manager islands;
+  sleep_settings sleepConfig;
+
+  // One solver per thread, and the ranges of islands each solve job covers.
+  struct solve_job
+  {
+    int begin;
+    int end;
+  };
+
+  std::vector<contact_solver> solvers;
+  std::span<solve_job> solveJobs;
+  solver_settings solverConfig;
+
+  // The transforms of every body before the last fixed step, the bodies that were saved then, and
+  // the time that hasn't been stepped yet.
+  std::vector<vector3> previousPositions;
+  std::vector<quaternion> previousOrientations;
+  std::vector<int> savedBodies;
+  float accumulator = 0.0f;
+  timestep_settings timestepConfig;
+
+  // The two states a renderer blends between, as of the end of an update. Updates only ever write
+  // the back frame, and the lock only guards swapping it to the front and reading the front.
+  struct transform_frame
+  {
+    std::vector<vector3> previousPositions;
+    std::vector<quaternion> previousOrientations;
+    std::vector<vector3> positions;
+    std::vector<quaternion> orientations;
+    float alpha = 0.0f;
+  };
+
+  transform_frame frames[2];
+  int frontFrame = 0;
+  mutable std::mutex frameLock;
+
+  vector3 gravityVector = vector3(0.0f, -9.81f, 0.0f);
 };
 
 } // namespace flexor
\ No newline at end of file
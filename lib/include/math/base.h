@@ -1,5 +1,7 @@
 #pragma once
 
+#include <type_traits>
+
 namespace flexor::base
 {
 
@@ -18,4 +20,32 @@ struct matrix
 {
 };
 
+/**
+ * The heap allocated vector and matrix are evaluated lazily through expression templates (see
+ * expression.h), so their operators build up expression nodes instead of computing results right
+ * away. These base classes mark every type that takes part in that, so the eagerly evaluated
+ * operators for the small stack allocated types can skip over them.
+ */
+struct vector_expression : vector
+{
+};
+
+struct matrix_expression : matrix
+{
+};
+
+// ----- Type Traits -----
+
+template <typename T>
+constexpr bool is_vector_expression = std::is_base_of_v<vector_expression, T>;
+
+template <typename T>
+constexpr bool is_matrix_expression = std::is_base_of_v<matrix_expression, T>;
+
+template <typename T>
+constexpr bool is_small_vector = std::is_base_of_v<vector, T> && !is_vector_expression<T>;
+
+template <typename T>
+constexpr bool is_small_matrix = std::is_base_of_v<matrix, T> && !is_matrix_expression<T>;
+
 } // namespace flexor::base
\ No newline at end of file
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <cassert>
+#include <type_traits>
+
+#include "base.h"
+
+namespace flexor::expr
+{
+
+// ----- Expression Nodes -----
+
+/**
+ * Arithmetic on the heap allocated vector and matrix doesn't compute anything right away. Instead,
+ * each operator returns a small node that remembers its operands, and the whole expression tree is
+ * only evaluated once it is assigned to (or used to construct) a vector or matrix. This turns an
+ * expression like a + b * s - c into a single loop over the elements, without allocating any
+ * temporaries along the way.
+ *
+ * Nodes are cheap to copy, so nodes store other nodes by value. Vectors and matrices are stored by
+ * reference, which means that a node must not outlive the operands it was built from. In practice,
+ * this just means not holding onto expressions with auto.
+ */
+struct node
+{
+};
+
+template <typename T>
+using operand = std::conditional_t<std::is_base_of_v<node, T>, const T, const T&>;
+
+// ----- Element Operations -----
+
+struct add
+{
+  static float apply(float lhs, float rhs) { return lhs + rhs; }
+};
+
+struct subtract
+{
+  static float apply(float lhs, float rhs) { return lhs - rhs; }
+};
+
+struct multiply
+{
+  static float apply(float lhs, float rhs) { return lhs * rhs; }
+};
+
+struct divide
+{
+  static float apply(float lhs, float rhs) { return lhs / rhs; }
+};
+
+// ----- Vector Nodes -----
+
+/**
+ * An elementwise operation between two vector expressions of the same length.
+ */
+template <typename L, typename R, typename Op>
+class vector_binary : public base::vector_expression, public node
+{
+public:
+  vector_binary(const L& lhs, const R& rhs)
+    : lhs(lhs), rhs(rhs)
+  {
+    assert(lhs.length() == rhs.length());
+  }
+
+  int length() const { return lhs.length(); }
+
+  float operator[](int index) const { return Op::apply(lhs[index], rhs[index]); }
+
+private:
+  operand<L> lhs;
+  operand<R> rhs;
+};
+
+/**
+ * An operation between each element of a vector expression and a scalar.
+ */
+template <typename E, typename Op> class vector_scalar : public base::vector_expression, public node
+{
+public:
+  vector_scalar(const E& vec, float scalar)
+    : vec(vec), scalar(scalar)
+  {
+  }
+
+  int length() const { return vec.length(); }
+
+  float operator[](int index) const { return Op::apply(vec[index], scalar); }
+
+private:
+  operand<E> vec;
+  float scalar;
+};
+
+// ----- Matrix Nodes -----
+
+/**
+ * A single column of a matrix expression, viewed as a vector expression.
+ */
+template <typename E> class matrix_column : public base::vector_expression, public node
+{
+public:
+  matrix_column(const E& mat, int column)
+    : mat(mat), column(column)
+  {
+  }
+
+  int length() const { return mat.rows(); }
+
+  float operator[](int index) const { return mat(index, column); }
+
+private:
+  operand<E> mat;
+  int column;
+};
+
+/**
+ * An elementwise operation between two matrix expressions with the same dimensions.
+ */
+template <typename L, typename R, typename Op>
+class matrix_binary : public base::matrix_expression, public node
+{
+public:
+  matrix_binary(const L& lhs, const R& rhs)
+    : lhs(lhs), rhs(rhs)
+  {
+    assert(lhs.rows() == rhs.rows() && lhs.columns() == rhs.columns());
+  }
+
+  int rows() const { return lhs.rows(); }
+  int columns() const { return lhs.columns(); }
+
+  float operator()(int row, int col) const { return Op::apply(lhs(row, col), rhs(row, col)); }
+  matrix_column<matrix_binary> operator[](int col) const { return {*this, col}; }
+
+private:
+  operand<L> lhs;
+  operand<R> rhs;
+};
+
+/**
+ * An operation between each element of a matrix expression and a scalar.
+ */
+template <typename E, typename Op> class matrix_scalar : public base::matrix_expression, public node
+{
+public:
+  matrix_scalar(const E& mat, float scalar)
+    : mat(mat), scalar(scalar)
+  {
+  }
+
+  int rows() const { return mat.rows(); }
+  int columns() const { return mat.columns(); }
+
+  float operator()(int row, int col) const { return Op::apply(mat(row, col), scalar); }
+  matrix_column<matrix_scalar> operator[](int col) const { return {*this, col}; }
+
+private:
+  operand<E> mat;
+  float scalar;
+};
+
+} // namespace flexor::expr
+
+namespace flexor
+{
+
+// ----- Vector Expression Operators -----
+
+template <typename L, typename R, std::enable_if_t<base::is_vector_expression<L>, bool> = true,
+          std::enable_if_t<base::is_vector_expression<R>, bool> = true>
+inline expr::vector_binary<L, R, expr::add> operator+(const L& lhs, const R& rhs)
+{
+  return {lhs, rhs};
+}
+
+template <typename L, typename R, std::enable_if_t<base::is_vector_expression<L>, bool> = true,
+          std::enable_if_t<base::is_vector_expression<R>, bool> = true>
+inline expr::vector_binary<L, R, expr::subtract> operator-(const L& lhs, const R& rhs)
+{
+  return {lhs, rhs};
+}
+
+template <typename E, std::enable_if_t<base::is_vector_expression<E>, bool> = true>
+inline expr::vector_scalar<E, expr::multiply> operator-(const E& vec)
+{
+  return {vec, -1.0f};
+}
+
+template <typename E, std::enable_if_t<base::is_vector_expression<E>, bool> = true>
+inline expr::vector_scalar<E, expr::multiply> operator*(const E& vec, float scalar)
+{
+  return {vec, scalar};
+}
+
+template <typename E, std::enable_if_t<base::is_vector_expression<E>, bool> = true>
+inline expr::vector_scalar<E, expr::multiply> operator*(float scalar, const E& vec)
+{
+  return {vec, scalar};
+}
+
+template <typename E, std::enable_if_t<base::is_vector_expression<E>, bool> = true>
+inline expr::vector_scalar<E, expr::divide> operator/(const E& vec, float scalar)
+{
+  assert(scalar != 0.0f);
+  return {vec, scalar};
+}
+
+/**
+ * Takes the dot product of two different kinds of vector expressions, without evaluating either.
+ */
+template <typename L, typename R, std::enable_if_t<base::is_vector_expression<L>, bool> = true,
+          std::enable_if_t<base::is_vector_expression<R>, bool> = true>
+inline float dot(const L& lhs, const R& rhs)
+{
+  assert(lhs.length() == rhs.length());
+
+  float res = 0.0f;
+  for (int i = 0; i < lhs.length(); i++)
+    res += lhs[i] * rhs[i];
+
+  return res;
+}
+
+// ----- Matrix Expression Operators -----
+
+template <typename L, typename R, std::enable_if_t<base::is_matrix_expression<L>, bool> = true,
+          std::enable_if_t<base::is_matrix_expression<R>, bool> = true>
+inline expr::matrix_binary<L, R, expr::add> operator+(const L& lhs, const R& rhs)
+{
+  return {lhs, rhs};
+}
+
+template <typename L, typename R, std::enable_if_t<base::is_matrix_expression<L>, bool> = true,
+          std::enable_if_t<base::is_matrix_expression<R>, bool> = true>
+inline expr::matrix_binary<L, R, expr::subtract> operator-(const L& lhs, const R& rhs)
+{
+  return {lhs, rhs};
+}
+
+template <typename E, std::enable_if_t<base::is_matrix_expression<E>, bool> = true>
+inline expr::matrix_scalar<E, expr::multiply> operator-(const E& mat)
+{
+  return {mat, -1.0f};
+}
+
+template <typename E, std::enable_if_t<base::is_matrix_expression<E>, bool> = true>
+inline expr::matrix_scalar<E, expr::multiply> operator*(const E& mat, float scalar)
+{
+  return {mat, scalar};
+}
+
+template <typename E, std::enable_if_t<base::is_matrix_expression<E>, bool> = true>
+inline expr::matrix_scalar<E, expr::multiply> operator*(float scalar, const E& mat)
+{
+  return {mat, scalar};
+}
+
+template <typename E, std::enable_if_t<base::is_matrix_expression<E>, bool> = true>
+inline expr::matrix_scalar<E, expr::divide> operator/(const E& mat, float scalar)
+{
+  assert(scalar != 0.0f);
+  return {mat, scalar};
+}
+
+} // namespace flexor
\ No newline at end of file
@@ -0,0 +1,240 @@
+#pragma once
+
+#include "simd.h"
+
+namespace flexor::kernels
+{
+
+// ----- Dense Kernels -----
+
+// These kernels work on raw column-major storage, where element (i, j) of a matrix with leading
+// dimension ld lives at ptr[i + j * ld]. They are what the heap matrix uses for its products, but
+// can be pointed at any column-major block of floats.
+
+// ----- Vector Kernels -----
+
+/**
+ * Computes the dot product of two arrays of n floats. Four separate accumulators hide the latency
+ * of the multiply-adds.
+ */
+inline float dot(int n, const float* x, const float* y)
+{
+  simd::float4 acc0 = simd::splat(0.0f), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+
+  int i = 0;
+  for (; i + 16 <= n; i += 16)
+  {
+    acc0 = simd::multiplyAdd(simd::loadUnaligned(x + i), simd::loadUnaligned(y + i), acc0);
+    acc1 = simd::multiplyAdd(simd::loadUnaligned(x + i + 4), simd::loadUnaligned(y + i + 4), acc1);
+    acc2 = simd::multiplyAdd(simd::loadUnaligned(x + i + 8), simd::loadUnaligned(y + i + 8), acc2);
+    acc3 =
+      simd::multiplyAdd(simd::loadUnaligned(x + i + 12), simd::loadUnaligned(y + i + 12), acc3);
+  }
+
+  for (; i + 4 <= n; i += 4)
+    acc0 = simd::multiplyAdd(simd::loadUnaligned(x + i), simd::loadUnaligned(y + i), acc0);
+
+  float res = simd::sum((acc0 + acc1) + (acc2 + acc3));
+  for (; i < n; i++)
+    res += x[i] * y[i];
+
+  return res;
+}
+
+/**
+ * Computes y += a * x over arrays of n floats.
+ */
+inline void axpy(int n, float a, const float* x, float* y)
+{
+  simd::float4 scale = simd::splat(a);
+
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    simd::storeUnaligned(y + i, simd::multiplyAdd(simd::loadUnaligned(x + i), scale,
+                                                  simd::loadUnaligned(y + i)));
+
+  for (; i < n; i++)
+    y[i] += a * x[i];
+}
+
+// ----- Matrix Multiplication -----
+
+// The cache blocking sizes. A KC by MC block of the left operand (128KB) is kept warm in the L2
+// cache while every column of the right operand streams past it.
+constexpr int gemmBlockK = 256;
+constexpr int gemmBlockM = 128;
+
+/**
+ * Accumulates an 8 by 4 tile of C += A * B over kc steps. The tile is held in eight registers for
+ * the whole loop, so each step is two loads from a column of A, four broadcasts from B, and eight
+ * multiply-adds.
+ */
+inline void gemmTile8x4(int kc, const float* a, int lda, const float* b, int ldb, float* c, int ldc)
+{
+  simd::float4 c00 = simd::splat(0.0f), c01 = c00, c02 = c00, c03 = c00;
+  simd::float4 c10 = c00, c11 = c00, c12 = c00, c13 = c00;
+
+  const float* b0 = b;
+  const float* b1 = b + ldb;
+  const float* b2 = b + 2 * ldb;
+  const float* b3 = b + 3 * ldb;
+
+  for (int p = 0; p < kc; p++)
+  {
+    simd::float4 a0 = simd::loadUnaligned(a + p * lda);
+    simd::float4 a1 = simd::loadUnaligned(a + p * lda + 4);
+
+    simd::float4 bp = simd::splat(b0[p]);
+    c00 = simd::multiplyAdd(a0, bp, c00);
+    c10 = simd::multiplyAdd(a1, bp, c10);
+
+    bp = simd::splat(b1[p]);
+    c01 = simd::multiplyAdd(a0, bp, c01);
+    c11 = simd::multiplyAdd(a1, bp, c11);
+
+    bp = simd::splat(b2[p]);
+    c02 = simd::multiplyAdd(a0, bp, c02);
+    c12 = simd::multiplyAdd(a1, bp, c12);
+
+    bp = simd::splat(b3[p]);
+    c03 = simd::multiplyAdd(a0, bp, c03);
+    c13 = simd::multiplyAdd(a1, bp, c13);
+  }
+
+  auto accumulate = [](float* col, simd::float4 top, simd::float4 bottom)
+  {
+    simd::storeUnaligned(col, simd::loadUnaligned(col) + top);
+    simd::storeUnaligned(col + 4, simd::loadUnaligned(col + 4) + bottom);
+  };
+
+  accumulate(c, c00, c10);
+  accumulate(c + ldc, c01, c11);
+  accumulate(c + 2 * ldc, c02, c12);
+  accumulate(c + 3 * ldc, c03, c13);
+}
+
+/**
+ * Accumulates an arbitrarily sized (but small) tile of C += A * B. This handles the edges of the
+ * matrix that don't fill a whole register tile.
+ */
+inline void gemmEdge(int m, int n, int kc, const float* a, int lda, const float* b, int ldb,
+                     float* c, int ldc)
+{
+  for (int j = 0; j < n; j++)
+  {
+    float* col = c + j * ldc;
+    for (int p = 0; p < kc; p++)
+    {
+      float scale = b[p + j * ldb];
+      const float* acol = a + p * lda;
+      for (int i = 0; i < m; i++)
+        col[i] += acol[i] * scale;
+    }
+  }
+}
+
+/**
+ * Computes C += A * B, where A is m by k, B is k by n, and C is m by n. The loops are blocked so
+ * that a block of A stays in cache while it is reused for every column of B, and the innermost
+ * loop works on 8 by 4 register tiles of C.
+ */
+inline void gemm(int m, int n, int k, const float* a, int lda, const float* b, int ldb, float* c,
+                 int ldc)
+{
+  for (int pc = 0; pc < k; pc += gemmBlockK)
+  {
+    int kc = k - pc < gemmBlockK ? k - pc : gemmBlockK;
+
+    for (int ic = 0; ic < m; ic += gemmBlockM)
+    {
+      int mc = m - ic < gemmBlockM ? m - ic : gemmBlockM;
+      const float* ablock = a + ic + pc * lda;
+
+      int j = 0;
+      for (; j + 4 <= n; j += 4)
+      {
+        const float* bblock = b + pc + j * ldb;
+        float* cblock = c + ic + j * ldc;
+
+        int i = 0;
+        for (; i + 8 <= mc; i += 8)
+          gemmTile8x4(kc, ablock + i, lda, bblock, ldb, cblock + i, ldc);
+
+        if (i < mc)
+          gemmEdge(mc - i, 4, kc, ablock + i, lda, bblock, ldb, cblock + i, ldc);
+      }
+
+      if (j < n)
+        gemmEdge(mc, n - j, kc, ablock, lda, b + pc + j * ldb, ldb, c + ic + j * ldc, ldc);
+    }
+  }
+}
+
+// ----- Matrix Vector Multiplication -----
+
+/**
+ * Computes y += A * x, where A is m by n. The columns of A are streamed four at a time, so each
+ * element of y is loaded and stored once for every four columns.
+ */
+inline void gemv(int m, int n, const float* a, int lda, const float* x, float* y)
+{
+  int j = 0;
+  for (; j + 4 <= n; j += 4)
+  {
+    const float* a0 = a + j * lda;
+    const float* a1 = a0 + lda;
+    const float* a2 = a1 + lda;
+    const float* a3 = a2 + lda;
+
+    simd::float4 x0 = simd::splat(x[j]);
+    simd::float4 x1 = simd::splat(x[j + 1]);
+    simd::float4 x2 = simd::splat(x[j + 2]);
+    simd::float4 x3 = simd::splat(x[j + 3]);
+
+    int i = 0;
+    for (; i + 4 <= m; i += 4)
+    {
+      simd::float4 acc = simd::loadUnaligned(y + i);
+      acc = simd::multiplyAdd(simd::loadUnaligned(a0 + i), x0, acc);
+      acc = simd::multiplyAdd(simd::loadUnaligned(a1 + i), x1, acc);
+      acc = simd::multiplyAdd(simd::loadUnaligned(a2 + i), x2, acc);
+      acc = simd::multiplyAdd(simd::loadUnaligned(a3 + i), x3, acc);
+      simd::storeUnaligned(y + i, acc);
+    }
+
+    for (; i < m; i++)
+      y[i] += a0[i] * x[j] + a1[i] * x[j + 1] + a2[i] * x[j + 2] + a3[i] * x[j + 3];
+  }
+
+  for (; j < n; j++)
+  {
+    const float* col = a + j * lda;
+    for (int i = 0; i < m; i++)
+      y[i] += col[i] * x[j];
+  }
+}
+
+/**
+ * Computes y += A^T * x, where A is m by n. Each element of y is the dot product of a contiguous
+ * column of A with x, so this never needs to form the transpose.
+ */
+inline void gemvTranspose(int m, int n, const float* a, int lda, const float* x, float* y)
+{
+  for (int j = 0; j < n; j++)
+  {
+    const float* col = a + j * lda;
+
+    simd::float4 acc = simd::splat(0.0f);
+    int i = 0;
+    for (; i + 4 <= m; i += 4)
+      acc = simd::multiplyAdd(simd::loadUnaligned(col + i), simd::loadUnaligned(x + i), acc);
+
+    float res = simd::sum(acc);
+    for (; i < m; i++)
+      res += col[i] * x[i];
+
+    y[j] += res;
+  }
+}
+
+} // namespace flexor::kernels
\ No newline at end of file
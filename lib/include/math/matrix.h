@@ -4,6 +4,7 @@
 #include <vector>
 
 #include "base.h"
+#include "kernels.h"
 #include "small_matrix.h"
 #include "vector.h"
 
@@ -14,20 +15,28 @@ namespace flexor
 
 // clang-format off
 
-template <typename T> inline typename std::enable_if<std::is_base_of<base::matrix, T>::value, T>::type operator+(const T& lhs, const T& rhs);
-template <typename T> inline typename std::enable_if<std::is_base_of<base::matrix, T>::value, T>::type operator-(const T& lhs, const T& rhs);
-template <typename T> inline typename std::enable_if<std::is_base_of<base::matrix, T>::value, T>::type operator*(const T& lhs, const T& rhs);
-template <typename T> inline typename std::enable_if<std::is_base_of<base::matrix, T>::value, T>::type operator*(const T& mat, float scalar);
-template <typename T> inline typename std::enable_if<std::is_base_of<base::matrix, T>::value, T>::type operator*(float scalar, const T& mat);
-template <typename T> inline typename std::enable_if<std::is_base_of<base::matrix, T>::value, T>::type operator/(const T& mat, float scalar);
+template <typename T> inline typename std::enable_if<base::is_small_matrix<T>, T>::type operator+(const T& lhs, const T& rhs);
+template <typename T> inline typename std::enable_if<base::is_small_matrix<T>, T>::type operator-(const T& lhs, const T& rhs);
+template <typename T> inline typename std::enable_if<base::is_small_matrix<T>, T>::type operator*(const T& lhs, const T& rhs);
+template <typename T> inline typename std::enable_if<base::is_small_matrix<T>, T>::type operator*(const T& mat, float scalar);
+template <typename T> inline typename std::enable_if<base::is_small_matrix<T>, T>::type operator*(float scalar, const T& mat);
+template <typename T> inline typename std::enable_if<base::is_small_matrix<T>, T>::type operator/(const T& mat, float scalar);
 
 // clang-format on
 
 // ----- Matrix Class -----
 /**
  * A generalized n by m matrix allocated on the heap.
+ *
+ * The elements are stored in a single contiguous buffer in column-major order. Each column is
+ * padded out to the leading dimension (stride), which is a multiple of the SIMD width for all but
+ * the smallest matrices. The padding is always zero, so kernels are free to read it.
+ *
+ * Like the heap allocated vector, elementwise arithmetic on this class is lazy (see expression.h),
+ * and is only evaluated once it is assigned to a matrix. Products are always evaluated right away,
+ * using the blocked kernels in kernels.h.
  */
-class matrix : public base::matrix
+class matrix : public base::matrix_expression
 {
 public:
   // Constructors
@@ -35,13 +44,13 @@ public:
   matrix() = delete;
 
   matrix(int rows, int columns, float v = 1.0f)
-    : numRows(rows), numCols(columns), cols(columns, vector(rows, 0.0f))
+    : numRows(rows), numCols(columns), ld(leadingDimension(rows)), elements(ld * columns, 0.0f)
   {
     assert(rows > 0 && columns > 0);
 
     int length = rows < columns ? rows : columns;
     for (int i = 0; i < length; i++)
-      cols[i][i] = v;
+      (*this)(i, i) = v;
   }
 
   /**
@@ -49,24 +58,38 @@ public:
    * of components.
    */
   matrix(std::initializer_list<vector> columns)
-    : numRows(columns.begin()->length()), numCols(columns.size()), cols(columns)
+    : matrix(columns.begin()->length(), columns.size(), 0.0f)
   {
-    // Make sure that we have the same number of compenents for each.
-    for (auto& col : cols)
-      assert(col.length() == numRows);
+    int col = 0;
+    for (auto& column : columns)
+    {
+      // Make sure that we have the same number of compenents for each.
+      assert(column.length() == numRows);
+      (*this)[col++] = column;
+    }
   }
 
   // Builds a matrix from a smaller matrix with given # rows and # cols or the same or the same
   // number of rows or cols as the given matrix for each of these parameters that are negative.
-  template <typename U, std::enable_if_t<std::is_base_of_v<base::matrix, U>, bool> = true>
+  template <typename U, std::enable_if_t<base::is_small_matrix<U>, bool> = true>
   matrix(const U& mat, int rows = -1, int columns = -1)
     : matrix(rows >= 0 ? rows : mat.rows(), columns >= 0 ? columns : mat.columns())
   {
     assert(mat.rows() <= numRows && mat.columns() <= numCols);
 
-    int length = mat.rows() < mat.columns() ? mat.rows() : mat.columns();
-    for (int i = 0; i < length; i++)
-      cols[i] = vector(mat[i], numRows);
+    for (int col = 0; col < mat.columns(); col++)
+      for (int row = 0; row < mat.rows(); row++)
+        (*this)(row, col) = mat[col][row];
+  }
+
+  /**
+   * Evaluates a matrix expression into a new matrix.
+   */
+  template <typename E, std::enable_if_t<base::is_matrix_expression<E>, bool> = true>
+  matrix(const E& expr)
+    : matrix(expr.rows(), expr.columns(), 0.0f)
+  {
+    (*this) = expr;
   }
 
   // Methods
@@ -74,60 +97,135 @@ public:
   int columns() const { return numCols; }
   int rows() const { return numRows; }
 
+  /**
+   * The distance in floats between the start of consecutive columns.
+   */
+  int stride() const { return ld; }
+
+  float* data() { return elements.data(); }
+  const float* data() const { return elements.data(); }
+
   // Operators
 
-  matrix& operator+=(const matrix& other)
+  /**
+   * Evaluates an expression directly into this matrix. If the dimensions already match, no memory
+   * is allocated. Expressions are evaluated elementwise, so it is safe for this matrix to appear in
+   * the expression.
+   */
+  template <typename E, std::enable_if_t<base::is_matrix_expression<E>, bool> = true>
+  matrix& operator=(const E& expr)
   {
-    (*this) = (*this) + other;
+    if (expr.rows() != rows() || expr.columns() != columns())
+      (*this) = matrix(expr.rows(), expr.columns(), 0.0f);
+
+    for (int col = 0; col < numCols; col++)
+    {
+      float* column = data() + col * ld;
+      for (int row = 0; row < numRows; row++)
+        column[row] = expr(row, col);
+    }
+
     return (*this);
   }
 
-  matrix& operator-=(const matrix& other)
+  template <typename E, std::enable_if_t<base::is_matrix_expression<E>, bool> = true>
+  matrix& operator+=(const E& other)
   {
-    (*this) = (*this) - other;
+    assert(rows() == other.rows() && columns() == other.columns());
+
+    for (int col = 0; col < numCols; col++)
+    {
+      float* column = data() + col * ld;
+      for (int row = 0; row < numRows; row++)
+        column[row] += other(row, col);
+    }
+
     return (*this);
   }
 
-  matrix& operator*=(const matrix& other)
+  template <typename E, std::enable_if_t<base::is_matrix_expression<E>, bool> = true>
+  matrix& operator-=(const E& other)
   {
-    (*this) = (*this) * other;
+    assert(rows() == other.rows() && columns() == other.columns());
+
+    for (int col = 0; col < numCols; col++)
+    {
+      float* column = data() + col * ld;
+      for (int row = 0; row < numRows; row++)
+        column[row] -= other(row, col);
+    }
+
     return (*this);
   }
 
+  matrix& operator*=(const matrix& other);
+
   matrix& operator*=(float scalar)
   {
-    (*this) = (*this) * scalar;
+    // The padding is zero, so we can scale the whole buffer in one pass.
+    for (float& elt : elements)
+      elt *= scalar;
+
     return (*this);
   }
 
   matrix& operator/=(float scalar)
   {
-    (*this) = (*this) / scalar;
+    assert(scalar != 0.0f);
+
+    for (float& elt : elements)
+      elt /= scalar;
+
     return (*this);
   }
 
-  vector& operator[](int index)
+  float& operator()(int row, int col)
+  {
+    assert(row >= 0 && row < rows() && col >= 0 && col < columns());
+    return elements[row + col * ld];
+  }
+
+  float operator()(int row, int col) const
+  {
+    assert(row >= 0 && row < rows() && col >= 0 && col < columns());
+    return elements[row + col * ld];
+  }
+
+  /**
+   * Returns a view of a column. Writing to the view writes to the matrix.
+   */
+  vector_view<float> operator[](int index)
   {
     assert(index >= 0 && index < columns());
-    return cols[index];
+    return {data() + index * ld, numRows};
   }
 
-  const vector operator[](int index) const
+  vector_view<const float> operator[](int index) const
   {
     assert(index >= 0 && index < columns());
-    return cols[index];
+    return {data() + index * ld, numRows};
   }
 
 private:
+  /**
+   * Columns long enough to fill a SIMD register are padded to a multiple of four floats, so that
+   * every column starts on a 16 byte boundary.
+   */
+  static int leadingDimension(int rows) { return rows < 4 ? rows : (rows + 3) & ~3; }
+
   // Fields
-  std::vector<vector> cols;
+
   int numRows, numCols;
+  int ld;
+  std::vector<float> elements;
 };
 
 // ----- Matrix Functions -----
 
 template <typename matType>
-inline typename std::enable_if<std::is_base_of<base::matrix, matType>::value, matType>::type
+inline typename std::enable_if<std::is_base_of_v<base::matrix, matType> &&
+                                   !std::is_base_of_v<expr::node, matType>,
+                               matType>::type
 transpose(const matType& matrix)
 {
   matType res(matrix.columns(), matrix.rows());
@@ -141,8 +239,11 @@ transpose(const matType& matrix)
 
 // ----- Inline Operators -----
 
+// These are eagerly evaluated and only apply to the small matrix types. The elementwise operators
+// for the heap allocated matrix live in expression.h, and its products are defined below.
+
 template <typename matType>
-inline typename std::enable_if<std::is_base_of<base::matrix, matType>::value, matType>::type
+inline typename std::enable_if<base::is_small_matrix<matType>, matType>::type
 operator+(const matType& lhs, const matType& rhs)
 {
   assert(lhs.rows() == rhs.rows() && lhs.columns() == rhs.columns());
@@ -155,27 +256,27 @@ operator+(const matType& lhs, const matType& rhs)
 }
 
 template <typename matType>
-inline typename std::enable_if<std::is_base_of<base::matrix, matType>::value, matType>::type
+inline typename std::enable_if<base::is_small_matrix<matType>, matType>::type
 operator-(const matType& lhs, const matType& rhs)
 {
   assert(lhs.rows() == rhs.rows() && lhs.columns() == rhs.columns());
 
   matType res(lhs.rows(), lhs.columns());
   for (int i = 0; i < res.columns(); i++)
-    res[i] = lhs[i] + rhs[i];
+    res[i] = lhs[i] - rhs[i];
 
   return res;
 }
 
 template <typename matType>
-inline typename std::enable_if<std::is_base_of<base::matrix, matType>::value, matType>::type
+inline typename std::enable_if<base::is_small_matrix<matType>, matType>::type
 operator-(const matType& mat)
 {
   return matType(mat) *= -1.0f;
 }
 
 template <typename matType>
-inline typename std::enable_if<std::is_base_of<base::matrix, matType>::value, matType>::type
+inline typename std::enable_if<base::is_small_matrix<matType>, matType>::type
 operator*(const matType& lhs, const matType& rhs)
 {
   assert(lhs.columns() == rhs.rows());
@@ -191,7 +292,7 @@ operator*(const matType& lhs, const matType& rhs)
 }
 
 template <typename matType>
-inline typename std::enable_if<std::is_base_of<base::matrix, matType>::value, matType>::type
+inline typename std::enable_if<base::is_small_matrix<matType>, matType>::type
 operator*(const matType& mat, float scalar)
 {
   matType res(mat.rows(), mat.columns());
@@ -202,14 +303,14 @@ operator*(const matType& mat, float scalar)
 }
 
 template <typename matType>
-inline typename std::enable_if<std::is_base_of<base::matrix, matType>::value, matType>::type
+inline typename std::enable_if<base::is_small_matrix<matType>, matType>::type
 operator*(float scalar, const matType& mat)
 {
   return mat * scalar;
 }
 
 template <typename matType>
-inline typename std::enable_if<std::is_base_of<base::matrix, matType>::value, matType>::type
+inline typename std::enable_if<base::is_small_matrix<matType>, matType>::type
 operator/(const matType& mat, float scalar)
 {
   assert(scalar != 0.0f);
@@ -237,8 +338,8 @@ inline bool operator==(const T& lhs, const U& rhs)
 
 // ----- Matrix Vector Multiplication -----
 
-template <typename T, typename V, std::enable_if_t<std::is_base_of_v<base::matrix, T>, bool> = true,
-          std::enable_if_t<std::is_base_of_v<base::vector, V>, bool> = true>
+template <typename T, typename V, std::enable_if_t<base::is_small_matrix<T>, bool> = true,
+          std::enable_if_t<base::is_small_vector<V>, bool> = true>
 inline V operator*(const T& mat, const V& vec)
 {
   assert(mat.rows() == vec.length());
@@ -251,4 +352,81 @@ inline V operator*(const T& mat, const V& vec)
   return res;
 }
 
+// ----- Heap Matrix Products -----
+
+/**
+ * Transposes a heap matrix. This works in square tiles, so that both the reads and the writes stay
+ * within a few cache lines at a time.
+ */
+inline matrix transpose(const matrix& mat)
+{
+  constexpr int tile = 16;
+
+  matrix res(mat.columns(), mat.rows(), 0.0f);
+  const float* src = mat.data();
+  float* dst = res.data();
+
+  for (int jj = 0; jj < mat.columns(); jj += tile)
+    for (int ii = 0; ii < mat.rows(); ii += tile)
+      for (int j = jj; j < jj + tile && j < mat.columns(); j++)
+        for (int i = ii; i < ii + tile && i < mat.rows(); i++)
+          dst[j + i * res.stride()] = src[i + j * mat.stride()];
+
+  return res;
+}
+
+/**
+ * Multiplies a matrix expression by a vector expression. A plain matrix goes straight to the
+ * matrix-vector kernel. Other expressions are accumulated one column at a time, so that they never
+ * have to be evaluated into a temporary matrix.
+ */
+template <typename E, typename V, std::enable_if_t<base::is_matrix_expression<E>, bool> = true,
+          std::enable_if_t<base::is_vector_expression<V>, bool> = true>
+inline vector operator*(const E& mat, const V& vec)
+{
+  assert(mat.columns() == vec.length());
+
+  vector res(mat.rows(), 0.0f);
+  if constexpr (std::is_same_v<E, matrix>)
+  {
+    if constexpr (std::is_same_v<V, vector>)
+    {
+      kernels::gemv(mat.rows(), mat.columns(), mat.data(), mat.stride(), vec.data(), res.data());
+    }
+    else
+    {
+      vector x = vec;
+      kernels::gemv(mat.rows(), mat.columns(), mat.data(), mat.stride(), x.data(), res.data());
+    }
+  }
+  else
+  {
+    for (int col = 0; col < mat.columns(); col++)
+    {
+      float scale = vec[col];
+      for (int row = 0; row < mat.rows(); row++)
+        res[row] += mat(row, col) * scale;
+    }
+  }
+
+  return res;
+}
+
+inline matrix operator*(const matrix& lhs, const matrix& rhs)
+{
+  assert(lhs.columns() == rhs.rows());
+
+  matrix res(lhs.rows(), rhs.columns(), 0.0f);
+  kernels::gemm(lhs.rows(), rhs.columns(), lhs.columns(), lhs.data(), lhs.stride(), rhs.data(),
+                rhs.stride(), res.data(), res.stride());
+
+  return res;
+}
+
+inline matrix& matrix::operator*=(const matrix& other)
+{
+  (*this) = (*this) * other;
+  return (*this);
+}
+
 } // namespace flexor
\ No newline at end of file
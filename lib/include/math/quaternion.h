@@ -1,7 +1,9 @@
 #pragma once
 
 #include <cmath>
+#include <span>
 
+#include "simd.h"
 #include "small_matrix.h"
 #include "vector.h"
 #include "vector3.h"
@@ -36,8 +38,12 @@ inline quaternion normalize(const quaternion& quat);
  *
  * This inspiration has been taken from the unity API for quaternions found here:
  * https://docs.unity3d.com/6000.0/Documentation/ScriptReference/Quaternion.html
+ *
+ * Internally, the imaginary components are stored first and the real component last, so that a
+ * quaternion fills one 16 byte aligned SIMD register with the vector part in the same lanes as a
+ * vector3.
  */
-class quaternion
+class alignas(16) quaternion
 {
 public:
   // Constructors
@@ -46,7 +52,7 @@ public:
    * Creates a quaternion with given real and imaginary values.
    */
   quaternion(float real = 1.0f, float i = 0.0f, float j = 0.0f, float k = 0.0f)
-    : real(real), imag(i, j, k)
+    : i(i), j(j), k(k), real(real)
   {
   }
 
@@ -58,8 +64,11 @@ public:
     assert(axis != vector3(0.0f));
 
     float halfAngle = 0.5f * angle;
+    vector3 imag = sin(halfAngle) * normalize(axis);
+    i = imag.x;
+    j = imag.y;
+    k = imag.z;
     real = cos(halfAngle);
-    imag = sin(halfAngle) * normalize(axis);
   }
 
   // Methods
@@ -74,14 +83,27 @@ public:
    */
   static quaternion multiply(const quaternion& lhs, const quaternion& rhs)
   {
-    quaternion res;
-
     // We can compute quaternion multiplication using dot and cross product.
     // https://fgiesen.wordpress.com/2019/02/09/rotating-a-single-vector-using-a-quaternion/
-    res.real = lhs.real * rhs.real - dot(lhs.imag, rhs.imag);
-    res.imag = lhs.real * rhs.imag + lhs.imag * rhs.real + cross(lhs.imag, rhs.imag);
-
-    return res;
+    //
+    // real = lhs.real * rhs.real - dot(lhs.imag, rhs.imag)
+    // imag = lhs.real * rhs.imag + lhs.imag * rhs.real + cross(lhs.imag, rhs.imag)
+    //
+    // Expanding this out, each component of lhs scales a shuffled and sign flipped copy of rhs, so
+    // the whole product is four multiply-adds in (i, j, k, real) lane order.
+    simd::float4 a = lhs.toSimd();
+    simd::float4 b = rhs.toSimd();
+
+    simd::float4 iSigns = simd::set(1.0f, -1.0f, 1.0f, -1.0f);
+    simd::float4 jSigns = simd::set(1.0f, 1.0f, -1.0f, -1.0f);
+    simd::float4 kSigns = simd::set(-1.0f, 1.0f, 1.0f, -1.0f);
+
+    simd::float4 res = simd::broadcast<3>(a) * b;
+    res = simd::multiplyAdd(simd::broadcast<0>(a), simd::shuffle<3, 2, 1, 0>(b) * iSigns, res);
+    res = simd::multiplyAdd(simd::broadcast<1>(a), simd::shuffle<2, 3, 0, 1>(b) * jSigns, res);
+    res = simd::multiplyAdd(simd::broadcast<2>(a), simd::shuffle<1, 0, 3, 2>(b) * kSigns, res);
+
+    return fromSimd(res);
   }
 
   /**
@@ -108,10 +130,29 @@ public:
   }
 
   float scalar() const { return real; }
-  vector3 vector() const { return imag; }
+  vector3 vector() const { return vector3(i, j, k); }
 
   float& scalar() { return real; }
-  vector3& vector() { return imag; }
+  void setVector(const vector3& imag)
+  {
+    i = imag.x;
+    j = imag.y;
+    k = imag.z;
+  }
+
+  // SIMD Access
+
+  /**
+   * Loads the quaternion into a SIMD register in (i, j, k, real) lane order.
+   */
+  simd::float4 toSimd() const { return simd::load(&i); }
+
+  static quaternion fromSimd(simd::float4 v)
+  {
+    quaternion res;
+    simd::store(&res.i, v);
+    return res;
+  }
 
   // Operators
 
@@ -129,37 +170,32 @@ public:
   float& operator[](int index)
   {
     assert(index >= 0 && index < length());
-    if (index == 0)
-      return real;
-    else
-      return imag[index - 1];
+
+    constexpr float quaternion::*components[] = {&quaternion::real, &quaternion::i, &quaternion::j,
+                                                 &quaternion::k};
+    return this->*components[index];
   }
 
   const float operator[](int index) const
   {
     assert(index >= 0 && index < length());
-    if (index == 0)
-      return real;
-    else
-      return imag[index - 1];
+
+    constexpr float quaternion::*components[] = {&quaternion::real, &quaternion::i, &quaternion::j,
+                                                 &quaternion::k};
+    return this->*components[index];
   }
 
 private:
   // Fields
 
-  float real;
-  vector3 imag;
+  float i, j, k, real;
 };
 
 // ----- Inline Operators -----
 
 inline bool operator==(const quaternion& lhs, const quaternion& rhs)
 {
-  for (int i = 0; i < lhs.length(); i++)
-    if (lhs[i] != rhs[i])
-      return false;
-
-  return true;
+  return simd::equal(lhs.toSimd(), rhs.toSimd());
 }
 
 inline quaternion operator*(const quaternion& lhs, const quaternion& rhs)
@@ -167,17 +203,31 @@ inline quaternion operator*(const quaternion& lhs, const quaternion& rhs)
   return quaternion(lhs) *= rhs;
 }
 
+/**
+ * Rotates a vector by a quaternion that doesn't need to be normalized. Expanding q * v * q^-1 for a
+ * quaternion q = (w, u) with squared magnitude n gives v + w * t + u x t, where t = (2 / n) u x v.
+ * This is the same as the fast path in rotate(), but divides by n instead of assuming it is one, so
+ * it still never takes a square root.
+ */
 inline vector3 operator*(const quaternion& lhs, const vector3& rhs)
 {
-  quaternion res = lhs * quaternion(0.0f, rhs[0], rhs[1], rhs[2]);
-  return res.vector();
+  simd::float4 q = lhs.toSimd();
+  simd::float4 v = rhs.toSimd();
+
+  float magSquared = simd::sum(q * q);
+  assert(magSquared != 0.0f);
+
+  simd::float4 t = simd::cross3(q, v) * simd::splat(2.0f / magSquared);
+  simd::float4 res = simd::multiplyAdd(simd::broadcast<3>(q), t, v) + simd::cross3(q, t);
+  return vector3::fromSimd(res);
 }
 
 // ----- Quaternion Operations -----
 
 inline float magnitude(const quaternion& quat)
 {
-  return sqrt(quat.scalar() * quat.scalar() + dot(quat.vector(), quat.vector()));
+  simd::float4 q = quat.toSimd();
+  return sqrt(simd::sum(q * q));
 }
 
 inline quaternion normalize(const quaternion& quat)
@@ -186,25 +236,144 @@ inline quaternion normalize(const quaternion& quat)
   assert(mag != 0.0f);
 
   float scale = 1.0f / mag;
-  return quaternion(quat[0] * scale, quat[1] * scale, quat[2] * scale, quat[3] * scale);
+  return quaternion::fromSimd(quat.toSimd() * simd::splat(scale));
 }
 
 inline quaternion conjugate(const quaternion& quat)
 {
-  return quaternion(quat[0], -quat[1], -quat[2], -quat[3]);
+  return quaternion::fromSimd(quat.toSimd() * simd::set(-1.0f, -1.0f, -1.0f, 1.0f));
 }
 
 inline quaternion inverse(const quaternion& quat)
 {
-  float mag = magnitude(quat);
-  assert(mag != 0.0f);
+  // The inverse is the conjugate over the squared magnitude, so we never need the square root.
+  simd::float4 q = quat.toSimd();
+  float magSquared = simd::sum(q * q);
+  assert(magSquared != 0.0f);
 
-  quaternion res = conjugate(quat);
-  float scale = 1.0f / (mag * mag);
-  res.scalar() *= scale;
-  res.vector() *= scale;
+  float scale = 1.0f / magSquared;
+  return quaternion::fromSimd(q * simd::set(-scale, -scale, -scale, scale));
+}
+
+// ----- Rotation -----
+
+/**
+ * Rotates a vector by a unit quaternion. This is the standard form v + 2w(u x v) + 2u x (u x v),
+ * written as t = 2 u x v and v + w * t + u x t, which is two cross products and no square root.
+ * https://fgiesen.wordpress.com/2019/02/09/rotating-a-single-vector-using-a-quaternion/
+ *
+ * The quaternion must already be normalized; use operator* otherwise.
+ */
+inline vector3 rotate(const quaternion& quat, const vector3& vec)
+{
+  simd::float4 q = quat.toSimd();
+  simd::float4 v = vec.toSimd();
+
+  simd::float4 t = simd::cross3(q, v) * simd::splat(2.0f);
+  simd::float4 res = simd::multiplyAdd(simd::broadcast<3>(q), t, v) + simd::cross3(q, t);
+  return vector3::fromSimd(res);
+}
+
+/**
+ * Rotates each vector by the unit quaternion at the same index, in place. Four pairs at a time are
+ * transposed so that each register holds one component of four quaternions or vectors, and the
+ * rotation is done lanewise without any shuffles.
+ */
+inline void rotate(std::span<const quaternion> quats, std::span<vector3> vecs)
+{
+  assert(quats.size() == vecs.size());
+
+  int count = static_cast<int>(vecs.size());
+  int index = 0;
+  for (; index + 4 <= count; index += 4)
+  {
+    simd::float4 qx = quats[index].toSimd();
+    simd::float4 qy = quats[index + 1].toSimd();
+    simd::float4 qz = quats[index + 2].toSimd();
+    simd::float4 qw = quats[index + 3].toSimd();
+    simd::transpose(qx, qy, qz, qw);
+
+    simd::float4 vx = vecs[index].toSimd();
+    simd::float4 vy = vecs[index + 1].toSimd();
+    simd::float4 vz = vecs[index + 2].toSimd();
+    simd::float4 pad = vecs[index + 3].toSimd();
+    simd::transpose(vx, vy, vz, pad);
+
+    // t = 2 u x v
+    simd::float4 two = simd::splat(2.0f);
+    simd::float4 tx = (qy * vz - qz * vy) * two;
+    simd::float4 ty = (qz * vx - qx * vz) * two;
+    simd::float4 tz = (qx * vy - qy * vx) * two;
+
+    // v + w * t + u x t
+    vx = simd::multiplyAdd(qw, tx, vx) + (qy * tz - qz * ty);
+    vy = simd::multiplyAdd(qw, ty, vy) + (qz * tx - qx * tz);
+    vz = simd::multiplyAdd(qw, tz, vz) + (qx * ty - qy * tx);
+
+    pad = simd::splat(0.0f);
+    simd::transpose(vx, vy, vz, pad);
+    vecs[index] = vector3::fromSimd(vx);
+    vecs[index + 1] = vector3::fromSimd(vy);
+    vecs[index + 2] = vector3::fromSimd(vz);
+    vecs[index + 3] = vector3::fromSimd(pad);
+  }
+
+  for (; index < count; index++)
+    vecs[index] = rotate(quats[index], vecs[index]);
+}
+
+/**
+ * Rotates every vector by the same unit quaternion, in place. The entries of its rotation matrix
+ * are worked out once, each splatted across a register, and the vectors are transposed four at a
+ * time like above, so each one only costs three multiply-adds per axis. This is the path for
+ * transforming the vertices of a shape.
+ */
+inline void rotate(const quaternion& quat, std::span<vector3> vecs)
+{
+  simd::float4 q = quat.toSimd();
+  simd::float4 x = simd::broadcast<0>(q);
+  simd::float4 y = simd::broadcast<1>(q);
+  simd::float4 z = simd::broadcast<2>(q);
+  simd::float4 w = simd::broadcast<3>(q);
+  simd::float4 one = simd::splat(1.0f);
+  simd::float4 two = simd::splat(2.0f);
+
+  // Going through quaternion::matrix() instead would build the matrix in memory and read each
+  // entry back out, which the compiler ends up redoing inside the loop.
+  simd::float4 m00 = one - two * (y * y + z * z);
+  simd::float4 m01 = two * (x * y - w * z);
+  simd::float4 m02 = two * (x * z + w * y);
+  simd::float4 m10 = two * (x * y + w * z);
+  simd::float4 m11 = one - two * (x * x + z * z);
+  simd::float4 m12 = two * (y * z - w * x);
+  simd::float4 m20 = two * (x * z - w * y);
+  simd::float4 m21 = two * (y * z + w * x);
+  simd::float4 m22 = one - two * (x * x + y * y);
+
+  int count = static_cast<int>(vecs.size());
+  int index = 0;
+  for (; index + 4 <= count; index += 4)
+  {
+    simd::float4 vx = vecs[index].toSimd();
+    simd::float4 vy = vecs[index + 1].toSimd();
+    simd::float4 vz = vecs[index + 2].toSimd();
+    simd::float4 pad = vecs[index + 3].toSimd();
+    simd::transpose(vx, vy, vz, pad);
+
+    simd::float4 rx = simd::multiplyAdd(m02, vz, simd::multiplyAdd(m01, vy, m00 * vx));
+    simd::float4 ry = simd::multiplyAdd(m12, vz, simd::multiplyAdd(m11, vy, m10 * vx));
+    simd::float4 rz = simd::multiplyAdd(m22, vz, simd::multiplyAdd(m21, vy, m20 * vx));
+
+    pad = simd::splat(0.0f);
+    simd::transpose(rx, ry, rz, pad);
+    vecs[index] = vector3::fromSimd(rx);
+    vecs[index + 1] = vector3::fromSimd(ry);
+    vecs[index + 2] = vector3::fromSimd(rz);
+    vecs[index + 3] = vector3::fromSimd(pad);
+  }
 
-  return res;
+  for (; index < count; index++)
+    vecs[index] = rotate(quat, vecs[index]);
 }
 
 } // namespace flexor
\ No newline at end of file
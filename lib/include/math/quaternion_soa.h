@@ -0,0 +1,393 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <span>
+
+#include "quaternion.h"
+#include "simd.h"
+#include "vector3.h"
+
+namespace flexor
+{
+
+// ----- Quaternion Streams -----
+
+/**
+ * A structure of arrays view over many quaternions, with each component in its own contiguous
+ * array. The stream kernels below load one component of wideLanes quaternions into each register,
+ * so every operation is lanewise and there is nothing to shuffle. The arrays are not owned.
+ */
+struct quaternion_soa
+{
+  float* i;
+  float* j;
+  float* k;
+  float* real;
+  int count;
+};
+
+// ----- Lane Kernels -----
+
+// Each kernel works on a batch of quaternions split into component registers. They are templates
+// over the register type, so that the same math serves the structure of arrays streams (which use
+// the widest register) and the array of quaternion overloads (which transpose four at a time).
+
+template <typename V> inline void normalizeLanes(V& i, V& j, V& k, V& w)
+{
+  V scale = simd::inverseSqrt(i * i + j * j + k * k + w * w);
+  i = i * scale;
+  j = j * scale;
+  k = k * scale;
+  w = w * scale;
+}
+
+/**
+ * Takes an explicit euler step of q' = 0.5 * (0, w) * q and renormalizes. Expanding the product,
+ * the imaginary part of the derivative is real(q) * w + w x imag(q), and its real part is
+ * -dot(w, imag(q)).
+ */
+template <typename V>
+inline void integrateLanes(V& i, V& j, V& k, V& w, V wx, V wy, V wz, V halfDt)
+{
+  V di = w * wx + (wy * k - wz * j);
+  V dj = w * wy + (wz * i - wx * k);
+  V dk = w * wz + (wx * j - wy * i);
+  V dw = simd::splatAs<V>(0.0f) - (wx * i + wy * j + wz * k);
+
+  i = simd::multiplyAdd(di, halfDt, i);
+  j = simd::multiplyAdd(dj, halfDt, j);
+  k = simd::multiplyAdd(dk, halfDt, k);
+  w = simd::multiplyAdd(dw, halfDt, w);
+  normalizeLanes(i, j, k, w);
+}
+
+/**
+ * Flips b onto the same hemisphere as a, so that blending takes the shorter way around, and returns
+ * the (now non-negative) cosine of the angle between them.
+ */
+template <typename V>
+inline V alignLanes(V ai, V aj, V ak, V aw, V& bi, V& bj, V& bk, V& bw)
+{
+  V cosine = ai * bi + aj * bj + ak * bk + aw * bw;
+  bi = simd::flipSign(bi, cosine);
+  bj = simd::flipSign(bj, cosine);
+  bk = simd::flipSign(bk, cosine);
+  bw = simd::flipSign(bw, cosine);
+  return simd::flipSign(cosine, cosine);
+}
+
+template <typename V>
+inline void nlerpLanes(V& ai, V& aj, V& ak, V& aw, V bi, V bj, V bk, V bw, V t)
+{
+  alignLanes(ai, aj, ak, aw, bi, bj, bk, bw);
+  ai = simd::multiplyAdd(bi - ai, t, ai);
+  aj = simd::multiplyAdd(bj - aj, t, aj);
+  ak = simd::multiplyAdd(bk - ak, t, ak);
+  aw = simd::multiplyAdd(bw - aw, t, aw);
+  normalizeLanes(ai, aj, ak, aw);
+}
+
+/**
+ * Spherical interpolation. There are no SIMD versions of acos and sin, so the two blend weights are
+ * computed one lane at a time, but everything else is lanewise. Nearly parallel quaternions fall
+ * back to linear weights, since the angle between them is lost in rounding.
+ */
+template <typename V>
+inline void slerpLanes(V& ai, V& aj, V& ak, V& aw, V bi, V bj, V bk, V bw, float t)
+{
+  constexpr int lanes = simd::lanesOf<V>;
+
+  float cosines[lanes];
+  simd::storeAs(cosines, alignLanes(ai, aj, ak, aw, bi, bj, bk, bw));
+
+  float weightsA[lanes];
+  float weightsB[lanes];
+  for (int lane = 0; lane < lanes; lane++)
+  {
+    float angle = std::acos(std::min(cosines[lane], 1.0f));
+    float sine = std::sin(angle);
+    bool linear = sine < 1e-4f;
+
+    weightsA[lane] = linear ? 1.0f - t : std::sin((1.0f - t) * angle) / sine;
+    weightsB[lane] = linear ? t : std::sin(t * angle) / sine;
+  }
+
+  V wa = simd::loadAs<V>(weightsA);
+  V wb = simd::loadAs<V>(weightsB);
+  ai = simd::multiplyAdd(bi, wb, ai * wa);
+  aj = simd::multiplyAdd(bj, wb, aj * wa);
+  ak = simd::multiplyAdd(bk, wb, ak * wa);
+  aw = simd::multiplyAdd(bw, wb, aw * wa);
+}
+
+// ----- Structure of Arrays Streams -----
+
+/**
+ * Runs a lane kernel over every quaternion of a stream. Full batches are loaded straight from the
+ * arrays, and the leftovers are copied into a padded batch on the stack, which is filled with the
+ * identity so that it stays finite.
+ */
+template <typename Kernel> inline void forEachBatch(const quaternion_soa& quats, Kernel kernel)
+{
+  constexpr int lanes = simd::wideLanes;
+
+  int index = 0;
+  for (; index + lanes <= quats.count; index += lanes)
+  {
+    simd::floatv i = simd::loadWide(quats.i + index);
+    simd::floatv j = simd::loadWide(quats.j + index);
+    simd::floatv k = simd::loadWide(quats.k + index);
+    simd::floatv w = simd::loadWide(quats.real + index);
+
+    kernel(index, i, j, k, w);
+
+    simd::storeWide(quats.i + index, i);
+    simd::storeWide(quats.j + index, j);
+    simd::storeWide(quats.k + index, k);
+    simd::storeWide(quats.real + index, w);
+  }
+
+  if (index == quats.count)
+    return;
+
+  float tail[4][lanes];
+  for (int lane = 0; lane < lanes; lane++)
+  {
+    bool valid = index + lane < quats.count;
+    tail[0][lane] = valid ? quats.i[index + lane] : 0.0f;
+    tail[1][lane] = valid ? quats.j[index + lane] : 0.0f;
+    tail[2][lane] = valid ? quats.k[index + lane] : 0.0f;
+    tail[3][lane] = valid ? quats.real[index + lane] : 1.0f;
+  }
+
+  simd::floatv i = simd::loadWide(tail[0]);
+  simd::floatv j = simd::loadWide(tail[1]);
+  simd::floatv k = simd::loadWide(tail[2]);
+  simd::floatv w = simd::loadWide(tail[3]);
+
+  kernel(index, i, j, k, w);
+
+  simd::storeWide(tail[0], i);
+  simd::storeWide(tail[1], j);
+  simd::storeWide(tail[2], k);
+  simd::storeWide(tail[3], w);
+  for (int lane = 0; index + lane < quats.count; lane++)
+  {
+    quats.i[index + lane] = tail[0][lane];
+    quats.j[index + lane] = tail[1][lane];
+    quats.k[index + lane] = tail[2][lane];
+    quats.real[index + lane] = tail[3][lane];
+  }
+}
+
+/**
+ * Loads wideLanes floats starting at index, reading zeros past the end of the array.
+ */
+inline simd::floatv loadPartial(const float* ptr, int index, int count)
+{
+  constexpr int lanes = simd::wideLanes;
+  if (index + lanes <= count)
+    return simd::loadWide(ptr + index);
+
+  float tail[lanes];
+  for (int lane = 0; lane < lanes; lane++)
+    tail[lane] = index + lane < count ? ptr[index + lane] : 0.0f;
+
+  return simd::loadWide(tail);
+}
+
+/**
+ * Renormalizes every quaternion of a stream.
+ */
+inline void normalize(const quaternion_soa& quats)
+{
+  forEachBatch(quats, [](int, simd::floatv& i, simd::floatv& j, simd::floatv& k, simd::floatv& w)
+               { normalizeLanes(i, j, k, w); });
+}
+
+/**
+ * Integrates every quaternion of a stream by the angular velocity with the same index, given as
+ * three component arrays.
+ */
+inline void integrate(const quaternion_soa& quats, const float* wx, const float* wy,
+                      const float* wz, float dt)
+{
+  simd::floatv halfDt = simd::splatWide(0.5f * dt);
+  int count = quats.count;
+
+  forEachBatch(quats,
+               [&](int index, simd::floatv& i, simd::floatv& j, simd::floatv& k, simd::floatv& w)
+               {
+                 integrateLanes(i, j, k, w, loadPartial(wx, index, count),
+                                loadPartial(wy, index, count), loadPartial(wz, index, count),
+                                halfDt);
+               });
+}
+
+/**
+ * Blends every quaternion of a stream toward the target with the same index by t, along the
+ * shorter path, and normalizes the result.
+ */
+inline void nlerp(const quaternion_soa& quats, const quaternion_soa& targets, float t)
+{
+  assert(quats.count == targets.count);
+
+  simd::floatv weight = simd::splatWide(t);
+  int count = quats.count;
+
+  forEachBatch(quats,
+               [&](int index, simd::floatv& i, simd::floatv& j, simd::floatv& k, simd::floatv& w)
+               {
+                 nlerpLanes(i, j, k, w, loadPartial(targets.i, index, count),
+                            loadPartial(targets.j, index, count),
+                            loadPartial(targets.k, index, count),
+                            loadPartial(targets.real, index, count), weight);
+               });
+}
+
+/**
+ * Spherically interpolates every quaternion of a stream toward the target with the same index by t.
+ */
+inline void slerp(const quaternion_soa& quats, const quaternion_soa& targets, float t)
+{
+  assert(quats.count == targets.count);
+
+  int count = quats.count;
+  forEachBatch(quats,
+               [&](int index, simd::floatv& i, simd::floatv& j, simd::floatv& k, simd::floatv& w)
+               {
+                 slerpLanes(i, j, k, w, loadPartial(targets.i, index, count),
+                            loadPartial(targets.j, index, count),
+                            loadPartial(targets.k, index, count),
+                            loadPartial(targets.real, index, count), t);
+               });
+}
+
+// ----- Quaternion Array Streams -----
+
+// Most of the engine stores quaternions as an array of quaternion, which already keeps each one in
+// a SIMD register. These overloads transpose four of them at a time into component registers, run
+// the same lane kernels, and transpose back, with the leftovers done one at a time.
+
+/**
+ * Renormalizes every quaternion in place.
+ */
+inline void normalize(std::span<quaternion> quats)
+{
+  int count = static_cast<int>(quats.size());
+  int index = 0;
+  for (; index + 4 <= count; index += 4)
+  {
+    simd::float4 i = quats[index].toSimd();
+    simd::float4 j = quats[index + 1].toSimd();
+    simd::float4 k = quats[index + 2].toSimd();
+    simd::float4 w = quats[index + 3].toSimd();
+    simd::transpose(i, j, k, w);
+
+    normalizeLanes(i, j, k, w);
+
+    simd::transpose(i, j, k, w);
+    quats[index] = quaternion::fromSimd(i);
+    quats[index + 1] = quaternion::fromSimd(j);
+    quats[index + 2] = quaternion::fromSimd(k);
+    quats[index + 3] = quaternion::fromSimd(w);
+  }
+
+  for (; index < count; index++)
+    quats[index] = normalize(quats[index]);
+}
+
+/**
+ * Integrates every quaternion in place by the angular velocity with the same index.
+ */
+inline void integrate(std::span<quaternion> quats, std::span<const vector3> angular, float dt)
+{
+  assert(quats.size() == angular.size());
+
+  simd::float4 halfDt = simd::splat(0.5f * dt);
+  int count = static_cast<int>(quats.size());
+  for (int index = 0; index < count; index += 4)
+  {
+    // The leftovers are padded with identity quaternions that don't spin.
+    simd::float4 q[4];
+    simd::float4 v[4];
+    for (int n = 0; n < 4; n++)
+    {
+      bool valid = index + n < count;
+      q[n] = valid ? quats[index + n].toSimd() : quaternion().toSimd();
+      v[n] = valid ? angular[index + n].toSimd() : simd::splat(0.0f);
+    }
+
+    simd::transpose(q[0], q[1], q[2], q[3]);
+    simd::transpose(v[0], v[1], v[2], v[3]);
+
+    integrateLanes(q[0], q[1], q[2], q[3], v[0], v[1], v[2], halfDt);
+
+    simd::transpose(q[0], q[1], q[2], q[3]);
+    for (int n = 0; n < 4 && index + n < count; n++)
+      quats[index + n] = quaternion::fromSimd(q[n]);
+  }
+}
+
+/**
+ * Blends two arrays of quaternions into a third, using either nlerp or slerp lanes.
+ */
+template <typename Kernel>
+inline void blend(std::span<const quaternion> from, std::span<const quaternion> to,
+                  std::span<quaternion> res, Kernel kernel)
+{
+  assert(from.size() == to.size() && from.size() == res.size());
+
+  int count = static_cast<int>(from.size());
+  for (int index = 0; index < count; index += 4)
+  {
+    simd::float4 a[4];
+    simd::float4 b[4];
+    for (int n = 0; n < 4; n++)
+    {
+      bool valid = index + n < count;
+      a[n] = valid ? from[index + n].toSimd() : quaternion().toSimd();
+      b[n] = valid ? to[index + n].toSimd() : quaternion().toSimd();
+    }
+
+    simd::transpose(a[0], a[1], a[2], a[3]);
+    simd::transpose(b[0], b[1], b[2], b[3]);
+
+    kernel(a[0], a[1], a[2], a[3], b[0], b[1], b[2], b[3]);
+
+    simd::transpose(a[0], a[1], a[2], a[3]);
+    for (int n = 0; n < 4 && index + n < count; n++)
+      res[index + n] = quaternion::fromSimd(a[n]);
+  }
+}
+
+/**
+ * Normalized linear interpolation from each quaternion to the one with the same index, along the
+ * shorter path. This is cheap and plenty accurate for the small differences between frames.
+ */
+inline void nlerp(std::span<const quaternion> from, std::span<const quaternion> to, float t,
+                  std::span<quaternion> res)
+{
+  simd::float4 weight = simd::splat(t);
+  blend(from, to, res,
+        [weight](simd::float4& ai, simd::float4& aj, simd::float4& ak, simd::float4& aw,
+                 simd::float4 bi, simd::float4 bj, simd::float4 bk, simd::float4 bw)
+        { nlerpLanes(ai, aj, ak, aw, bi, bj, bk, bw, weight); });
+}
+
+/**
+ * Spherical linear interpolation from each quaternion to the one with the same index, which moves
+ * at a constant angular speed.
+ */
+inline void slerp(std::span<const quaternion> from, std::span<const quaternion> to, float t,
+                  std::span<quaternion> res)
+{
+  blend(from, to, res,
+        [t](simd::float4& ai, simd::float4& aj, simd::float4& ak, simd::float4& aw,
+            simd::float4 bi, simd::float4 bj, simd::float4 bk, simd::float4 bw)
+        { slerpLanes(ai, aj, ak, aw, bi, bj, bk, bw, t); });
+}
+
+} // namespace flexor
\ No newline at end of file
@@ -0,0 +1,572 @@
+#pragma once
+
+#include <cmath>
+#include <type_traits>
+
+// ----- Backend Selection -----
+
+// The backend can be forced by defining one of FLEXOR_SIMD_SCALAR, FLEXOR_SIMD_SSE, or
+// FLEXOR_SIMD_AVX2 (the FLEXOR_SIMD cmake option does this). Otherwise, we pick the widest backend
+// that the compiler has been told it can target.
+#if !defined(FLEXOR_SIMD_SCALAR) && !defined(FLEXOR_SIMD_SSE) && !defined(FLEXOR_SIMD_AVX2)
+#if defined(__AVX2__) && defined(__FMA__)
+#define FLEXOR_SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FLEXOR_SIMD_SSE
+#else
+#define FLEXOR_SIMD_SCALAR
+#endif
+#endif
+
+#if defined(FLEXOR_SIMD_AVX2)
+#include <immintrin.h>
+#elif defined(FLEXOR_SIMD_SSE)
+#include <emmintrin.h>
+#endif
+
+namespace flexor::simd
+{
+
+// ----- Float4 Type -----
+
+/**
+ * A register of four floats. This is the building block of the small vector, quaternion, and small
+ * matrix types, which all store their components in one or more 16 byte aligned groups of four
+ * floats. The SSE backend only relies on SSE2, the AVX2 backend adds fused multiply-add, and the
+ * scalar backend does the same math one lane at a time so that every backend gives the same
+ * results (up to fused rounding).
+ */
+struct float4
+{
+#if defined(FLEXOR_SIMD_SCALAR)
+  float v[4];
+#else
+  __m128 v;
+#endif
+};
+
+// ----- Loads and Stores -----
+
+/**
+ * Loads four floats from a 16 byte aligned address.
+ */
+inline float4 load(const float* ptr)
+{
+#if defined(FLEXOR_SIMD_SCALAR)
+  return {ptr[0], ptr[1], ptr[2], ptr[3]};
+#else
+  return {_mm_load_ps(ptr)};
+#endif
+}
+
+/**
+ * Loads four floats from an address with any alignment.
+ */
+inline float4 loadUnaligned(const float* ptr)
+{
+#if defined(FLEXOR_SIMD_SCALAR)
+  return {ptr[0], ptr[1], ptr[2], ptr[3]};
+#else
+  return {_mm_loadu_ps(ptr)};
+#endif
+}
+
+/**
+ * Stores four floats to a 16 byte aligned address.
+ */
+inline void store(float* ptr, float4 a)
+{
+#if defined(FLEXOR_SIMD_SCALAR)
+  for (int i = 0; i < 4; i++)
+    ptr[i] = a.v[i];
+#else
+  _mm_store_ps(ptr, a.v);
+#endif
+}
+
+/**
+ * Stores four floats to an address with any alignment.
+ */
+inline void storeUnaligned(float* ptr, float4 a)
+{
+#if defined(FLEXOR_SIMD_SCALAR)
+  for (int i = 0; i < 4; i++)
+    ptr[i] = a.v[i];
+#else
+  _mm_storeu_ps(ptr, a.v);
+#endif
+}
+
+inline float4 set(float x, float y, float z, float w)
+{
+#if defined(FLEXOR_SIMD_SCALAR)
+  return {x, y, z, w};
+#else
+  return {_mm_setr_ps(x, y, z, w)};
+#endif
+}
+
+inline float4 splat(float s)
+{
+#if defined(FLEXOR_SIMD_SCALAR)
+  return {s, s, s, s};
+#else
+  return {_mm_set1_ps(s)};
+#endif
+}
+
+inline float lane(float4 a, int index)
+{
+#if defined(FLEXOR_SIMD_SCALAR)
+  return a.v[index];
+#else
+  alignas(16) float lanes[4];
+  _mm_store_ps(lanes, a.v);
+  return lanes[index];
+#endif
+}
+
+// ----- Arithmetic -----
+
+// Each operation is written once per backend. The scalar versions are simple enough that the
+// compiler is free to auto-vectorize them on targets we don't have a backend for.
+
+#if defined(FLEXOR_SIMD_SCALAR)
+#define FLEXOR_SIMD_LANEWISE(expr)                                                                 \
+  float4 res;                                                                                      \
+  for (int i = 0; i < 4; i++)                                                                      \
+    res.v[i] = (expr);                                                                             \
+  return res;
+#endif
+
+inline float4 operator+(float4 a, float4 b)
+{
+#if defined(FLEXOR_SIMD_SCALAR)
+  FLEXOR_SIMD_LANEWISE(a.v[i] + b.v[i])
+#else
+  return {_mm_add_ps(a.v, b.v)};
+#endif
+}
+
+inline float4 operator-(float4 a, float4 b)
+{
+#if defined(FLEXOR_SIMD_SCALAR)
+  FLEXOR_SIMD_LANEWISE(a.v[i] - b.v[i])
+#else
+  return {_mm_sub_ps(a.v, b.v)};
+#endif
+}
+
+inline float4 operator*(float4 a, float4 b)
+{
+#if defined(FLEXOR_SIMD_SCALAR)
+  FLEXOR_SIMD_LANEWISE(a.v[i] * b.v[i])
+#else
+  return {_mm_mul_ps(a.v, b.v)};
+#endif
+}
+
+inline float4 operator/(float4 a, float4 b)
+{
+#if defined(FLEXOR_SIMD_SCALAR)
+  FLEXOR_SIMD_LANEWISE(a.v[i] / b.v[i])
+#else
+  return {_mm_div_ps(a.v, b.v)};
+#endif
+}
+
+/**
+ * Computes a * b + c, fused into a single instruction when the backend supports it.
+ */
+inline float4 multiplyAdd(float4 a, float4 b, float4 c)
+{
+#if defined(FLEXOR_SIMD_SCALAR)
+  FLEXOR_SIMD_LANEWISE(a.v[i] * b.v[i] + c.v[i])
+#elif defined(FLEXOR_SIMD_AVX2)
+  return {_mm_fmadd_ps(a.v, b.v, c.v)};
+#else
+  return {_mm_add_ps(_mm_mul_ps(a.v, b.v), c.v)};
+#endif
+}
+
+inline float4 min(float4 a, float4 b)
+{
+#if defined(FLEXOR_SIMD_SCALAR)
+  FLEXOR_SIMD_LANEWISE(a.v[i] < b.v[i] ? a.v[i] : b.v[i])
+#else
+  return {_mm_min_ps(a.v, b.v)};
+#endif
+}
+
+inline float4 max(float4 a, float4 b)
+{
+#if defined(FLEXOR_SIMD_SCALAR)
+  FLEXOR_SIMD_LANEWISE(a.v[i] > b.v[i] ? a.v[i] : b.v[i])
+#else
+  return {_mm_max_ps(a.v, b.v)};
+#endif
+}
+
+inline float4 sqrt(float4 a)
+{
+#if defined(FLEXOR_SIMD_SCALAR)
+  FLEXOR_SIMD_LANEWISE(std::sqrt(a.v[i]))
+#else
+  return {_mm_sqrt_ps(a.v)};
+#endif
+}
+
+/**
+ * Computes 1 / sqrt(a). The SIMD backends refine the hardware estimate with one newton step, which
+ * is accurate to about 22 bits and much cheaper than a square root and a division.
+ */
+inline float4 inverseSqrt(float4 a)
+{
+#if defined(FLEXOR_SIMD_SCALAR)
+  FLEXOR_SIMD_LANEWISE(1.0f / std::sqrt(a.v[i]))
+#else
+  __m128 y = _mm_rsqrt_ps(a.v);
+  __m128 ayy = _mm_mul_ps(_mm_mul_ps(a.v, y), y);
+  return {_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), y), _mm_sub_ps(_mm_set1_ps(3.0f), ayy))};
+#endif
+}
+
+/**
+ * Negates each lane of a where the same lane of b is negative.
+ */
+inline float4 flipSign(float4 a, float4 b)
+{
+#if defined(FLEXOR_SIMD_SCALAR)
+  FLEXOR_SIMD_LANEWISE(std::signbit(b.v[i]) ? -a.v[i] : a.v[i])
+#else
+  return {_mm_xor_ps(a.v, _mm_and_ps(b.v, _mm_set1_ps(-0.0f)))};
+#endif
+}
+
+/**
+ * Zeroes the last lane of a register, and keeps the other three.
+ */
+inline float4 clearLast(float4 a)
+{
+#if defined(FLEXOR_SIMD_SCALAR)
+  return {a.v[0], a.v[1], a.v[2], 0.0f};
+#else
+  return {_mm_and_ps(a.v, _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1)))};
+#endif
+}
+
+// ----- Shuffles -----
+
+/**
+ * Rearranges the lanes of a register, so that lane n of the result is lane In of the input.
+ */
+template <int I0, int I1, int I2, int I3> inline float4 shuffle(float4 a)
+{
+#if defined(FLEXOR_SIMD_SCALAR)
+  return {a.v[I0], a.v[I1], a.v[I2], a.v[I3]};
+#else
+  return {_mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(I3, I2, I1, I0))};
+#endif
+}
+
+/**
+ * Broadcasts lane I of a register to every lane.
+ */
+template <int I> inline float4 broadcast(float4 a)
+{
+  return shuffle<I, I, I, I>(a);
+}
+
+/**
+ * Transposes the 4x4 matrix whose columns (or rows) are the four given registers in place.
+ */
+inline void transpose(float4& a, float4& b, float4& c, float4& d)
+{
+#if defined(FLEXOR_SIMD_SCALAR)
+  float4 rows[4] = {a, b, c, d};
+  for (int i = 0; i < 4; i++)
+  {
+    a.v[i] = rows[i].v[0];
+    b.v[i] = rows[i].v[1];
+    c.v[i] = rows[i].v[2];
+    d.v[i] = rows[i].v[3];
+  }
+#else
+  _MM_TRANSPOSE4_PS(a.v, b.v, c.v, d.v);
+#endif
+}
+
+/**
+ * Takes the cross product of the first three lanes of two registers. The fourth lane of the result
+ * is a3 * b3 - a3 * b3, which is zero for finite inputs.
+ */
+inline float4 cross3(float4 a, float4 b)
+{
+  // https://en.wikipedia.org/wiki/Cross_product
+  // We compute both products with shuffles as (yzx * zxy) - (zxy * yzx).
+  return shuffle<1, 2, 0, 3>(a) * shuffle<2, 0, 1, 3>(b) -
+         shuffle<2, 0, 1, 3>(a) * shuffle<1, 2, 0, 3>(b);
+}
+
+// ----- Reductions -----
+
+/**
+ * Adds the four lanes of a register together.
+ */
+inline float sum(float4 a)
+{
+#if defined(FLEXOR_SIMD_SCALAR)
+  return (a.v[0] + a.v[1]) + (a.v[2] + a.v[3]);
+#else
+  __m128 pairs = _mm_add_ps(a.v, _mm_movehl_ps(a.v, a.v));
+  return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, _MM_SHUFFLE(1, 1, 1, 1))));
+#endif
+}
+
+/**
+ * Adds the first three lanes of a register together, ignoring the fourth.
+ */
+inline float sum3(float4 a)
+{
+#if defined(FLEXOR_SIMD_SCALAR)
+  return (a.v[0] + a.v[1]) + a.v[2];
+#else
+  __m128 y = _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(1, 1, 1, 1));
+  __m128 z = _mm_movehl_ps(a.v, a.v);
+  return _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(a.v, y), z));
+#endif
+}
+
+/**
+ * Returns whether every lane of a equals the same lane of b.
+ */
+inline bool equal(float4 a, float4 b)
+{
+#if defined(FLEXOR_SIMD_SCALAR)
+  return a.v[0] == b.v[0] && a.v[1] == b.v[1] && a.v[2] == b.v[2] && a.v[3] == b.v[3];
+#else
+  return _mm_movemask_ps(_mm_cmpeq_ps(a.v, b.v)) == 0xF;
+#endif
+}
+
+/**
+ * Returns whether the first three lanes of a equal the same lanes of b.
+ */
+inline bool equal3(float4 a, float4 b)
+{
+#if defined(FLEXOR_SIMD_SCALAR)
+  return a.v[0] == b.v[0] && a.v[1] == b.v[1] && a.v[2] == b.v[2];
+#else
+  return (_mm_movemask_ps(_mm_cmpeq_ps(a.v, b.v)) & 0x7) == 0x7;
+#endif
+}
+
+/**
+ * Returns a bit mask with bit i set when lane i of a is less than or equal to lane i of b. Masks
+ * from several comparisons can be combined with bitwise operators, and the set bits walked to find
+ * the lanes that passed.
+ */
+inline int lessEqualMask(float4 a, float4 b)
+{
+#if defined(FLEXOR_SIMD_SCALAR)
+  return (a.v[0] <= b.v[0]) | (a.v[1] <= b.v[1]) << 1 | (a.v[2] <= b.v[2]) << 2 |
+         (a.v[3] <= b.v[3]) << 3;
+#else
+  return _mm_movemask_ps(_mm_cmple_ps(a.v, b.v));
+#endif
+}
+
+// ----- Wide Float Type -----
+
+/**
+ * The widest register the backend has, which is eight floats on AVX2 and four otherwise. This is
+ * meant for batched kernels that work on many independent problems at once, with one problem per
+ * lane, so they only need the lanewise arithmetic below and never shuffle across lanes.
+ */
+#if defined(FLEXOR_SIMD_AVX2)
+struct floatv
+{
+  __m256 v;
+};
+
+constexpr int wideLanes = 8;
+
+inline floatv loadWide(const float* ptr)
+{
+  return {_mm256_loadu_ps(ptr)};
+}
+
+inline void storeWide(float* ptr, floatv a)
+{
+  _mm256_storeu_ps(ptr, a.v);
+}
+
+inline floatv splatWide(float s)
+{
+  return {_mm256_set1_ps(s)};
+}
+
+inline floatv operator+(floatv a, floatv b)
+{
+  return {_mm256_add_ps(a.v, b.v)};
+}
+
+inline floatv operator-(floatv a, floatv b)
+{
+  return {_mm256_sub_ps(a.v, b.v)};
+}
+
+inline floatv operator*(floatv a, floatv b)
+{
+  return {_mm256_mul_ps(a.v, b.v)};
+}
+
+inline floatv operator/(floatv a, floatv b)
+{
+  return {_mm256_div_ps(a.v, b.v)};
+}
+
+inline floatv multiplyAdd(floatv a, floatv b, floatv c)
+{
+  return {_mm256_fmadd_ps(a.v, b.v, c.v)};
+}
+
+inline floatv min(floatv a, floatv b)
+{
+  return {_mm256_min_ps(a.v, b.v)};
+}
+
+inline floatv max(floatv a, floatv b)
+{
+  return {_mm256_max_ps(a.v, b.v)};
+}
+
+inline floatv inverseSqrt(floatv a)
+{
+  __m256 y = _mm256_rsqrt_ps(a.v);
+  __m256 ayy = _mm256_mul_ps(_mm256_mul_ps(a.v, y), y);
+  return {_mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), y),
+                        _mm256_sub_ps(_mm256_set1_ps(3.0f), ayy))};
+}
+
+inline floatv flipSign(floatv a, floatv b)
+{
+  return {_mm256_xor_ps(a.v, _mm256_and_ps(b.v, _mm256_set1_ps(-0.0f)))};
+}
+
+inline int lessEqualMask(floatv a, floatv b)
+{
+  return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ));
+}
+#else
+using floatv = float4;
+
+constexpr int wideLanes = 4;
+
+inline floatv loadWide(const float* ptr)
+{
+  return loadUnaligned(ptr);
+}
+
+inline void storeWide(float* ptr, floatv a)
+{
+  storeUnaligned(ptr, a);
+}
+
+inline floatv splatWide(float s)
+{
+  return splat(s);
+}
+#endif
+
+// ----- Wide Transposes -----
+
+/**
+ * Turns wideLanes vectors, each held in the first three lanes of a register, into three wide
+ * registers with the x, y, and z of every vector. This is how a batched kernel gathers vectors from
+ * an array of structures.
+ */
+inline void transposeToWide(const float4* rows, floatv& x, floatv& y, floatv& z)
+{
+  float4 a = rows[0], b = rows[1], c = rows[2], d = rows[3];
+  transpose(a, b, c, d);
+
+#if defined(FLEXOR_SIMD_AVX2)
+  float4 e = rows[4], f = rows[5], g = rows[6], h = rows[7];
+  transpose(e, f, g, h);
+
+  x = {_mm256_insertf128_ps(_mm256_castps128_ps256(a.v), e.v, 1)};
+  y = {_mm256_insertf128_ps(_mm256_castps128_ps256(b.v), f.v, 1)};
+  z = {_mm256_insertf128_ps(_mm256_castps128_ps256(c.v), g.v, 1)};
+#else
+  x = a;
+  y = b;
+  z = c;
+#endif
+}
+
+/**
+ * The inverse of transposeToWide, which scatters three wide registers back out to wideLanes
+ * vectors. The last lane of each vector is zero.
+ */
+inline void transposeFromWide(floatv x, floatv y, floatv z, float4* rows)
+{
+#if defined(FLEXOR_SIMD_AVX2)
+  float4 a = {_mm256_castps256_ps128(x.v)}, b = {_mm256_castps256_ps128(y.v)};
+  float4 c = {_mm256_castps256_ps128(z.v)}, d = splat(0.0f);
+  float4 e = {_mm256_extractf128_ps(x.v, 1)}, f = {_mm256_extractf128_ps(y.v, 1)};
+  float4 g = {_mm256_extractf128_ps(z.v, 1)}, h = splat(0.0f);
+
+  transpose(e, f, g, h);
+  rows[4] = e;
+  rows[5] = f;
+  rows[6] = g;
+  rows[7] = h;
+#else
+  float4 a = x, b = y, c = z, d = splat(0.0f);
+#endif
+
+  transpose(a, b, c, d);
+  rows[0] = a;
+  rows[1] = b;
+  rows[2] = c;
+  rows[3] = d;
+}
+
+// ----- Generic Register Access -----
+
+// Lanewise kernels can be written once as templates over the register type, and then run on four
+// lanes at a time (float4) or as wide as the backend allows (floatv). These pick the right load,
+// store, and splat for either type.
+
+template <typename V> constexpr int lanesOf = std::is_same_v<V, float4> ? 4 : wideLanes;
+
+template <typename V> inline V loadAs(const float* ptr)
+{
+  if constexpr (std::is_same_v<V, float4>)
+    return loadUnaligned(ptr);
+  else
+    return loadWide(ptr);
+}
+
+template <typename V> inline void storeAs(float* ptr, V a)
+{
+  if constexpr (std::is_same_v<V, float4>)
+    storeUnaligned(ptr, a);
+  else
+    storeWide(ptr, a);
+}
+
+template <typename V> inline V splatAs(float s)
+{
+  if constexpr (std::is_same_v<V, float4>)
+    return splat(s);
+  else
+    return splatWide(s);
+}
+
+#if defined(FLEXOR_SIMD_SCALAR)
+#undef FLEXOR_SIMD_LANEWISE
+#endif
+
+} // namespace flexor::simd
\ No newline at end of file
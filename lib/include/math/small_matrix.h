@@ -1,9 +1,13 @@
 #pragma once
 
 #include <cassert>
+#include <cmath>
+#include <concepts>
+#include <utility>
 
 #include "base.h"
 #include "matrix.h"
+#include "simd.h"
 #include "vector.h"
 
 namespace flexor
@@ -13,12 +17,12 @@ namespace flexor
 
 // clang-format off
 
-template <typename T> inline typename std::enable_if<std::is_base_of<base::matrix, T>::value, T>::type operator+(const T& lhs, const T& rhs);
-template <typename T> inline typename std::enable_if<std::is_base_of<base::matrix, T>::value, T>::type operator-(const T& lhs, const T& rhs);
-template <typename T> inline typename std::enable_if<std::is_base_of<base::matrix, T>::value, T>::type operator*(const T& lhs, const T& rhs);
-template <typename T> inline typename std::enable_if<std::is_base_of<base::matrix, T>::value, T>::type operator*(const T& mat, float scalar);
-template <typename T> inline typename std::enable_if<std::is_base_of<base::matrix, T>::value, T>::type operator*(float scalar, const T& mat);
-template <typename T> inline typename std::enable_if<std::is_base_of<base::matrix, T>::value, T>::type operator/(const T& mat, float scalar);
+template <typename T> inline typename std::enable_if<base::is_small_matrix<T>, T>::type operator+(const T& lhs, const T& rhs);
+template <typename T> inline typename std::enable_if<base::is_small_matrix<T>, T>::type operator-(const T& lhs, const T& rhs);
+template <typename T> inline typename std::enable_if<base::is_small_matrix<T>, T>::type operator*(const T& lhs, const T& rhs);
+template <typename T> inline typename std::enable_if<base::is_small_matrix<T>, T>::type operator*(const T& mat, float scalar);
+template <typename T> inline typename std::enable_if<base::is_small_matrix<T>, T>::type operator*(float scalar, const T& mat);
+template <typename T> inline typename std::enable_if<base::is_small_matrix<T>, T>::type operator/(const T& mat, float scalar);
 
 // clang-format on
 
@@ -114,10 +118,439 @@ private:
   T cols[N];
 };
 
+// ----- SIMD Kernels -----
+
+// The columns of matrix3 and matrix4 each fill one SIMD register, so their products and transposes
+// can be done entirely in registers. Other column types fall back to the generic loops.
+template <typename T>
+concept simd_column = requires(const T& col) {
+  { col.toSimd() } -> std::same_as<simd::float4>;
+};
+
+/**
+ * Multiplies a matrix by a column vector. The result is the sum of the columns of the matrix
+ * weighted by the components of the vector, which is a multiply-add per column.
+ */
+template <typename T, int N> inline T operator*(const small_matrix<T, N>& mat, const T& vec)
+{
+  if constexpr (simd_column<T> && (N == 3 || N == 4))
+  {
+    simd::float4 v = vec.toSimd();
+    simd::float4 res = mat[0].toSimd() * simd::broadcast<0>(v);
+    res = simd::multiplyAdd(mat[1].toSimd(), simd::broadcast<1>(v), res);
+    res = simd::multiplyAdd(mat[2].toSimd(), simd::broadcast<2>(v), res);
+    if constexpr (N == 4)
+      res = simd::multiplyAdd(mat[3].toSimd(), simd::broadcast<3>(v), res);
+
+    return T::fromSimd(res);
+  }
+  else
+  {
+    T res = mat[0] * vec[0];
+    for (int i = 1; i < N; i++)
+      res += mat[i] * vec[i];
+
+    return res;
+  }
+}
+
+/**
+ * Multiplies two matrices. Each column of the product is lhs times the same column of rhs, so this
+ * reuses the matrix-vector kernel instead of transposing and taking dot products.
+ */
+template <typename T, int N>
+inline small_matrix<T, N> operator*(const small_matrix<T, N>& lhs, const small_matrix<T, N>& rhs)
+{
+  small_matrix<T, N> res(0.0f);
+  for (int i = 0; i < N; i++)
+    res[i] = lhs * rhs[i];
+
+  return res;
+}
+
+template <typename T, int N> inline small_matrix<T, N> transpose(const small_matrix<T, N>& mat)
+{
+  small_matrix<T, N> res(0.0f);
+  if constexpr (simd_column<T> && (N == 3 || N == 4))
+  {
+    // A matrix3 is transposed as a 4x4 matrix with a zero last column. The padding lanes of its
+    // columns are zero, so the padding lanes of the result are too.
+    simd::float4 c0 = mat[0].toSimd();
+    simd::float4 c1 = mat[1].toSimd();
+    simd::float4 c2 = mat[2].toSimd();
+    simd::float4 c3 = simd::splat(0.0f);
+    if constexpr (N == 4)
+      c3 = mat[3].toSimd();
+
+    simd::transpose(c0, c1, c2, c3);
+    res[0] = T::fromSimd(c0);
+    res[1] = T::fromSimd(c1);
+    res[2] = T::fromSimd(c2);
+    if constexpr (N == 4)
+      res[3] = T::fromSimd(c3);
+  }
+  else
+  {
+    for (int i = 0; i < N; i++)
+      for (int j = 0; j < N; j++)
+        res[j][i] = mat[i][j];
+  }
+
+  return res;
+}
+
+// ----- Determinant and Inverse -----
+
+// The sizes we care about are known at compile time, so 2, 3, and 4 get closed forms, and larger
+// sizes fall back to elimination loops with constant bounds that the compiler can unroll. The
+// elimination works on a plain array copy of the matrix, indexed as a[row][col].
+
+template <typename T, int N>
+inline void loadElements(const small_matrix<T, N>& mat, float (&a)[N][N])
+{
+  for (int c = 0; c < N; c++)
+  {
+    T col = mat[c];
+    for (int r = 0; r < N; r++)
+      a[r][c] = col[r];
+  }
+}
+
+template <typename T, int N>
+inline small_matrix<T, N> storeElements(const float (&a)[N][N])
+{
+  small_matrix<T, N> res(0.0f);
+  for (int c = 0; c < N; c++)
+    for (int r = 0; r < N; r++)
+      res[c][r] = a[r][c];
+
+  return res;
+}
+
+template <typename T, int N> inline float determinant(const small_matrix<T, N>& mat)
+{
+  if constexpr (N == 2)
+  {
+    return mat[0][0] * mat[1][1] - mat[1][0] * mat[0][1];
+  }
+  else if constexpr (N == 3)
+  {
+    return dot(mat[0], cross(mat[1], mat[2]));
+  }
+  else
+  {
+    // Reduce to upper triangular form with partial pivoting, and take the product of the diagonal.
+    float a[N][N];
+    loadElements(mat, a);
+
+    float det = 1.0f;
+    for (int k = 0; k < N; k++)
+    {
+      int pivot = k;
+      for (int r = k + 1; r < N; r++)
+        if (std::fabs(a[r][k]) > std::fabs(a[pivot][k]))
+          pivot = r;
+
+      if (a[pivot][k] == 0.0f)
+        return 0.0f;
+
+      if (pivot != k)
+      {
+        for (int c = k; c < N; c++)
+          std::swap(a[k][c], a[pivot][c]);
+        det = -det;
+      }
+
+      det *= a[k][k];
+      float inverse = 1.0f / a[k][k];
+      for (int r = k + 1; r < N; r++)
+      {
+        float scale = a[r][k] * inverse;
+        for (int c = k + 1; c < N; c++)
+          a[r][c] -= scale * a[k][c];
+      }
+    }
+
+    return det;
+  }
+}
+
+/**
+ * Inverts a matrix. The matrix must not be singular.
+ */
+template <typename T, int N> inline small_matrix<T, N> inverse(const small_matrix<T, N>& mat)
+{
+  if constexpr (N == 2)
+  {
+    float det = determinant(mat);
+    assert(det != 0.0f);
+
+    float invDet = 1.0f / det;
+    small_matrix<T, N> res(0.0f);
+    res[0] = T(mat[1][1], -mat[0][1]) * invDet;
+    res[1] = T(-mat[1][0], mat[0][0]) * invDet;
+    return res;
+  }
+  else if constexpr (N == 3)
+  {
+    // The rows of the inverse are the cross products of pairs of columns, divided by the
+    // determinant (which is the triple product of the columns).
+    T r0 = cross(mat[1], mat[2]);
+    T r1 = cross(mat[2], mat[0]);
+    T r2 = cross(mat[0], mat[1]);
+
+    float det = dot(mat[0], r0);
+    assert(det != 0.0f);
+
+    small_matrix<T, N> rows(0.0f);
+    rows[0] = r0;
+    rows[1] = r1;
+    rows[2] = r2;
+    return transpose(rows) * (1.0f / det);
+  }
+  else if constexpr (N == 4)
+  {
+    // Expand by the 2x2 minors of the top two rows and the bottom two rows, which are shared by
+    // every cofactor.
+    float a[4][4];
+    loadElements(mat, a);
+
+    float s0 = a[0][0] * a[1][1] - a[1][0] * a[0][1];
+    float s1 = a[0][0] * a[1][2] - a[1][0] * a[0][2];
+    float s2 = a[0][0] * a[1][3] - a[1][0] * a[0][3];
+    float s3 = a[0][1] * a[1][2] - a[1][1] * a[0][2];
+    float s4 = a[0][1] * a[1][3] - a[1][1] * a[0][3];
+    float s5 = a[0][2] * a[1][3] - a[1][2] * a[0][3];
+
+    float c5 = a[2][2] * a[3][3] - a[3][2] * a[2][3];
+    float c4 = a[2][1] * a[3][3] - a[3][1] * a[2][3];
+    float c3 = a[2][1] * a[3][2] - a[3][1] * a[2][2];
+    float c2 = a[2][0] * a[3][3] - a[3][0] * a[2][3];
+    float c1 = a[2][0] * a[3][2] - a[3][0] * a[2][2];
+    float c0 = a[2][0] * a[3][1] - a[3][0] * a[2][1];
+
+    float det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+    assert(det != 0.0f);
+    float invDet = 1.0f / det;
+
+    float b[4][4] = {
+      {a[1][1] * c5 - a[1][2] * c4 + a[1][3] * c3, -a[0][1] * c5 + a[0][2] * c4 - a[0][3] * c3,
+       a[3][1] * s5 - a[3][2] * s4 + a[3][3] * s3, -a[2][1] * s5 + a[2][2] * s4 - a[2][3] * s3},
+      {-a[1][0] * c5 + a[1][2] * c2 - a[1][3] * c1, a[0][0] * c5 - a[0][2] * c2 + a[0][3] * c1,
+       -a[3][0] * s5 + a[3][2] * s2 - a[3][3] * s1, a[2][0] * s5 - a[2][2] * s2 + a[2][3] * s1},
+      {a[1][0] * c4 - a[1][1] * c2 + a[1][3] * c0, -a[0][0] * c4 + a[0][1] * c2 - a[0][3] * c0,
+       a[3][0] * s4 - a[3][1] * s2 + a[3][3] * s0, -a[2][0] * s4 + a[2][1] * s2 - a[2][3] * s0},
+      {-a[1][0] * c3 + a[1][1] * c1 - a[1][2] * c0, a[0][0] * c3 - a[0][1] * c1 + a[0][2] * c0,
+       -a[3][0] * s3 + a[3][1] * s1 - a[3][2] * s0, a[2][0] * s3 - a[2][1] * s1 + a[2][2] * s0}};
+
+    return storeElements<T, N>(b) * invDet;
+  }
+  else
+  {
+    // Gauss-jordan elimination with partial pivoting, applied to the identity alongside.
+    float a[N][N];
+    float b[N][N] = {};
+    loadElements(mat, a);
+    for (int k = 0; k < N; k++)
+      b[k][k] = 1.0f;
+
+    for (int k = 0; k < N; k++)
+    {
+      int pivot = k;
+      for (int r = k + 1; r < N; r++)
+        if (std::fabs(a[r][k]) > std::fabs(a[pivot][k]))
+          pivot = r;
+
+      assert(a[pivot][k] != 0.0f);
+      if (pivot != k)
+        for (int c = 0; c < N; c++)
+        {
+          std::swap(a[k][c], a[pivot][c]);
+          std::swap(b[k][c], b[pivot][c]);
+        }
+
+      float inverse = 1.0f / a[k][k];
+      for (int c = 0; c < N; c++)
+      {
+        a[k][c] *= inverse;
+        b[k][c] *= inverse;
+      }
+
+      for (int r = 0; r < N; r++)
+      {
+        if (r == k)
+          continue;
+
+        float scale = a[r][k];
+        for (int c = 0; c < N; c++)
+        {
+          a[r][c] -= scale * a[k][c];
+          b[r][c] -= scale * b[k][c];
+        }
+      }
+    }
+
+    return storeElements<T, N>(b);
+  }
+}
+
+// ----- Factorizations -----
+
+/**
+ * Computes the cholesky factorization A = L * L^T of a symmetric positive definite matrix, and
+ * returns the lower triangular L. Only the lower triangle of A is read.
+ */
+template <typename T, int N> inline small_matrix<T, N> cholesky(const small_matrix<T, N>& mat)
+{
+  float a[N][N];
+  float l[N][N] = {};
+  loadElements(mat, a);
+
+  for (int j = 0; j < N; j++)
+  {
+    float diagonal = a[j][j];
+    for (int k = 0; k < j; k++)
+      diagonal -= l[j][k] * l[j][k];
+
+    assert(diagonal > 0.0f);
+    l[j][j] = std::sqrt(diagonal);
+
+    float inverse = 1.0f / l[j][j];
+    for (int i = j + 1; i < N; i++)
+    {
+      float value = a[i][j];
+      for (int k = 0; k < j; k++)
+        value -= l[i][k] * l[j][k];
+
+      l[i][j] = value * inverse;
+    }
+  }
+
+  return storeElements<T, N>(l);
+}
+
+/**
+ * Solves A * x = b, given the cholesky factor L of A.
+ */
+template <typename T, int N> inline T choleskySolve(const small_matrix<T, N>& lower, const T& b)
+{
+  float l[N][N];
+  loadElements(lower, l);
+
+  // Forward substitution with L, then backward substitution with L^T.
+  float x[N];
+  for (int i = 0; i < N; i++)
+  {
+    float value = b[i];
+    for (int k = 0; k < i; k++)
+      value -= l[i][k] * x[k];
+    x[i] = value / l[i][i];
+  }
+
+  for (int i = N - 1; i >= 0; i--)
+  {
+    float value = x[i];
+    for (int k = i + 1; k < N; k++)
+      value -= l[k][i] * x[k];
+    x[i] = value / l[i][i];
+  }
+
+  T res(0.0f);
+  for (int i = 0; i < N; i++)
+    res[i] = x[i];
+
+  return res;
+}
+
+/**
+ * The factors of A = L * D * L^T, where L is unit lower triangular and D is diagonal.
+ */
+template <typename T, int N> struct ldlt_factors
+{
+  small_matrix<T, N> lower;
+  T diagonal;
+};
+
+/**
+ * Computes the LDL^T factorization of a symmetric matrix. Unlike cholesky, this takes no square
+ * roots, and still works for matrices that are only positive semi-definite or are indefinite, as
+ * long as no pivot is zero. Only the lower triangle of A is read.
+ */
+template <typename T, int N> inline ldlt_factors<T, N> ldlt(const small_matrix<T, N>& mat)
+{
+  float a[N][N];
+  float l[N][N] = {};
+  float d[N];
+  loadElements(mat, a);
+
+  for (int j = 0; j < N; j++)
+  {
+    float diagonal = a[j][j];
+    for (int k = 0; k < j; k++)
+      diagonal -= l[j][k] * l[j][k] * d[k];
+
+    assert(diagonal != 0.0f);
+    d[j] = diagonal;
+    l[j][j] = 1.0f;
+
+    float inverse = 1.0f / diagonal;
+    for (int i = j + 1; i < N; i++)
+    {
+      float value = a[i][j];
+      for (int k = 0; k < j; k++)
+        value -= l[i][k] * l[j][k] * d[k];
+
+      l[i][j] = value * inverse;
+    }
+  }
+
+  ldlt_factors<T, N> res = {storeElements<T, N>(l), T(0.0f)};
+  for (int i = 0; i < N; i++)
+    res.diagonal[i] = d[i];
+
+  return res;
+}
+
+/**
+ * Solves A * x = b, given the LDL^T factors of A.
+ */
+template <typename T, int N> inline T ldltSolve(const ldlt_factors<T, N>& factors, const T& b)
+{
+  float l[N][N];
+  loadElements(factors.lower, l);
+
+  float x[N];
+  for (int i = 0; i < N; i++)
+  {
+    float value = b[i];
+    for (int k = 0; k < i; k++)
+      value -= l[i][k] * x[k];
+    x[i] = value;
+  }
+
+  for (int i = 0; i < N; i++)
+    x[i] /= factors.diagonal[i];
+
+  for (int i = N - 1; i >= 0; i--)
+  {
+    float value = x[i];
+    for (int k = i + 1; k < N; k++)
+      value -= l[k][i] * x[k];
+    x[i] = value;
+  }
+
+  T res(0.0f);
+  for (int i = 0; i < N; i++)
+    res[i] = x[i];
+
+  return res;
+}
+
 // ----- Convenient Typenames -----
 
 using matrix2 = small_matrix<vector2>;
 using matrix3 = small_matrix<vector3>;
 using matrix4 = small_matrix<vector4>;
+using matrix6 = small_matrix<vector6>;
 
-} // namespace flexor
+} // namespace flexor
\ No newline at end of file
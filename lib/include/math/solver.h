@@ -1,9 +1,16 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <stdexcept>
+#include <vector>
 
+#include "kernels.h"
 #include "matrix.h"
+#include "simd.h"
+#include "small_matrix.h"
+#include "sparse.h"
 #include "vector.h"
 
 namespace flexor::solver
@@ -54,6 +61,9 @@ inline void performRowOperation(matrix& A, int i, int j, float scalar = 1.0f)
  * An implementation of gauss-jordan elimination to solve the linear system Ax = B, where A is a
  * known n by n matrix, B is a known n-dimensional vector, and x is an unknown x dimensional
  * vector. If A is a singular matrix, an exception is thrown.
+ *
+ * This redoes the whole elimination for every call, so when the same matrix is solved against
+ * several right hand sides, factor it once with solver::lu instead.
  */
 inline vector gaussJordan(const matrix& A, const vector& B)
 {
@@ -68,28 +78,22 @@ inline vector gaussJordan(const matrix& A, const vector& B)
 
   // Iterate over each row to perform the elimination. We use the i-th row to zero out all values in
   // the i-th column except for the diagonal, which is made to 1 using row operations.
-  for (int row = 0; row < A.rows(); row++)
+  for (int row = 0; row < n; row++)
   {
-    // If diagonal entry is zero, then we will swap with a later row to guarantee that is is.
-    if (copyA[row][row] == 0.0f)
-    {
-      bool foundRow = false;
-      int swapRow = row + 1;
-      for (; swapRow < A.rows(); swapRow++)
-      {
-        // If this row is good, then we can stop looking.
-        if (copyA[swapRow][row] != 0.0f)
-        {
-          foundRow = true;
-          break;
-        }
-      }
+    // We always swap the entry with the largest magnitude onto the diagonal (partial pivoting).
+    // Dividing by a tiny pivot would blow up the rounding error of every other entry.
+    int swapRow = row;
+    for (int other = row + 1; other < n; other++)
+      if (fabs(copyA[row][other]) > fabs(copyA[row][swapRow]))
+        swapRow = other;
 
-      // If we didn't find a row, we have none or infinite solutions. Don't handle these.
-      if (!foundRow)
-        throw new std::runtime_error("Unable to solve singular linear system!");
+    // If every candidate is zero, we have none or infinite solutions. Don't handle these.
+    if (copyA[row][swapRow] == 0.0f)
+      throw std::runtime_error("Unable to solve singular linear system!");
 
-      // Now, we need to swap this row with the current row (and do the same for the vector).
+    // Now, we need to swap this row with the current row (and do the same for the vector).
+    if (swapRow != row)
+    {
       swapRows(copyA, row, swapRow);
       float tmp = copyB[swapRow];
       copyB[swapRow] = copyB[row];
@@ -103,7 +107,7 @@ inline vector gaussJordan(const matrix& A, const vector& B)
     copyB[row] *= scale;
 
     // We'll add this to all the other row to ensure that this column is only one in current row.
-    for (int other = 0; other < A.rows(); other++)
+    for (int other = 0; other < n; other++)
     {
       // Don't add the current row to itself.
       if (row == other)
@@ -121,4 +125,754 @@ inline vector gaussJordan(const matrix& A, const vector& B)
   return copyB;
 }
 
+// ----- LU Factorization -----
+
+/**
+ * A reusable LU factorization of a square matrix A with partial pivoting, so that PA = LU where P
+ * is a permutation, L is unit lower triangular, and U is upper triangular. Factoring costs O(n^3)
+ * once, and after that every right hand side is solved in O(n^2) by a forward and a backward
+ * substitution. This is the tool of choice when the same system is solved many times, like an
+ * effective mass matrix that is fixed across solver iterations.
+ *
+ * L and U are packed into a single matrix (the unit diagonal of L is implied), and every loop runs
+ * down the contiguous columns of that matrix.
+ */
+class lu
+{
+public:
+  // Constructors
+
+  /**
+   * Factors the given matrix. Check singular() before solving.
+   */
+  lu(const matrix& A)
+    : factors(A), pivots(A.rows())
+  {
+    assert(A.rows() == A.columns());
+    factorInPlace();
+  }
+
+  // Methods
+
+  /**
+   * Factors a new matrix, reusing the storage of the last factorization if it has the same size.
+   * Returns false if the matrix is singular, in which case it can't be used to solve.
+   */
+  bool factor(const matrix& A)
+  {
+    assert(A.rows() == A.columns());
+
+    factors = A;
+    pivots.resize(A.rows());
+    return factorInPlace();
+  }
+
+  int size() const { return factors.rows(); }
+  bool singular() const { return isSingular; }
+
+  /**
+   * The determinant of the factored matrix, which is the product of the diagonal of U with a sign
+   * flip for every row swap. A singular matrix has a determinant of zero, since the elimination
+   * stops partway and leaves the rest of U unfinished.
+   */
+  float determinant() const
+  {
+    if (isSingular)
+      return 0.0f;
+
+    float det = 1.0f;
+    for (int k = 0; k < size(); k++)
+    {
+      det *= factors(k, k);
+      if (pivots[k] != k)
+        det = -det;
+    }
+
+    return det;
+  }
+
+  /**
+   * Solves Ax = b for x.
+   */
+  vector solve(const vector& b) const
+  {
+    vector x = b;
+    solveInPlace(x);
+    return x;
+  }
+
+  /**
+   * Solves Ax = b, overwriting b with x. This doesn't allocate.
+   */
+  void solveInPlace(vector& b) const
+  {
+    assert(b.length() == size());
+    solveColumn(b.data());
+  }
+
+  /**
+   * Solves AX = B for every column of B at once.
+   */
+  matrix solve(const matrix& B) const
+  {
+    matrix X = B;
+    solveInPlace(X);
+    return X;
+  }
+
+  /**
+   * Solves AX = B, overwriting B with X. This doesn't allocate.
+   */
+  void solveInPlace(matrix& B) const
+  {
+    assert(B.rows() == size());
+
+    for (int col = 0; col < B.columns(); col++)
+      solveColumn(B.data() + col * B.stride());
+  }
+
+private:
+  /**
+   * Performs the right-looking elimination on the copy of A in factors. Returns false if a column
+   * has no usable pivot.
+   */
+  bool factorInPlace()
+  {
+    int n = size();
+    int ld = factors.stride();
+    float* a = factors.data();
+
+    // A pivot is considered zero if it is lost in the rounding error of the largest entry of A.
+    float largest = 0.0f;
+    for (int col = 0; col < n; col++)
+      for (int row = 0; row < n; row++)
+        largest = fmax(largest, fabs(a[row + col * ld]));
+
+    float tolerance = static_cast<float>(n) * 1.1920929e-7f * largest;
+    isSingular = largest == 0.0f;
+
+    for (int k = 0; k < n && !isSingular; k++)
+    {
+      float* colK = a + k * ld;
+
+      // Pick the entry of largest magnitude on or below the diagonal. This scans a contiguous
+      // column.
+      int pivot = k;
+      for (int row = k + 1; row < n; row++)
+        if (fabs(colK[row]) > fabs(colK[pivot]))
+          pivot = row;
+
+      pivots[k] = pivot;
+      if (fabs(colK[pivot]) <= tolerance)
+      {
+        isSingular = true;
+        break;
+      }
+
+      if (pivot != k)
+        for (int col = 0; col < n; col++)
+          std::swap(a[k + col * ld], a[pivot + col * ld]);
+
+      // The multipliers of L go below the diagonal of column k.
+      float inverse = 1.0f / colK[k];
+      for (int row = k + 1; row < n; row++)
+        colK[row] *= inverse;
+
+      // Then we eliminate them from the trailing columns, which is an axpy down each column.
+      for (int col = k + 1; col < n; col++)
+      {
+        float* colJ = a + col * ld;
+        float scale = colJ[k];
+        for (int row = k + 1; row < n; row++)
+          colJ[row] -= colK[row] * scale;
+      }
+    }
+
+    return !isSingular;
+  }
+
+  /**
+   * Solves Ax = b for a single contiguous right hand side, in place.
+   */
+  void solveColumn(float* b) const
+  {
+    assert(!isSingular);
+
+    int n = size();
+    int ld = factors.stride();
+    const float* a = factors.data();
+
+    // Apply the row swaps in the order they were made.
+    for (int k = 0; k < n; k++)
+      if (pivots[k] != k)
+        std::swap(b[k], b[pivots[k]]);
+
+    // Forward substitution with the unit lower triangle L.
+    for (int k = 0; k < n; k++)
+    {
+      const float* colK = a + k * ld;
+      float scale = b[k];
+      for (int row = k + 1; row < n; row++)
+        b[row] -= colK[row] * scale;
+    }
+
+    // Backward substitution with the upper triangle U.
+    for (int k = n - 1; k >= 0; k--)
+    {
+      const float* colK = a + k * ld;
+      b[k] /= colK[k];
+
+      float scale = b[k];
+      for (int row = 0; row < k; row++)
+        b[row] -= colK[row] * scale;
+    }
+  }
+
+  // Fields
+
+  matrix factors;
+  std::vector<int> pivots;
+  bool isSingular = false;
+};
+
+// ----- Projected Gauss-Seidel -----
+
+/**
+ * The settings shared by the iterative constraint solvers. A relaxation above 1 over-relaxes each
+ * update, which can speed up convergence of stiff stacks, while a value below 1 damps it.
+ */
+struct pgs_settings
+{
+  int iterations = 10;
+  float relaxation = 1.0f;
+};
+
+/**
+ * The impulse limits of each row of a mixed linear complementarity problem. Each multiplier is
+ * clamped to [lower[i], upper[i]], so a contact uses [0, inf) and a bilateral joint uses (-inf,
+ * inf). If friction is given and friction[i] is not negative, row i is a friction row: upper[i] is
+ * then its friction coefficient, and its limits become +/- upper[i] * lambda[friction[i]], where
+ * friction[i] is the index of the normal row it belongs to.
+ */
+struct lcp_bounds
+{
+  const float* lower;
+  const float* upper;
+  const int* friction = nullptr;
+};
+
+/**
+ * Clamps a single multiplier to its row's limits, given the current multipliers.
+ */
+inline float clampMultiplier(const lcp_bounds& bounds, int row, float value, const float* lambda)
+{
+  if (bounds.friction && bounds.friction[row] >= 0)
+  {
+    float limit = bounds.upper[row] * lambda[bounds.friction[row]];
+    return std::clamp(value, -limit, limit);
+  }
+
+  return std::clamp(value, bounds.lower[row], bounds.upper[row]);
+}
+
+/**
+ * Solves the bounded system A * lambda = b with projected Gauss-Seidel, where A is an assembled
+ * system matrix (such as J * M^-1 * J^T from assembleSystem). Each iteration sweeps the rows once,
+ * solves each row for its own multiplier using the latest values of the others, and clamps it to
+ * the row's limits. lambda is both the initial guess and the result, so passing in the multipliers
+ * of the last step warm starts the solve. Returns the largest change of any multiplier during the
+ * last sweep.
+ */
+inline float projectedGaussSeidel(const csr_matrix& A, const float* b, const lcp_bounds& bounds,
+                                  float* lambda, const pgs_settings& settings = {})
+{
+  assert(A.rows() == A.columns());
+
+  const int* offsets = A.rowOffsets();
+  const int* indices = A.columnIndices();
+  const float* values = A.values();
+
+  // Cache the inverse of each diagonal, since the rows are revisited every iteration.
+  std::vector<float> inverseDiagonal(A.rows());
+  for (int row = 0; row < A.rows(); row++)
+  {
+    float diagonal = A.diagonal(row);
+    inverseDiagonal[row] = diagonal > 0.0f ? 1.0f / diagonal : 0.0f;
+  }
+
+  float largestChange = 0.0f;
+  for (int iteration = 0; iteration < settings.iterations; iteration++)
+  {
+    largestChange = 0.0f;
+    for (int row = 0; row < A.rows(); row++)
+    {
+      float residual = b[row];
+      for (int i = offsets[row]; i < offsets[row + 1]; i++)
+        residual -= values[i] * lambda[indices[i]];
+
+      float old = lambda[row];
+      float updated = old + settings.relaxation * residual * inverseDiagonal[row];
+      lambda[row] = clampMultiplier(bounds, row, updated, lambda);
+
+      largestChange = std::max(largestChange, std::fabs(lambda[row] - old));
+    }
+  }
+
+  return largestChange;
+}
+
+/**
+ * Solves the same bounded problem as projectedGaussSeidel, but directly on body velocities without
+ * ever assembling J * M^-1 * J^T. This is the sequential impulse formulation: each row measures the
+ * current velocity along its Jacobian, computes the impulse that drives it to b[row], clamps the
+ * accumulated impulse, and immediately applies the change to the two bodies it touches. Every
+ * iteration is therefore linear in the number of rows.
+ *
+ * linear and angular are the velocities of every body, and are updated in place. The initial
+ * multipliers in lambda are applied to the velocities first, which warm starts the solve. Returns
+ * the largest change of any multiplier during the last sweep.
+ */
+inline float sequentialImpulse(const block_jacobian& J, const float* inverseMasses,
+                               const matrix3* inverseInertias, const float* b,
+                               const lcp_bounds& bounds, float* lambda, vector3* linear,
+                               vector3* angular, const pgs_settings& settings = {})
+{
+  int rows = J.rows();
+
+  // Precompute M^-1 * J^T for both sides of each row, along with the inverse of the effective mass
+  // J * M^-1 * J^T of the row.
+  std::vector<jacobian_block> weightedA(rows);
+  std::vector<jacobian_block> weightedB(rows);
+  std::vector<float> inverseEffectiveMass(rows);
+
+  auto weigh = [&](int body, const jacobian_block& block, jacobian_block& weighted)
+  {
+    if (body < 0)
+      return 0.0f;
+
+    weighted.linear = block.linear * inverseMasses[body];
+    weighted.angular = inverseInertias[body] * block.angular;
+    return dot(block.linear, weighted.linear) + dot(block.angular, weighted.angular);
+  };
+
+  auto apply = [&](int body, const jacobian_block& weighted, float impulse)
+  {
+    if (body < 0)
+      return;
+
+    linear[body] += weighted.linear * impulse;
+    angular[body] += weighted.angular * impulse;
+  };
+
+  for (int row = 0; row < rows; row++)
+  {
+    float effectiveMass = weigh(J.bodyA(row), J.blockA(row), weightedA[row]) +
+                          weigh(J.bodyB(row), J.blockB(row), weightedB[row]);
+    inverseEffectiveMass[row] = effectiveMass > 0.0f ? 1.0f / effectiveMass : 0.0f;
+
+    apply(J.bodyA(row), weightedA[row], lambda[row]);
+    apply(J.bodyB(row), weightedB[row], lambda[row]);
+  }
+
+  auto velocity = [&](int body, const jacobian_block& block)
+  {
+    if (body < 0)
+      return 0.0f;
+
+    return dot(block.linear, linear[body]) + dot(block.angular, angular[body]);
+  };
+
+  float largestChange = 0.0f;
+  for (int iteration = 0; iteration < settings.iterations; iteration++)
+  {
+    largestChange = 0.0f;
+    for (int row = 0; row < rows; row++)
+    {
+      float current = velocity(J.bodyA(row), J.blockA(row)) +
+                      velocity(J.bodyB(row), J.blockB(row));
+
+      float old = lambda[row];
+      float updated = old + settings.relaxation * (b[row] - current) * inverseEffectiveMass[row];
+      lambda[row] = clampMultiplier(bounds, row, updated, lambda);
+
+      float impulse = lambda[row] - old;
+      apply(J.bodyA(row), weightedA[row], impulse);
+      apply(J.bodyB(row), weightedB[row], impulse);
+
+      largestChange = std::max(largestChange, std::fabs(impulse));
+    }
+  }
+
+  return largestChange;
+}
+
+// ----- Conjugate Gradient -----
+
+/**
+ * The stopping criteria of the conjugate gradient solver. The solve ends once the norm of the
+ * residual falls below tolerance times the norm of the right hand side, or after maxIterations.
+ */
+struct cg_settings
+{
+  float tolerance = 1e-5f;
+  int maxIterations = 100;
+};
+
+/**
+ * Reports how a conjugate gradient solve went. The residual is relative to the norm of the right
+ * hand side, so it can be compared directly against the tolerance.
+ */
+struct cg_result
+{
+  int iterations;
+  float residual;
+};
+
+/**
+ * A preconditioner that does nothing, for when the system is well conditioned enough as it is.
+ */
+struct identity_preconditioner
+{
+  int size;
+
+  void operator()(const float* r, float* z) const { std::copy(r, r + size, z); }
+};
+
+/**
+ * The jacobi preconditioner scales the residual by the inverse of the diagonal of A. It costs
+ * almost nothing to build or apply, and helps most when the diagonal varies a lot between rows,
+ * such as for bodies with very different masses.
+ */
+class jacobi_preconditioner
+{
+public:
+  jacobi_preconditioner(const csr_matrix& A)
+    : inverseDiagonal(A.rows())
+  {
+    for (int row = 0; row < A.rows(); row++)
+    {
+      float diagonal = A.diagonal(row);
+      inverseDiagonal[row] = diagonal != 0.0f ? 1.0f / diagonal : 1.0f;
+    }
+  }
+
+  void operator()(const float* r, float* z) const
+  {
+    for (int i = 0; i < static_cast<int>(inverseDiagonal.size()); i++)
+      z[i] = r[i] * inverseDiagonal[i];
+  }
+
+private:
+  std::vector<float> inverseDiagonal;
+};
+
+/**
+ * The zero fill-in incomplete cholesky preconditioner, IC(0). It computes a lower triangular L with
+ * exactly the sparsity of the lower triangle of A, such that L * L^T is close to A, and applies the
+ * preconditioner by solving with L and then L^T. A must be symmetric, with both of its triangles
+ * stored. If a pivot breaks down (which can happen even for SPD matrices, since entries are
+ * dropped), the diagonal of A is used in its place.
+ */
+class incomplete_cholesky
+{
+public:
+  incomplete_cholesky(const csr_matrix& A)
+    : offsets(A.rows() + 1, 0)
+  {
+    assert(A.rows() == A.columns());
+    int n = A.rows();
+
+    // Copy out the lower triangle (including the diagonal), which is the last entry of every row.
+    const int* rowOffsets = A.rowOffsets();
+    const int* columnIndices = A.columnIndices();
+    const float* values = A.values();
+    for (int row = 0; row < n; row++)
+    {
+      for (int i = rowOffsets[row]; i < rowOffsets[row + 1] && columnIndices[i] < row; i++)
+      {
+        indices.push_back(columnIndices[i]);
+        elements.push_back(values[i]);
+      }
+
+      indices.push_back(row);
+      elements.push_back(A.diagonal(row));
+      offsets[row + 1] = static_cast<int>(indices.size());
+    }
+
+    // Factor row by row. Entry (i, k) needs the dot product of row i and row k of L over the
+    // columns before k, which is a merge of two sorted rows.
+    for (int row = 0; row < n; row++)
+    {
+      int diagonal = offsets[row + 1] - 1;
+      for (int i = offsets[row]; i < diagonal; i++)
+      {
+        int k = indices[i];
+        elements[i] = (elements[i] - rowDot(row, k, k)) / elements[offsets[k + 1] - 1];
+      }
+
+      float pivot = elements[diagonal] - rowDot(row, row, row);
+      elements[diagonal] = std::sqrt(pivot > 0.0f ? pivot : std::fabs(A.diagonal(row)));
+    }
+  }
+
+  void operator()(const float* r, float* z) const
+  {
+    int n = static_cast<int>(offsets.size()) - 1;
+
+    // Solve L * y = r, walking the rows of L.
+    for (int row = 0; row < n; row++)
+    {
+      float value = r[row];
+      int diagonal = offsets[row + 1] - 1;
+      for (int i = offsets[row]; i < diagonal; i++)
+        value -= elements[i] * z[indices[i]];
+
+      z[row] = value / elements[diagonal];
+    }
+
+    // Solve L^T * z = y in place. The rows of L are the columns of L^T, so each solved value is
+    // scattered into the rows above it.
+    for (int row = n - 1; row >= 0; row--)
+    {
+      int diagonal = offsets[row + 1] - 1;
+      z[row] /= elements[diagonal];
+
+      for (int i = offsets[row]; i < diagonal; i++)
+        z[indices[i]] -= elements[i] * z[row];
+    }
+  }
+
+private:
+  /**
+   * Takes the dot product of rows a and b of L over the columns before end.
+   */
+  float rowDot(int a, int b, int end) const
+  {
+    float res = 0.0f;
+    int i = offsets[a];
+    int j = offsets[b];
+    while (i < offsets[a + 1] && j < offsets[b + 1] && indices[i] < end && indices[j] < end)
+    {
+      if (indices[i] == indices[j])
+        res += elements[i++] * elements[j++];
+      else if (indices[i] < indices[j])
+        i++;
+      else
+        j++;
+    }
+
+    return res;
+  }
+
+  std::vector<int> offsets;
+  std::vector<int> indices;
+  std::vector<float> elements;
+};
+
+/**
+ * Solves A * x = b with the preconditioned conjugate gradient method, where A is symmetric positive
+ * definite. The solver never looks at A directly; it only needs an operator that computes y = A * x
+ * as A(x, y), so A can be a sparse matrix, a product like J * M^-1 * J^T that is never assembled,
+ * or anything else. The preconditioner is applied the same way, as M(r, z) computing z = M^-1 * r.
+ *
+ * x is the initial guess on input and the solution on output, so a good guess (such as the solution
+ * of the last step) cuts down on iterations.
+ */
+template <typename Operator, typename Preconditioner>
+inline cg_result conjugateGradient(int n, const Operator& A, const float* b, float* x,
+                                   const Preconditioner& M, const cg_settings& settings = {})
+{
+  std::vector<float> r(n), z(n), p(n), Ap(n);
+
+  float bNorm = std::sqrt(kernels::dot(n, b, b));
+  if (bNorm == 0.0f)
+  {
+    std::fill(x, x + n, 0.0f);
+    return {0, 0.0f};
+  }
+
+  // r = b - A * x
+  A(x, Ap.data());
+  for (int i = 0; i < n; i++)
+    r[i] = b[i] - Ap[i];
+
+  float residual = std::sqrt(kernels::dot(n, r.data(), r.data())) / bNorm;
+  if (residual <= settings.tolerance)
+    return {0, residual};
+
+  M(r.data(), z.data());
+  p = z;
+  float rz = kernels::dot(n, r.data(), z.data());
+
+  int iteration = 0;
+  while (iteration < settings.maxIterations)
+  {
+    iteration++;
+
+    A(p.data(), Ap.data());
+    float alpha = rz / kernels::dot(n, p.data(), Ap.data());
+    kernels::axpy(n, alpha, p.data(), x);
+    kernels::axpy(n, -alpha, Ap.data(), r.data());
+
+    residual = std::sqrt(kernels::dot(n, r.data(), r.data())) / bNorm;
+    if (residual <= settings.tolerance)
+      break;
+
+    M(r.data(), z.data());
+    float rzNext = kernels::dot(n, r.data(), z.data());
+    float beta = rzNext / rz;
+    rz = rzNext;
+
+    for (int i = 0; i < n; i++)
+      p[i] = z[i] + beta * p[i];
+  }
+
+  return {iteration, residual};
+}
+
+/**
+ * Solves A * x = b with the unpreconditioned conjugate gradient method.
+ */
+template <typename Operator>
+inline cg_result conjugateGradient(int n, const Operator& A, const float* b, float* x,
+                                   const cg_settings& settings = {})
+{
+  return conjugateGradient(n, A, b, x, identity_preconditioner{n}, settings);
+}
+
+/**
+ * Solves A * x = b for a sparse symmetric positive definite A.
+ */
+template <typename Preconditioner>
+inline cg_result conjugateGradient(const csr_matrix& A, const vector& b, vector& x,
+                                   const Preconditioner& M, const cg_settings& settings = {})
+{
+  assert(A.rows() == A.columns() && A.rows() == b.length() && b.length() == x.length());
+
+  auto multiply = [&A](const float* in, float* out) { A.multiply(in, out); };
+  return conjugateGradient(A.rows(), multiply, b.data(), x.data(), M, settings);
+}
+
+// ----- Batched Small Systems -----
+
+/**
+ * Solves wideLanes independent N by N systems at once, one per SIMD lane. Element (r, c) of the
+ * systems is read from A + (c * N + r) * stride, entry r of the right hand sides from b + r *
+ * stride, and entry r of the solutions is written to x + r * stride. Everything stays in registers
+ * (or on the stack for N = 6), and there are no branches that depend on the data.
+ *
+ * The elimination doesn't pivot, which is safe for the symmetric positive definite systems that
+ * constraints produce.
+ */
+template <int N> inline void solveLanes(const float* A, const float* b, float* x, int stride)
+{
+  simd::floatv a[N][N];
+  simd::floatv rhs[N];
+  for (int c = 0; c < N; c++)
+    for (int r = 0; r < N; r++)
+      a[c][r] = simd::loadWide(A + (c * N + r) * stride);
+  for (int r = 0; r < N; r++)
+    rhs[r] = simd::loadWide(b + r * stride);
+
+  // Forward elimination. We keep the reciprocal of each pivot, so there is only one division per
+  // column.
+  simd::floatv inverse[N];
+  for (int k = 0; k < N; k++)
+  {
+    inverse[k] = simd::splatWide(1.0f) / a[k][k];
+    for (int r = k + 1; r < N; r++)
+    {
+      simd::floatv scale = a[k][r] * inverse[k];
+      for (int c = k + 1; c < N; c++)
+        a[c][r] = a[c][r] - scale * a[c][k];
+      rhs[r] = rhs[r] - scale * rhs[k];
+    }
+  }
+
+  // Back substitution.
+  for (int r = N - 1; r >= 0; r--)
+  {
+    simd::floatv value = rhs[r];
+    for (int c = r + 1; c < N; c++)
+      value = value - a[c][r] * rhs[c];
+    rhs[r] = value * inverse[r];
+  }
+
+  for (int r = 0; r < N; r++)
+    simd::storeWide(x + r * stride, rhs[r]);
+}
+
+/**
+ * Solves count independent N by N systems A_k * x_k = b_k stored as structures of arrays, for N of
+ * 3 (point constraints) or 6 (weld constraints). Element (r, c) of system k is A[(c * N + r) *
+ * count + k], and entry r of its right hand side and solution are b[r * count + k] and x[r * count
+ * + k]. Systems are solved wideLanes at a time. The leftover systems are copied into a padded
+ * batch on the stack, so this never touches the heap.
+ */
+template <int N> inline void solveBatch(int count, const float* A, const float* b, float* x)
+{
+  static_assert(N == 3 || N == 6, "Batched solves are only provided for 3x3 and 6x6 systems.");
+  constexpr int lanes = simd::wideLanes;
+
+  int k = 0;
+  for (; k + lanes <= count; k += lanes)
+    solveLanes<N>(A + k, b + k, x + k, count);
+
+  if (k == count)
+    return;
+
+  // Pad the leftover lanes with identity systems, so that they stay finite.
+  float tailA[N * N * lanes];
+  float tailB[N * lanes];
+  float tailX[N * lanes];
+  for (int c = 0; c < N; c++)
+    for (int r = 0; r < N; r++)
+      for (int lane = 0; lane < lanes; lane++)
+        tailA[(c * N + r) * lanes + lane] =
+          k + lane < count ? A[(c * N + r) * count + k + lane] : (r == c ? 1.0f : 0.0f);
+
+  for (int r = 0; r < N; r++)
+    for (int lane = 0; lane < lanes; lane++)
+      tailB[r * lanes + lane] = k + lane < count ? b[r * count + k + lane] : 0.0f;
+
+  solveLanes<N>(tailA, tailB, tailX, lanes);
+
+  for (int r = 0; r < N; r++)
+    for (int lane = 0; k + lane < count; lane++)
+      x[r * count + k + lane] = tailX[r * lanes + lane];
+}
+
+/**
+ * Solves count independent 3x3 systems given as arrays of matrix3 and vector3. Each group of
+ * wideLanes systems is transposed into lanes on the stack first, so this is a drop-in for code
+ * that already stores its effective masses as matrices.
+ */
+inline void solveBatch(int count, const matrix3* A, const vector3* b, vector3* x)
+{
+  constexpr int lanes = simd::wideLanes;
+
+  float batchA[9 * lanes];
+  float batchB[3 * lanes];
+  float batchX[3 * lanes];
+  for (int k = 0; k < count; k += lanes)
+  {
+    for (int lane = 0; lane < lanes; lane++)
+    {
+      bool valid = k + lane < count;
+      for (int c = 0; c < 3; c++)
+      {
+        for (int r = 0; r < 3; r++)
+          batchA[(c * 3 + r) * lanes + lane] =
+            valid ? A[k + lane][c][r] : (r == c ? 1.0f : 0.0f);
+        batchB[c * lanes + lane] = valid ? b[k + lane][c] : 0.0f;
+      }
+    }
+
+    solveLanes<3>(batchA, batchB, batchX, lanes);
+
+    for (int lane = 0; lane < lanes && k + lane < count; lane++)
+      x[k + lane] = vector3(batchX[lane], batchX[lanes + lane], batchX[2 * lanes + lane]);
+  }
+}
+
 } // namespace flexor::solver
\ No newline at end of file
@@ -0,0 +1,506 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+#include <vector>
+
+#include "small_matrix.h"
+#include "vector.h"
+#include "vector3.h"
+
+namespace flexor
+{
+
+// ----- Triplet -----
+
+/**
+ * A single entry of a sparse matrix, used to build one in any order.
+ */
+struct triplet
+{
+  int row;
+  int col;
+  float value;
+};
+
+// ----- CSR Matrix -----
+
+/**
+ * A sparse matrix in compressed sparse row form. The nonzeros of each row are stored contiguously,
+ * sorted by column, and the offsets array gives where each row begins. Row i spans the entries in
+ * [offsets[i], offsets[i + 1]). This makes products with a vector a single streaming pass over the
+ * nonzeros, and is the format the iterative solvers work on.
+ */
+class csr_matrix
+{
+public:
+  // Constructors
+
+  /**
+   * Creates an empty matrix with the given dimensions.
+   */
+  csr_matrix(int rows, int cols)
+    : numRows(rows), numCols(cols), offsets(rows + 1, 0)
+  {
+    assert(rows >= 0 && cols >= 0);
+  }
+
+  /**
+   * Creates a matrix from a list of entries in any order. Entries at the same position are summed,
+   * which is convenient when assembling a matrix out of overlapping pieces.
+   */
+  csr_matrix(int rows, int cols, const std::vector<triplet>& entries)
+    : csr_matrix(rows, cols)
+  {
+    // Bucket the entries by row with a counting sort.
+    for (const triplet& entry : entries)
+    {
+      assert(entry.row >= 0 && entry.row < rows && entry.col >= 0 && entry.col < cols);
+      offsets[entry.row + 1]++;
+    }
+
+    for (int row = 0; row < rows; row++)
+      offsets[row + 1] += offsets[row];
+
+    indices.resize(entries.size());
+    elements.resize(entries.size());
+
+    std::vector<int> cursors(offsets.begin(), offsets.end() - 1);
+    for (const triplet& entry : entries)
+    {
+      int index = cursors[entry.row]++;
+      indices[index] = entry.col;
+      elements[index] = entry.value;
+    }
+
+    // Sort each row by column and merge duplicates, compacting the arrays as we go. Rows are short,
+    // so an insertion sort is plenty.
+    int write = 0;
+    for (int row = 0; row < rows; row++)
+    {
+      int begin = offsets[row];
+      int end = offsets[row + 1];
+
+      for (int i = begin + 1; i < end; i++)
+        for (int j = i; j > begin && indices[j - 1] > indices[j]; j--)
+        {
+          std::swap(indices[j - 1], indices[j]);
+          std::swap(elements[j - 1], elements[j]);
+        }
+
+      offsets[row] = write;
+      for (int i = begin; i < end; i++)
+      {
+        if (write > offsets[row] && indices[write - 1] == indices[i])
+        {
+          elements[write - 1] += elements[i];
+          continue;
+        }
+
+        indices[write] = indices[i];
+        elements[write] = elements[i];
+        write++;
+      }
+    }
+
+    offsets[rows] = write;
+    indices.resize(write);
+    elements.resize(write);
+  }
+
+  // Accessors
+
+  int rows() const { return numRows; }
+  int columns() const { return numCols; }
+  int nonZeros() const { return static_cast<int>(elements.size()); }
+
+  /**
+   * Returns the entry at the given position, which is zero if it isn't stored. This is a binary
+   * search over the row, so prefer walking the arrays directly in loops.
+   */
+  float operator()(int row, int col) const
+  {
+    assert(row >= 0 && row < numRows && col >= 0 && col < numCols);
+
+    auto begin = indices.begin() + offsets[row];
+    auto end = indices.begin() + offsets[row + 1];
+    auto it = std::lower_bound(begin, end, col);
+
+    return it != end && *it == col ? elements[it - indices.begin()] : 0.0f;
+  }
+
+  /**
+   * Returns the diagonal entry of a row, which the iterative solvers divide by.
+   */
+  float diagonal(int row) const { return (*this)(row, row); }
+
+  const int* rowOffsets() const { return offsets.data(); }
+  const int* columnIndices() const { return indices.data(); }
+  const float* values() const { return elements.data(); }
+  float* values() { return elements.data(); }
+
+  // Products
+
+  /**
+   * Computes y = A * x, where x has columns() entries and y has rows() entries.
+   */
+  void multiply(const float* x, float* y) const
+  {
+    for (int row = 0; row < numRows; row++)
+    {
+      float res = 0.0f;
+      for (int i = offsets[row]; i < offsets[row + 1]; i++)
+        res += elements[i] * x[indices[i]];
+
+      y[row] = res;
+    }
+  }
+
+  /**
+   * Computes y = A^T * x, where x has rows() entries and y has columns() entries. Each row of A is
+   * scattered into y, so the transpose is never formed.
+   */
+  void multiplyTranspose(const float* x, float* y) const
+  {
+    std::fill(y, y + numCols, 0.0f);
+
+    for (int row = 0; row < numRows; row++)
+    {
+      float scale = x[row];
+      for (int i = offsets[row]; i < offsets[row + 1]; i++)
+        y[indices[i]] += elements[i] * scale;
+    }
+  }
+
+private:
+  // Fields
+
+  int numRows;
+  int numCols;
+
+  std::vector<int> offsets;
+  std::vector<int> indices;
+  std::vector<float> elements;
+};
+
+inline vector operator*(const csr_matrix& mat, const vector& vec)
+{
+  assert(mat.columns() == vec.length());
+
+  vector res(mat.rows());
+  mat.multiply(vec.data(), res.data());
+  return res;
+}
+
+/**
+ * Computes A^T * x without forming the transpose.
+ */
+inline vector multiplyTranspose(const csr_matrix& mat, const vector& vec)
+{
+  assert(mat.rows() == vec.length());
+
+  vector res(mat.columns());
+  mat.multiplyTranspose(vec.data(), res.data());
+  return res;
+}
+
+// ----- Block Jacobian -----
+
+/**
+ * The part of a constraint row that acts on a single body, which is the row's derivative with
+ * respect to that body's linear and angular velocity.
+ */
+struct jacobian_block
+{
+  vector3 linear = vector3(0.0f);
+  vector3 angular = vector3(0.0f);
+};
+
+/**
+ * A constraint Jacobian in a block sparse layout. Every constraint row couples at most two bodies,
+ * so instead of a generic sparse row, each row stores two body indices and a 1 by 6 block for each
+ * of them. A body index of -1 means that side of the constraint is attached to the world.
+ *
+ * The full Jacobian has 6 columns per body. Whenever it is multiplied by a flat velocity vector,
+ * body i owns entries 6i to 6i + 5, with the linear velocity first and the angular velocity second.
+ */
+class block_jacobian
+{
+public:
+  // Constructors
+
+  block_jacobian(int bodies)
+    : numBodies(bodies)
+  {
+    assert(bodies >= 0);
+  }
+
+  // Methods
+
+  /**
+   * Adds a constraint row between two bodies and returns its index.
+   */
+  int addRow(int bodyA, const jacobian_block& blockA, int bodyB, const jacobian_block& blockB)
+  {
+    assert(bodyA >= -1 && bodyA < numBodies && bodyB >= -1 && bodyB < numBodies);
+    assert(bodyA != bodyB || bodyA == -1);
+
+    bodiesA.push_back(bodyA);
+    bodiesB.push_back(bodyB);
+    blocksA.push_back(blockA);
+    blocksB.push_back(blockB);
+
+    return rows() - 1;
+  }
+
+  void reserve(int rows)
+  {
+    bodiesA.reserve(rows);
+    bodiesB.reserve(rows);
+    blocksA.reserve(rows);
+    blocksB.reserve(rows);
+  }
+
+  void clear()
+  {
+    bodiesA.clear();
+    bodiesB.clear();
+    blocksA.clear();
+    blocksB.clear();
+  }
+
+  // Accessors
+
+  int rows() const { return static_cast<int>(bodiesA.size()); }
+  int columns() const { return 6 * numBodies; }
+  int bodies() const { return numBodies; }
+
+  int bodyA(int row) const { return bodiesA[row]; }
+  int bodyB(int row) const { return bodiesB[row]; }
+  const jacobian_block& blockA(int row) const { return blocksA[row]; }
+  const jacobian_block& blockB(int row) const { return blocksB[row]; }
+
+  // Products
+
+  /**
+   * Computes the constraint velocities J * v for the velocities of every body.
+   */
+  void multiply(const vector3* linear, const vector3* angular, float* res) const
+  {
+    for (int row = 0; row < rows(); row++)
+    {
+      float value = 0.0f;
+      if (bodiesA[row] >= 0)
+        value += dot(blocksA[row].linear, linear[bodiesA[row]]) +
+                 dot(blocksA[row].angular, angular[bodiesA[row]]);
+      if (bodiesB[row] >= 0)
+        value += dot(blocksB[row].linear, linear[bodiesB[row]]) +
+                 dot(blocksB[row].angular, angular[bodiesB[row]]);
+
+      res[row] = value;
+    }
+  }
+
+  /**
+   * Computes the linear and angular impulses J^T * lambda applied to every body by the given
+   * constraint multipliers. Both outputs are overwritten.
+   */
+  void multiplyTranspose(const float* lambda, vector3* linear, vector3* angular) const
+  {
+    std::fill(linear, linear + numBodies, vector3(0.0f));
+    std::fill(angular, angular + numBodies, vector3(0.0f));
+
+    for (int row = 0; row < rows(); row++)
+    {
+      if (bodiesA[row] >= 0)
+      {
+        linear[bodiesA[row]] += blocksA[row].linear * lambda[row];
+        angular[bodiesA[row]] += blocksA[row].angular * lambda[row];
+      }
+
+      if (bodiesB[row] >= 0)
+      {
+        linear[bodiesB[row]] += blocksB[row].linear * lambda[row];
+        angular[bodiesB[row]] += blocksB[row].angular * lambda[row];
+      }
+    }
+  }
+
+  /**
+   * Computes J * v, where v is a flat velocity vector.
+   */
+  void multiply(const float* velocities, float* res) const
+  {
+    for (int row = 0; row < rows(); row++)
+      res[row] = blockDot(bodiesA[row], blocksA[row], velocities) +
+                 blockDot(bodiesB[row], blocksB[row], velocities);
+  }
+
+  /**
+   * Computes J^T * lambda into a flat vector with 6 entries per body.
+   */
+  void multiplyTranspose(const float* lambda, float* res) const
+  {
+    std::fill(res, res + columns(), 0.0f);
+
+    for (int row = 0; row < rows(); row++)
+    {
+      blockScatter(bodiesA[row], blocksA[row], lambda[row], res);
+      blockScatter(bodiesB[row], blocksB[row], lambda[row], res);
+    }
+  }
+
+  /**
+   * Expands the Jacobian into a generic sparse matrix with 6 columns per body.
+   */
+  csr_matrix toCsr() const
+  {
+    std::vector<triplet> entries;
+    entries.reserve(12 * rows());
+
+    auto addBlock = [&](int row, int body, const jacobian_block& block)
+    {
+      if (body < 0)
+        return;
+
+      for (int k = 0; k < 3; k++)
+      {
+        entries.push_back({row, 6 * body + k, block.linear[k]});
+        entries.push_back({row, 6 * body + 3 + k, block.angular[k]});
+      }
+    };
+
+    for (int row = 0; row < rows(); row++)
+    {
+      addBlock(row, bodiesA[row], blocksA[row]);
+      addBlock(row, bodiesB[row], blocksB[row]);
+    }
+
+    return csr_matrix(rows(), columns(), entries);
+  }
+
+private:
+  static float blockDot(int body, const jacobian_block& block, const float* velocities)
+  {
+    if (body < 0)
+      return 0.0f;
+
+    const float* v = velocities + 6 * body;
+    return block.linear.x * v[0] + block.linear.y * v[1] + block.linear.z * v[2] +
+           block.angular.x * v[3] + block.angular.y * v[4] + block.angular.z * v[5];
+  }
+
+  static void blockScatter(int body, const jacobian_block& block, float scale, float* res)
+  {
+    if (body < 0)
+      return;
+
+    float* v = res + 6 * body;
+    for (int k = 0; k < 3; k++)
+    {
+      v[k] += block.linear[k] * scale;
+      v[3 + k] += block.angular[k] * scale;
+    }
+  }
+
+  // Fields
+
+  int numBodies;
+
+  std::vector<int> bodiesA;
+  std::vector<int> bodiesB;
+  std::vector<jacobian_block> blocksA;
+  std::vector<jacobian_block> blocksB;
+};
+
+inline vector operator*(const block_jacobian& jacobian, const vector& velocities)
+{
+  assert(jacobian.columns() == velocities.length());
+
+  vector res(jacobian.rows());
+  jacobian.multiply(velocities.data(), res.data());
+  return res;
+}
+
+inline vector multiplyTranspose(const block_jacobian& jacobian, const vector& lambda)
+{
+  assert(jacobian.rows() == lambda.length());
+
+  vector res(jacobian.columns());
+  jacobian.multiplyTranspose(lambda.data(), res.data());
+  return res;
+}
+
+// ----- System Assembly -----
+
+/**
+ * Assembles the constraint system matrix J * M^-1 * J^T from a block Jacobian, given the inverse
+ * mass and world space inverse inertia of every body. Entry (i, j) is only nonzero when rows i and
+ * j share a body, so we first bucket the rows by the bodies they touch, and then only ever pair up
+ * rows within a bucket. The cost is proportional to the number of such pairs, rather than the
+ * square of the number of rows.
+ */
+inline csr_matrix assembleSystem(const block_jacobian& jacobian, const float* inverseMasses,
+                                 const matrix3* inverseInertias)
+{
+  int rows = jacobian.rows();
+  int bodies = jacobian.bodies();
+
+  // Bucket the rows by body with a counting sort, so that rowsOf[bodyOffsets[b]...] lists every row
+  // that touches body b.
+  std::vector<int> bodyOffsets(bodies + 1, 0);
+  for (int row = 0; row < rows; row++)
+  {
+    if (jacobian.bodyA(row) >= 0)
+      bodyOffsets[jacobian.bodyA(row) + 1]++;
+    if (jacobian.bodyB(row) >= 0)
+      bodyOffsets[jacobian.bodyB(row) + 1]++;
+  }
+
+  for (int body = 0; body < bodies; body++)
+    bodyOffsets[body + 1] += bodyOffsets[body];
+
+  std::vector<int> rowsOf(bodyOffsets[bodies]);
+  std::vector<int> cursors(bodyOffsets.begin(), bodyOffsets.end() - 1);
+  for (int row = 0; row < rows; row++)
+  {
+    if (jacobian.bodyA(row) >= 0)
+      rowsOf[cursors[jacobian.bodyA(row)]++] = row;
+    if (jacobian.bodyB(row) >= 0)
+      rowsOf[cursors[jacobian.bodyB(row)]++] = row;
+  }
+
+  // Returns the block of a row acting on a body, which is known to be one of its two sides.
+  auto blockOf = [&](int row, int body) -> const jacobian_block&
+  { return jacobian.bodyA(row) == body ? jacobian.blockA(row) : jacobian.blockB(row); };
+
+  std::vector<triplet> entries;
+  for (int row = 0; row < rows; row++)
+  {
+    for (int body : {jacobian.bodyA(row), jacobian.bodyB(row)})
+    {
+      if (body < 0)
+        continue;
+
+      // Scale this row's block by the inverse mass of the body once, and then dot it with every
+      // other row that shares the body.
+      const jacobian_block& block = blockOf(row, body);
+      vector3 linear = block.linear * inverseMasses[body];
+      vector3 angular = inverseInertias[body] * block.angular;
+
+      for (int i = bodyOffsets[body]; i < bodyOffsets[body + 1]; i++)
+      {
+        int other = rowsOf[i];
+        const jacobian_block& otherBlock = blockOf(other, body);
+        float value = dot(otherBlock.linear, linear) + dot(otherBlock.angular, angular);
+
+        entries.push_back({row, other, value});
+      }
+    }
+  }
+
+  return csr_matrix(rows, rows, entries);
+}
+
+} // namespace flexor
\ No newline at end of file
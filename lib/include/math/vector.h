@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "base.h"
+#include "expression.h"
 
 // These each form a circular include, but this is okay as long as small vectors aren't included
 // without operators defined in this header. We also want them accessible from just including this
@@ -12,6 +13,7 @@
 #include "vector2.h"
 #include "vector3.h"
 #include "vector4.h"
+#include "vector6.h"
 
 namespace flexor
 {
@@ -23,8 +25,11 @@ namespace flexor
  * strongly suggested to use the vectorN types, since they are stack allocated and will perform
  * better in general. This class is most useful when the size of the vector is not known until
  * runtime. We ironically implement this class by wrapping over std::vector.
+ *
+ * Arithmetic on this class is lazy (see expression.h). The operators build an expression that is
+ * evaluated in a single pass once it is assigned to a vector.
  */
-class vector : public base::vector
+class vector : public base::vector_expression
 {
 public:
   // Constructors
@@ -32,7 +37,7 @@ public:
   vector() = delete;
 
   vector(int len, float fill = 0.0f)
-    : data(len, fill)
+    : elements(len, fill)
   {
     assert(len > 0);
   }
@@ -41,7 +46,7 @@ public:
    * Constructs a vector from a list of numbers
    */
   vector(std::initializer_list<float> elts)
-    : data(elts)
+    : elements(elts)
   {
   }
 
@@ -56,38 +61,63 @@ public:
     assert(vec.length() <= length());
 
     for (int i = 0; i < vec.length(); i++)
-      data[i] = vec[i];
+      elements[i] = vec[i];
   }
 
   // Methods
 
-  int length() const { return data.size(); }
+  int length() const { return elements.size(); }
+
+  float* data() { return elements.data(); }
+  const float* data() const { return elements.data(); }
 
   // Operators
 
-  vector& operator+=(const vector& other)
+  /**
+   * Evaluates an expression directly into this vector. If the lengths already match, no memory is
+   * allocated. Expressions are evaluated elementwise, so it is safe for this vector to appear in
+   * the expression.
+   */
+  template <typename E, std::enable_if_t<base::is_vector_expression<E>, bool> = true>
+  vector& operator=(const E& expr)
+  {
+    if (expr.length() != length())
+      elements.resize(expr.length());
+
+    float* elts = data();
+    for (int i = 0; i < length(); i++)
+      elts[i] = expr[i];
+
+    return (*this);
+  }
+
+  template <typename E, std::enable_if_t<base::is_vector_expression<E>, bool> = true>
+  vector& operator+=(const E& other)
   {
     assert(length() == other.length());
 
+    float* elts = data();
     for (int i = 0; i < length(); i++)
-      data[i] += other[i];
+      elts[i] += other[i];
 
     return (*this);
   }
 
-  vector& operator-=(const vector& other)
+  template <typename E, std::enable_if_t<base::is_vector_expression<E>, bool> = true>
+  vector& operator-=(const E& other)
   {
     assert(length() == other.length());
 
+    float* elts = data();
     for (int i = 0; i < length(); i++)
-      data[i] -= other[i];
+      elts[i] -= other[i];
 
     return (*this);
   };
 
   vector& operator*=(float scalar)
   {
-    for (float& elt : data)
+    for (float& elt : elements)
       elt *= scalar;
 
     return (*this);
@@ -97,7 +127,7 @@ public:
   {
     assert(scalar != 0.0f);
 
-    for (float& elt : data)
+    for (float& elt : elements)
       elt /= scalar;
 
     return (*this);
@@ -106,60 +136,160 @@ public:
   float& operator[](int index)
   {
     assert(index >= 0 && index < length());
-    return data[index];
+    return elements[index];
   }
 
   const float operator[](int index) const
   {
     assert(index >= 0 && index < length());
-    return data[index];
+    return elements[index];
   }
 
 private:
   // Fields
 
-  std::vector<float> data;
+  std::vector<float> elements;
+};
+
+// ----- Vector View Class -----
+
+/**
+ * A non-owning view of contiguous floats as a vector, such as a column of a matrix. The view takes
+ * part in expressions like a vector does, and assigning to it writes through to the viewed floats
+ * instead of rebinding the view. The type T is either float or const float.
+ */
+template <typename T> class vector_view : public base::vector_expression, public expr::node
+{
+public:
+  // Constructors
+
+  vector_view(T* elts, int len)
+    : elts(elts), len(len)
+  {
+    assert(len > 0);
+  }
+
+  vector_view(const vector_view& other) = default;
+
+  // Methods
+
+  int length() const { return len; }
+
+  T* data() const { return elts; }
+
+  // Operators
+
+  vector_view& operator=(const vector_view& other)
+  {
+    return this->operator= <vector_view>(other);
+  }
+
+  template <typename E, std::enable_if_t<std::is_base_of_v<base::vector, E>, bool> = true>
+  vector_view& operator=(const E& expr)
+  {
+    assert(expr.length() == length());
+
+    for (int i = 0; i < len; i++)
+      elts[i] = expr[i];
+
+    return (*this);
+  }
+
+  template <typename E, std::enable_if_t<base::is_vector_expression<E>, bool> = true>
+  vector_view& operator+=(const E& other)
+  {
+    assert(length() == other.length());
+
+    for (int i = 0; i < len; i++)
+      elts[i] += other[i];
+
+    return (*this);
+  }
+
+  template <typename E, std::enable_if_t<base::is_vector_expression<E>, bool> = true>
+  vector_view& operator-=(const E& other)
+  {
+    assert(length() == other.length());
+
+    for (int i = 0; i < len; i++)
+      elts[i] -= other[i];
+
+    return (*this);
+  }
+
+  vector_view& operator*=(float scalar)
+  {
+    for (int i = 0; i < len; i++)
+      elts[i] *= scalar;
+
+    return (*this);
+  }
+
+  vector_view& operator/=(float scalar)
+  {
+    assert(scalar != 0.0f);
+
+    for (int i = 0; i < len; i++)
+      elts[i] /= scalar;
+
+    return (*this);
+  }
+
+  T& operator[](int index) const
+  {
+    assert(index >= 0 && index < length());
+    return elts[index];
+  }
+
+private:
+  // Fields
+
+  T* elts;
+  int len;
 };
 
 // ----- Inline Operators -----
 
+// These are eagerly evaluated and only apply to the small vector types. The operators for the heap
+// allocated vector live in expression.h.
+
 template <typename vecType>
-inline typename std::enable_if<std::is_base_of<base::vector, vecType>::value, vecType>::type
+inline typename std::enable_if<base::is_small_vector<vecType>, vecType>::type
 operator+(const vecType& lhs, const vecType& rhs)
 {
   return vecType(lhs) += rhs;
 }
 
 template <typename vecType>
-inline typename std::enable_if<std::is_base_of<base::vector, vecType>::value, vecType>::type
+inline typename std::enable_if<base::is_small_vector<vecType>, vecType>::type
 operator-(const vecType& lhs, const vecType& rhs)
 {
   return vecType(lhs) -= rhs;
 }
 
 template <typename vecType>
-inline typename std::enable_if<std::is_base_of<base::vector, vecType>::value, vecType>::type
+inline typename std::enable_if<base::is_small_vector<vecType>, vecType>::type
 operator-(const vecType& vec)
 {
   return vecType(vec) *= -1.0f;
 }
 
 template <typename vecType>
-inline typename std::enable_if<std::is_base_of<base::vector, vecType>::value, vecType>::type
+inline typename std::enable_if<base::is_small_vector<vecType>, vecType>::type
 operator*(const vecType& vec, float scalar)
 {
   return vecType(vec) *= scalar;
 }
 
 template <typename vecType>
-inline typename std::enable_if<std::is_base_of<base::vector, vecType>::value, vecType>::type
+inline typename std::enable_if<base::is_small_vector<vecType>, vecType>::type
 operator*(float scalar, const vecType& vec)
 {
   return vec * scalar;
 }
 
 template <typename vecType>
-inline typename std::enable_if<std::is_base_of<base::vector, vecType>::value, vecType>::type
+inline typename std::enable_if<base::is_small_vector<vecType>, vecType>::type
 operator/(const vecType& vec, float scalar)
 {
   return vecType(vec) /= scalar;
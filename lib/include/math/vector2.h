@@ -15,8 +15,10 @@ namespace flexor
  *
  * Since many of the vectors in this engine will have a small size, either being 2, 3, or 4, it is
  * likely not worth it to store these in a dynamically sized heap array. Since we will need to be
- * able to have larger vectors as well, we will implement both methods. Also note that we are only
- * implementing this for academic purposes, as we performance benefits of SIMD with this method.
+ * able to have larger vectors as well, we will implement both methods.
+ *
+ * Unlike the larger vectors, a vector2 only fills half of a SIMD register, so its operations are
+ * left as plain scalar math, which the compiler handles just as well.
  */
 struct vector2 : public base::vector
 {
@@ -81,23 +83,17 @@ struct vector2 : public base::vector
   float& operator[](int index)
   {
     assert(index >= 0 && index < length());
-    switch (index)
-    {
-      default:
-      case 0: return x;
-      case 1: return y;
-    }
+
+    constexpr float vector2::*components[] = {&vector2::x, &vector2::y};
+    return this->*components[index];
   }
 
   const float operator[](int index) const
   {
     assert(index >= 0 && index < length());
-    switch (index)
-    {
-      default:
-      case 0: return x;
-      case 1: return y;
-    }
+
+    constexpr float vector2::*components[] = {&vector2::x, &vector2::y};
+    return this->*components[index];
   }
 };
 
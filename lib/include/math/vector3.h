@@ -3,6 +3,7 @@
 #include <cassert>
 
 #include "base.h"
+#include "simd.h"
 #include "vector.h"
 #include "vector2.h"
 
@@ -16,10 +17,13 @@ namespace flexor
  *
  * Since many of the vectors in this engine will have a small size, either being 2, 3, or 4, it is
  * likely not worth it to store these in a dynamically sized heap array. Since we will need to be
- * able to have larger vectors as well, we will implement both methods. Also note that we are only
- * implementing this for academic purposes, as we performance benefits of SIMD with this method.
+ * able to have larger vectors as well, we will implement both methods.
+ *
+ * The components are padded out to four floats and aligned to 16 bytes so that every operation
+ * maps onto a single SIMD register (see simd.h). The padding lane is kept at zero, and is never
+ * visible through the public interface.
  */
-struct vector3 : public base::vector
+struct alignas(16) vector3 : public base::vector
 {
   // Fields
 
@@ -39,7 +43,7 @@ struct vector3 : public base::vector
   }
 
   vector3(float x, float y, float z)
-    : x(x), y(y), z(z)
+    : x(x), y(y), z(z), pad(0.0f)
   {
   }
 
@@ -56,25 +60,19 @@ struct vector3 : public base::vector
 
   vector3& operator+=(const vector3& other)
   {
-    x += other.x;
-    y += other.y;
-    z += other.z;
+    (*this) = fromSimd(toSimd() + other.toSimd());
     return (*this);
   }
 
   vector3& operator-=(const vector3& other)
   {
-    x -= other.x;
-    y -= other.y;
-    z -= other.z;
+    (*this) = fromSimd(toSimd() - other.toSimd());
     return (*this);
   };
 
   vector3& operator*=(float scalar)
   {
-    x *= scalar;
-    y *= scalar;
-    z *= scalar;
+    (*this) = fromSimd(toSimd() * simd::splat(scalar));
     return (*this);
   }
 
@@ -82,47 +80,86 @@ struct vector3 : public base::vector
   {
     assert(scalar != 0.0f);
 
-    x /= scalar;
-    y /= scalar;
-    z /= scalar;
+    (*this) = fromSimd(toSimd() / simd::splat(scalar));
     return (*this);
   }
 
   float& operator[](int index)
   {
     assert(index >= 0 && index < length());
-    switch (index)
-    {
-      default:
-      case 0: return x;
-      case 1: return y;
-      case 2: return z;
-    }
+
+    constexpr float vector3::*components[] = {&vector3::x, &vector3::y, &vector3::z};
+    return this->*components[index];
   }
 
   const float operator[](int index) const
   {
     assert(index >= 0 && index < length());
-    switch (index)
-    {
-      default:
-      case 0: return x;
-      case 1: return y;
-      case 2: return z;
-    }
+
+    constexpr float vector3::*components[] = {&vector3::x, &vector3::y, &vector3::z};
+    return this->*components[index];
+  }
+
+  // SIMD Access
+
+  /**
+   * Loads the vector into a SIMD register, with zero in the last lane.
+   */
+  simd::float4 toSimd() const { return simd::load(&x); }
+
+  /**
+   * Builds a vector from the first three lanes of a SIMD register. The last lane is cleared in the
+   * register rather than after the store, since a separate store to the padding would keep the
+   * next load of the whole vector from being forwarded out of the store buffer.
+   */
+  static vector3 fromSimd(simd::float4 v)
+  {
+    vector3 res;
+    simd::store(&res.x, simd::clearLast(v));
+    return res;
   }
+
+private:
+  // Fields
+
+  float pad;
 };
 
 // ----- Cross Product -----
 
 inline vector3 cross(const vector3& lhs, const vector3& rhs)
 {
-  // https://en.wikipedia.org/wiki/Cross_product
-  vector3 res;
-  res[0] = lhs[1] * rhs[2] - lhs[2] * rhs[1];
-  res[1] = lhs[2] * rhs[0] - lhs[0] * rhs[2];
-  res[2] = lhs[0] * rhs[1] - lhs[1] * rhs[0];
-  return res;
+  return vector3::fromSimd(simd::cross3(lhs.toSimd(), rhs.toSimd()));
+}
+
+// ----- Vector Operations -----
+
+// These are more specialized than the generic versions in vector.h, and are picked instead of them.
+
+inline float dot(const vector3& lhs, const vector3& rhs)
+{
+  return simd::sum3(lhs.toSimd() * rhs.toSimd());
+}
+
+inline bool operator==(const vector3& lhs, const vector3& rhs)
+{
+  return simd::equal3(lhs.toSimd(), rhs.toSimd());
+}
+
+/**
+ * Takes the smaller of each pair of components.
+ */
+inline vector3 min(const vector3& lhs, const vector3& rhs)
+{
+  return vector3::fromSimd(simd::min(lhs.toSimd(), rhs.toSimd()));
+}
+
+/**
+ * Takes the larger of each pair of components.
+ */
+inline vector3 max(const vector3& lhs, const vector3& rhs)
+{
+  return vector3::fromSimd(simd::max(lhs.toSimd(), rhs.toSimd()));
 }
 
 } // namespace flexor
\ No newline at end of file
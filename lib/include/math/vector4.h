@@ -3,6 +3,7 @@
 #include <cassert>
 
 #include "base.h"
+#include "simd.h"
 #include "vector.h"
 #include "vector2.h"
 #include "vector3.h"
@@ -17,10 +18,12 @@ namespace flexor
  *
  * Since many of the vectors in this engine will have a small size, either being 2, 3, or 4, it is
  * likely not worth it to store these in a dynamically sized heap array. Since we will need to be
- * able to have larger vectors as well, we will implement both methods. Also note that we are only
- * implementing this for academic purposes, as we performance benefits of SIMD with this method.
+ * able to have larger vectors as well, we will implement both methods.
+ *
+ * The components are aligned to 16 bytes so that every operation maps onto a single SIMD register
+ * (see simd.h).
  */
-struct vector4 : public base::vector
+struct alignas(16) vector4 : public base::vector
 {
   // Fields
 
@@ -62,28 +65,19 @@ struct vector4 : public base::vector
 
   vector4& operator+=(const vector4& other)
   {
-    x += other.x;
-    y += other.y;
-    z += other.z;
-    w += other.w;
+    (*this) = fromSimd(toSimd() + other.toSimd());
     return (*this);
   }
 
   vector4& operator-=(const vector4& other)
   {
-    x -= other.x;
-    y -= other.y;
-    z -= other.z;
-    w -= other.w;
+    (*this) = fromSimd(toSimd() - other.toSimd());
     return (*this);
   };
 
   vector4& operator*=(float scalar)
   {
-    x *= scalar;
-    y *= scalar;
-    z *= scalar;
-    w *= scalar;
+    (*this) = fromSimd(toSimd() * simd::splat(scalar));
     return (*this);
   }
 
@@ -91,38 +85,50 @@ struct vector4 : public base::vector
   {
     assert(scalar != 0.0f);
 
-    x /= scalar;
-    y /= scalar;
-    z /= scalar;
-    w /= scalar;
+    (*this) = fromSimd(toSimd() / simd::splat(scalar));
     return (*this);
   }
 
   float& operator[](int index)
   {
     assert(index >= 0 && index < length());
-    switch (index)
-    {
-      default:
-      case 0: return x;
-      case 1: return y;
-      case 2: return z;
-      case 3: return w;
-    }
+
+    constexpr float vector4::*components[] = {&vector4::x, &vector4::y, &vector4::z, &vector4::w};
+    return this->*components[index];
   }
 
   const float operator[](int index) const
   {
     assert(index >= 0 && index < length());
-    switch (index)
-    {
-      default:
-      case 0: return x;
-      case 1: return y;
-      case 2: return z;
-      case 3: return w;
-    }
+
+    constexpr float vector4::*components[] = {&vector4::x, &vector4::y, &vector4::z, &vector4::w};
+    return this->*components[index];
+  }
+
+  // SIMD Access
+
+  simd::float4 toSimd() const { return simd::load(&x); }
+
+  static vector4 fromSimd(simd::float4 v)
+  {
+    vector4 res;
+    simd::store(&res.x, v);
+    return res;
   }
 };
 
+// ----- Vector Operations -----
+
+// These are more specialized than the generic versions in vector.h, and are picked instead of them.
+
+inline float dot(const vector4& lhs, const vector4& rhs)
+{
+  return simd::sum(lhs.toSimd() * rhs.toSimd());
+}
+
+inline bool operator==(const vector4& lhs, const vector4& rhs)
+{
+  return simd::equal(lhs.toSimd(), rhs.toSimd());
+}
+
 } // namespace flexor
\ No newline at end of file
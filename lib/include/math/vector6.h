@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cassert>
+
+#include "base.h"
+#include "vector.h"
+#include "vector3.h"
+
+namespace flexor
+{
+
+// ----- Vector6 Class -----
+
+/**
+ * A 6-component floating point vector, made of a linear and an angular part
+ *
+ * This is the size of a rigid body's velocity, or of a constraint row that acts on one body, and is
+ * mostly used through matrix6 for effective masses of weld constraints. The components are stored
+ * as two vector3, so each half still maps onto a SIMD register.
+ */
+struct alignas(16) vector6 : public base::vector
+{
+  // Fields
+
+  vector3 linear;
+  vector3 angular;
+
+  // Constructors
+
+  vector6(float v = 0.0f)
+    : linear(v), angular(v)
+  {
+  }
+
+  vector6([[maybe_unused]] int len, float v = 0.0f)
+    : vector6(v)
+  {
+    assert(len == length());
+  }
+
+  vector6(const vector3& linear, const vector3& angular)
+    : linear(linear), angular(angular)
+  {
+  }
+
+  vector6(float x, float y, float z, float u, float v, float w)
+    : linear(x, y, z), angular(u, v, w)
+  {
+  }
+
+  // Methods
+
+  constexpr static int length() { return 6; }
+
+  // Operators
+
+  vector6& operator+=(const vector6& other)
+  {
+    linear += other.linear;
+    angular += other.angular;
+    return (*this);
+  }
+
+  vector6& operator-=(const vector6& other)
+  {
+    linear -= other.linear;
+    angular -= other.angular;
+    return (*this);
+  };
+
+  vector6& operator*=(float scalar)
+  {
+    linear *= scalar;
+    angular *= scalar;
+    return (*this);
+  }
+
+  vector6& operator/=(float scalar)
+  {
+    assert(scalar != 0.0f);
+
+    linear /= scalar;
+    angular /= scalar;
+    return (*this);
+  }
+
+  float& operator[](int index)
+  {
+    assert(index >= 0 && index < length());
+    return index < 3 ? linear[index] : angular[index - 3];
+  }
+
+  float operator[](int index) const
+  {
+    assert(index >= 0 && index < length());
+    return index < 3 ? linear[index] : angular[index - 3];
+  }
+};
+
+// ----- Vector Operations -----
+
+// These are more specialized than the generic versions in vector.h, and are picked instead of them.
+
+inline float dot(const vector6& lhs, const vector6& rhs)
+{
+  return dot(lhs.linear, rhs.linear) + dot(lhs.angular, rhs.angular);
+}
+
+inline bool operator==(const vector6& lhs, const vector6& rhs)
+{
+  return lhs.linear == rhs.linear && lhs.angular == rhs.angular;
+}
+
+} // namespace flexor
\ No newline at end of file
@@ -0,0 +1,49 @@
+#include "collision/broadphase.h"
+
+#include <algorithm>
+
+#include "collision/grid_broadphase.h"
+#include "collision/sap_broadphase.h"
+#include "collision/tree_broadphase.h"
+
+namespace flexor
+{
+
+bool broadphase::canRestorePairs(const snapshot_view& snapshot, int size)
+{
+  std::span<const body_pair> saved = snapshot.array<body_pair>(snapshot_section::broadphasePairs);
+  return std::all_of(saved.begin(), saved.end(),
+                     [size](const body_pair& pair)
+                     { return pair.a >= 0 && pair.a < pair.b && pair.b < size; });
+}
+
+std::unique_ptr<broadphase> createBroadphase(broadphase_type type, thread_pool* pool)
+{
+  switch (type)
+  {
+  case broadphase_type::sweepAndPrune:
+    return std::make_unique<sap_broadphase>();
+  case broadphase_type::grid:
+    return std::make_unique<grid_broadphase>(-1.0f, pool);
+  case broadphase_type::tree:
+  default:
+    return std::make_unique<tree_broadphase>();
+  }
+}
+
+bool canRestoreBroadphase(broadphase_type type, const snapshot_view& snapshot, int bodies)
+{
+  switch (type)
+  {
+  case broadphase_type::tree:
+    return tree_broadphase::canRestore(snapshot, bodies);
+  case broadphase_type::sweepAndPrune:
+    return sap_broadphase::canRestore(snapshot, bodies);
+  case broadphase_type::grid:
+    return grid_broadphase::canRestore(snapshot, bodies);
+  default:
+    return false;
+  }
+}
+
+} // namespace flexor
\ No newline at end of file
@@ -0,0 +1,396 @@
+#include "collision/dynamic_tree.h"
+
+#include <algorithm>
+
+namespace flexor
+{
+
+dynamic_tree::dynamic_tree(float margin, float displacementScale)
+  : margin(margin), displacementScale(displacementScale)
+{
+}
+
+// ----- Proxies -----
+
+int dynamic_tree::createProxy(const aabb& bounds, int userData)
+{
+  int proxy = allocateNode();
+  nodes[proxy].bounds = bounds.fatten(margin);
+  nodes[proxy].userData = userData;
+  nodes[proxy].height = 0;
+
+  insertLeaf(proxy);
+  return proxy;
+}
+
+void dynamic_tree::destroyProxy(int proxy)
+{
+  assert(proxy >= 0 && proxy < static_cast<int>(nodes.size()) && nodes[proxy].isLeaf());
+
+  removeLeaf(proxy);
+  freeNode(proxy);
+}
+
+bool dynamic_tree::moveProxy(int proxy, const aabb& bounds, const vector3& displacement)
+{
+  assert(proxy >= 0 && proxy < static_cast<int>(nodes.size()) && nodes[proxy].isLeaf());
+
+  if (nodes[proxy].bounds.contains(bounds))
+    return false;
+
+  // Grow the new box ahead of the motion, so that a body moving steadily in one direction doesn't
+  // need to be reinserted every step.
+  aabb fat = bounds.fatten(margin);
+  vector3 ahead = displacement * displacementScale;
+  fat.min += min(ahead, vector3(0.0f));
+  fat.max += max(ahead, vector3(0.0f));
+
+  removeLeaf(proxy);
+  nodes[proxy].bounds = fat;
+  insertLeaf(proxy);
+
+  return true;
+}
+
+// ----- Node Pool -----
+
+int dynamic_tree::allocateNode()
+{
+  if (freeList == nullNode)
+  {
+    nodes.emplace_back();
+    return static_cast<int>(nodes.size()) - 1;
+  }
+
+  int node = freeList;
+  freeList = nodes[node].parent;
+  nodes[node] = tree_node();
+  return node;
+}
+
+void dynamic_tree::freeNode(int node)
+{
+  nodes[node].parent = freeList;
+  nodes[node].height = -1;
+  freeList = node;
+}
+
+// ----- Insertion and Removal -----
+
+void dynamic_tree::insertLeaf(int leaf)
+{
+  if (root == nullNode)
+  {
+    root = leaf;
+    nodes[leaf].parent = nullNode;
+    return;
+  }
+
+  // Descend toward the sibling that increases the total surface area the least. At each node, we
+  // compare the cost of pairing the leaf with the node itself against the cheapest possible cost of
+  // descending into either child, which includes the growth of every ancestor along the way.
+  aabb leafBounds = nodes[leaf].bounds;
+  int index = root;
+  while (!nodes[index].isLeaf())
+  {
+    const tree_node& node = nodes[index];
+
+    float area = node.bounds.surfaceArea();
+    float combinedArea = combine(node.bounds, leafBounds).surfaceArea();
+
+    float cost = 2.0f * combinedArea;
+    float inheritanceCost = 2.0f * (combinedArea - area);
+
+    auto descendCost = [&](int child)
+    {
+      float grown = combine(leafBounds, nodes[child].bounds).surfaceArea();
+      if (nodes[child].isLeaf())
+        return grown + inheritanceCost;
+
+      return grown - nodes[child].bounds.surfaceArea() + inheritanceCost;
+    };
+
+    float cost1 = descendCost(node.child1);
+    float cost2 = descendCost(node.child2);
+    if (cost < cost1 && cost < cost2)
+      break;
+
+    index = cost1 < cost2 ? node.child1 : node.child2;
+  }
+
+  // Replace the sibling with a new parent of both the sibling and the leaf. The allocation can grow
+  // the node array, so we don't hold onto references across it.
+  int sibling = index;
+  int oldParent = nodes[sibling].parent;
+  int newParent = allocateNode();
+
+  nodes[newParent].parent = oldParent;
+  nodes[newParent].bounds = combine(leafBounds, nodes[sibling].bounds);
+  nodes[newParent].height = nodes[sibling].height + 1;
+  nodes[newParent].child1 = sibling;
+  nodes[newParent].child2 = leaf;
+  nodes[sibling].parent = newParent;
+  nodes[leaf].parent = newParent;
+
+  if (oldParent == nullNode)
+    root = newParent;
+  else if (nodes[oldParent].child1 == sibling)
+    nodes[oldParent].child1 = newParent;
+  else
+    nodes[oldParent].child2 = newParent;
+
+  refit(newParent);
+}
+
+void dynamic_tree::removeLeaf(int leaf)
+{
+  if (leaf == root)
+  {
+    root = nullNode;
+    return;
+  }
+
+  // The parent of the leaf is removed as well, and the sibling takes its place.
+  int parent = nodes[leaf].parent;
+  int grandParent = nodes[parent].parent;
+  int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+  nodes[sibling].parent = grandParent;
+  freeNode(parent);
+
+  if (grandParent == nullNode)
+  {
+    root = sibling;
+    return;
+  }
+
+  if (nodes[grandParent].child1 == parent)
+    nodes[grandParent].child1 = sibling;
+  else
+    nodes[grandParent].child2 = sibling;
+
+  refit(grandParent);
+}
+
+// ----- Balancing -----
+
+void dynamic_tree::refit(int node)
+{
+  while (node != nullNode)
+  {
+    node = balance(node);
+
+    tree_node& current = nodes[node];
+    const tree_node& child1 = nodes[current.child1];
+    const tree_node& child2 = nodes[current.child2];
+
+    current.height = 1 + std::max(child1.height, child2.height);
+    current.bounds = combine(child1.bounds, child2.bounds);
+
+    node = current.parent;
+  }
+}
+
+int dynamic_tree::balance(int iA)
+{
+  tree_node& A = nodes[iA];
+  if (A.isLeaf() || A.height < 2)
+    return iA;
+
+  int iB = A.child1;
+  int iC = A.child2;
+  tree_node& B = nodes[iB];
+  tree_node& C = nodes[iC];
+
+  // Points the parent of a rotated subtree (or the root) at its new top node.
+  auto replaceChild = [this](int parent, int oldChild, int newChild)
+  {
+    if (parent == nullNode)
+      root = newChild;
+    else if (nodes[parent].child1 == oldChild)
+      nodes[parent].child1 = newChild;
+    else
+      nodes[parent].child2 = newChild;
+  };
+
+  int difference = C.height - B.height;
+
+  // C is too tall, so rotate it up. A keeps B and the shorter child of C, and C takes A and its
+  // taller child.
+  if (difference > 1)
+  {
+    int iF = C.child1;
+    int iG = C.child2;
+    tree_node& F = nodes[iF];
+    tree_node& G = nodes[iG];
+
+    C.child1 = iA;
+    C.parent = A.parent;
+    A.parent = iC;
+    replaceChild(C.parent, iA, iC);
+
+    int taller = F.height > G.height ? iF : iG;
+    int shorter = taller == iF ? iG : iF;
+
+    C.child2 = taller;
+    A.child2 = shorter;
+    nodes[shorter].parent = iA;
+
+    A.bounds = combine(B.bounds, nodes[shorter].bounds);
+    C.bounds = combine(A.bounds, nodes[taller].bounds);
+    A.height = 1 + std::max(B.height, nodes[shorter].height);
+    C.height = 1 + std::max(A.height, nodes[taller].height);
+
+    return iC;
+  }
+
+  // B is too tall, so rotate it up the same way.
+  if (difference < -1)
+  {
+    int iD = B.child1;
+    int iE = B.child2;
+    tree_node& D = nodes[iD];
+    tree_node& E = nodes[iE];
+
+    B.child1 = iA;
+    B.parent = A.parent;
+    A.parent = iB;
+    replaceChild(B.parent, iA, iB);
+
+    int taller = D.height > E.height ? iD : iE;
+    int shorter = taller == iD ? iE : iD;
+
+    B.child2 = taller;
+    A.child1 = shorter;
+    nodes[shorter].parent = iA;
+
+    A.bounds = combine(C.bounds, nodes[shorter].bounds);
+    B.bounds = combine(A.bounds, nodes[taller].bounds);
+    A.height = 1 + std::max(C.height, nodes[shorter].height);
+    B.height = 1 + std::max(A.height, nodes[taller].height);
+
+    return iB;
+  }
+
+  return iA;
+}
+
+// ----- Validation -----
+
+bool dynamic_tree::validate() const
+{
+  if (root == nullNode)
+    return true;
+
+  return nodes[root].parent == nullNode && validate(root);
+}
+
+bool dynamic_tree::validate(int node) const
+{
+  const tree_node& current = nodes[node];
+  if (current.isLeaf())
+    return current.height == 0 && current.child2 == nullNode;
+
+  const tree_node& child1 = nodes[current.child1];
+  const tree_node& child2 = nodes[current.child2];
+  if (child1.parent != node || child2.parent != node)
+    return false;
+
+  if (current.height != 1 + std::max(child1.height, child2.height))
+    return false;
+
+  if (!current.bounds.contains(child1.bounds) || !current.bounds.contains(child2.bounds))
+    return false;
+
+  return validate(current.child1) && validate(current.child2);
+}
+
+// ----- Snapshots -----
+
+void dynamic_tree::save(world_snapshot& snapshot) const
+{
+  int roots[2] = {root, freeList};
+
+  snapshot.write(snapshot_section::treeNodes, nodes);
+  snapshot.write(snapshot_section::treeRoot, std::span<const int>(roots));
+}
+
+void dynamic_tree::restore(const snapshot_view& snapshot)
+{
+  snapshot.read(snapshot_section::treeNodes, nodes);
+
+  std::span<const int> roots = snapshot.array<int>(snapshot_section::treeRoot);
+  root = roots.size() == 2 ? roots[0] : nullNode;
+  freeList = roots.size() == 2 ? roots[1] : nullNode;
+}
+
+bool dynamic_tree::canRestore(const snapshot_view& snapshot, std::span<const int> proxies)
+{
+  std::span<const tree_node> saved = snapshot.array<tree_node>(snapshot_section::treeNodes);
+  std::span<const int> roots = snapshot.array<int>(snapshot_section::treeRoot);
+
+  int count = static_cast<int>(saved.size());
+  auto linked = [count](int node) { return node >= nullNode && node < count; };
+  if (roots.size() != 2 || !linked(roots[0]) || !linked(roots[1]))
+    return false;
+
+  // Every node is reached exactly once, either through the free list or from the root, which also
+  // rules out any cycles.
+  std::vector<bool> reached(count, false);
+  for (int node = roots[1]; node != nullNode; node = saved[node].parent)
+  {
+    if (reached[node] || saved[node].height != -1 || !linked(saved[node].parent))
+      return false;
+
+    reached[node] = true;
+  }
+
+  std::vector<int> stack;
+  if (roots[0] != nullNode)
+  {
+    if (saved[roots[0]].parent != nullNode || saved[roots[0]].height >= maxDepth - 1)
+      return false;
+
+    stack.push_back(roots[0]);
+  }
+
+  int leaves = 0;
+  while (!stack.empty())
+  {
+    int node = stack.back();
+    stack.pop_back();
+    if (reached[node])
+      return false;
+
+    reached[node] = true;
+    const tree_node& current = saved[node];
+    if (current.isLeaf())
+    {
+      int body = current.userData;
+      if (current.child2 != nullNode || current.height != 0 || body < 0 ||
+          body >= static_cast<int>(proxies.size()) || proxies[body] != node)
+        return false;
+
+      leaves++;
+      continue;
+    }
+
+    int child1 = current.child1;
+    int child2 = current.child2;
+    if (child1 < 0 || child1 >= count || child2 < 0 || child2 >= count ||
+        saved[child1].parent != node || saved[child2].parent != node ||
+        current.height != 1 + std::max(saved[child1].height, saved[child2].height))
+      return false;
+
+    stack.push_back(child1);
+    stack.push_back(child2);
+  }
+
+  // Each leaf belongs to a different proxy, so counting them is enough to know they cover all the
+  // proxies.
+  auto proxyCount = std::count_if(proxies.begin(), proxies.end(),
+                                  [](int proxy) { return proxy != nullNode; });
+  return leaves == proxyCount && std::find(reached.begin(), reached.end(), false) == reached.end();
+}
+
+} // namespace flexor
\ No newline at end of file
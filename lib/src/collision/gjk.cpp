@@ -0,0 +1,537 @@
+#include "collision/gjk.h"
+
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+#include <limits>
+
+namespace flexor
+{
+
+// ----- Helper Functions -----
+
+/**
+ * Finds the vertex of the Minkowski difference A - B that is farthest along a direction.
+ */
+static support_point supportPoint(const convex_proxy& a, const convex_proxy& b,
+                                  const vector3& dir)
+{
+  vector3 pointA = a.support(dir);
+  vector3 pointB = b.support(-dir);
+  return {pointA - pointB, pointA, pointB};
+}
+
+static float lengthSquared(const vector3& vec)
+{
+  return dot(vec, vec);
+}
+
+/**
+ * Keeps only the given vertices of a simplex, with the given barycentric weights.
+ */
+static void reduce(gjk_simplex& simplex, std::initializer_list<int> keep,
+                   std::initializer_list<float> weights)
+{
+  support_point vertices[4];
+  int count = 0;
+  for (int index : keep)
+    vertices[count++] = simplex.vertices[index];
+
+  count = 0;
+  for (float weight : weights)
+  {
+    simplex.vertices[count] = vertices[count];
+    simplex.weights[count] = weight;
+    count++;
+  }
+
+  simplex.count = count;
+}
+
+// ----- Simplex Solvers -----
+
+// Each solver finds the point of the simplex closest to the origin, reduces the simplex to the
+// smallest face that holds that point, and records its barycentric weights. The voronoi region
+// tests follow Ericson's Real-Time Collision Detection, with the query point at the origin.
+
+static vector3 solveSegment(gjk_simplex& simplex)
+{
+  vector3 a = simplex.vertices[0].w;
+  vector3 b = simplex.vertices[1].w;
+  vector3 ab = b - a;
+
+  float t = -dot(a, ab);
+  if (t <= 0.0f)
+  {
+    reduce(simplex, {0}, {1.0f});
+    return a;
+  }
+
+  float denom = dot(ab, ab);
+  if (t >= denom)
+  {
+    reduce(simplex, {1}, {1.0f});
+    return b;
+  }
+
+  t /= denom;
+  simplex.weights[0] = 1.0f - t;
+  simplex.weights[1] = t;
+  return a + ab * t;
+}
+
+static vector3 solveTriangle(gjk_simplex& simplex)
+{
+  vector3 a = simplex.vertices[0].w;
+  vector3 b = simplex.vertices[1].w;
+  vector3 c = simplex.vertices[2].w;
+  vector3 ab = b - a;
+  vector3 ac = c - a;
+
+  float d1 = -dot(ab, a);
+  float d2 = -dot(ac, a);
+  if (d1 <= 0.0f && d2 <= 0.0f)
+  {
+    reduce(simplex, {0}, {1.0f});
+    return a;
+  }
+
+  float d3 = -dot(ab, b);
+  float d4 = -dot(ac, b);
+  if (d3 >= 0.0f && d4 <= d3)
+  {
+    reduce(simplex, {1}, {1.0f});
+    return b;
+  }
+
+  float vc = d1 * d4 - d3 * d2;
+  if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+  {
+    float v = d1 / (d1 - d3);
+    reduce(simplex, {0, 1}, {1.0f - v, v});
+    return a + ab * v;
+  }
+
+  float d5 = -dot(ab, c);
+  float d6 = -dot(ac, c);
+  if (d6 >= 0.0f && d5 <= d6)
+  {
+    reduce(simplex, {2}, {1.0f});
+    return c;
+  }
+
+  float vb = d5 * d2 - d1 * d6;
+  if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+  {
+    float w = d2 / (d2 - d6);
+    reduce(simplex, {0, 2}, {1.0f - w, w});
+    return a + ac * w;
+  }
+
+  float va = d3 * d6 - d5 * d4;
+  if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+  {
+    float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+    reduce(simplex, {1, 2}, {1.0f - w, w});
+    return b + (c - b) * w;
+  }
+
+  float denom = 1.0f / (va + vb + vc);
+  float v = vb * denom;
+  float w = vc * denom;
+  simplex.weights[0] = 1.0f - v - w;
+  simplex.weights[1] = v;
+  simplex.weights[2] = w;
+  return a + ab * v + ac * w;
+}
+
+/**
+ * Solves a tetrahedron, and reports whether it contains the origin. If it doesn't, the closest
+ * point lies on one of the faces that the origin is in front of.
+ */
+static vector3 solveTetrahedron(gjk_simplex& simplex, bool& inside)
+{
+  constexpr int faces[4][4] = {{0, 1, 2, 3}, {0, 3, 1, 2}, {0, 2, 3, 1}, {1, 3, 2, 0}};
+
+  gjk_simplex best;
+  vector3 closest(0.0f);
+  float bestDistance = std::numeric_limits<float>::max();
+
+  inside = true;
+  for (const auto& face : faces)
+  {
+    vector3 p0 = simplex.vertices[face[0]].w;
+    vector3 normal = cross(simplex.vertices[face[1]].w - p0, simplex.vertices[face[2]].w - p0);
+
+    // The origin is outside of this face when it's on the other side from the fourth vertex.
+    float origin = -dot(normal, p0);
+    float opposite = dot(normal, simplex.vertices[face[3]].w - p0);
+    if (origin * opposite > 0.0f)
+      continue;
+
+    inside = false;
+
+    gjk_simplex triangle;
+    triangle.count = 3;
+    for (int i = 0; i < 3; i++)
+      triangle.vertices[i] = simplex.vertices[face[i]];
+
+    vector3 point = solveTriangle(triangle);
+    float distance = lengthSquared(point);
+    if (distance < bestDistance)
+    {
+      bestDistance = distance;
+      best = triangle;
+      closest = point;
+    }
+  }
+
+  if (!inside)
+    simplex = best;
+
+  return closest;
+}
+
+// ----- GJK -----
+
+gjk_output gjkDistance(const convex_proxy& a, const convex_proxy& b, gjk_simplex& simplex)
+{
+  constexpr int maxIterations = 64;
+
+  // Any vertex of the difference will do as a start, but the one toward the other shape usually
+  // saves an iteration.
+  vector3 dir = a.transform.position - b.transform.position;
+  if (lengthSquared(dir) < 1e-12f)
+    dir = vector3(1.0f, 0.0f, 0.0f);
+
+  simplex.count = 1;
+  simplex.vertices[0] = supportPoint(a, b, dir);
+  simplex.weights[0] = 1.0f;
+  vector3 closest = simplex.vertices[0].w;
+
+  gjk_output output;
+  for (; output.iterations < maxIterations; output.iterations++)
+  {
+    float distance = lengthSquared(closest);
+    if (distance < 1e-12f)
+    {
+      output.overlap = true;
+      break;
+    }
+
+    // If the farthest point toward the origin gets no closer along the search direction than the
+    // current closest point, then that closest point is the closest point of the whole difference.
+    support_point next = supportPoint(a, b, -closest);
+    if (distance - dot(closest, next.w) <= 1e-6f * distance)
+      break;
+
+    bool duplicate = false;
+    for (int i = 0; i < simplex.count; i++)
+      duplicate |= lengthSquared(simplex.vertices[i].w - next.w) < 1e-12f;
+
+    if (duplicate)
+      break;
+
+    simplex.vertices[simplex.count++] = next;
+
+    bool inside = false;
+    if (simplex.count == 2)
+      closest = solveSegment(simplex);
+    else if (simplex.count == 3)
+      closest = solveTriangle(simplex);
+    else
+      closest = solveTetrahedron(simplex, inside);
+
+    if (inside)
+    {
+      output.overlap = true;
+      break;
+    }
+
+    // Rounding can keep the simplex from making progress near the end, which means we're done.
+    if (lengthSquared(closest) >= distance)
+      break;
+  }
+
+  if (!output.overlap)
+  {
+    for (int i = 0; i < simplex.count; i++)
+    {
+      output.pointA += simplex.vertices[i].a * simplex.weights[i];
+      output.pointB += simplex.vertices[i].b * simplex.weights[i];
+    }
+
+    output.distance = magnitude(output.pointA - output.pointB);
+  }
+
+  return output;
+}
+
+// ----- EPA -----
+
+namespace
+{
+
+constexpr int epaMaxVertices = 64;
+constexpr int epaMaxFaces = 128;
+constexpr int epaMaxIterations = 48;
+
+struct epa_face
+{
+  int vertices[3];
+  vector3 normal;
+  float distance;
+  bool live;
+};
+
+struct epa_edge
+{
+  int from;
+  int to;
+};
+
+} // namespace
+
+/**
+ * Grows a simplex that contains the origin into a tetrahedron, by adding support points in
+ * directions that leave the current line or plane.
+ */
+static bool buildTetrahedron(const convex_proxy& a, const convex_proxy& b, support_point* vertices,
+                             int& count)
+{
+  constexpr float epsilon = 1e-6f;
+  const vector3 axes[6] = {vector3(1.0f, 0.0f, 0.0f), vector3(-1.0f, 0.0f, 0.0f),
+                           vector3(0.0f, 1.0f, 0.0f), vector3(0.0f, -1.0f, 0.0f),
+                           vector3(0.0f, 0.0f, 1.0f), vector3(0.0f, 0.0f, -1.0f)};
+
+  if (count == 1)
+  {
+    for (const vector3& axis : axes)
+    {
+      support_point point = supportPoint(a, b, axis);
+      if (lengthSquared(point.w - vertices[0].w) > epsilon * epsilon)
+      {
+        vertices[count++] = point;
+        break;
+      }
+    }
+  }
+
+  if (count == 2)
+  {
+    vector3 line = vertices[1].w - vertices[0].w;
+
+    // Any axis that isn't parallel to the line gives a perpendicular direction.
+    vector3 axis = std::fabs(line.x) < std::fabs(line.y)
+                     ? (std::fabs(line.x) < std::fabs(line.z) ? axes[0] : axes[4])
+                     : (std::fabs(line.y) < std::fabs(line.z) ? axes[2] : axes[4]);
+    vector3 first = normalize(cross(line, axis));
+    vector3 second = cross(normalize(line), first);
+
+    for (const vector3& dir : {first, -first, second, -second})
+    {
+      support_point point = supportPoint(a, b, dir);
+      if (lengthSquared(cross(point.w - vertices[0].w, line)) >
+          epsilon * epsilon * lengthSquared(line))
+      {
+        vertices[count++] = point;
+        break;
+      }
+    }
+  }
+
+  if (count == 3)
+  {
+    vector3 normal = cross(vertices[1].w - vertices[0].w, vertices[2].w - vertices[0].w);
+    for (const vector3& dir : {normal, -normal})
+    {
+      support_point point = supportPoint(a, b, dir);
+      if (std::fabs(dot(point.w - vertices[0].w, normal)) > epsilon * magnitude(normal))
+      {
+        vertices[count++] = point;
+        break;
+      }
+    }
+  }
+
+  return count == 4;
+}
+
+/**
+ * Fills in the normal and distance of a face, flipping the normal to point away from the given
+ * interior point. Returns false if the face is too thin to have a normal.
+ */
+static bool makeFace(const support_point* vertices, epa_face& face, int v0, int v1, int v2)
+{
+  vector3 normal = cross(vertices[v1].w - vertices[v0].w, vertices[v2].w - vertices[v0].w);
+  float length = magnitude(normal);
+  if (length < 1e-12f)
+    return false;
+
+  face.vertices[0] = v0;
+  face.vertices[1] = v1;
+  face.vertices[2] = v2;
+  face.normal = normal / length;
+  face.distance = dot(face.normal, vertices[v0].w);
+  face.live = true;
+  return true;
+}
+
+/**
+ * Returns the index of the live face nearest the origin, or -1 if every face is dead.
+ */
+static int closestFace(const epa_face* faces, int count)
+{
+  int closest = -1;
+  for (int i = 0; i < count; i++)
+    if (faces[i].live && (closest < 0 || faces[i].distance < faces[closest].distance))
+      closest = i;
+
+  return closest;
+}
+
+bool epaPenetration(const convex_proxy& a, const convex_proxy& b, const gjk_simplex& simplex,
+                    epa_output& output)
+{
+  support_point vertices[epaMaxVertices];
+  int vertexCount = simplex.count;
+  for (int i = 0; i < simplex.count; i++)
+    vertices[i] = simplex.vertices[i];
+
+  if (!buildTetrahedron(a, b, vertices, vertexCount))
+    return false;
+
+  // Wind every face of the tetrahedron so that its normal points away from the opposite vertex.
+  epa_face faces[epaMaxFaces];
+  int faceCount = 0;
+
+  constexpr int tetrahedron[4][4] = {{0, 1, 2, 3}, {0, 3, 1, 2}, {0, 2, 3, 1}, {1, 3, 2, 0}};
+  for (const auto& face : tetrahedron)
+  {
+    vector3 p0 = vertices[face[0]].w;
+    vector3 normal = cross(vertices[face[1]].w - p0, vertices[face[2]].w - p0);
+    bool flip = dot(normal, vertices[face[3]].w - p0) > 0.0f;
+
+    if (!makeFace(vertices, faces[faceCount], face[0], flip ? face[2] : face[1],
+                  flip ? face[1] : face[2]))
+      return false;
+
+    faceCount++;
+  }
+
+  // The closest face is kept by index, since dropping the dead faces moves the rest around. It only
+  // still names the closest face if the search stopped before the polytope changed.
+  int closest = -1;
+  bool changed = true;
+  for (int iteration = 0; iteration < epaMaxIterations; iteration++)
+  {
+    closest = closestFace(faces, faceCount);
+    if (closest < 0)
+      return false;
+
+    // Once the support point along the normal of the closest face is no farther out than the face
+    // itself, the face lies on the surface of the difference.
+    changed = false;
+    support_point point = supportPoint(a, b, faces[closest].normal);
+    float distance = dot(point.w, faces[closest].normal);
+    if (distance - faces[closest].distance <= 1e-4f * std::max(1.0f, distance))
+      break;
+
+    if (vertexCount == epaMaxVertices)
+      break;
+
+    changed = true;
+
+    int index = vertexCount++;
+    vertices[index] = point;
+
+    // Remove every face the new point can see. The edges of those faces that aren't shared by two
+    // of them form the horizon, which gets connected to the new point.
+    epa_edge horizon[3 * epaMaxFaces];
+    int edgeCount = 0;
+    for (int i = 0; i < faceCount; i++)
+    {
+      epa_face& face = faces[i];
+      if (!face.live || dot(face.normal, point.w - vertices[face.vertices[0]].w) <= 0.0f)
+        continue;
+
+      face.live = false;
+      for (int e = 0; e < 3; e++)
+      {
+        epa_edge edge = {face.vertices[e], face.vertices[(e + 1) % 3]};
+
+        bool shared = false;
+        for (int j = 0; j < edgeCount; j++)
+          if (horizon[j].from == edge.to && horizon[j].to == edge.from)
+          {
+            horizon[j] = horizon[--edgeCount];
+            shared = true;
+            break;
+          }
+
+        if (!shared)
+          horizon[edgeCount++] = edge;
+      }
+    }
+
+    // Make room for the new faces by dropping the dead ones.
+    if (faceCount + edgeCount > epaMaxFaces)
+    {
+      int live = 0;
+      for (int i = 0; i < faceCount; i++)
+        if (faces[i].live)
+          faces[live++] = faces[i];
+
+      faceCount = live;
+      if (faceCount + edgeCount > epaMaxFaces)
+        break;
+    }
+
+    for (int e = 0; e < edgeCount; e++)
+      if (makeFace(vertices, faces[faceCount], horizon[e].from, horizon[e].to, index))
+        faceCount++;
+  }
+
+  if (changed)
+  {
+    closest = closestFace(faces, faceCount);
+    if (closest < 0)
+      return false;
+  }
+
+  const epa_face& face = faces[closest];
+  output.normal = face.normal;
+  output.depth = std::max(face.distance, 0.0f);
+
+  // The deepest points come from the barycentric coordinates of the origin's projection onto the
+  // closest face.
+  const support_point& p0 = vertices[face.vertices[0]];
+  const support_point& p1 = vertices[face.vertices[1]];
+  const support_point& p2 = vertices[face.vertices[2]];
+
+  vector3 e0 = p1.w - p0.w;
+  vector3 e1 = p2.w - p0.w;
+  vector3 e2 = face.normal * face.distance - p0.w;
+
+  float d00 = dot(e0, e0);
+  float d01 = dot(e0, e1);
+  float d11 = dot(e1, e1);
+  float d20 = dot(e2, e0);
+  float d21 = dot(e2, e1);
+  float denom = d00 * d11 - d01 * d01;
+
+  float v = 0.0f;
+  float w = 0.0f;
+  if (std::fabs(denom) > 1e-12f)
+  {
+    v = (d11 * d20 - d01 * d21) / denom;
+    w = (d00 * d21 - d01 * d20) / denom;
+  }
+
+  float u = 1.0f - v - w;
+  output.pointA = p0.a * u + p1.a * v + p2.a * w;
+  output.pointB = p0.b * u + p1.b * v + p2.b * w;
+  return true;
+}
+
+} // namespace flexor
\ No newline at end of file
@@ -0,0 +1,427 @@
+#include "collision/grid_broadphase.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace flexor
+{
+
+// ----- Helper Functions -----
+
+static float largestExtent(const aabb& box)
+{
+  vector3 size = box.max - box.min;
+  return std::max(size.x, std::max(size.y, size.z));
+}
+
+// ----- Grid Broadphase -----
+
+grid_broadphase::grid_broadphase(float cellSize, thread_pool* pool)
+  : minimumCellSize(cellSize), pool(pool)
+{
+}
+
+// ----- Bodies -----
+
+void grid_broadphase::add(int body, const aabb& box, bool isStatic)
+{
+  assert(body >= 0 && !tracked(body));
+
+  if (body >= static_cast<int>(slots.size()))
+  {
+    bounds.resize(body + 1);
+    statics.resize(body + 1, false);
+    slots.resize(body + 1, false);
+    activeSlots.resize(body + 1, -1);
+  }
+
+  bounds[body] = box;
+  statics[body] = isStatic;
+  slots[body] = true;
+
+  activeSlots[body] = static_cast<int>(active.size());
+  active.push_back(body);
+}
+
+void grid_broadphase::move(int body, const aabb& box, const vector3&)
+{
+  assert(tracked(body));
+
+  // The grid is rebuilt from the current bounds every update, so the motion doesn't matter.
+  bounds[body] = box;
+}
+
+void grid_broadphase::remove(int body)
+{
+  assert(tracked(body));
+
+  slots[body] = false;
+
+  int slot = activeSlots[body];
+  active[slot] = active.back();
+  activeSlots[active[slot]] = slot;
+  active.pop_back();
+  activeSlots[body] = -1;
+}
+
+// ----- Grid -----
+
+grid_broadphase::cell_coord grid_broadphase::cellOf(const vector3& point) const
+{
+  return {static_cast<int>(std::floor(point.x * inverseCellSize)),
+          static_cast<int>(std::floor(point.y * inverseCellSize)),
+          static_cast<int>(std::floor(point.z * inverseCellSize))};
+}
+
+std::uint32_t grid_broadphase::bucketOf(const cell_coord& cell) const
+{
+  if (dense)
+  {
+    int x = cell.x - origin.x;
+    int y = cell.y - origin.y;
+    int z = cell.z - origin.z;
+    return x + dimensions.x * (y + dimensions.y * z);
+  }
+
+  // Each coordinate is scaled by a large odd constant, and the top bits of the sum pick the bucket.
+  // This spreads neighbouring cells far apart, where the common xor of products hash sends many
+  // nearby cells to the same bucket. Distinct cells may still share a bucket, which only costs a
+  // few extra comparisons.
+  std::uint32_t hash = static_cast<std::uint32_t>(cell.x) * 0x8da6b343u +
+                       static_cast<std::uint32_t>(cell.y) * 0xd8163841u +
+                       static_cast<std::uint32_t>(cell.z) * 0xcb1ab31fu;
+
+  return hash >> (32 - bucketBits);
+}
+
+void grid_broadphase::binBodies()
+{
+  int count = static_cast<int>(gridded.size());
+
+  // In a compact world, giving each cell its own bucket keeps neighbouring cells next to each
+  // other in memory and never mixes cells. The grid is only used when it has at most a few cells
+  // per body though, since a sparse world would be mostly empty cells.
+  cell_coord low = cellOf(bounds[gridded[0]].min);
+  cell_coord high = low;
+  for (int body : gridded)
+  {
+    cell_coord cell = cellOf(bounds[body].min);
+    low = {std::min(low.x, cell.x), std::min(low.y, cell.y), std::min(low.z, cell.z)};
+    high = {std::max(high.x, cell.x), std::max(high.y, cell.y), std::max(high.z, cell.z)};
+  }
+
+  occupiedLow = low;
+  occupiedHigh = high;
+
+  // The dense grid is padded by an empty cell on every side, so that every neighbour of an
+  // occupied cell is inside the grid, and the neighbours along x never wrap into another row.
+  double cells = (static_cast<double>(high.x) - low.x + 3) *
+                 (static_cast<double>(high.y) - low.y + 3) *
+                 (static_cast<double>(high.z) - low.z + 3);
+
+  dense = cells <= 4.0 * count;
+  if (dense)
+  {
+    origin = {low.x - 1, low.y - 1, low.z - 1};
+    dimensions = {high.x - low.x + 3, high.y - low.y + 3, high.z - low.z + 3};
+    buckets = static_cast<int>(cells);
+  }
+  else
+  {
+    // Two buckets per body keeps unrelated cells from sharing buckets too often. The table size
+    // is a power of two so that the bucket is just the top bits of the hash.
+    bucketBits = 1;
+    while ((1 << bucketBits) < 2 * count && bucketBits < 30)
+      bucketBits++;
+
+    buckets = 1 << bucketBits;
+  }
+
+  griddedBuckets.resize(count);
+  auto hashBodies = [&](int begin, int end, int)
+  {
+    for (int i = begin; i < end; i++)
+      griddedBuckets[i] = bucketOf(cellOf(bounds[gridded[i]].min));
+  };
+
+  if (pool)
+    pool->parallelFor(count, 1024, hashBodies);
+  else
+    hashBodies(0, count, 0);
+
+  // A counting sort lays out the bodies of each bucket contiguously in two linear passes. The
+  // starts are used as insertion cursors and shifted back afterwards.
+  bucketStarts.assign(buckets + 1, 0);
+  for (int i = 0; i < count; i++)
+    bucketStarts[griddedBuckets[i] + 1]++;
+
+  for (int b = 0; b < buckets; b++)
+    bucketStarts[b + 1] += bucketStarts[b];
+
+  binned.resize(count);
+  for (int i = 0; i < count; i++)
+  {
+    int body = gridded[i];
+    binned[bucketStarts[griddedBuckets[i]]++] = {bounds[body], cellOf(bounds[body].min), body};
+  }
+
+  for (int b = buckets; b > 0; b--)
+    bucketStarts[b] = bucketStarts[b - 1];
+  bucketStarts[0] = 0;
+}
+
+// ----- Pairs -----
+
+void grid_broadphase::findPairs(int index, std::vector<body_pair>& pairs) const
+{
+  const grid_entry& entry = binned[index];
+
+  auto test = [&](const grid_entry& other)
+  {
+    if (!overlaps(entry.bounds, other.bounds) || (statics[entry.body] && statics[other.body]))
+      return;
+
+    pairs.push_back({std::min(entry.body, other.body), std::max(entry.body, other.body)});
+  };
+
+  // Bodies in the same cell are paired in bucket order, so only the later ones are tested. The
+  // rest of the search covers the 13 neighbours that come after this cell in (z, y, x) order, and
+  // the cell on the other side of each one searches this cell in turn.
+  int bucket = bucketOf(entry.cell);
+
+  // In the dense grid, the three cells of a row along x are consecutive buckets, and so their
+  // bodies are contiguous. The 13 neighbours become the next cell in this row, and four whole
+  // rows: the one above in this slab, and the three around this cell in the next slab.
+  if (dense)
+  {
+    int row = dimensions.x;
+    int slab = dimensions.x * dimensions.y;
+
+    for (int i = index + 1; i < bucketStarts[bucket + 2]; i++)
+      test(binned[i]);
+
+    for (int center : {bucket + row, bucket - row + slab, bucket + slab, bucket + row + slab})
+      for (int i = bucketStarts[center - 1]; i < bucketStarts[center + 2]; i++)
+        test(binned[i]);
+
+    return;
+  }
+
+  // Hashed buckets may mix in other cells, which have to be skipped.
+  for (int i = index + 1; i < bucketStarts[bucket + 1]; i++)
+    if (binned[i].cell == entry.cell)
+      test(binned[i]);
+
+  for (int dz = 0; dz <= 1; dz++)
+    for (int dy = dz == 0 ? 0 : -1; dy <= 1; dy++)
+      for (int dx = dz == 0 && dy == 0 ? 1 : -1; dx <= 1; dx++)
+      {
+        cell_coord cell = {entry.cell.x + dx, entry.cell.y + dy, entry.cell.z + dz};
+
+        int neighbour = bucketOf(cell);
+        for (int i = bucketStarts[neighbour]; i < bucketStarts[neighbour + 1]; i++)
+          if (binned[i].cell == cell)
+            test(binned[i]);
+      }
+}
+
+void grid_broadphase::findOverflowPairs(int index, std::vector<body_pair>& pairs) const
+{
+  int body = overflow[index];
+  const aabb& box = bounds[body];
+  bool isStatic = statics[body];
+
+  auto test = [&](int other, const aabb& otherBox)
+  {
+    if (!overlaps(box, otherBox) || (isStatic && statics[other]))
+      return;
+
+    pairs.push_back({std::min(body, other), std::max(body, other)});
+  };
+
+  // There are only ever a few bodies left out of the grid, so they are simply tested against each
+  // other, each one against the ones after it.
+  for (int i = index + 1; i < static_cast<int>(overflow.size()); i++)
+    test(overflow[i], bounds[overflow[i]]);
+
+  if (binned.empty())
+    return;
+
+  // The boxes in the grid are smaller than a cell, so any box that reaches this one has its minimum
+  // corner between the cell before the minimum corner of this box and the cell of its maximum.
+  cell_coord low = cellOf(box.min);
+  cell_coord high = cellOf(box.max);
+  low = {std::max(low.x - 1, occupiedLow.x), std::max(low.y - 1, occupiedLow.y),
+         std::max(low.z - 1, occupiedLow.z)};
+  high = {std::min(high.x, occupiedHigh.x), std::min(high.y, occupiedHigh.y),
+          std::min(high.z, occupiedHigh.z)};
+
+  if (low.x > high.x || low.y > high.y || low.z > high.z)
+    return;
+
+  // A box that covers more cells than there are bodies in the grid, such as a floor under the
+  // whole world, is cheaper to test against every body.
+  double cells = (static_cast<double>(high.x) - low.x + 1) *
+                 (static_cast<double>(high.y) - low.y + 1) *
+                 (static_cast<double>(high.z) - low.z + 1);
+
+  if (cells >= static_cast<double>(binned.size()))
+  {
+    for (const grid_entry& entry : binned)
+      test(entry.body, entry.bounds);
+
+    return;
+  }
+
+  // Hashed buckets may mix in other cells, which have to be skipped, and that also keeps a bucket
+  // shared by two of the cells from being searched twice.
+  for (int z = low.z; z <= high.z; z++)
+    for (int y = low.y; y <= high.y; y++)
+      for (int x = low.x; x <= high.x; x++)
+      {
+        cell_coord cell = {x, y, z};
+
+        int bucket = bucketOf(cell);
+        for (int i = bucketStarts[bucket]; i < bucketStarts[bucket + 1]; i++)
+          if (dense || binned[i].cell == cell)
+            test(binned[i].body, binned[i].bounds);
+      }
+}
+
+void grid_broadphase::updatePairs()
+{
+  pairList.clear();
+  gridded.clear();
+  overflow.clear();
+
+  if (active.empty())
+    return;
+
+  // Static bodies never move, and any size they have would only pad the cells, so they stay out of
+  // the grid along with the few moving bodies that are far larger than the rest.
+  double totalExtent = 0.0;
+  int moving = 0;
+  for (int body : active)
+    if (!statics[body])
+    {
+      totalExtent += largestExtent(bounds[body]);
+      moving++;
+    }
+
+  float oversized = moving > 0 ? oversizeRatio * static_cast<float>(totalExtent / moving) : 0.0f;
+  oversized = std::max(oversized, minimumCellSize);
+
+  // Two boxes can only overlap if their minimum corners are less than a cell apart on every axis,
+  // which is what makes searching the neighbouring cells enough.
+  float cellSize = minimumCellSize;
+  for (int body : active)
+  {
+    float extent = largestExtent(bounds[body]);
+    if (statics[body] || extent > oversized)
+      overflow.push_back(body);
+    else
+    {
+      gridded.push_back(body);
+      cellSize = std::max(cellSize, extent);
+    }
+  }
+
+  // The cells are grown a hair so that rounding in the cell lookup can't push two boxes that
+  // exactly touch two cells apart.
+  inverseCellSize = cellSize > 0.0f ? 1.0f / (cellSize * 1.001f) : 1.0f;
+  if (!gridded.empty())
+    binBodies();
+  else
+    binned.clear();
+
+  // The bodies in the grid are searched in fixed chunks, followed by one job for each body left
+  // out of it, so that a large body doesn't hold up the rest of its chunk.
+  constexpr int chunk = 256;
+  int count = static_cast<int>(gridded.size());
+  int gridJobs = (count + chunk - 1) / chunk;
+  int jobs = gridJobs + static_cast<int>(overflow.size());
+  chunkPairs.resize(jobs);
+
+  auto searchBodies = [&](int begin, int end, int)
+  {
+    for (int job = begin; job < end; job++)
+    {
+      std::vector<body_pair>& pairs = chunkPairs[job];
+      pairs.clear();
+
+      if (job >= gridJobs)
+      {
+        findOverflowPairs(job - gridJobs, pairs);
+        continue;
+      }
+
+      for (int i = job * chunk; i < std::min((job + 1) * chunk, count); i++)
+        findPairs(i, pairs);
+    }
+  };
+
+  if (pool)
+    pool->parallelFor(jobs, 1, searchBodies);
+  else
+    searchBodies(0, jobs, 0);
+
+  for (int i = 0; i < jobs; i++)
+    pairList.insert(pairList.end(), chunkPairs[i].begin(), chunkPairs[i].end());
+}
+
+// ----- Snapshots -----
+
+void grid_broadphase::save(world_snapshot& snapshot) const
+{
+  snapshot.write(snapshot_section::broadphaseBounds, bounds);
+  snapshot.writeFlags(snapshot_section::broadphaseStatics, statics);
+  snapshot.writeFlags(snapshot_section::broadphaseSlots, slots);
+  snapshot.write(snapshot_section::gridActiveSlots, activeSlots);
+  snapshot.write(snapshot_section::gridActive, active);
+  snapshot.write(snapshot_section::broadphasePairs, pairList);
+}
+
+void grid_broadphase::restore(const snapshot_view& snapshot)
+{
+  snapshot.read(snapshot_section::broadphaseBounds, bounds);
+  snapshot.readFlags(snapshot_section::broadphaseStatics, statics);
+  snapshot.readFlags(snapshot_section::broadphaseSlots, slots);
+  snapshot.read(snapshot_section::gridActiveSlots, activeSlots);
+  snapshot.read(snapshot_section::gridActive, active);
+  snapshot.read(snapshot_section::broadphasePairs, pairList);
+}
+
+bool grid_broadphase::canRestore(const snapshot_view& snapshot, int bodies)
+{
+  std::span<const aabb> savedBounds = snapshot.array<aabb>(snapshot_section::broadphaseBounds);
+  std::span<const std::uint8_t> savedStatics =
+    snapshot.array<std::uint8_t>(snapshot_section::broadphaseStatics);
+  std::span<const std::uint8_t> savedSlots =
+    snapshot.array<std::uint8_t>(snapshot_section::broadphaseSlots);
+  std::span<const int> savedActiveSlots = snapshot.array<int>(snapshot_section::gridActiveSlots);
+  std::span<const int> savedActive = snapshot.array<int>(snapshot_section::gridActive);
+
+  int count = static_cast<int>(savedBounds.size());
+  if (count < bodies || savedStatics.size() != savedBounds.size() ||
+      savedSlots.size() != savedBounds.size() || savedActiveSlots.size() != savedBounds.size() ||
+      savedActive.size() != static_cast<std::size_t>(bodies))
+    return false;
+
+  for (int body = 0; body < count; body++)
+    if ((savedSlots[body] != 0) != (body < bodies))
+      return false;
+
+  // The active list names each tracked body once, since there are exactly as many entries as
+  // tracked bodies and each one points back at its own slot.
+  for (int slot = 0; slot < bodies; slot++)
+  {
+    int body = savedActive[slot];
+    if (body < 0 || body >= bodies || savedActiveSlots[body] != slot)
+      return false;
+  }
+
+  return canRestorePairs(snapshot, count);
+}
+
+} // namespace flexor
\ No newline at end of file
@@ -0,0 +1,252 @@
+#include "collision/manifold_cache.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace flexor
+{
+
+// ----- Helper Functions -----
+
+// Points from GJK and EPA that are within this distance of each other are the same point, and a
+// kept point is dropped once its surfaces drift this far apart along the normal, or this far
+// sideways.
+constexpr float persistDistance = 0.02f;
+
+static std::uint32_t hashKey(std::uint64_t key, int bits)
+{
+  return static_cast<std::uint32_t>((key * 0x9e3779b97f4a7c15ull) >> (64 - bits));
+}
+
+// ----- Manifold Cache -----
+
+int manifold_cache::find(int bodyA, int bodyB) const
+{
+  if (kept.empty())
+    return -1;
+
+  std::uint64_t key = keyOf(bodyA, bodyB);
+  std::uint32_t mask = (1u << tableBits) - 1;
+  for (std::uint32_t slot = hashKey(key, tableBits);; slot = (slot + 1) & mask)
+  {
+    const table_slot& entry = table[slot];
+    if (entry.manifold < 0)
+      return -1;
+
+    if (entry.key == key)
+      return entry.manifold;
+  }
+}
+
+void manifold_cache::merge(contact_manifold& manifold, const body_store& bodies) const
+{
+  int index = find(manifold.bodyA, manifold.bodyB);
+  if (index < 0)
+    return;
+
+  const contact_manifold& previous = kept[index];
+  bool matched[contact_manifold::maxPoints] = {};
+  bool generic = false;
+
+  for (int i = 0; i < manifold.count; i++)
+  {
+    contact_point& point = manifold.points[i];
+    generic |= point.id == 0;
+
+    // Points with features match the point with the same features, and the rest match the closest
+    // point without any.
+    int match = -1;
+    float closest = persistDistance * persistDistance;
+    for (int j = 0; j < previous.count; j++)
+    {
+      const contact_point& old = previous.points[j];
+      if (matched[j] || old.id != point.id)
+        continue;
+
+      if (point.id != 0)
+      {
+        match = j;
+        break;
+      }
+
+      vector3 offset = old.position - point.position;
+      float distance = dot(offset, offset);
+      if (distance < closest)
+      {
+        closest = distance;
+        match = j;
+      }
+    }
+
+    if (match < 0)
+      continue;
+
+    matched[match] = true;
+    point.normalImpulse = previous.points[match].normalImpulse;
+    point.tangentImpulse[0] = previous.points[match].tangentImpulse[0];
+    point.tangentImpulse[1] = previous.points[match].tangentImpulse[1];
+  }
+
+  if (!generic)
+    return;
+
+  // Follow the unmatched points of the last step with the bodies, and keep the ones whose surfaces
+  // still touch. The deepest and widest spread of all of them make up the manifold.
+  contact_point points[2 * contact_manifold::maxPoints];
+  int count = manifold.count;
+  std::copy(manifold.points, manifold.points + count, points);
+
+  const point_anchors& anchor = anchors[index];
+  rigid_transform transformA = bodies.worldTransform(manifold.bodyA);
+  rigid_transform transformB = bodies.worldTransform(manifold.bodyB);
+
+  for (int j = 0; j < previous.count; j++)
+  {
+    if (matched[j] || previous.points[j].id != 0)
+      continue;
+
+    vector3 surfaceA = transformA.toWorld(anchor.localA[j]);
+    vector3 surfaceB = transformB.toWorld(anchor.localB[j]);
+    vector3 offset = surfaceA - surfaceB;
+
+    float depth = dot(offset, manifold.normal);
+    vector3 drift = offset - manifold.normal * depth;
+    if (depth < -persistDistance || dot(drift, drift) > persistDistance * persistDistance)
+      continue;
+
+    contact_point point = previous.points[j];
+    point.position = (surfaceA + surfaceB) * 0.5f;
+    point.depth = depth;
+    points[count++] = point;
+  }
+
+  manifold.count = reducePoints(manifold.normal, points, count);
+  std::copy(points, points + manifold.count, manifold.points);
+}
+
+void manifold_cache::store(std::vector<contact_manifold>& found, const body_store& bodies)
+{
+  kept.swap(found);
+  int count = static_cast<int>(kept.size());
+
+  // The surface of each body is half the depth away from the midpoint, on its side of it.
+  anchors.resize(count);
+  for (int i = 0; i < count; i++)
+  {
+    const contact_manifold& manifold = kept[i];
+    rigid_transform transformA = bodies.worldTransform(manifold.bodyA);
+    rigid_transform transformB = bodies.worldTransform(manifold.bodyB);
+
+    for (int j = 0; j < manifold.count; j++)
+    {
+      const contact_point& point = manifold.points[j];
+      vector3 half = manifold.normal * (0.5f * point.depth);
+      anchors[i].localA[j] = transformA.toLocal(point.position + half);
+      anchors[i].localB[j] = transformB.toLocal(point.position - half);
+    }
+  }
+
+  buildTable();
+}
+
+void manifold_cache::remap(std::span<const int> newIndices)
+{
+  // The kept manifolds are compacted in place, along with their anchors.
+  int count = 0;
+  for (int i = 0; i < static_cast<int>(kept.size()); i++)
+  {
+    int bodyA = newIndices[kept[i].bodyA];
+    int bodyB = newIndices[kept[i].bodyB];
+    if (bodyA < 0 || bodyB < 0)
+      continue;
+
+    kept[count] = kept[i];
+    kept[count].bodyA = bodyA;
+    kept[count].bodyB = bodyB;
+    anchors[count] = anchors[i];
+
+    // Pairs are always looked up with the lower body first, which the renaming may have undone.
+    if (bodyA > bodyB)
+    {
+      flipManifold(kept[count]);
+      std::swap(anchors[count].localA, anchors[count].localB);
+    }
+
+    count++;
+  }
+
+  kept.resize(count);
+  anchors.resize(count);
+  buildTable();
+}
+
+void manifold_cache::buildTable()
+{
+  int count = static_cast<int>(kept.size());
+
+  tableBits = 1;
+  while ((1 << tableBits) < 2 * count)
+    tableBits++;
+
+  std::uint32_t mask = (1u << tableBits) - 1;
+  table.assign(std::size_t(1) << tableBits, {0, -1});
+  for (int i = 0; i < count; i++)
+  {
+    std::uint64_t key = keyOf(kept[i].bodyA, kept[i].bodyB);
+
+    std::uint32_t slot = hashKey(key, tableBits);
+    while (table[slot].manifold >= 0)
+      slot = (slot + 1) & mask;
+
+    table[slot] = {key, i};
+  }
+}
+
+void manifold_cache::save(world_snapshot& snapshot) const
+{
+  snapshot.write(snapshot_section::manifolds, kept);
+  snapshot.write(snapshot_section::manifoldAnchors, anchors);
+  snapshot.write(snapshot_section::manifoldTable, table);
+}
+
+bool manifold_cache::canRestore(const snapshot_view& snapshot, int bodies)
+{
+  std::span<const contact_manifold> manifolds =
+    snapshot.array<contact_manifold>(snapshot_section::manifolds);
+  std::span<const table_slot> slots = snapshot.array<table_slot>(snapshot_section::manifoldTable);
+  int count = static_cast<int>(manifolds.size());
+
+  if (snapshot.array<point_anchors>(snapshot_section::manifoldAnchors).size() != manifolds.size())
+    return false;
+
+  // Lookups probe until they find an empty slot, so a table with manifolds needs more slots than
+  // manifolds, and a power of two of them.
+  if (count > 0 && (!std::has_single_bit(slots.size()) || slots.size() <= manifolds.size()))
+    return false;
+
+  for (const contact_manifold& manifold : manifolds)
+    if (manifold.bodyA < 0 || manifold.bodyA >= bodies || manifold.bodyB < 0 ||
+        manifold.bodyB >= bodies)
+      return false;
+
+  return std::all_of(slots.begin(), slots.end(),
+                     [count](const table_slot& slot) { return slot.manifold < count; });
+}
+
+void manifold_cache::restore(const snapshot_view& snapshot)
+{
+  snapshot.read(snapshot_section::manifolds, kept);
+  snapshot.read(snapshot_section::manifoldAnchors, anchors);
+  snapshot.read(snapshot_section::manifoldTable, table);
+  tableBits = table.empty() ? 0 : std::countr_zero(table.size());
+}
+
+void manifold_cache::clear()
+{
+  kept.clear();
+  anchors.clear();
+  table.clear();
+  tableBits = 0;
+}
+
+} // namespace flexor
\ No newline at end of file
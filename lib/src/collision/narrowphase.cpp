@@ -0,0 +1,584 @@
+#include "collision/narrowphase.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "collision/gjk.h"
+
+namespace flexor
+{
+
+// ----- Manifold Reduction -----
+
+int reducePoints(const vector3& normal, contact_point* points, int count)
+{
+  if (count <= contact_manifold::maxPoints)
+    return count;
+
+  auto pick = [&](int slot, int index) { std::swap(points[slot], points[index]); };
+
+  // The deepest point.
+  int best = 0;
+  for (int i = 1; i < count; i++)
+    if (points[i].depth > points[best].depth)
+      best = i;
+  pick(0, best);
+
+  // The point farthest from it.
+  best = 1;
+  float bestScore = -1.0f;
+  for (int i = 1; i < count; i++)
+  {
+    vector3 offset = points[i].position - points[0].position;
+    float score = dot(offset, offset);
+    if (score > bestScore)
+    {
+      bestScore = score;
+      best = i;
+    }
+  }
+  pick(1, best);
+
+  // The point that makes the largest triangle with the first two, on either side of them.
+  vector3 edge = points[1].position - points[0].position;
+  best = 2;
+  bestScore = -1.0f;
+  for (int i = 2; i < count; i++)
+  {
+    float score = std::fabs(dot(cross(edge, points[i].position - points[0].position), normal));
+    if (score > bestScore)
+    {
+      bestScore = score;
+      best = i;
+    }
+  }
+  pick(2, best);
+
+  // The point that adds the most area outside of that triangle. The signed area against each edge
+  // is negative outside of it, once the edges are wound the same way as the normal.
+  float winding = dot(cross(edge, points[2].position - points[0].position), normal) < 0.0f
+                    ? -1.0f
+                    : 1.0f;
+
+  best = -1;
+  bestScore = 0.0f;
+  for (int i = 3; i < count; i++)
+  {
+    for (int e = 0; e < 3; e++)
+    {
+      const vector3& from = points[e].position;
+      const vector3& to = points[(e + 1) % 3].position;
+      float area = winding * dot(cross(to - from, points[i].position - from), normal);
+      if (-area > bestScore)
+      {
+        bestScore = -area;
+        best = i;
+      }
+    }
+  }
+
+  if (best < 0)
+    return 3;
+
+  pick(3, best);
+  return 4;
+}
+
+void flipManifold(contact_manifold& manifold)
+{
+  std::swap(manifold.bodyA, manifold.bodyB);
+  manifold.normal = -manifold.normal;
+
+  for (int i = 0; i < manifold.count; i++)
+  {
+    manifold.points[i].tangentImpulse[0] = 0.0f;
+    manifold.points[i].tangentImpulse[1] = 0.0f;
+  }
+}
+
+// ----- Sphere Collisions -----
+
+bool collideSpheres(const shape& a, const rigid_transform& transformA, const shape& b,
+                    const rigid_transform& transformB, contact_manifold& manifold)
+{
+  vector3 offset = transformB.position - transformA.position;
+  float radius = a.radius + b.radius;
+  float distanceSquared = dot(offset, offset);
+  if (distanceSquared > radius * radius)
+    return false;
+
+  float distance = std::sqrt(distanceSquared);
+  vector3 normal = distance > 1e-6f ? offset / distance : vector3(0.0f, 1.0f, 0.0f);
+
+  vector3 surfaceA = transformA.position + normal * a.radius;
+  vector3 surfaceB = transformB.position - normal * b.radius;
+
+  manifold.normal = normal;
+  manifold.points[0] = {(surfaceA + surfaceB) * 0.5f, radius - distance, 0};
+  manifold.count = 1;
+  return true;
+}
+
+bool collideSphereBox(const shape& a, const rigid_transform& transformA, const shape& b,
+                      const rigid_transform& transformB, contact_manifold& manifold)
+{
+  const vector3& extents = b.halfExtents;
+  vector3 center = transformB.toLocal(transformA.position);
+  vector3 closest = max(min(center, extents), -extents);
+
+  vector3 outward;
+  float depth;
+  std::uint32_t id;
+
+  if (closest == center)
+  {
+    // The center is inside the box, so push it out through the nearest face.
+    int axis = 0;
+    float overlap = std::numeric_limits<float>::max();
+    for (int i = 0; i < vector3::length(); i++)
+    {
+      float faceOverlap = extents[i] - std::fabs(center[i]);
+      if (faceOverlap < overlap)
+      {
+        overlap = faceOverlap;
+        axis = i;
+      }
+    }
+
+    float sign = center[axis] < 0.0f ? -1.0f : 1.0f;
+    outward = vector3(0.0f);
+    outward[axis] = sign;
+    closest[axis] = sign * extents[axis];
+
+    depth = overlap + a.radius;
+    id = 1 + axis * 2 + (sign < 0.0f);
+  }
+  else
+  {
+    vector3 offset = center - closest;
+    float distanceSquared = dot(offset, offset);
+    if (distanceSquared > a.radius * a.radius)
+      return false;
+
+    float distance = std::sqrt(distanceSquared);
+    outward = offset / distance;
+    depth = a.radius - distance;
+    id = 0;
+  }
+
+  // The outward normal of the box points from B toward A.
+  vector3 normal = -transformB.rotate(outward);
+  vector3 surfaceA = transformA.position + normal * a.radius;
+  vector3 surfaceB = transformB.toWorld(closest);
+
+  manifold.normal = normal;
+  manifold.points[0] = {(surfaceA + surfaceB) * 0.5f, depth, id};
+  manifold.count = 1;
+  return true;
+}
+
+// ----- Box Collisions -----
+
+namespace
+{
+
+/**
+ * A vertex of the incident face as it gets clipped. The code names the features the vertex came
+ * from, and the edge names the edge that leaves the vertex: 0 to 3 for an edge of the incident
+ * face, and 4 to 7 for a side of the reference face.
+ */
+struct clip_vertex
+{
+  vector3 position;
+  int code;
+  int edge;
+};
+
+} // namespace
+
+/**
+ * Clips a polygon to the half space dot(normal, x) <= offset with the Sutherland-Hodgman
+ * algorithm. Each new vertex lies where an edge crosses the plane, so the pair of them names it.
+ */
+static int clipPolygon(const clip_vertex* input, int count, const vector3& normal, float offset,
+                       int plane, clip_vertex* output)
+{
+  int outCount = 0;
+  for (int i = 0; i < count; i++)
+  {
+    const clip_vertex& from = input[i];
+    const clip_vertex& to = input[(i + 1) % count];
+
+    float fromDistance = dot(normal, from.position) - offset;
+    float toDistance = dot(normal, to.position) - offset;
+    bool fromInside = fromDistance <= 0.0f;
+    bool toInside = toDistance <= 0.0f;
+
+    if (fromInside != toInside)
+    {
+      float t = fromDistance / (fromDistance - toDistance);
+
+      clip_vertex crossing;
+      crossing.position = from.position + (to.position - from.position) * t;
+      crossing.code = 8 + from.edge * 4 + plane;
+      crossing.edge = toInside ? from.edge : 4 + plane;
+      output[outCount++] = crossing;
+    }
+
+    if (toInside)
+      output[outCount++] = to;
+  }
+
+  return outCount;
+}
+
+/**
+ * Builds a face contact, where the given face of the reference box is the axis of least overlap.
+ * The normal points from the reference box toward the incident box, and flip says whether the
+ * reference box is body B.
+ */
+static bool clipFaces(const shape& reference, const rigid_transform& referenceTransform,
+                      const shape& incident, const rigid_transform& incidentTransform, int axis,
+                      const vector3& normal, bool flip, contact_manifold& manifold)
+{
+  const vector3& referenceExtents = reference.halfExtents;
+  const vector3& incidentExtents = incident.halfExtents;
+
+  int referenceFace = axis * 2 + (dot(referenceTransform.rotation[axis], normal) < 0.0f);
+  vector3 faceCenter = referenceTransform.position + normal * referenceExtents[axis];
+
+  // The incident face is the face of the other box that is most anti-parallel to the normal.
+  vector3 localNormal = incidentTransform.inverseRotate(normal);
+  int incidentAxis = 0;
+  for (int i = 1; i < vector3::length(); i++)
+    if (std::fabs(localNormal[i]) > std::fabs(localNormal[incidentAxis]))
+      incidentAxis = i;
+
+  float incidentSign = localNormal[incidentAxis] > 0.0f ? -1.0f : 1.0f;
+  int incidentFace = incidentAxis * 2 + (incidentSign < 0.0f);
+
+  int u = (incidentAxis + 1) % 3;
+  int v = (incidentAxis + 2) % 3;
+  vector3 center = incidentTransform.position + incidentTransform.rotation[incidentAxis] *
+                                                  (incidentSign * incidentExtents[incidentAxis]);
+  vector3 edgeU = incidentTransform.rotation[u] * incidentExtents[u];
+  vector3 edgeV = incidentTransform.rotation[v] * incidentExtents[v];
+
+  clip_vertex polygon[8] = {{center + edgeU + edgeV, 0, 0},
+                            {center - edgeU + edgeV, 1, 1},
+                            {center - edgeU - edgeV, 2, 2},
+                            {center + edgeU - edgeV, 3, 3}};
+  clip_vertex scratch[8];
+  int count = 4;
+
+  // Clip against the four sides of the reference face. Each clip adds at most one vertex. The
+  // sides are pushed out a hair, so that a box stacked flush on another of the same size keeps its
+  // corners instead of having rounding clip each of them into two points.
+  constexpr float clipTolerance = 1e-3f;
+  for (int plane = 0; plane < 4 && count > 0; plane++)
+  {
+    int side = (axis + 1 + plane / 2) % 3;
+    float sign = plane % 2 == 0 ? 1.0f : -1.0f;
+    vector3 sideNormal = referenceTransform.rotation[side] * sign;
+    float offset = dot(sideNormal, faceCenter) + referenceExtents[side] + clipTolerance;
+
+    count = clipPolygon(polygon, count, sideNormal, offset, plane, scratch);
+    std::copy(scratch, scratch + count, polygon);
+  }
+
+  // Keep the vertices below the reference face, and put each contact halfway between the vertex
+  // and the face. Vertices just above the face are kept too, so that a corner rocking off its
+  // support keeps its point and the solver can catch it before it lands.
+  constexpr float speculativeDistance = 0.02f;
+  float faceOffset = dot(normal, faceCenter);
+  std::uint32_t faces = (flip << 16) | (referenceFace << 12) | (incidentFace << 8);
+
+  contact_point points[8];
+  int pointCount = 0;
+  for (int i = 0; i < count; i++)
+  {
+    float separation = dot(normal, polygon[i].position) - faceOffset;
+    if (separation > speculativeDistance)
+      continue;
+
+    points[pointCount++] = {polygon[i].position - normal * (separation * 0.5f), -separation,
+                            faces | static_cast<std::uint32_t>(polygon[i].code)};
+  }
+
+  if (pointCount == 0)
+    return false;
+
+  pointCount = reducePoints(normal, points, pointCount);
+
+  manifold.normal = flip ? -normal : normal;
+  manifold.count = pointCount;
+  std::copy(points, points + pointCount, manifold.points);
+  return true;
+}
+
+bool collideBoxes(const shape& a, const rigid_transform& transformA, const shape& b,
+                  const rigid_transform& transformB, contact_manifold& manifold)
+{
+  const vector3& extentsA = a.halfExtents;
+  const vector3& extentsB = b.halfExtents;
+
+  // Work in the frame of A, where the axes of B are the columns of the relative rotation r. The
+  // separating axis tests follow Ericson's Real-Time Collision Detection, and only need r and the
+  // offset between the centers in that frame.
+  vector3 offset = transformB.position - transformA.position;
+  vector3 localOffset = transformA.inverseRotate(offset);
+
+  float t[3] = {localOffset.x, localOffset.y, localOffset.z};
+  float ea[3] = {extentsA.x, extentsA.y, extentsA.z};
+  float eb[3] = {extentsB.x, extentsB.y, extentsB.z};
+
+  float r[3][3];
+  float absR[3][3];
+  for (int j = 0; j < 3; j++)
+  {
+    vector3 axis = transformA.inverseRotate(transformB.rotation[j]);
+    for (int i = 0; i < 3; i++)
+    {
+      r[i][j] = axis[i];
+      absR[i][j] = std::fabs(axis[i]);
+    }
+  }
+
+  // The separation along each face axis of A.
+  float faceSeparationA = -std::numeric_limits<float>::max();
+  int faceAxisA = 0;
+  for (int i = 0; i < 3; i++)
+  {
+    float radiusB = eb[0] * absR[i][0] + eb[1] * absR[i][1] + eb[2] * absR[i][2];
+    float separation = std::fabs(t[i]) - ea[i] - radiusB;
+    if (separation > 0.0f)
+      return false;
+
+    if (separation > faceSeparationA)
+    {
+      faceSeparationA = separation;
+      faceAxisA = i;
+    }
+  }
+
+  // The separation along each face axis of B.
+  float faceSeparationB = -std::numeric_limits<float>::max();
+  int faceAxisB = 0;
+  for (int j = 0; j < 3; j++)
+  {
+    float radiusA = ea[0] * absR[0][j] + ea[1] * absR[1][j] + ea[2] * absR[2][j];
+    float distance = t[0] * r[0][j] + t[1] * r[1][j] + t[2] * r[2][j];
+    float separation = std::fabs(distance) - eb[j] - radiusA;
+    if (separation > 0.0f)
+      return false;
+
+    if (separation > faceSeparationB)
+    {
+      faceSeparationB = separation;
+      faceAxisB = j;
+    }
+  }
+
+  // The separation along the cross product of each pair of edges, which is e_i x r_j in the frame
+  // of A. These axes aren't normalized, so the separation is divided by their length. Parallel
+  // edges don't give an axis, but then one of the face axes already covers them.
+  float edgeSeparation = -std::numeric_limits<float>::max();
+  int edgeA = -1;
+  int edgeB = -1;
+  for (int i = 0; i < 3; i++)
+  {
+    int i1 = (i + 1) % 3;
+    int i2 = (i + 2) % 3;
+
+    for (int j = 0; j < 3; j++)
+    {
+      float length = std::sqrt(r[i1][j] * r[i1][j] + r[i2][j] * r[i2][j]);
+      if (length < 1e-5f)
+        continue;
+
+      int j1 = (j + 1) % 3;
+      int j2 = (j + 2) % 3;
+      float radiusA = ea[i1] * absR[i2][j] + ea[i2] * absR[i1][j];
+      float radiusB = eb[j1] * absR[i][j2] + eb[j2] * absR[i][j1];
+      float distance = std::fabs(t[i2] * r[i1][j] - t[i1] * r[i2][j]);
+
+      float separation = (distance - radiusA - radiusB) / length;
+      if (separation > 0.0f)
+        return false;
+
+      if (separation > edgeSeparation)
+      {
+        edgeSeparation = separation;
+        edgeA = i;
+        edgeB = j;
+      }
+    }
+  }
+
+  // Face contacts are preferred unless an edge axis is clearly better, since rounding would
+  // otherwise flip a resting box between nearly equal axes from one step to the next.
+  constexpr float relativeTolerance = 0.95f;
+  constexpr float absoluteTolerance = 0.005f;
+
+  bool faceB = faceSeparationB > relativeTolerance * faceSeparationA + absoluteTolerance;
+  float faceSeparation = faceB ? faceSeparationB : faceSeparationA;
+
+  if (edgeA < 0 || edgeSeparation <= relativeTolerance * faceSeparation + absoluteTolerance)
+  {
+    if (faceB)
+    {
+      vector3 normal = transformB.rotation[faceAxisB];
+      if (dot(normal, offset) > 0.0f)
+        normal = -normal;
+
+      return clipFaces(b, transformB, a, transformA, faceAxisB, normal, true, manifold);
+    }
+
+    vector3 normal = transformA.rotation[faceAxisA];
+    if (dot(normal, offset) < 0.0f)
+      normal = -normal;
+
+    return clipFaces(a, transformA, b, transformB, faceAxisA, normal, false, manifold);
+  }
+
+  // An edge contact, between the edge of A that is farthest along the normal and the edge of B
+  // that is farthest against it.
+  vector3 normal = normalize(cross(transformA.rotation[edgeA], transformB.rotation[edgeB]));
+  if (dot(normal, offset) < 0.0f)
+    normal = -normal;
+
+  std::uint32_t signs = 0;
+  vector3 pointA = transformA.position;
+  vector3 pointB = transformB.position;
+  for (int k = 0; k < 3; k++)
+  {
+    if (k != edgeA)
+    {
+      bool negative = dot(transformA.rotation[k], normal) < 0.0f;
+      pointA += transformA.rotation[k] * (negative ? -extentsA[k] : extentsA[k]);
+      signs = (signs << 1) | negative;
+    }
+
+    if (k != edgeB)
+    {
+      bool negative = dot(transformB.rotation[k], normal) > 0.0f;
+      pointB += transformB.rotation[k] * (negative ? -extentsB[k] : extentsB[k]);
+      signs = (signs << 1) | negative;
+    }
+  }
+
+  // The closest points between the lines through the edges, clamped to the edges.
+  const vector3& directionA = transformA.rotation[edgeA];
+  const vector3& directionB = transformB.rotation[edgeB];
+  vector3 between = pointA - pointB;
+
+  float alignment = dot(directionA, directionB);
+  float alongA = dot(directionA, between);
+  float alongB = dot(directionB, between);
+  float denom = 1.0f - alignment * alignment;
+
+  float paramA = denom > 1e-6f ? (alignment * alongB - alongA) / denom : 0.0f;
+  paramA = std::fmax(-extentsA[edgeA], std::fmin(paramA, extentsA[edgeA]));
+  float paramB = alignment * paramA + alongB;
+  paramB = std::fmax(-extentsB[edgeB], std::fmin(paramB, extentsB[edgeB]));
+
+  vector3 closestA = pointA + directionA * paramA;
+  vector3 closestB = pointB + directionB * paramB;
+
+  manifold.normal = normal;
+  manifold.points[0] = {(closestA + closestB) * 0.5f, -edgeSeparation,
+                        (1u << 24) | ((edgeA * 3 + edgeB) << 4) | signs};
+  manifold.count = 1;
+  return true;
+}
+
+// ----- Convex Collisions -----
+
+bool collideConvex(const shape& a, const rigid_transform& transformA, const shape& b,
+                   const rigid_transform& transformB, contact_manifold& manifold)
+{
+  // Below this distance between the cores, the direction between the closest points is too noisy
+  // to use as a normal.
+  constexpr float coreTolerance = 1e-3f;
+
+  convex_proxy proxyA = {&a, transformA, true};
+  convex_proxy proxyB = {&b, transformB, true};
+  float radiusA = a.coreRadius();
+  float radiusB = b.coreRadius();
+
+  gjk_simplex simplex;
+  gjk_output distance = gjkDistance(proxyA, proxyB, simplex);
+  if (!distance.overlap && distance.distance > radiusA + radiusB)
+    return false;
+
+  // When the cores are apart, the closest points give the contact directly, and inflating them by
+  // the radii is exact.
+  if (!distance.overlap && distance.distance > coreTolerance)
+  {
+    vector3 normal = (distance.pointB - distance.pointA) / distance.distance;
+    vector3 surfaceA = distance.pointA + normal * radiusA;
+    vector3 surfaceB = distance.pointB - normal * radiusB;
+
+    manifold.normal = normal;
+    manifold.points[0] = {(surfaceA + surfaceB) * 0.5f, radiusA + radiusB - distance.distance, 0};
+    manifold.count = 1;
+    return true;
+  }
+
+  // Otherwise the full shapes overlap deeply enough to need EPA. Shapes without a radius are their
+  // own cores, so the simplex GJK just built already encloses the origin.
+  if (radiusA + radiusB > 0.0f)
+  {
+    proxyA.core = false;
+    proxyB.core = false;
+    distance = gjkDistance(proxyA, proxyB, simplex);
+  }
+
+  if (!distance.overlap)
+    return false;
+
+  epa_output penetration;
+  if (!epaPenetration(proxyA, proxyB, simplex, penetration))
+    return false;
+
+  manifold.normal = penetration.normal;
+  manifold.points[0] = {(penetration.pointA + penetration.pointB) * 0.5f, penetration.depth, 0};
+  manifold.count = 1;
+  return true;
+}
+
+// ----- Dispatch -----
+
+/**
+ * Runs a collision function that expects the shapes the other way around, and flips the normal
+ * back to point from A to B.
+ */
+template <collide_function fn>
+static bool collideSwapped(const shape& a, const rigid_transform& transformA, const shape& b,
+                           const rigid_transform& transformB, contact_manifold& manifold)
+{
+  if (!fn(b, transformB, a, transformA, manifold))
+    return false;
+
+  manifold.normal = -manifold.normal;
+  return true;
+}
+
+constexpr int shapeTypes = static_cast<int>(shape_type::count);
+
+// Indexed by the type of shape A, then the type of shape B.
+static constexpr collide_function collideTable[shapeTypes][shapeTypes] = {
+  {collideSpheres, collideSphereBox, collideConvex, collideConvex},
+  {collideSwapped<collideSphereBox>, collideBoxes, collideConvex, collideConvex},
+  {collideConvex, collideConvex, collideConvex, collideConvex},
+  {collideConvex, collideConvex, collideConvex, collideConvex}};
+
+bool collide(const shape& a, const rigid_transform& transformA, const shape& b,
+             const rigid_transform& transformB, contact_manifold& manifold)
+{
+  collide_function fn = collideTable[static_cast<int>(a.type)][static_cast<int>(b.type)];
+  return fn(a, transformA, b, transformB, manifold);
+}
+
+} // namespace flexor
\ No newline at end of file
@@ -0,0 +1,263 @@
+#include "collision/sap_broadphase.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <limits>
+
+#include "math/simd.h"
+
+namespace flexor
+{
+
+sap_broadphase::sap_broadphase(int axis)
+  : axis(axis), otherAxis1((axis + 1) % 3), otherAxis2((axis + 2) % 3)
+{
+  assert(axis >= 0 && axis < 3);
+}
+
+// ----- Bodies -----
+
+void sap_broadphase::add(int body, const aabb& box, bool isStatic)
+{
+  assert(body >= 0 && !tracked(body));
+
+  if (body >= static_cast<int>(slots.size()))
+  {
+    bounds.resize(body + 1);
+    statics.resize(body + 1, false);
+    slots.resize(body + 1, false);
+    listed.resize(body + 1, false);
+  }
+
+  bounds[body] = box;
+  statics[body] = isStatic;
+  slots[body] = true;
+
+  if (!listed[body])
+    endpoints.push_back({box.min[axis], body});
+  listed[body] = true;
+}
+
+void sap_broadphase::move(int body, const aabb& box, const vector3&)
+{
+  assert(tracked(body));
+
+  // Every update sweeps over the current bounds, so there is nothing to predict ahead of time.
+  bounds[body] = box;
+}
+
+void sap_broadphase::remove(int body)
+{
+  assert(tracked(body));
+
+  slots[body] = false;
+  removedAny = true;
+}
+
+// ----- Sorting -----
+
+void sap_broadphase::sortEndpoints()
+{
+  if (removedAny)
+  {
+    // The sorted prefix stays sorted when bodies are removed from it, so we only need to track
+    // how many of the survivors came from it.
+    int survivors = 0;
+    for (int i = 0; i < sortedCount; i++)
+      survivors += slots[endpoints[i].body];
+
+    for (const endpoint& e : endpoints)
+      listed[e.body] = slots[e.body];
+
+    std::erase_if(endpoints, [this](const endpoint& e) { return !slots[e.body]; });
+    sortedCount = survivors;
+    removedAny = false;
+  }
+
+  for (endpoint& e : endpoints)
+    e.value = bounds[e.body].min[axis];
+
+  // The bodies that were already sorted barely moved since the last update, so insertion sort only
+  // has to shift each one past the handful of neighbours it crossed.
+  for (int i = 1; i < sortedCount; i++)
+  {
+    endpoint e = endpoints[i];
+
+    int j = i - 1;
+    for (; j >= 0 && endpoints[j].value > e.value; j--)
+      endpoints[j + 1] = endpoints[j];
+
+    endpoints[j + 1] = e;
+  }
+
+  // New bodies have no order to exploit, and could be an entire world added at once, so they are
+  // sorted on their own and merged in.
+  if (sortedCount < static_cast<int>(endpoints.size()))
+  {
+    auto less = [](const endpoint& lhs, const endpoint& rhs) { return lhs.value < rhs.value; };
+
+    std::sort(endpoints.begin() + sortedCount, endpoints.end(), less);
+    std::inplace_merge(endpoints.begin(), endpoints.begin() + sortedCount, endpoints.end(), less);
+    sortedCount = static_cast<int>(endpoints.size());
+  }
+}
+
+void sap_broadphase::gatherBounds()
+{
+  int count = static_cast<int>(endpoints.size());
+  int padded = count + simd::wideLanes;
+
+  sweepMin.resize(padded);
+  sweepMax.resize(padded);
+  min1.resize(padded);
+  max1.resize(padded);
+  min2.resize(padded);
+  max2.resize(padded);
+
+  for (int i = 0; i < count; i++)
+  {
+    const aabb& box = bounds[endpoints[i].body];
+
+    sweepMin[i] = endpoints[i].value;
+    sweepMax[i] = box.max[axis];
+    min1[i] = box.min[otherAxis1];
+    max1[i] = box.max[otherAxis1];
+    min2[i] = box.min[otherAxis2];
+    max2[i] = box.max[otherAxis2];
+  }
+
+  // The padding starts after every real box ends, so the sweep always stops before reaching it.
+  float infinity = std::numeric_limits<float>::infinity();
+  std::fill(sweepMin.begin() + count, sweepMin.end(), infinity);
+  std::fill(sweepMax.begin() + count, sweepMax.end(), infinity);
+  std::fill(min1.begin() + count, min1.end(), infinity);
+  std::fill(max1.begin() + count, max1.end(), -infinity);
+  std::fill(min2.begin() + count, min2.end(), infinity);
+  std::fill(max2.begin() + count, max2.end(), -infinity);
+}
+
+// ----- Pairs -----
+
+void sap_broadphase::updatePairs()
+{
+  sortEndpoints();
+  gatherBounds();
+
+  pairList.clear();
+
+  using simd::floatv;
+  constexpr int lanes = simd::wideLanes;
+  constexpr int allLanes = (1 << lanes) - 1;
+
+  int count = static_cast<int>(endpoints.size());
+  for (int i = 0; i < count; i++)
+  {
+    int body = endpoints[i].body;
+
+    floatv reach = simd::splatWide(sweepMax[i]);
+    floatv lower1 = simd::splatWide(min1[i]);
+    floatv upper1 = simd::splatWide(max1[i]);
+    floatv lower2 = simd::splatWide(min2[i]);
+    floatv upper2 = simd::splatWide(max2[i]);
+
+    // Every box after this one starts after it does, so the candidates are exactly the boxes that
+    // start before it ends. Those form a contiguous run, which we test a register at a time.
+    for (int j = i + 1; j < count; j += lanes)
+    {
+      int inReach = simd::lessEqualMask(simd::loadWide(sweepMin.data() + j), reach);
+      if (inReach == 0)
+        break;
+
+      int hits = inReach;
+      hits &= simd::lessEqualMask(simd::loadWide(min1.data() + j), upper1);
+      hits &= simd::lessEqualMask(lower1, simd::loadWide(max1.data() + j));
+      hits &= simd::lessEqualMask(simd::loadWide(min2.data() + j), upper2);
+      hits &= simd::lessEqualMask(lower2, simd::loadWide(max2.data() + j));
+
+      while (hits != 0)
+      {
+        int other = endpoints[j + std::countr_zero(static_cast<unsigned>(hits))].body;
+        hits &= hits - 1;
+
+        if (!(statics[body] && statics[other]))
+          pairList.push_back({std::min(body, other), std::max(body, other)});
+      }
+
+      if (inReach != allLanes)
+        break;
+    }
+  }
+}
+
+// ----- Snapshots -----
+
+void sap_broadphase::save(world_snapshot& snapshot) const
+{
+  int counts[2] = {sortedCount, removedAny};
+
+  snapshot.write(snapshot_section::broadphaseBounds, bounds);
+  snapshot.writeFlags(snapshot_section::broadphaseStatics, statics);
+  snapshot.writeFlags(snapshot_section::broadphaseSlots, slots);
+  snapshot.writeFlags(snapshot_section::sweepListed, listed);
+  snapshot.write(snapshot_section::sweepEndpoints, endpoints);
+  snapshot.write(snapshot_section::sweepCounts, std::span<const int>(counts));
+  snapshot.write(snapshot_section::broadphasePairs, pairList);
+}
+
+void sap_broadphase::restore(const snapshot_view& snapshot)
+{
+  snapshot.read(snapshot_section::broadphaseBounds, bounds);
+  snapshot.readFlags(snapshot_section::broadphaseStatics, statics);
+  snapshot.readFlags(snapshot_section::broadphaseSlots, slots);
+  snapshot.readFlags(snapshot_section::sweepListed, listed);
+  snapshot.read(snapshot_section::sweepEndpoints, endpoints);
+  snapshot.read(snapshot_section::broadphasePairs, pairList);
+
+  std::span<const int> counts = snapshot.array<int>(snapshot_section::sweepCounts);
+  sortedCount = counts.size() == 2 ? counts[0] : 0;
+  removedAny = counts.size() == 2 && counts[1] != 0;
+}
+
+bool sap_broadphase::canRestore(const snapshot_view& snapshot, int bodies)
+{
+  std::span<const aabb> savedBounds = snapshot.array<aabb>(snapshot_section::broadphaseBounds);
+  std::span<const std::uint8_t> savedStatics =
+    snapshot.array<std::uint8_t>(snapshot_section::broadphaseStatics);
+  std::span<const std::uint8_t> savedSlots =
+    snapshot.array<std::uint8_t>(snapshot_section::broadphaseSlots);
+  std::span<const std::uint8_t> savedListed =
+    snapshot.array<std::uint8_t>(snapshot_section::sweepListed);
+  std::span<const endpoint> savedEndpoints =
+    snapshot.array<endpoint>(snapshot_section::sweepEndpoints);
+  std::span<const int> counts = snapshot.array<int>(snapshot_section::sweepCounts);
+
+  int count = static_cast<int>(savedBounds.size());
+  if (count < bodies || savedStatics.size() != savedBounds.size() ||
+      savedSlots.size() != savedBounds.size() || savedListed.size() != savedBounds.size() ||
+      counts.size() != 2 || counts[0] < 0 || counts[0] > static_cast<int>(savedEndpoints.size()))
+    return false;
+
+  for (int body = 0; body < count; body++)
+    if ((savedSlots[body] != 0) != (body < bodies) || (savedSlots[body] && !savedListed[body]))
+      return false;
+
+  // Every listed body has exactly one endpoint. Endpoints of removed bodies are only dropped by
+  // the next update if it knows to look for them.
+  std::vector<bool> found(count, false);
+  for (const endpoint& e : savedEndpoints)
+  {
+    if (e.body < 0 || e.body >= count || found[e.body] || !savedListed[e.body] ||
+        (!savedSlots[e.body] && counts[1] == 0))
+      return false;
+
+    found[e.body] = true;
+  }
+
+  auto listedCount = std::count_if(savedListed.begin(), savedListed.end(),
+                                   [](std::uint8_t flag) { return flag != 0; });
+  return listedCount == static_cast<std::ptrdiff_t>(savedEndpoints.size()) &&
+         canRestorePairs(snapshot, count);
+}
+
+} // namespace flexor
\ No newline at end of file
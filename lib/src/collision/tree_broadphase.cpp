@@ -0,0 +1,150 @@
+#include "collision/tree_broadphase.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace flexor
+{
+
+// ----- Bodies -----
+
+void tree_broadphase::add(int body, const aabb& bounds, bool isStatic)
+{
+  assert(body >= 0 && !tracked(body));
+
+  if (body >= static_cast<int>(proxies.size()))
+  {
+    proxies.resize(body + 1, dynamic_tree::nullNode);
+    statics.resize(body + 1, false);
+    moved.resize(body + 1, false);
+  }
+
+  proxies[body] = bvh.createProxy(bounds, body);
+  statics[body] = isStatic;
+  markMoved(body);
+}
+
+void tree_broadphase::move(int body, const aabb& bounds, const vector3& displacement)
+{
+  assert(tracked(body));
+
+  if (bvh.moveProxy(proxies[body], bounds, displacement))
+    markMoved(body);
+}
+
+void tree_broadphase::remove(int body)
+{
+  assert(tracked(body));
+
+  bvh.destroyProxy(proxies[body]);
+  proxies[body] = dynamic_tree::nullNode;
+
+  // The body is flagged as moved so that the next update drops its pairs, but it isn't queried.
+  markMoved(body);
+}
+
+void tree_broadphase::markMoved(int body)
+{
+  if (moved[body])
+    return;
+
+  moved[body] = true;
+  moveBuffer.push_back(body);
+}
+
+// ----- Pairs -----
+
+void tree_broadphase::updatePairs()
+{
+  if (moveBuffer.empty())
+    return;
+
+  // Any pair involving a moved body is found again below if it still overlaps, so we only keep
+  // the pairs between bodies that stayed inside their fat boxes.
+  std::erase_if(pairList, [this](const body_pair& pair) { return moved[pair.a] || moved[pair.b]; });
+
+  for (int body : moveBuffer)
+  {
+    if (!tracked(body))
+      continue;
+
+    bvh.query(bvh.fatBounds(proxies[body]),
+              [&](int proxy)
+              {
+                int other = bvh.userData(proxy);
+
+                // When both bodies moved, the pair is found by both queries, so only the query of
+                // the larger index reports it.
+                if (other == body || (moved[other] && other < body))
+                  return true;
+
+                if (statics[body] && statics[other])
+                  return true;
+
+                pairList.push_back({std::min(body, other), std::max(body, other)});
+                return true;
+              });
+  }
+
+  for (int body : moveBuffer)
+    moved[body] = false;
+  moveBuffer.clear();
+}
+
+// ----- Snapshots -----
+
+void tree_broadphase::save(world_snapshot& snapshot) const
+{
+  bvh.save(snapshot);
+  snapshot.write(snapshot_section::treeProxies, proxies);
+  snapshot.writeFlags(snapshot_section::broadphaseStatics, statics);
+  snapshot.writeFlags(snapshot_section::treeMoved, moved);
+  snapshot.write(snapshot_section::treeMoveBuffer, moveBuffer);
+  snapshot.write(snapshot_section::broadphasePairs, pairList);
+}
+
+void tree_broadphase::restore(const snapshot_view& snapshot)
+{
+  bvh.restore(snapshot);
+  snapshot.read(snapshot_section::treeProxies, proxies);
+  snapshot.readFlags(snapshot_section::broadphaseStatics, statics);
+  snapshot.readFlags(snapshot_section::treeMoved, moved);
+  snapshot.read(snapshot_section::treeMoveBuffer, moveBuffer);
+  snapshot.read(snapshot_section::broadphasePairs, pairList);
+}
+
+bool tree_broadphase::canRestore(const snapshot_view& snapshot, int bodies)
+{
+  std::span<const int> savedProxies = snapshot.array<int>(snapshot_section::treeProxies);
+  std::span<const std::uint8_t> savedStatics =
+    snapshot.array<std::uint8_t>(snapshot_section::broadphaseStatics);
+  std::span<const std::uint8_t> savedMoved =
+    snapshot.array<std::uint8_t>(snapshot_section::treeMoved);
+  std::span<const int> savedBuffer = snapshot.array<int>(snapshot_section::treeMoveBuffer);
+
+  int count = static_cast<int>(savedProxies.size());
+  if (count < bodies || savedStatics.size() != savedProxies.size() ||
+      savedMoved.size() != savedProxies.size())
+    return false;
+
+  for (int body = 0; body < count; body++)
+    if ((savedProxies[body] != dynamic_tree::nullNode) != (body < bodies))
+      return false;
+
+  // Every moved body is buffered exactly once.
+  std::vector<bool> buffered(count, false);
+  for (int body : savedBuffer)
+  {
+    if (body < 0 || body >= count || buffered[body] || !savedMoved[body])
+      return false;
+
+    buffered[body] = true;
+  }
+
+  auto movedCount = std::count_if(savedMoved.begin(), savedMoved.end(),
+                                  [](std::uint8_t flag) { return flag != 0; });
+  return movedCount == static_cast<std::ptrdiff_t>(savedBuffer.size()) &&
+         dynamic_tree::canRestore(snapshot, savedProxies) && canRestorePairs(snapshot, count);
+}
+
+} // namespace flexor
\ No newline at end of file
@@ -0,0 +1,89 @@
+#include "core/frame_arena.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <new>
+
+namespace flexor
+{
+
+// ----- Helper Functions -----
+
+// Blocks are aligned for anything a SIMD register or a cache line needs.
+constexpr std::size_t blockAlignment = 64;
+
+// The smallest block the arena spills into, so that many small allocations don't each get one.
+constexpr std::size_t minimumSpill = 64 * 1024;
+
+// ----- Frame Arena -----
+
+frame_arena::frame_arena(std::size_t capacity)
+{
+  if (capacity == 0)
+    return;
+
+  first = allocateBlock(capacity);
+  blockSize = capacity;
+  reserved = capacity;
+  current = first.get();
+  currentSize = capacity;
+}
+
+void frame_arena::block_deleter::operator()(std::byte* memory) const
+{
+  ::operator delete[](memory, std::align_val_t(blockAlignment));
+}
+
+frame_arena::block frame_arena::allocateBlock(std::size_t bytes)
+{
+  return block(static_cast<std::byte*>(::operator new[](bytes, std::align_val_t(blockAlignment))));
+}
+
+void* frame_arena::allocate(std::size_t bytes, std::size_t alignment)
+{
+  assert(alignment > 0 && (alignment & (alignment - 1)) == 0 && alignment <= blockAlignment);
+
+  std::size_t start = (offset + alignment - 1) & ~(alignment - 1);
+  if (!current || start + bytes > currentSize)
+  {
+    // Spill into a new block that at least doubles what the arena has, so a growing step only
+    // spills a few times before the next reset folds it all into one block.
+    std::size_t size = std::max({bytes, minimumSpill, reserved});
+
+    spilled += offset;
+    spills.push_back(allocateBlock(size));
+    reserved += size;
+
+    current = spills.back().get();
+    currentSize = size;
+    start = 0;
+  }
+
+  offset = start + bytes;
+  return current + start;
+}
+
+std::size_t frame_arena::used() const
+{
+  return spilled + offset;
+}
+
+void frame_arena::reset()
+{
+  // Everything the last step needed fits in one block from now on, along with the alignment it
+  // took and some room to grow.
+  if (!spills.empty())
+  {
+    spills.clear();
+    first = allocateBlock(reserved);
+    blockSize = reserved;
+  }
+
+  current = first.get();
+  currentSize = blockSize;
+  offset = 0;
+  spilled = 0;
+}
+
+} // namespace flexor
\ No newline at end of file
@@ -0,0 +1,126 @@
+#include "core/snapshot.h"
+
+#include <algorithm>
+#include <bit>
+#include <new>
+
+namespace flexor
+{
+
+// Snapshots are read in place, so they are only ever written and read in the byte order of the
+// format.
+static_assert(std::endian::native == std::endian::little, "snapshots are little-endian");
+
+// ----- Helper Functions -----
+
+// The snapshot header padded out to the first section, so the header is never part of one.
+constexpr std::size_t headerSize =
+  (sizeof(snapshot_header) + snapshotAlignment - 1) & ~(snapshotAlignment - 1);
+
+// ----- Snapshot View -----
+
+snapshot_view::snapshot_view(std::span<const std::byte> bytes)
+{
+  auto address = reinterpret_cast<std::uintptr_t>(bytes.data());
+  if (bytes.size() < headerSize || address % snapshotAlignment != 0)
+    return;
+
+  const snapshot_header& header = *reinterpret_cast<const snapshot_header*>(bytes.data());
+  if (header.magic != snapshot_header::magicNumber ||
+      header.version != snapshot_header::currentVersion || header.size > bytes.size() ||
+      header.tableOffset % alignof(snapshot_entry) != 0 || header.tableOffset > header.size ||
+      header.sectionCount > (header.size - header.tableOffset) / sizeof(snapshot_entry))
+    return;
+
+  // Every section has to lie inside the snapshot, starting on a boundary fit for its values.
+  auto table = reinterpret_cast<const snapshot_entry*>(bytes.data() + header.tableOffset);
+  for (std::uint32_t i = 0; i < header.sectionCount; i++)
+  {
+    const snapshot_entry& entry = table[i];
+    if (entry.id >= snapshot_section::count || entry.offset % snapshotAlignment != 0 ||
+        entry.offset < headerSize || entry.offset > header.tableOffset ||
+        (entry.elementSize > 0 &&
+         entry.count > (header.tableOffset - entry.offset) / entry.elementSize))
+      return;
+
+    entries[static_cast<std::size_t>(entry.id)] = &entry;
+  }
+
+  data = bytes.data();
+}
+
+std::uint32_t snapshot_view::layout() const
+{
+  return valid() ? reinterpret_cast<const snapshot_header*>(data)->layout : 0;
+}
+
+void snapshot_view::readFlags(snapshot_section id, std::vector<bool>& flags) const
+{
+  std::span<const std::uint8_t> source = array<std::uint8_t>(id);
+  flags.resize(source.size());
+  for (std::size_t i = 0; i < source.size(); i++)
+    flags[i] = source[i] != 0;
+}
+
+// ----- World Snapshot -----
+
+void world_snapshot::buffer_deleter::operator()(std::byte* memory) const
+{
+  ::operator delete[](memory, std::align_val_t(snapshotAlignment));
+}
+
+void world_snapshot::reserve(std::size_t bytes)
+{
+  if (bytes <= capacity)
+    return;
+
+  // Growing by half again keeps a snapshot that grows with its world from copying too often.
+  std::size_t grown = std::max(bytes, capacity + capacity / 2);
+  std::unique_ptr<std::byte[], buffer_deleter> larger(
+    static_cast<std::byte*>(::operator new[](grown, std::align_val_t(snapshotAlignment))));
+
+  if (size > 0)
+    std::memcpy(larger.get(), buffer.get(), size);
+
+  buffer = std::move(larger);
+  capacity = grown;
+}
+
+void world_snapshot::begin(std::uint32_t layout)
+{
+  reserve(headerSize);
+  std::memset(buffer.get(), 0, headerSize);
+
+  snapshot_header header;
+  header.layout = layout;
+  std::memcpy(buffer.get(), &header, sizeof(header));
+
+  size = headerSize;
+  sections.clear();
+}
+
+void world_snapshot::writeFlags(snapshot_section id, const std::vector<bool>& flags)
+{
+  std::span<std::uint8_t> target = add<std::uint8_t>(id, static_cast<int>(flags.size()));
+  for (std::size_t i = 0; i < flags.size(); i++)
+    target[i] = flags[i];
+}
+
+void world_snapshot::finish()
+{
+  assert(size >= headerSize);
+
+  std::span<const snapshot_entry> table = sections;
+  std::size_t offset = (size + alignof(snapshot_entry) - 1) & ~(alignof(snapshot_entry) - 1);
+  reserve(offset + table.size_bytes());
+  std::memset(buffer.get() + size, 0, offset - size);
+  std::memcpy(buffer.get() + offset, table.data(), table.size_bytes());
+  size = offset + table.size_bytes();
+
+  snapshot_header& header = *reinterpret_cast<snapshot_header*>(buffer.get());
+  header.sectionCount = static_cast<std::uint32_t>(table.size());
+  header.tableOffset = offset;
+  header.size = size;
+}
+
+} // namespace flexor
\ No newline at end of file
@@ -0,0 +1,281 @@
+#include "core/thread_pool.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace flexor
+{
+
+// ----- Helper Functions -----
+
+// The pool a thread works for, and its index in it. Threads outside of every pool have none.
+static thread_local const thread_pool* currentPool = nullptr;
+static thread_local int currentIndex = 0;
+
+// How many times an idle worker looks for jobs before going to sleep.
+constexpr int idleSpins = 64;
+
+// ----- Job Deque -----
+
+void thread_pool::job_deque::lock()
+{
+  while (locked.exchange(true, std::memory_order_acquire))
+    while (locked.load(std::memory_order_relaxed))
+      std::this_thread::yield();
+}
+
+bool thread_pool::job_deque::empty() const
+{
+  return top.load(std::memory_order_relaxed) == bottom.load(std::memory_order_relaxed);
+}
+
+bool thread_pool::job_deque::push(const job& work)
+{
+  lock();
+  int end = bottom.load(std::memory_order_relaxed);
+  bool room = end - top.load(std::memory_order_relaxed) < capacity;
+  if (room)
+  {
+    jobs[end % capacity] = work;
+    bottom.store(end + 1, std::memory_order_relaxed);
+  }
+
+  unlock();
+  return room;
+}
+
+bool thread_pool::job_deque::pop(job& work)
+{
+  lock();
+  int begin = top.load(std::memory_order_relaxed);
+  int end = bottom.load(std::memory_order_relaxed);
+  bool found = begin != end;
+  if (found)
+  {
+    work = jobs[(end - 1) % capacity];
+
+    // Starting over whenever the deque runs empty keeps the indices from ever overflowing.
+    bottom.store(end - 1 == begin ? 0 : end - 1, std::memory_order_relaxed);
+    if (end - 1 == begin)
+      top.store(0, std::memory_order_relaxed);
+  }
+
+  unlock();
+  return found;
+}
+
+bool thread_pool::job_deque::steal(job& work)
+{
+  if (empty())
+    return false;
+
+  lock();
+  int begin = top.load(std::memory_order_relaxed);
+  int end = bottom.load(std::memory_order_relaxed);
+  bool found = begin != end;
+  if (found)
+  {
+    work = jobs[begin % capacity];
+    top.store(begin + 1 == end ? 0 : begin + 1, std::memory_order_relaxed);
+    if (begin + 1 == end)
+      bottom.store(0, std::memory_order_relaxed);
+  }
+
+  unlock();
+  return found;
+}
+
+// ----- Thread Pool -----
+
+thread_pool::thread_pool(int threads)
+{
+  if (threads < 0)
+    threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+  threadCount = std::max(threads, 1);
+  deques = std::make_unique<job_deque[]>(threadCount);
+  for (int i = 1; i < threadCount; i++)
+    workers.emplace_back(&thread_pool::workerMain, this, i);
+}
+
+thread_pool::~thread_pool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+
+  wake.notify_all();
+  for (std::thread& worker : workers)
+    worker.join();
+}
+
+int thread_pool::currentThread() const
+{
+  return currentPool == this ? currentIndex : 0;
+}
+
+// ----- Scheduling -----
+
+void thread_pool::submit(const job& work, int thread)
+{
+  if (!deques[thread].push(work))
+  {
+    work.execute(*this, work, thread);
+    return;
+  }
+
+  // A sleeping worker counts itself before it checks for jobs, and the job is counted before the
+  // sleepers are, so one of the two always sees the other. Taking the lock before notifying keeps
+  // the wakeup from landing between a worker's check and its wait.
+  queued.fetch_add(1);
+  if (sleepers.load() > 0)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+    }
+    wake.notify_one();
+  }
+}
+
+bool thread_pool::runOne(int thread)
+{
+  job work;
+  bool found = deques[thread].pop(work);
+
+  // Thieves start looking right after themselves, so they don't all line up behind one thread.
+  for (int i = 1; !found && i < size(); i++)
+    found = deques[(thread + i) % size()].steal(work);
+
+  if (!found)
+    return false;
+
+  queued.fetch_sub(1, std::memory_order_relaxed);
+  work.execute(*this, work, thread);
+  return true;
+}
+
+void thread_pool::waitFor(const std::atomic<int>& counter, int thread)
+{
+  while (counter.load(std::memory_order_acquire) != 0)
+    if (!runOne(thread))
+      std::this_thread::yield();
+}
+
+void thread_pool::workerMain(int thread)
+{
+  currentPool = this;
+  currentIndex = thread;
+
+  while (true)
+  {
+    int spins = 0;
+    while (spins < idleSpins)
+    {
+      if (runOne(thread))
+        spins = 0;
+      else
+        spins++;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    sleepers.fetch_add(1);
+    wake.wait(lock, [this] { return stopping || queued.load() > 0; });
+    sleepers.fetch_sub(1);
+
+    if (stopping)
+      return;
+  }
+}
+
+// ----- Loops -----
+
+void thread_pool::runLoop(loop& work)
+{
+  int chunks = (work.count + work.grain - 1) / work.grain;
+  work.remaining.store(chunks, std::memory_order_relaxed);
+
+  // The whole loop starts out as one job on the calling thread, which splits it as others come
+  // looking for work.
+  int thread = currentThread();
+  executeLoop(*this, {executeLoop, &work, 0, chunks}, thread);
+  waitFor(work.remaining, thread);
+}
+
+void thread_pool::executeLoop(thread_pool& pool, const job& work, int thread)
+{
+  loop& current = *static_cast<loop*>(work.context);
+  int begin = work.begin;
+  int end = work.end;
+  int done = 0;
+
+  while (begin < end)
+  {
+    // Lazy binary splitting: half of what is left goes up for grabs only once the last half that
+    // went up has been taken, so a busy pool hardly splits at all.
+    if (end - begin > 1 && pool.deques[thread].empty())
+    {
+      int middle = begin + (end - begin) / 2;
+      pool.submit({executeLoop, &current, middle, end}, thread);
+      end = middle;
+    }
+
+    int first = begin * current.grain;
+    current.invoke(current.fn, first, std::min(first + current.grain, current.count), thread);
+    begin++;
+    done++;
+  }
+
+  // The loop lives on the stack of the thread that started it, which may return as soon as this
+  // lands, so it must be the last thing touched.
+  current.remaining.fetch_sub(done, std::memory_order_release);
+}
+
+// ----- Graphs -----
+
+void thread_pool::run(task_graph& graph)
+{
+  int count = graph.size();
+  if (count == 0)
+    return;
+
+  if (!graph.waiting)
+    graph.waiting = std::make_unique<std::atomic<int>[]>(count);
+
+  for (int task = 0; task < count; task++)
+    graph.waiting[task].store(graph.tasks[task].dependencies, std::memory_order_relaxed);
+  graph.unfinished.store(count, std::memory_order_relaxed);
+
+  int thread = currentThread();
+  for (int task = 0; task < count; task++)
+    if (graph.tasks[task].dependencies == 0)
+      submit({executeTask, &graph, task, task + 1}, thread);
+
+  waitFor(graph.unfinished, thread);
+}
+
+void thread_pool::executeTask(thread_pool& pool, const job& work, int thread)
+{
+  task_graph& graph = *static_cast<task_graph*>(work.context);
+  const task_graph::task& task = graph.tasks[work.begin];
+  task.fn(thread);
+
+  // The last task to become ready runs right here instead of going through the deque, since this
+  // thread is free now anyway.
+  int next = -1;
+  for (int successor : task.successors)
+  {
+    if (graph.waiting[successor].fetch_sub(1, std::memory_order_acq_rel) != 1)
+      continue;
+
+    if (next >= 0)
+      pool.submit({executeTask, &graph, next, next + 1}, thread);
+    next = successor;
+  }
+
+  graph.unfinished.fetch_sub(1, std::memory_order_release);
+  if (next >= 0)
+    executeTask(pool, {executeTask, &graph, next, next + 1}, thread);
+}
+
+} // namespace flexor
\ No newline at end of file
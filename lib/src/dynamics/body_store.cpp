@@ -0,0 +1,222 @@
+#include "dynamics/body_store.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "dynamics/integrator.h"
+
+namespace flexor
+{
+
+// ----- Helper Functions -----
+
+// Moves the last element of an array into the given index and drops the last element.
+template <typename T> static void swapRemoveFrom(std::vector<T>& array, int index)
+{
+  array[index] = array.back();
+  array.pop_back();
+}
+
+// A shape as it is kept in a snapshot, with the vertices of a hull as a range of the vertex
+// section instead of a pointer.
+struct shape_record
+{
+  shape_type type;
+  float radius;
+  float halfHeight;
+  vector3 halfExtents;
+  int firstVertex;
+  int vertexCount;
+};
+
+// ----- Body Store -----
+
+int body_store::add(const body_def& def)
+{
+  int index = size();
+
+  positions.push_back(def.position);
+  orientations.push_back(normalize(def.orientation));
+  linearVelocities.push_back(def.linearVelocity);
+  angularVelocities.push_back(def.angularVelocity);
+
+  forces.push_back(vector3(0.0f));
+  torques.push_back(vector3(0.0f));
+
+  // Static bodies have infinite mass and inertia, which we store as zero inverses so that the
+  // integration passes don't need to special case them.
+  bool dynamic = def.mass > 0.0f;
+  inverseMasses.push_back(dynamic ? 1.0f / def.mass : 0.0f);
+
+  vector3 inverseInertia(0.0f);
+  for (int i = 0; dynamic && i < vector3::length(); i++)
+    inverseInertia[i] = def.inertia[i] > 0.0f ? 1.0f / def.inertia[i] : 0.0f;
+  inverseInertias.push_back(inverseInertia);
+
+  worldInverseInertias.push_back(matrix3(0.0f));
+  integrator::updateInertia(*this, index, index + 1);
+
+  shapes.push_back(def.geometry);
+  localBounds.push_back(bounds(def.geometry));
+
+  return index;
+}
+
+void body_store::swapRemove(int body)
+{
+  assert(body >= 0 && body < size());
+
+  swapRemoveFrom(positions, body);
+  swapRemoveFrom(orientations, body);
+  swapRemoveFrom(linearVelocities, body);
+  swapRemoveFrom(angularVelocities, body);
+  swapRemoveFrom(forces, body);
+  swapRemoveFrom(torques, body);
+  swapRemoveFrom(inverseMasses, body);
+  swapRemoveFrom(inverseInertias, body);
+  swapRemoveFrom(worldInverseInertias, body);
+  swapRemoveFrom(shapes, body);
+  swapRemoveFrom(localBounds, body);
+}
+
+// ----- Snapshots -----
+
+void body_store::save(world_snapshot& snapshot) const
+{
+  snapshot.write(snapshot_section::positions, positions);
+  snapshot.write(snapshot_section::orientations, orientations);
+  snapshot.write(snapshot_section::linearVelocities, linearVelocities);
+  snapshot.write(snapshot_section::angularVelocities, angularVelocities);
+  snapshot.write(snapshot_section::forces, forces);
+  snapshot.write(snapshot_section::torques, torques);
+  snapshot.write(snapshot_section::inverseMasses, inverseMasses);
+  snapshot.write(snapshot_section::inverseInertias, inverseInertias);
+  snapshot.write(snapshot_section::worldInverseInertias, worldInverseInertias);
+  snapshot.write(snapshot_section::localBounds, localBounds);
+
+  // Bodies tend to share a handful of hulls, so each hull is found by its vertices and written
+  // once.
+  savedHulls.clear();
+  int vertexCount = 0;
+
+  std::span<shape_record> records = snapshot.add<shape_record>(snapshot_section::shapes, size());
+  for (int body = 0; body < size(); body++)
+  {
+    const shape& geometry = shapes[body];
+    shape_record& record = records[body];
+    record = {geometry.type, geometry.radius, geometry.halfHeight, geometry.halfExtents, 0, 0};
+
+    if (geometry.type != shape_type::hull)
+      continue;
+
+    hull_key key = {geometry.vertices.data(), geometry.vertices.size()};
+    auto [found, added] = savedHulls.try_emplace(key, vertexCount);
+    if (added)
+      vertexCount += static_cast<int>(key.count);
+
+    record.firstVertex = found->second;
+    record.vertexCount = static_cast<int>(geometry.vertices.size());
+  }
+
+  std::span<vector3> vertices = snapshot.add<vector3>(snapshot_section::hullVertices, vertexCount);
+  for (const auto& [hull, offset] : savedHulls)
+    std::copy(hull.vertices, hull.vertices + hull.count, vertices.begin() + offset);
+}
+
+bool body_store::restore(const snapshot_view& snapshot)
+{
+  std::size_t count = snapshot.array<vector3>(snapshot_section::positions).size();
+  std::span<const shape_record> records = snapshot.array<shape_record>(snapshot_section::shapes);
+  std::size_t vertexCount = snapshot.array<vector3>(snapshot_section::hullVertices).size();
+
+  if (snapshot.array<quaternion>(snapshot_section::orientations).size() != count ||
+      snapshot.array<vector3>(snapshot_section::linearVelocities).size() != count ||
+      snapshot.array<vector3>(snapshot_section::angularVelocities).size() != count ||
+      snapshot.array<vector3>(snapshot_section::forces).size() != count ||
+      snapshot.array<vector3>(snapshot_section::torques).size() != count ||
+      snapshot.array<float>(snapshot_section::inverseMasses).size() != count ||
+      snapshot.array<vector3>(snapshot_section::inverseInertias).size() != count ||
+      snapshot.array<matrix3>(snapshot_section::worldInverseInertias).size() != count ||
+      snapshot.array<aabb>(snapshot_section::localBounds).size() != count ||
+      records.size() != count)
+    return false;
+
+  for (const shape_record& record : records)
+  {
+    // The type picks the collision routine out of a table, so it has to be one of the real ones.
+    if (record.type >= shape_type::count)
+      return false;
+
+    if (record.type != shape_type::hull)
+      continue;
+
+    // Compared as sizes, so that a huge first vertex can't wrap around.
+    if (record.firstVertex < 0 || record.vertexCount <= 0 ||
+        static_cast<std::size_t>(record.firstVertex) > vertexCount ||
+        static_cast<std::size_t>(record.vertexCount) > vertexCount - record.firstVertex)
+      return false;
+  }
+
+  snapshot.read(snapshot_section::positions, positions);
+  snapshot.read(snapshot_section::orientations, orientations);
+  snapshot.read(snapshot_section::linearVelocities, linearVelocities);
+  snapshot.read(snapshot_section::angularVelocities, angularVelocities);
+  snapshot.read(snapshot_section::forces, forces);
+  snapshot.read(snapshot_section::torques, torques);
+  snapshot.read(snapshot_section::inverseMasses, inverseMasses);
+  snapshot.read(snapshot_section::inverseInertias, inverseInertias);
+  snapshot.read(snapshot_section::worldInverseInertias, worldInverseInertias);
+  snapshot.read(snapshot_section::localBounds, localBounds);
+  snapshot.read(snapshot_section::hullVertices, hullVertices);
+
+  shapes.resize(records.size());
+  for (std::size_t body = 0; body < records.size(); body++)
+  {
+    const shape_record& record = records[body];
+    shape& geometry = shapes[body];
+    geometry = shape();
+    geometry.type = record.type;
+    geometry.radius = record.radius;
+    geometry.halfHeight = record.halfHeight;
+    geometry.halfExtents = record.halfExtents;
+
+    if (record.type == shape_type::hull)
+      geometry.vertices =
+        std::span<const vector3>(hullVertices).subspan(record.firstVertex, record.vertexCount);
+  }
+
+  return true;
+}
+
+void body_store::reserve(int capacity)
+{
+  positions.reserve(capacity);
+  orientations.reserve(capacity);
+  linearVelocities.reserve(capacity);
+  angularVelocities.reserve(capacity);
+  forces.reserve(capacity);
+  torques.reserve(capacity);
+  inverseMasses.reserve(capacity);
+  inverseInertias.reserve(capacity);
+  worldInverseInertias.reserve(capacity);
+  shapes.reserve(capacity);
+  localBounds.reserve(capacity);
+}
+
+void body_store::clear()
+{
+  positions.clear();
+  orientations.clear();
+  linearVelocities.clear();
+  angularVelocities.clear();
+  forces.clear();
+  torques.clear();
+  inverseMasses.clear();
+  inverseInertias.clear();
+  worldInverseInertias.clear();
+  shapes.clear();
+  localBounds.clear();
+  hullVertices.clear();
+}
+
+} // namespace flexor
\ No newline at end of file
@@ -0,0 +1,488 @@
+#include "dynamics/contact_solver.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <iterator>
+#include <numeric>
+
+namespace flexor
+{
+
+// ----- Helper Functions -----
+
+/**
+ * Builds two tangents that make an orthonormal basis with a unit normal, using the branchless
+ * construction of Duff et al. The tangents change smoothly with the normal, so friction impulses
+ * along them can carry over from one step to the next.
+ */
+static void tangentBasis(const vector3& normal, vector3& first, vector3& second)
+{
+  float sign = std::copysign(1.0f, normal.z);
+  float a = -1.0f / (sign + normal.z);
+  float b = normal.x * normal.y * a;
+
+  first = vector3(1.0f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x);
+  second = vector3(b, sign + normal.y * normal.y * a, -normal.y);
+}
+
+/**
+ * Computes the inverse of the effective mass of a pair of bodies along a direction, at the given
+ * arms.
+ */
+static float effectiveMass(float inverseMassA, const matrix3& inverseInertiaA, const vector3& armA,
+                           float inverseMassB, const matrix3& inverseInertiaB, const vector3& armB,
+                           const vector3& dir)
+{
+  vector3 turnA = cross(inverseInertiaA * cross(armA, dir), armA);
+  vector3 turnB = cross(inverseInertiaB * cross(armB, dir), armB);
+
+  float mass = inverseMassA + inverseMassB + dot(turnA + turnB, dir);
+  return mass > 0.0f ? 1.0f / mass : 0.0f;
+}
+
+// ----- Lane Math -----
+
+// A vector with each component in a wide register, one vector per lane.
+struct wide3
+{
+  simd::floatv x, y, z;
+};
+
+static wide3 operator+(const wide3& lhs, const wide3& rhs)
+{
+  return {lhs.x + rhs.x, lhs.y + rhs.y, lhs.z + rhs.z};
+}
+
+static wide3 operator-(const wide3& lhs, const wide3& rhs)
+{
+  return {lhs.x - rhs.x, lhs.y - rhs.y, lhs.z - rhs.z};
+}
+
+static wide3 operator*(const wide3& lhs, simd::floatv rhs)
+{
+  return {lhs.x * rhs, lhs.y * rhs, lhs.z * rhs};
+}
+
+static simd::floatv dot(const wide3& lhs, const wide3& rhs)
+{
+  return simd::multiplyAdd(lhs.x, rhs.x, simd::multiplyAdd(lhs.y, rhs.y, lhs.z * rhs.z));
+}
+
+static wide3 cross(const wide3& lhs, const wide3& rhs)
+{
+  return {lhs.y * rhs.z - lhs.z * rhs.y, lhs.z * rhs.x - lhs.x * rhs.z,
+          lhs.x * rhs.y - lhs.y * rhs.x};
+}
+
+/**
+ * Multiplies by a symmetric matrix given by its upper triangle, as xx, yy, zz, xy, xz, and yz.
+ */
+static wide3 multiplySymmetric(const simd::floatv* m, const wide3& v)
+{
+  return {simd::multiplyAdd(m[0], v.x, simd::multiplyAdd(m[3], v.y, m[4] * v.z)),
+          simd::multiplyAdd(m[3], v.x, simd::multiplyAdd(m[1], v.y, m[5] * v.z)),
+          simd::multiplyAdd(m[4], v.x, simd::multiplyAdd(m[5], v.y, m[2] * v.z))};
+}
+
+// The lane arrays are private to the solver, so these take them by deduced type.
+
+template <typename L> static simd::floatv loadLanes(const L& floats)
+{
+  return simd::loadWide(floats.lane);
+}
+
+template <typename L> static void storeLanes(L& floats, simd::floatv v)
+{
+  simd::storeWide(floats.lane, v);
+}
+
+template <typename L> static wide3 loadLanes3(const L* floats)
+{
+  return {loadLanes(floats[0]), loadLanes(floats[1]), loadLanes(floats[2])};
+}
+
+/**
+ * Gathers the vectors at the given indices of an array into the lanes of a wide vector.
+ */
+static wide3 gather(const std::vector<vector3>& vectors, const int* indices)
+{
+  simd::float4 rows[simd::wideLanes];
+  for (int lane = 0; lane < simd::wideLanes; lane++)
+    rows[lane] = vectors[indices[lane]].toSimd();
+
+  wide3 res;
+  simd::transposeToWide(rows, res.x, res.y, res.z);
+  return res;
+}
+
+/**
+ * Scatters the lanes of a wide vector back to the given indices of an array, skipping the lanes
+ * whose bit is clear in the mask.
+ */
+static void scatter(std::vector<vector3>& vectors, const int* indices, int mask, const wide3& v)
+{
+  simd::float4 rows[simd::wideLanes];
+  simd::transposeFromWide(v.x, v.y, v.z, rows);
+
+  for (int lane = 0; lane < simd::wideLanes; lane++)
+    if (mask & (1 << lane))
+      vectors[indices[lane]] = vector3::fromSimd(rows[lane]);
+}
+
+/**
+ * The velocities and masses of the bodies of a batch, gathered into lanes.
+ */
+struct batch_bodies
+{
+  wide3 linearA, angularA;
+  wide3 linearB, angularB;
+
+  simd::floatv inverseMassA, inverseMassB;
+  simd::floatv inertiaA[6], inertiaB[6];
+
+  wide3 relativeVelocity(const wide3& armA, const wide3& armB) const
+  {
+    return (linearB + cross(angularB, armB)) - (linearA + cross(angularA, armA));
+  }
+
+  void apply(const wide3& armA, const wide3& armB, const wide3& impulse)
+  {
+    linearA = linearA - impulse * inverseMassA;
+    angularA = angularA - multiplySymmetric(inertiaA, cross(armA, impulse));
+    linearB = linearB + impulse * inverseMassB;
+    angularB = angularB + multiplySymmetric(inertiaB, cross(armB, impulse));
+  }
+};
+
+template <typename B> static batch_bodies gatherBodies(const body_store& bodies, const B& batch)
+{
+  batch_bodies res;
+  res.linearA = gather(bodies.linearVelocities, batch.bodyA);
+  res.angularA = gather(bodies.angularVelocities, batch.bodyA);
+  res.linearB = gather(bodies.linearVelocities, batch.bodyB);
+  res.angularB = gather(bodies.angularVelocities, batch.bodyB);
+
+  res.inverseMassA = loadLanes(batch.inverseMassA);
+  res.inverseMassB = loadLanes(batch.inverseMassB);
+  for (int i = 0; i < 6; i++)
+  {
+    res.inertiaA[i] = loadLanes(batch.inertiaA[i]);
+    res.inertiaB[i] = loadLanes(batch.inertiaB[i]);
+  }
+
+  return res;
+}
+
+template <typename B>
+static void scatterBodies(body_store& bodies, const B& batch, const batch_bodies& state)
+{
+  scatter(bodies.linearVelocities, batch.bodyA, batch.writeA, state.linearA);
+  scatter(bodies.angularVelocities, batch.bodyA, batch.writeA, state.angularA);
+  scatter(bodies.linearVelocities, batch.bodyB, batch.writeB, state.linearB);
+  scatter(bodies.angularVelocities, batch.bodyB, batch.writeB, state.angularB);
+}
+
+// ----- Contact Solver -----
+
+void contact_solver::color(const body_store& bodies,
+                           const std::vector<contact_manifold>& manifolds,
+                           std::span<const int> list, frame_arena& arena)
+{
+  static_assert(maxColors <= 32, "every color needs a bit in the body masks");
+
+  int count = static_cast<int>(list.size());
+  bodyColors.resize(bodies.size(), 0);
+  std::span<int> manifoldColors = arena.allocate<int>(count);
+  colorOffsets.fill(0);
+
+  // Static bodies are never written, so any number of manifolds of a color can share one.
+  auto colorsOf = [&](int body)
+  { return bodies.inverseMasses[body] > 0.0f ? bodyColors[body] : 0u; };
+
+  for (int i = 0; i < count; i++)
+  {
+    const contact_manifold& manifold = manifolds[list[i]];
+    std::uint32_t used = colorsOf(manifold.bodyA) | colorsOf(manifold.bodyB);
+
+    int color = maxColors;
+    if (~used != 0u)
+    {
+      color = std::countr_zero(~used);
+      if (bodies.inverseMasses[manifold.bodyA] > 0.0f)
+        bodyColors[manifold.bodyA] |= 1u << color;
+      if (bodies.inverseMasses[manifold.bodyB] > 0.0f)
+        bodyColors[manifold.bodyB] |= 1u << color;
+    }
+
+    manifoldColors[i] = color;
+    colorOffsets[color + 1]++;
+  }
+
+  for (int i = 0; i < count; i++)
+  {
+    bodyColors[manifolds[list[i]].bodyA] = 0;
+    bodyColors[manifolds[list[i]].bodyB] = 0;
+  }
+
+  // Sort the manifolds by color, keeping their order within each color.
+  for (int color = 0; color <= maxColors; color++)
+    colorOffsets[color + 1] += colorOffsets[color];
+
+  colorOrder = arena.allocate<int>(count);
+  for (int i = 0; i < count; i++)
+    colorOrder[colorOffsets[manifoldColors[i]]++] = list[i];
+
+  for (int color = maxColors; color > 0; color--)
+    colorOffsets[color] = colorOffsets[color - 1];
+  colorOffsets[0] = 0;
+}
+
+void contact_solver::fillLane(contact_batch& batch, int lane, const body_store& bodies,
+                              const std::vector<contact_manifold>& manifolds, int index,
+                              const solver_settings& settings, float dt) const
+{
+  const contact_manifold& manifold = manifolds[index];
+  int a = manifold.bodyA;
+  int b = manifold.bodyB;
+
+  float inverseMassA = bodies.inverseMasses[a];
+  float inverseMassB = bodies.inverseMasses[b];
+  const matrix3& inverseInertiaA = bodies.worldInverseInertias[a];
+  const matrix3& inverseInertiaB = bodies.worldInverseInertias[b];
+
+  batch.manifolds[lane] = index;
+  batch.bodyA[lane] = a;
+  batch.bodyB[lane] = b;
+  batch.writeA |= inverseMassA > 0.0f ? 1 << lane : 0;
+  batch.writeB |= inverseMassB > 0.0f ? 1 << lane : 0;
+  batch.pointCount = std::max(batch.pointCount, manifold.count);
+
+  vector3 tangents[2];
+  tangentBasis(manifold.normal, tangents[0], tangents[1]);
+  for (int axis = 0; axis < 3; axis++)
+  {
+    batch.normal[axis].lane[lane] = manifold.normal[axis];
+    batch.tangents[0][axis].lane[lane] = tangents[0][axis];
+    batch.tangents[1][axis].lane[lane] = tangents[1][axis];
+  }
+  batch.friction.lane[lane] = settings.friction;
+
+  // The inertias are symmetric, so the upper triangle is all there is to them.
+  auto triangle = [&](lane_floats* res, const matrix3& inertia)
+  {
+    res[0].lane[lane] = inertia[0].x;
+    res[1].lane[lane] = inertia[1].y;
+    res[2].lane[lane] = inertia[2].z;
+    res[3].lane[lane] = inertia[1].x;
+    res[4].lane[lane] = inertia[2].x;
+    res[5].lane[lane] = inertia[2].y;
+  };
+
+  batch.inverseMassA.lane[lane] = inverseMassA;
+  batch.inverseMassB.lane[lane] = inverseMassB;
+  triangle(batch.inertiaA, inverseInertiaA);
+  triangle(batch.inertiaB, inverseInertiaB);
+
+  for (int i = 0; i < manifold.count; i++)
+  {
+    const contact_point& point = manifold.points[i];
+    batch_point& slot = batch.points[i];
+
+    vector3 armA = point.position - bodies.positions[a];
+    vector3 armB = point.position - bodies.positions[b];
+    for (int axis = 0; axis < 3; axis++)
+    {
+      slot.armA[axis].lane[lane] = armA[axis];
+      slot.armB[axis].lane[lane] = armB[axis];
+    }
+
+    slot.normalMass.lane[lane] = effectiveMass(inverseMassA, inverseInertiaA, armA, inverseMassB,
+                                               inverseInertiaB, armB, manifold.normal);
+    for (int t = 0; t < 2; t++)
+      slot.tangentMass[t].lane[lane] = effectiveMass(inverseMassA, inverseInertiaA, armA,
+                                                     inverseMassB, inverseInertiaB, armB,
+                                                     tangents[t]);
+
+    // Overlap beyond the slop is pushed apart over a few steps, and a gap can be closed in a
+    // single step without the bodies ever passing through each other.
+    float overlap = std::max(point.depth - settings.slop, 0.0f);
+    float gap = std::max(-point.depth, 0.0f);
+    slot.bias.lane[lane] = (gap - settings.baumgarte * overlap) / dt;
+
+    bool warm = settings.warmStarting;
+    slot.normalImpulse.lane[lane] = warm ? point.normalImpulse : 0.0f;
+    slot.tangentImpulse[0].lane[lane] = warm ? point.tangentImpulse[0] : 0.0f;
+    slot.tangentImpulse[1].lane[lane] = warm ? point.tangentImpulse[1] : 0.0f;
+  }
+}
+
+void contact_solver::prepare(const body_store& bodies,
+                             const std::vector<contact_manifold>& manifolds,
+                             const solver_settings& settings, float dt)
+{
+  ownArena.reset();
+  std::span<int> all = ownArena.allocate<int>(static_cast<int>(manifolds.size()));
+  std::iota(all.begin(), all.end(), 0);
+  prepare(bodies, manifolds, all, settings, dt, ownArena);
+}
+
+void contact_solver::prepare(const body_store& bodies,
+                             const std::vector<contact_manifold>& manifolds,
+                             std::span<const int> list, const solver_settings& settings, float dt,
+                             frame_arena& arena)
+{
+  batchList = {};
+  colorCount = 0;
+  if (list.empty())
+    return;
+
+  color(bodies, manifolds, list, arena);
+
+  // Every full color is cut into batches of a lane per manifold, and each manifold left over gets
+  // a batch and a color of its own.
+  int batchCount = 0;
+  for (int color = 0; color < maxColors; color++)
+  {
+    int size = colorOffsets[color + 1] - colorOffsets[color];
+    batchCount += (size + lanes - 1) / lanes;
+    colorCount += size > 0 ? 1 : 0;
+  }
+
+  int overflow = colorOffsets[maxColors + 1] - colorOffsets[maxColors];
+  batchCount += overflow;
+  colorCount += overflow;
+  batchList = arena.allocate<contact_batch>(batchCount);
+
+  // Empty lanes point at a real body so they can be gathered, but have no mass and are never
+  // scattered.
+  contact_batch empty = {};
+  std::fill(std::begin(empty.manifolds), std::end(empty.manifolds), -1);
+  int emptyBody = manifolds[list[0]].bodyA;
+  std::fill(std::begin(empty.bodyA), std::end(empty.bodyA), emptyBody);
+  std::fill(std::begin(empty.bodyB), std::end(empty.bodyB), emptyBody);
+
+  int next = 0;
+  for (int color = 0; color <= maxColors; color++)
+  {
+    int begin = colorOffsets[color];
+    int end = colorOffsets[color + 1];
+
+    // The manifolds left over after the last color share bodies with each other, so they each get
+    // a batch of their own.
+    int width = color < maxColors ? lanes : 1;
+    for (int first = begin; first < end; first += width)
+    {
+      contact_batch& batch = batchList[next++];
+      batch = empty;
+
+      int count = std::min(width, end - first);
+      for (int lane = 0; lane < count; lane++)
+        fillLane(batch, lane, bodies, manifolds, colorOrder[first + lane], settings, dt);
+    }
+  }
+
+  assert(next == batchCount);
+}
+
+void contact_solver::warmStart(body_store& bodies)
+{
+  for (const contact_batch& batch : batchList)
+  {
+    batch_bodies state = gatherBodies(bodies, batch);
+
+    wide3 normal = loadLanes3(batch.normal);
+    wide3 tangents[2] = {loadLanes3(batch.tangents[0]), loadLanes3(batch.tangents[1])};
+
+    for (int i = 0; i < batch.pointCount; i++)
+    {
+      const batch_point& point = batch.points[i];
+      wide3 impulse = normal * loadLanes(point.normalImpulse) +
+                      tangents[0] * loadLanes(point.tangentImpulse[0]) +
+                      tangents[1] * loadLanes(point.tangentImpulse[1]);
+      state.apply(loadLanes3(point.armA), loadLanes3(point.armB), impulse);
+    }
+
+    scatterBodies(bodies, batch, state);
+  }
+}
+
+void contact_solver::solve(body_store& bodies)
+{
+  simd::floatv zero = simd::splatWide(0.0f);
+
+  for (contact_batch& batch : batchList)
+  {
+    batch_bodies state = gatherBodies(bodies, batch);
+
+    wide3 normal = loadLanes3(batch.normal);
+    wide3 tangents[2] = {loadLanes3(batch.tangents[0]), loadLanes3(batch.tangents[1])};
+    simd::floatv friction = loadLanes(batch.friction);
+
+    // Friction goes first, since the normal impulses matter more and should have the last word.
+    // Each friction impulse is bounded by the normal impulse from the last pass.
+    for (int i = 0; i < batch.pointCount; i++)
+    {
+      batch_point& point = batch.points[i];
+      wide3 armA = loadLanes3(point.armA);
+      wide3 armB = loadLanes3(point.armB);
+
+      simd::floatv limit = friction * loadLanes(point.normalImpulse);
+      simd::floatv lowest = zero - limit;
+
+      for (int t = 0; t < 2; t++)
+      {
+        wide3 velocity = state.relativeVelocity(armA, armB);
+        simd::floatv lambda = (zero - dot(velocity, tangents[t])) * loadLanes(point.tangentMass[t]);
+
+        simd::floatv previous = loadLanes(point.tangentImpulse[t]);
+        simd::floatv total = simd::min(simd::max(previous + lambda, lowest), limit);
+        storeLanes(point.tangentImpulse[t], total);
+        state.apply(armA, armB, tangents[t] * (total - previous));
+      }
+    }
+
+    // The bodies may push but never pull, so the total normal impulse stays positive.
+    for (int i = 0; i < batch.pointCount; i++)
+    {
+      batch_point& point = batch.points[i];
+      wide3 armA = loadLanes3(point.armA);
+      wide3 armB = loadLanes3(point.armB);
+
+      wide3 velocity = state.relativeVelocity(armA, armB);
+      simd::floatv lambda =
+        (zero - (dot(velocity, normal) + loadLanes(point.bias))) * loadLanes(point.normalMass);
+
+      simd::floatv previous = loadLanes(point.normalImpulse);
+      simd::floatv total = simd::max(previous + lambda, zero);
+      storeLanes(point.normalImpulse, total);
+      state.apply(armA, armB, normal * (total - previous));
+    }
+
+    scatterBodies(bodies, batch, state);
+  }
+}
+
+void contact_solver::storeImpulses(std::vector<contact_manifold>& manifolds) const
+{
+  for (const contact_batch& batch : batchList)
+  {
+    for (int lane = 0; lane < lanes; lane++)
+    {
+      if (batch.manifolds[lane] < 0)
+        continue;
+
+      contact_manifold& manifold = manifolds[batch.manifolds[lane]];
+      for (int i = 0; i < manifold.count; i++)
+      {
+        const batch_point& point = batch.points[i];
+        manifold.points[i].normalImpulse = point.normalImpulse.lane[lane];
+        manifold.points[i].tangentImpulse[0] = point.tangentImpulse[0].lane[lane];
+        manifold.points[i].tangentImpulse[1] = point.tangentImpulse[1].lane[lane];
+      }
+    }
+  }
+}
+
+} // namespace flexor
\ No newline at end of file
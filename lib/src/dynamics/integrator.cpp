@@ -0,0 +1,184 @@
+#include "dynamics/integrator.h"
+
+#include <algorithm>
+#include <ranges>
+
+#include "math/quaternion_soa.h"
+
+namespace flexor::integrator
+{
+
+// ----- Helper Functions -----
+
+/**
+ * Clamps a negative end of a range to the number of bodies in the store.
+ */
+static int rangeEnd(const body_store& bodies, int end)
+{
+  return end < 0 ? bodies.size() : end;
+}
+
+/**
+ * Rotates a diagonal body space inertia tensor into world space. We use the fact that R D R^T is
+ * the sum of d_k * r_k * r_k^T over the columns r_k of R, which avoids two full matrix products.
+ */
+static matrix3 rotateInertia(const quaternion& orientation, const vector3& diagonal)
+{
+  matrix3 rotation = quaternion::matrix(orientation);
+  vector3 r0 = rotation[0];
+  vector3 r1 = rotation[1];
+  vector3 r2 = rotation[2];
+
+  matrix3 res(0.0f);
+  for (int col = 0; col < 3; col++)
+    res[col] = r0 * (diagonal.x * r0[col]) + r1 * (diagonal.y * r1[col]) +
+               r2 * (diagonal.z * r2[col]);
+
+  return res;
+}
+
+// ----- Shared Passes -----
+
+// These passes only touch each body on its own, so they are written once over any sequence of body
+// indices, which is either a range or a list.
+
+template <typename Bodies>
+static void integrateVelocitiesOf(body_store& bodies, const Bodies& list, const vector3& gravity,
+                                  float dt)
+{
+  const float* inverseMasses = bodies.inverseMasses.data();
+  const vector3* forces = bodies.forces.data();
+  const vector3* torques = bodies.torques.data();
+  const matrix3* inverseInertias = bodies.worldInverseInertias.data();
+  vector3* linear = bodies.linearVelocities.data();
+  vector3* angular = bodies.angularVelocities.data();
+
+  // Linear velocities only depend on the mass and the force, so they get their own pass. Gravity
+  // is masked off for static bodies instead of branching on them.
+  for (int i : list)
+  {
+    float dynamic = inverseMasses[i] > 0.0f ? 1.0f : 0.0f;
+    linear[i] += (gravity * dynamic + forces[i] * inverseMasses[i]) * dt;
+  }
+
+  // Static bodies have a zero inverse inertia, so the torque has no effect on them.
+  for (int i : list)
+    angular[i] += (inverseInertias[i] * torques[i]) * dt;
+}
+
+template <typename Bodies> static void updateInertiaOf(body_store& bodies, const Bodies& list)
+{
+  const quaternion* orientations = bodies.orientations.data();
+  const vector3* inverseInertias = bodies.inverseInertias.data();
+  matrix3* worldInverseInertias = bodies.worldInverseInertias.data();
+
+  for (int i : list)
+    worldInverseInertias[i] = rotateInertia(orientations[i], inverseInertias[i]);
+}
+
+template <typename Bodies> static void clearForcesOf(body_store& bodies, const Bodies& list)
+{
+  vector3* forces = bodies.forces.data();
+  vector3* torques = bodies.torques.data();
+
+  for (int i : list)
+  {
+    forces[i] = vector3(0.0f);
+    torques[i] = vector3(0.0f);
+  }
+}
+
+// ----- Integration Passes -----
+
+void integrateVelocities(body_store& bodies, const vector3& gravity, float dt, int begin, int end)
+{
+  integrateVelocitiesOf(bodies, std::views::iota(begin, rangeEnd(bodies, end)), gravity, dt);
+}
+
+void integratePositions(body_store& bodies, float dt, int begin, int end)
+{
+  end = rangeEnd(bodies, end);
+
+  const vector3* linear = bodies.linearVelocities.data();
+  const vector3* angular = bodies.angularVelocities.data();
+  vector3* positions = bodies.positions.data();
+  quaternion* orientations = bodies.orientations.data();
+
+  for (int i = begin; i < end; i++)
+    positions[i] += linear[i] * dt;
+
+  // The derivative of an orientation q under angular velocity w is 0.5 * (0, w) * q. The stream
+  // kernel takes an explicit euler step along it and renormalizes, four bodies at a time.
+  integrate(std::span<quaternion>(orientations + begin, end - begin),
+            std::span<const vector3>(angular + begin, end - begin), dt);
+}
+
+void updateInertia(body_store& bodies, int begin, int end)
+{
+  updateInertiaOf(bodies, std::views::iota(begin, rangeEnd(bodies, end)));
+}
+
+void clearForces(body_store& bodies, int begin, int end)
+{
+  clearForcesOf(bodies, std::views::iota(begin, rangeEnd(bodies, end)));
+}
+
+// ----- Listed Passes -----
+
+void integrateVelocities(body_store& bodies, std::span<const int> list, const vector3& gravity,
+                         float dt)
+{
+  integrateVelocitiesOf(bodies, list, gravity, dt);
+}
+
+void integratePositions(body_store& bodies, std::span<const int> list, float dt)
+{
+  const vector3* linear = bodies.linearVelocities.data();
+  const vector3* angular = bodies.angularVelocities.data();
+  vector3* positions = bodies.positions.data();
+  quaternion* orientations = bodies.orientations.data();
+
+  for (int i : list)
+    positions[i] += linear[i] * dt;
+
+  // The same lane kernel as the stream, with four orientations gathered from the list at a time.
+  // The leftovers are padded with the last body of the list, which is integrated (and stored) again
+  // from the same starting point, so it gets the same result.
+  simd::float4 halfDt = simd::splat(0.5f * dt);
+  int count = static_cast<int>(list.size());
+  for (int index = 0; index < count; index += 4)
+  {
+    int listed[4];
+    for (int n = 0; n < 4; n++)
+      listed[n] = list[std::min(index + n, count - 1)];
+
+    simd::float4 q[4];
+    simd::float4 v[4];
+    for (int n = 0; n < 4; n++)
+    {
+      q[n] = orientations[listed[n]].toSimd();
+      v[n] = angular[listed[n]].toSimd();
+    }
+
+    simd::transpose(q[0], q[1], q[2], q[3]);
+    simd::transpose(v[0], v[1], v[2], v[3]);
+
+    integrateLanes(q[0], q[1], q[2], q[3], v[0], v[1], v[2], halfDt);
+
+    simd::transpose(q[0], q[1], q[2], q[3]);
+    for (int n = 0; n < 4; n++)
+      orientations[listed[n]] = quaternion::fromSimd(q[n]);
+  }
+}
+
+void updateInertia(body_store& bodies, std::span<const int> list)
+{
+  updateInertiaOf(bodies, list);
+}
+
+void clearForces(body_store& bodies, std::span<const int> list)
+{
+  clearForcesOf(bodies, list);
+}
+
+} // namespace flexor::integrator
\ No newline at end of file
@@ -0,0 +1,506 @@
+#include "dynamics/island_manager.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace flexor
+{
+
+// ----- Bodies -----
+
+void island_manager::add(int body, bool isStatic)
+{
+  assert(body >= static_cast<int>(states.size()));
+
+  int count = body + 1;
+  states.resize(count, body_state::isStatic);
+  restFrames.resize(count, 0);
+  sleeperOf.resize(count, -1);
+  parents.resize(count, -1);
+  islandOf.resize(count, -1);
+
+  if (isStatic)
+    return;
+
+  states[body] = body_state::awake;
+  awakeList.push_back(body);
+  dirty = true;
+}
+
+// Moves every kept element of an array indexed by body to its new index.
+template <typename T>
+static void remapArray(std::vector<T>& array, std::span<const int> newIndices, int count)
+{
+  for (int body = 0; body < static_cast<int>(newIndices.size()); body++)
+    if (newIndices[body] >= 0 && newIndices[body] != body)
+      array[newIndices[body]] = array[body];
+
+  array.resize(count);
+}
+
+// Renames the bodies of manifolds, and drops the ones with a removed body. A manifold whose bodies
+// end up the other way around is flipped, so the cache finds it again once the island wakes.
+static void remapManifolds(std::vector<contact_manifold>& manifolds,
+                           std::span<const int> newIndices)
+{
+  std::erase_if(manifolds,
+                [&](const contact_manifold& manifold)
+                { return newIndices[manifold.bodyA] < 0 || newIndices[manifold.bodyB] < 0; });
+
+  for (contact_manifold& manifold : manifolds)
+  {
+    manifold.bodyA = newIndices[manifold.bodyA];
+    manifold.bodyB = newIndices[manifold.bodyB];
+    if (manifold.bodyA > manifold.bodyB)
+      flipManifold(manifold);
+  }
+}
+
+void island_manager::remap(std::span<const int> newIndices, int count)
+{
+  assert(newIndices.size() == states.size());
+
+  // A sleeping island wakes when one of its bodies is removed, or a body it rests on.
+  for (int body = 0; body < static_cast<int>(newIndices.size()); body++)
+    if (newIndices[body] < 0)
+      wake(body);
+
+  for (const sleeping_island& island : sleepers)
+  {
+    for (const contact_manifold& manifold : island.manifolds)
+    {
+      if (newIndices[manifold.bodyA] < 0 || newIndices[manifold.bodyB] < 0)
+      {
+        wake(island.bodies.front());
+        break;
+      }
+    }
+  }
+
+  // Bodies only ever move to a smaller index, so moving them in order never overwrites a body
+  // that is still to be moved.
+  remapArray(states, newIndices, count);
+  remapArray(restFrames, newIndices, count);
+  remapArray(sleeperOf, newIndices, count);
+  remapArray(parents, newIndices, count);
+  remapArray(islandOf, newIndices, count);
+
+  std::erase_if(awakeList, [&](int body) { return newIndices[body] < 0; });
+  for (int& body : awakeList)
+    body = newIndices[body];
+
+  for (sleeping_island& island : sleepers)
+  {
+    for (int& body : island.bodies)
+      body = newIndices[body];
+    remapManifolds(island.manifolds, newIndices);
+  }
+
+  remapManifolds(restored, newIndices);
+
+  // The islands refer to the old indices, so they are dropped until they are built again.
+  islandBodyList.clear();
+  bodyStarts.assign(1, 0);
+  islandManifoldList.clear();
+  manifoldStarts.assign(1, 0);
+  dirty = true;
+}
+
+void island_manager::clear()
+{
+  states.clear();
+  restFrames.clear();
+  sleeperOf.clear();
+  parents.clear();
+  islandOf.clear();
+
+  awakeList.clear();
+  islandBodyList.clear();
+  bodyStarts.assign(1, 0);
+  islandManifoldList.clear();
+  manifoldStarts.assign(1, 0);
+
+  sleepers.clear();
+  freeSleepers.clear();
+  restored.clear();
+  dirty = false;
+}
+
+// ----- Snapshots -----
+
+void island_manager::save(world_snapshot& snapshot) const
+{
+  snapshot.write(snapshot_section::islandStates, states);
+  snapshot.write(snapshot_section::islandRestFrames, restFrames);
+  snapshot.write(snapshot_section::islandSleeperOf, sleeperOf);
+  snapshot.write(snapshot_section::islandParents, parents);
+  snapshot.write(snapshot_section::islandOf, islandOf);
+
+  snapshot.write(snapshot_section::awakeBodies, awakeList);
+  snapshot.write(snapshot_section::islandBodies, islandBodyList);
+  snapshot.write(snapshot_section::islandBodyStarts, bodyStarts);
+  snapshot.write(snapshot_section::islandManifolds, islandManifoldList);
+  snapshot.write(snapshot_section::islandManifoldStarts, manifoldStarts);
+
+  // The sleeping islands are flattened into one list of bodies and one of manifolds, with the
+  // offsets of each island (and one past the last) into them.
+  int count = static_cast<int>(sleepers.size());
+  int bodyCount = 0;
+  int manifoldCount = 0;
+
+  std::span<int> bodyOffsets = snapshot.add<int>(snapshot_section::sleeperBodyStarts, count + 1);
+  for (int i = 0; i < count; i++)
+  {
+    bodyOffsets[i] = bodyCount;
+    bodyCount += static_cast<int>(sleepers[i].bodies.size());
+  }
+  bodyOffsets[count] = bodyCount;
+
+  std::span<int> manifoldOffsets =
+    snapshot.add<int>(snapshot_section::sleeperManifoldStarts, count + 1);
+  for (int i = 0; i < count; i++)
+  {
+    manifoldOffsets[i] = manifoldCount;
+    manifoldCount += static_cast<int>(sleepers[i].manifolds.size());
+  }
+  manifoldOffsets[count] = manifoldCount;
+
+  auto bodies = snapshot.add<int>(snapshot_section::sleeperBodies, bodyCount).begin();
+  for (const sleeping_island& island : sleepers)
+    bodies = std::copy(island.bodies.begin(), island.bodies.end(), bodies);
+
+  auto manifolds =
+    snapshot.add<contact_manifold>(snapshot_section::sleeperManifolds, manifoldCount).begin();
+  for (const sleeping_island& island : sleepers)
+    manifolds = std::copy(island.manifolds.begin(), island.manifolds.end(), manifolds);
+
+  snapshot.write(snapshot_section::freeSleepers, freeSleepers);
+  snapshot.write(snapshot_section::restoredManifolds, restored);
+  snapshot.writeValue(snapshot_section::islandDirty, dirty);
+}
+
+// Returns whether every value of a list lies in [low, high).
+static bool allWithin(std::span<const int> values, int low, int high)
+{
+  return std::all_of(values.begin(), values.end(),
+                     [low, high](int value) { return value >= low && value < high; });
+}
+
+// Returns whether a list of offsets starts at zero, never goes back, and ends at the given size.
+static bool validOffsets(std::span<const int> offsets, std::size_t size)
+{
+  return !offsets.empty() && offsets.front() == 0 &&
+         std::is_sorted(offsets.begin(), offsets.end()) &&
+         static_cast<std::size_t>(offsets.back()) == size;
+}
+
+static bool validManifolds(std::span<const contact_manifold> manifolds, int bodies)
+{
+  return std::all_of(manifolds.begin(), manifolds.end(),
+                     [bodies](const contact_manifold& manifold)
+                     {
+                       return manifold.bodyA >= 0 && manifold.bodyA < bodies &&
+                              manifold.bodyB >= 0 && manifold.bodyB < bodies;
+                     });
+}
+
+bool island_manager::canRestore(const snapshot_view& snapshot, int bodies)
+{
+  auto count = static_cast<std::size_t>(bodies);
+  if (snapshot.array<body_state>(snapshot_section::islandStates).size() != count ||
+      snapshot.array<int>(snapshot_section::islandRestFrames).size() != count ||
+      snapshot.array<int>(snapshot_section::islandSleeperOf).size() != count ||
+      snapshot.array<int>(snapshot_section::islandParents).size() != count ||
+      snapshot.array<int>(snapshot_section::islandOf).size() != count)
+    return false;
+
+  // The islands of awake bodies, and the cached manifolds they refer to.
+  std::span<const int> bodyList = snapshot.array<int>(snapshot_section::islandBodies);
+  std::span<const int> manifoldList = snapshot.array<int>(snapshot_section::islandManifolds);
+  auto cached =
+    static_cast<int>(snapshot.array<contact_manifold>(snapshot_section::manifolds).size());
+
+  if (!allWithin(snapshot.array<int>(snapshot_section::awakeBodies), 0, bodies) ||
+      !allWithin(bodyList, 0, bodies) || !allWithin(manifoldList, 0, cached) ||
+      !validOffsets(snapshot.array<int>(snapshot_section::islandBodyStarts), bodyList.size()) ||
+      !validOffsets(snapshot.array<int>(snapshot_section::islandManifoldStarts),
+                    manifoldList.size()))
+    return false;
+
+  // The sleeping islands, flattened the way saving writes them.
+  std::span<const int> bodyOffsets = snapshot.array<int>(snapshot_section::sleeperBodyStarts);
+  std::span<const int> manifoldOffsets =
+    snapshot.array<int>(snapshot_section::sleeperManifoldStarts);
+  std::span<const int> sleeperBodies = snapshot.array<int>(snapshot_section::sleeperBodies);
+  std::span<const contact_manifold> sleeperManifolds =
+    snapshot.array<contact_manifold>(snapshot_section::sleeperManifolds);
+  int sleeperCount = static_cast<int>(bodyOffsets.size()) - 1;
+
+  return manifoldOffsets.size() == bodyOffsets.size() &&
+         validOffsets(bodyOffsets, sleeperBodies.size()) &&
+         validOffsets(manifoldOffsets, sleeperManifolds.size()) &&
+         allWithin(sleeperBodies, 0, bodies) &&
+         allWithin(snapshot.array<int>(snapshot_section::islandSleeperOf), -1, sleeperCount) &&
+         allWithin(snapshot.array<int>(snapshot_section::freeSleepers), 0, sleeperCount) &&
+         validManifolds(sleeperManifolds, bodies) &&
+         validManifolds(snapshot.array<contact_manifold>(snapshot_section::restoredManifolds),
+                        bodies);
+}
+
+void island_manager::restore(const snapshot_view& snapshot)
+{
+  snapshot.read(snapshot_section::islandStates, states);
+  snapshot.read(snapshot_section::islandRestFrames, restFrames);
+  snapshot.read(snapshot_section::islandSleeperOf, sleeperOf);
+  snapshot.read(snapshot_section::islandParents, parents);
+  snapshot.read(snapshot_section::islandOf, islandOf);
+
+  snapshot.read(snapshot_section::awakeBodies, awakeList);
+  snapshot.read(snapshot_section::islandBodies, islandBodyList);
+  snapshot.read(snapshot_section::islandBodyStarts, bodyStarts);
+  snapshot.read(snapshot_section::islandManifolds, islandManifoldList);
+  snapshot.read(snapshot_section::islandManifoldStarts, manifoldStarts);
+
+  std::span<const int> bodyOffsets = snapshot.array<int>(snapshot_section::sleeperBodyStarts);
+  std::span<const int> manifoldOffsets =
+    snapshot.array<int>(snapshot_section::sleeperManifoldStarts);
+  std::span<const int> bodies = snapshot.array<int>(snapshot_section::sleeperBodies);
+  std::span<const contact_manifold> manifolds =
+    snapshot.array<contact_manifold>(snapshot_section::sleeperManifolds);
+
+  // The islands already here keep their lists, so restoring over and over doesn't allocate.
+  sleepers.resize(bodyOffsets.empty() ? 0 : bodyOffsets.size() - 1);
+  for (std::size_t i = 0; i < sleepers.size(); i++)
+  {
+    sleepers[i].bodies.assign(bodies.begin() + bodyOffsets[i],
+                              bodies.begin() + bodyOffsets[i + 1]);
+    sleepers[i].manifolds.assign(manifolds.begin() + manifoldOffsets[i],
+                                 manifolds.begin() + manifoldOffsets[i + 1]);
+  }
+
+  snapshot.read(snapshot_section::freeSleepers, freeSleepers);
+  snapshot.read(snapshot_section::restoredManifolds, restored);
+  dirty = snapshot.value<bool>(snapshot_section::islandDirty);
+}
+
+// ----- Sleeping -----
+
+void island_manager::wake(int body)
+{
+  if (states[body] != body_state::asleep)
+    return;
+
+  sleeping_island& island = sleepers[sleeperOf[body]];
+  for (int member : island.bodies)
+  {
+    states[member] = body_state::awake;
+    restFrames[member] = 0;
+    sleeperOf[member] = -1;
+    awakeList.push_back(member);
+  }
+
+  restored.insert(restored.end(), island.manifolds.begin(), island.manifolds.end());
+  island.bodies.clear();
+  island.manifolds.clear();
+
+  freeSleepers.push_back(static_cast<int>(&island - sleepers.data()));
+  dirty = true;
+}
+
+// ----- Islands -----
+
+std::span<const int> island_manager::islandBodies(int island) const
+{
+  assert(island >= 0 && island < islands());
+  return std::span<const int>(islandBodyList).subspan(bodyStarts[island],
+                                                      bodyStarts[island + 1] - bodyStarts[island]);
+}
+
+std::span<const int> island_manager::islandManifolds(int begin, int end) const
+{
+  assert(begin >= 0 && begin <= end && end <= islands());
+  return std::span<const int>(islandManifoldList)
+    .subspan(manifoldStarts[begin], manifoldStarts[end] - manifoldStarts[begin]);
+}
+
+int island_manager::findRoot(int body)
+{
+  // Path halving points every other body on the way at its grandparent, which keeps the trees
+  // nearly flat without a second pass.
+  while (parents[body] != body)
+  {
+    parents[body] = parents[parents[body]];
+    body = parents[body];
+  }
+
+  return body;
+}
+
+void island_manager::build(const body_store& bodies, manifold_cache& cache)
+{
+  if (!restored.empty())
+  {
+    scratch = cache.manifolds();
+    scratch.insert(scratch.end(), restored.begin(), restored.end());
+    cache.store(scratch, bodies);
+    restored.clear();
+  }
+
+  const std::vector<contact_manifold>& manifolds = cache.manifolds();
+
+  // Join the bodies of every contact between two awake bodies. Every other contact is with a
+  // static body, which doesn't join anything.
+  for (int body : awakeList)
+    parents[body] = body;
+
+  for (const contact_manifold& manifold : manifolds)
+  {
+    if (!awake(manifold.bodyA) || !awake(manifold.bodyB))
+      continue;
+
+    int rootA = findRoot(manifold.bodyA);
+    int rootB = findRoot(manifold.bodyB);
+    if (rootA != rootB)
+      parents[std::max(rootA, rootB)] = std::min(rootA, rootB);
+  }
+
+  // Number the islands in the order their first body appears, and sort the bodies and the
+  // manifolds by island.
+  for (int body : awakeList)
+    islandOf[body] = -1;
+
+  int count = 0;
+  for (int body : awakeList)
+  {
+    int root = findRoot(body);
+    if (islandOf[root] < 0)
+      islandOf[root] = count++;
+
+    islandOf[body] = islandOf[root];
+  }
+
+  bodyStarts.assign(count + 1, 0);
+  for (int body : awakeList)
+    bodyStarts[islandOf[body] + 1]++;
+
+  manifoldStarts.assign(count + 1, 0);
+  for (const contact_manifold& manifold : manifolds)
+  {
+    int body = awake(manifold.bodyA) ? manifold.bodyA : manifold.bodyB;
+    assert(awake(body));
+    manifoldStarts[islandOf[body] + 1]++;
+  }
+
+  for (int island = 0; island < count; island++)
+  {
+    bodyStarts[island + 1] += bodyStarts[island];
+    manifoldStarts[island + 1] += manifoldStarts[island];
+  }
+
+  // The starts double as cursors while filling, and are shifted back afterwards.
+  islandBodyList.resize(awakeList.size());
+  for (int body : awakeList)
+    islandBodyList[bodyStarts[islandOf[body]]++] = body;
+
+  islandManifoldList.resize(manifolds.size());
+  for (int i = 0; i < static_cast<int>(manifolds.size()); i++)
+  {
+    int body = awake(manifolds[i].bodyA) ? manifolds[i].bodyA : manifolds[i].bodyB;
+    islandManifoldList[manifoldStarts[islandOf[body]]++] = i;
+  }
+
+  for (int island = count; island > 0; island--)
+  {
+    bodyStarts[island] = bodyStarts[island - 1];
+    manifoldStarts[island] = manifoldStarts[island - 1];
+  }
+  bodyStarts[0] = 0;
+  manifoldStarts[0] = 0;
+
+  awakeList = islandBodyList;
+  dirty = false;
+}
+
+void island_manager::refresh(body_store& bodies, manifold_cache& cache)
+{
+  build(bodies, cache);
+}
+
+void island_manager::update(body_store& bodies, manifold_cache& cache,
+                            const sleep_settings& settings)
+{
+  build(bodies, cache);
+  if (!settings.enabled)
+    return;
+
+  float linearLimit = settings.linearThreshold * settings.linearThreshold;
+  float angularLimit = settings.angularThreshold * settings.angularThreshold;
+  for (int body : awakeList)
+  {
+    const vector3& linear = bodies.linearVelocities[body];
+    const vector3& angular = bodies.angularVelocities[body];
+    bool resting = dot(linear, linear) < linearLimit && dot(angular, angular) < angularLimit;
+    restFrames[body] = resting ? restFrames[body] + 1 : 0;
+  }
+
+  // An island sleeps once its most restless body has been at rest for long enough.
+  std::vector<contact_manifold>& manifolds = cache.manifolds();
+  bool slept = false;
+  for (int island = 0; island < islands(); island++)
+  {
+    std::span<const int> members = islandBodies(island);
+
+    int rested = settings.frames;
+    for (int body : members)
+      rested = std::min(rested, restFrames[body]);
+
+    if (rested < settings.frames)
+      continue;
+
+    int slot = static_cast<int>(sleepers.size());
+    if (!freeSleepers.empty())
+    {
+      slot = freeSleepers.back();
+      freeSleepers.pop_back();
+    }
+    else
+    {
+      sleepers.emplace_back();
+    }
+
+    sleeping_island& sleeper = sleepers[slot];
+    sleeper.bodies.assign(members.begin(), members.end());
+    for (int index : islandManifolds(island, island + 1))
+    {
+      sleeper.manifolds.push_back(manifolds[index]);
+
+      // Flag the manifold for removal from the cache.
+      manifolds[index].count = -1;
+    }
+
+    for (int body : members)
+    {
+      states[body] = body_state::asleep;
+      sleeperOf[body] = slot;
+      bodies.linearVelocities[body] = vector3(0.0f);
+      bodies.angularVelocities[body] = vector3(0.0f);
+    }
+
+    slept = true;
+  }
+
+  if (!slept)
+    return;
+
+  // Take the sleeping manifolds out of the cache, and build the islands again from what is left.
+  scratch.clear();
+  for (const contact_manifold& manifold : manifolds)
+    if (manifold.count >= 0)
+      scratch.push_back(manifold);
+  cache.store(scratch, bodies);
+
+  std::erase_if(awakeList, [this](int body) { return !awake(body); });
+  build(bodies, cache);
+}
+
+} // namespace flexor
\ No newline at end of file
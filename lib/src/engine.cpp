@@ -1,13 +1,493 @@
 #include "engine.h"
 
+#include <algorithm>
+#include <cassert>
+#include <cmath>
 #include <iostream>
+#include <span>
+
+#include "dynamics/integrator.h"
+#include "math/quaternion_soa.h"
 
 namespace flexor
 {
 
-engine::engine()
+// ----- Helper Functions -----
+
+// The awake bodies are integrated in chunks of this many. Each pass does very little per body, so
+// smaller chunks would spend more time being handed out than being run.
+constexpr int bodyGrain = 256;
+
+// Everything about a world that isn't kept in an array.
+struct engine_state
+{
+  vector3 gravity;
+  timestep_settings timestep;
+  solver_settings solver;
+  sleep_settings sleep;
+  float accumulator;
+  broadphase_type broadphaseType;
+};
+
+// Mixes the sizes of the values a snapshot holds into a signature, so that a snapshot is only ever
+// restored by a build that lays them out the same way.
+static constexpr std::uint32_t snapshotLayout()
 {
+  std::uint32_t sizes[] = {sizeof(vector3),          sizeof(quaternion), sizeof(matrix3),
+                           sizeof(aabb),             sizeof(shape),      sizeof(contact_manifold),
+                           sizeof(engine_state)};
+
+  std::uint32_t hash = 2166136261u;
+  for (std::uint32_t size : sizes)
+    hash = (hash ^ size) * 16777619u;
+
+  return hash;
+}
+
+// ----- Flexor Engine -----
+
+engine::engine(broadphase_type broadphaseType, thread_pool* pool)
+  : ownedWorkers(pool ? nullptr : std::make_unique<thread_pool>()),
+    workers(pool ? pool : ownedWorkers.get()),
+    broadType(broadphaseType),
+    broad(createBroadphase(broadphaseType, workers))
+{
+  arenas.resize(workers->size());
+  solvers.resize(workers->size());
+  buildStep();
   std::cout << "Created a flexor engine!" << std::endl;
 }
 
+body_handle engine::addBody(const body_def& def)
+{
+  int body = store.add(def);
+  bool isStatic = store.inverseMasses[body] == 0.0f;
+  broad->add(body, store.worldBounds(body), isStatic);
+  islands.add(body, isStatic);
+
+  previousPositions.push_back(store.positions[body]);
+  previousOrientations.push_back(store.orientations[body]);
+
+  return handles.add();
+}
+
+void engine::removeBodies(std::span<const body_handle> bodies)
+{
+  if (bodies.empty())
+    return;
+
+  int count = store.size();
+  newIndices.resize(count);
+  oldIndices.resize(count);
+  for (int body = 0; body < count; body++)
+  {
+    newIndices[body] = body;
+    oldIndices[body] = body;
+  }
+
+  // Each body is swapped out of every array right away, so the broadphase only ever sees the
+  // indices of the store as it is. The islands and the contacts are renamed once at the end.
+  for (body_handle handle : bodies)
+  {
+    int body = indexOf(handle);
+    int last = store.size() - 1;
+
+    broad->remove(body);
+    newIndices[oldIndices[body]] = -1;
+    if (body != last)
+    {
+      broad->remove(last);
+      oldIndices[body] = oldIndices[last];
+      newIndices[oldIndices[body]] = body;
+    }
+
+    store.swapRemove(body);
+    handles.remove(handle);
+
+    previousPositions[body] = previousPositions.back();
+    previousPositions.pop_back();
+    previousOrientations[body] = previousOrientations.back();
+    previousOrientations.pop_back();
+
+    if (body != last)
+      broad->add(body, store.worldBounds(body), store.inverseMasses[body] == 0.0f);
+  }
+
+  islands.remap(newIndices, store.size());
+  cache.remap(newIndices);
+
+  std::erase_if(savedBodies, [this](int body) { return newIndices[body] < 0; });
+  for (int& body : savedBodies)
+    body = newIndices[body];
+}
+
+void engine::applyForce(body_handle handle, const vector3& force, const vector3& torque)
+{
+  int body = indexOf(handle);
+
+  islands.wake(body);
+  store.forces[body] += force;
+  store.torques[body] += torque;
+}
+
+// ----- Stepping -----
+
+void engine::step(float dt)
+{
+  assert(dt > 0.0f);
+
+  // Bodies that were woken or added since the last step need their islands before they're solved.
+  if (islands.pending())
+    islands.refresh(store, cache);
+
+  for (frame_arena& arena : arenas)
+    arena.reset();
+
+  stepDt = dt;
+  workers->run(stepGraph);
+}
+
+// ----- Fixed Steps -----
+
+int engine::update(float frameTime)
+{
+  assert(frameTime >= 0.0f);
+
+  float fixedStep = timestepConfig.fixedStep;
+  float substep = fixedStep / timestepConfig.substeps;
+  accumulator += frameTime;
+
+  int steps = 0;
+  while (accumulator >= fixedStep && steps < timestepConfig.maxSteps)
+  {
+    saveTransforms();
+    for (int i = 0; i < timestepConfig.substeps; i++)
+      step(substep);
+
+    accumulator -= fixedStep;
+    steps++;
+  }
+
+  // Falling this far behind means the world can't keep up, so the whole steps left are dropped.
+  if (accumulator >= fixedStep)
+    accumulator = std::fmod(accumulator, fixedStep);
+
+  publishTransforms();
+  return steps;
+}
+
+void engine::saveTransforms()
+{
+  for (int body : savedBodies)
+  {
+    previousPositions[body] = store.positions[body];
+    previousOrientations[body] = store.orientations[body];
+  }
+
+  savedBodies = islands.awakeBodies();
+  for (int body : savedBodies)
+  {
+    previousPositions[body] = store.positions[body];
+    previousOrientations[body] = store.orientations[body];
+  }
+}
+
+void engine::publishTransforms()
+{
+  // Only this thread ever changes which frame is in front, so it can read that without the lock.
+  transform_frame& back = frames[1 - frontFrame];
+  back.previousPositions.assign(previousPositions.begin(), previousPositions.end());
+  back.previousOrientations.assign(previousOrientations.begin(), previousOrientations.end());
+  back.positions.assign(store.positions.begin(), store.positions.end());
+  back.orientations.assign(store.orientations.begin(), store.orientations.end());
+  back.alpha = interpolationAlpha();
+
+  std::lock_guard<std::mutex> lock(frameLock);
+  frontFrame = 1 - frontFrame;
+}
+
+int engine::interpolateTransforms(std::span<vector3> positions,
+                                  std::span<quaternion> orientations) const
+{
+  std::lock_guard<std::mutex> lock(frameLock);
+  const transform_frame& front = frames[frontFrame];
+
+  int count = static_cast<int>(front.positions.size());
+  assert(static_cast<int>(positions.size()) >= count);
+  assert(static_cast<int>(orientations.size()) >= count);
+
+  for (int body = 0; body < count; body++)
+  {
+    const vector3& from = front.previousPositions[body];
+    positions[body] = from + (front.positions[body] - from) * front.alpha;
+  }
+
+  nlerp(front.previousOrientations, front.orientations, front.alpha, orientations.first(count));
+  return count;
+}
+
+void engine::setTimestepSettings(const timestep_settings& settings)
+{
+  assert(settings.fixedStep > 0.0f && settings.substeps >= 1 && settings.maxSteps >= 1);
+  timestepConfig = settings;
+}
+
+// ----- Snapshots -----
+
+void engine::save(world_snapshot& snapshot) const
+{
+  snapshot.begin(snapshotLayout());
+
+  engine_state state = {gravityVector, timestepConfig, solverConfig, sleepConfig, accumulator,
+                        broadType};
+  snapshot.writeValue(snapshot_section::engineState, state);
+  snapshot.write(snapshot_section::previousPositions, previousPositions);
+  snapshot.write(snapshot_section::previousOrientations, previousOrientations);
+  snapshot.write(snapshot_section::savedBodies, savedBodies);
+
+  store.save(snapshot);
+  handles.save(snapshot, snapshot_section::handleSlots);
+  cache.save(snapshot);
+  islands.save(snapshot);
+  broad->save(snapshot);
+
+  snapshot.finish();
+}
+
+bool engine::restore(const snapshot_view& snapshot)
+{
+  std::span<const engine_state> state = snapshot.array<engine_state>(snapshot_section::engineState);
+  if (!snapshot.valid() || snapshot.layout() != snapshotLayout() || state.size() != 1)
+    return false;
+
+  // Every part of the world has to agree on the bodies before any of it is replaced, so that a
+  // damaged snapshot leaves the world as it was. The body store checks its own arrays, and is the
+  // first part to be restored.
+  std::size_t count = snapshot.array<vector3>(snapshot_section::positions).size();
+  if (snapshot.array<vector3>(snapshot_section::previousPositions).size() != count ||
+      snapshot.array<quaternion>(snapshot_section::previousOrientations).size() != count)
+    return false;
+
+  int bodies = static_cast<int>(count);
+  std::span<const int> saved = snapshot.array<int>(snapshot_section::savedBodies);
+  if (std::any_of(saved.begin(), saved.end(),
+                  [bodies](int body) { return body < 0 || body >= bodies; }))
+    return false;
+
+  if (!handle_pool<body_tag>::canRestore(snapshot, snapshot_section::handleSlots, bodies) ||
+      !manifold_cache::canRestore(snapshot, bodies) ||
+      !island_manager::canRestore(snapshot, bodies) ||
+      !canRestoreBroadphase(state[0].broadphaseType, snapshot, bodies) || !store.restore(snapshot))
+    return false;
+
+  gravityVector = state[0].gravity;
+  timestepConfig = state[0].timestep;
+  solverConfig = state[0].solver;
+  sleepConfig = state[0].sleep;
+  accumulator = state[0].accumulator;
+
+  snapshot.read(snapshot_section::previousPositions, previousPositions);
+  snapshot.read(snapshot_section::previousOrientations, previousOrientations);
+  snapshot.read(snapshot_section::savedBodies, savedBodies);
+
+  handles.restore(snapshot, snapshot_section::handleSlots);
+  cache.restore(snapshot);
+  islands.restore(snapshot);
+
+  if (state[0].broadphaseType != broadType)
+  {
+    broadType = state[0].broadphaseType;
+    broad = createBroadphase(broadType, workers);
+  }
+
+  broad->restore(snapshot);
+  publishTransforms();
+  return true;
+}
+
+// ----- Step Graph -----
+
+void engine::buildStep()
+{
+  int velocities = stepGraph.add([this](int) { integrateVelocities(); });
+  int solve = stepGraph.add([this](int thread) { solveContacts(thread); });
+  int positions = stepGraph.add([this](int) { integratePositions(); });
+  int finish = stepGraph.add([this](int) { finishBodies(); });
+  int broadphase = stepGraph.add([this](int) { updateBroadphase(); });
+  int narrowphase = stepGraph.add([this](int) { findContacts(); });
+  int writeback = stepGraph.add([this](int) { writeBack(); });
+
+  stepGraph.precede(velocities, solve);
+  stepGraph.precede(solve, positions);
+  stepGraph.precede(positions, finish);
+  stepGraph.precede(positions, broadphase);
+  stepGraph.precede(broadphase, narrowphase);
+  stepGraph.precede(narrowphase, writeback);
+
+  // Waking bodies changes the awake list that finishing the bodies walks through.
+  stepGraph.precede(finish, writeback);
+}
+
+// ----- Phases -----
+
+// Each pass streams through only the arrays it needs for every awake body before the next one
+// starts. Sleeping bodies aren't touched at all.
+
+void engine::integrateVelocities()
+{
+  std::span<const int> awakeBodies = islands.awakeBodies();
+  workers->parallelFor(static_cast<int>(awakeBodies.size()), bodyGrain,
+                       [&](int begin, int end, int)
+                       {
+                         integrator::integrateVelocities(
+                           store, awakeBodies.subspan(begin, end - begin), gravityVector, stepDt);
+                       });
+}
+
+void engine::integratePositions()
+{
+  std::span<const int> awakeBodies = islands.awakeBodies();
+  workers->parallelFor(static_cast<int>(awakeBodies.size()), bodyGrain,
+                       [&](int begin, int end, int)
+                       {
+                         integrator::integratePositions(
+                           store, awakeBodies.subspan(begin, end - begin), stepDt);
+                       });
+}
+
+void engine::finishBodies()
+{
+  std::span<const int> awakeBodies = islands.awakeBodies();
+  workers->parallelFor(static_cast<int>(awakeBodies.size()), bodyGrain,
+                       [&](int begin, int end, int)
+                       {
+                         std::span<const int> chunk = awakeBodies.subspan(begin, end - begin);
+                         integrator::updateInertia(store, chunk);
+                         integrator::clearForces(store, chunk);
+                       });
+}
+
+void engine::updateBroadphase()
+{
+  // Static and sleeping bodies never move, so only the awake bodies need their bounds refreshed.
+  // The displacement lets a broadphase predict where each body will be next step. Broadphases
+  // aren't safe to move bodies in from several threads, but finding the pairs may be split up.
+  for (int body : islands.awakeBodies())
+    broad->move(body, store.worldBounds(body), store.linearVelocities[body] * stepDt);
+
+  broad->updatePairs();
+}
+
+void engine::findContacts()
+{
+  const std::vector<body_pair>& candidates = broad->pairs();
+  int count = static_cast<int>(candidates.size());
+
+  constexpr int chunk = 256;
+  chunkOutputs.resize((count + chunk - 1) / chunk);
+
+  auto collidePairs = [&](int begin, int end, int thread)
+  {
+    // Every pair of the chunk could touch, so there is room for all of them.
+    std::span<contact_manifold> contacts = arenas[thread].allocate<contact_manifold>(end - begin);
+    std::span<int> wakes = arenas[thread].allocate<int>(end - begin);
+    int found = 0;
+    int woken = 0;
+
+    for (int i = begin; i < end; i++)
+    {
+      int a = candidates[i].a;
+      int b = candidates[i].b;
+
+      // Contacts between sleeping (or static) bodies are kept with their islands.
+      bool awakeA = islands.awake(a);
+      bool awakeB = islands.awake(b);
+      if (!awakeA && !awakeB)
+        continue;
+
+      contact_manifold manifold;
+      if (!collide(store.shapes[a], store.worldTransform(a), store.shapes[b],
+                   store.worldTransform(b), manifold))
+        continue;
+
+      manifold.bodyA = a;
+      manifold.bodyB = b;
+      cache.merge(manifold, store);
+      contacts[found++] = manifold;
+
+      // An awake body touching a sleeping one wakes its island.
+      if (!awakeA || !awakeB)
+        wakes[woken++] = awakeA ? b : a;
+    }
+
+    chunkOutputs[begin / chunk] = {contacts.first(found), wakes.first(woken)};
+  };
+
+  // The pairs are independent, and merging only reads from the cache, so each chunk can be tested
+  // on any thread.
+  workers->parallelFor(count, chunk, collidePairs);
+}
+
+void engine::writeBack()
+{
+  contactList.clear();
+  for (const chunk_output& output : chunkOutputs)
+  {
+    contactList.insert(contactList.end(), output.contacts.begin(), output.contacts.end());
+    for (int body : output.wakes)
+      islands.wake(body);
+  }
+
+  cache.store(contactList, store);
+  islands.update(store, cache, sleepConfig);
+}
+
+void engine::solveContacts(int thread)
+{
+  std::vector<contact_manifold>& manifolds = cache.manifolds();
+  if (manifolds.empty())
+    return;
+
+  // Small islands are grouped together, so that each job has enough manifolds to fill the SIMD
+  // lanes of its solver and to be worth handing to another thread.
+  constexpr int jobManifolds = 64;
+
+  // There can't be more jobs than islands.
+  std::span<solve_job> jobs = arenas[thread].allocate<solve_job>(islands.islands());
+
+  int jobCount = 0;
+  int first = 0;
+  for (int island = 0; island < islands.islands(); island++)
+  {
+    if (islands.islandManifolds(first, island + 1).size() < jobManifolds)
+      continue;
+
+    jobs[jobCount++] = {first, island + 1};
+    first = island + 1;
+  }
+
+  if (first < islands.islands())
+    jobs[jobCount++] = {first, islands.islands()};
+
+  solveJobs = jobs.first(jobCount);
+  auto solveIslands = [&](int begin, int end, int thread)
+  {
+    contact_solver& solver = solvers[thread];
+    for (int job = begin; job < end; job++)
+    {
+      std::span<const int> list = islands.islandManifolds(solveJobs[job].begin,
+                                                          solveJobs[job].end);
+      solver.prepare(store, manifolds, list, solverConfig, stepDt, arenas[thread]);
+      solver.warmStart(store);
+
+      for (int i = 0; i < solverConfig.iterations; i++)
+        solver.solve(store);
+
+      solver.storeImpulses(manifolds);
+    }
+  };
+
+  workers->parallelFor(static_cast<int>(solveJobs.size()), 1, solveIslands);
+}
+
 } // namespace flexor
\ No newline at end of file
@@ -0,0 +1,310 @@
+#include <collision/grid_broadphase.h>
+#include <collision/sap_broadphase.h>
+#include <collision/tree_broadphase.h>
+#include <engine.h>
+using namespace flexor;
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Finds every overlapping pair of boxes by testing all of them against each other.
+static std::vector<body_pair> bruteForcePairs(const std::vector<aabb>& boxes,
+                                              const std::vector<bool>& statics)
+{
+  std::vector<body_pair> pairs;
+  for (int i = 0; i < static_cast<int>(boxes.size()); i++)
+    for (int j = i + 1; j < static_cast<int>(boxes.size()); j++)
+      if (!(statics[i] && statics[j]) && overlaps(boxes[i], boxes[j]))
+        pairs.push_back({i, j});
+
+  return pairs;
+}
+
+// Returns the pairs found by a broadphase in sorted order, so they can be compared.
+static std::vector<body_pair> sortedPairs(const broadphase& broad)
+{
+  std::vector<body_pair> pairs = broad.pairs();
+  std::sort(pairs.begin(), pairs.end());
+  return pairs;
+}
+
+// Returns whether every pair in the subset also shows up in the superset. Both are sorted.
+static bool includes(const std::vector<body_pair>& superset, const std::vector<body_pair>& subset)
+{
+  return std::includes(superset.begin(), superset.end(), subset.begin(), subset.end());
+}
+
+// Moves a crowd of boxes around a handful of static ones for a couple of seconds, and checks the
+// pairs against brute force after every step. A broadphase with exact pairs should find exactly
+// the overlapping boxes, and one that works with fattened bounds should find at least those.
+static void simulateCrowd(broadphase& broad, bool exact)
+{
+  std::mt19937 rng(11);
+  std::uniform_real_distribution<float> position(-8.0f, 8.0f);
+  std::uniform_real_distribution<float> velocity(-2.0f, 2.0f);
+
+  int count = 200;
+  int staticCount = 20;
+
+  std::vector<aabb> boxes;
+  std::vector<vector3> velocities;
+  std::vector<bool> statics;
+  for (int i = 0; i < count; i++)
+  {
+    vector3 center(position(rng), position(rng), position(rng));
+    boxes.push_back(aabb(center - vector3(0.5f), center + vector3(0.5f)));
+    velocities.push_back(i < staticCount ? vector3(0.0f)
+                                         : vector3(velocity(rng), velocity(rng), velocity(rng)));
+    statics.push_back(i < staticCount);
+
+    broad.add(i, boxes[i], statics[i]);
+  }
+
+  float dt = 1.0f / 60.0f;
+  for (int step = 0; step < 120; step++)
+  {
+    for (int i = staticCount; i < count; i++)
+    {
+      vector3 displacement = velocities[i] * dt;
+      boxes[i].min += displacement;
+      boxes[i].max += displacement;
+      broad.move(i, boxes[i], displacement);
+    }
+
+    broad.updatePairs();
+
+    std::vector<body_pair> pairs = sortedPairs(broad);
+    std::vector<body_pair> expected = bruteForcePairs(boxes, statics);
+    assert(exact ? pairs == expected : includes(pairs, expected));
+
+    for (int i = 0; i < static_cast<int>(pairs.size()); i++)
+    {
+      assert(pairs[i].a < pairs[i].b);
+      assert(!(statics[pairs[i].a] && statics[pairs[i].b]));
+      assert(i == 0 || pairs[i - 1] < pairs[i]);
+    }
+  }
+
+  // Removing a body drops all of its pairs.
+  broad.remove(staticCount);
+  broad.updatePairs();
+  for (const body_pair& pair : broad.pairs())
+    assert(pair.a != staticCount && pair.b != staticCount);
+}
+
+int collision_broadphase(int argc, char** argv)
+{
+  // AABB Tests
+  {
+    aabb box(vector3(-1.0f), vector3(1.0f));
+    assert(box.center() == vector3(0.0f) && box.extents() == vector3(1.0f));
+    assert(box.surfaceArea() == 24.0f);
+    assert(box.contains(aabb(vector3(0.0f), vector3(1.0f))));
+    assert(!box.contains(aabb(vector3(0.0f), vector3(1.5f))));
+    assert(overlaps(box, aabb(vector3(1.0f), vector3(2.0f))));
+    assert(!overlaps(box, aabb(vector3(1.5f), vector3(2.0f))));
+
+    aabb both = combine(box, aabb(vector3(0.0f), vector3(3.0f)));
+    assert(both.min == vector3(-1.0f) && both.max == vector3(3.0f));
+
+    // A unit cube rotated 45 degrees about z reaches sqrt(2) / 2 along x and y.
+    quaternion rotation(vector3(0.0f, 0.0f, 1.0f), 0.785398163f);
+    aabb rotated = transform(aabb(vector3(-0.5f), vector3(0.5f)), vector3(1.0f), rotation);
+    assert(std::fabs(rotated.max.x - (1.0f + 0.70710678f)) < 1e-5f);
+    assert(std::fabs(rotated.min.y - (1.0f - 0.70710678f)) < 1e-5f);
+    assert(std::fabs(rotated.max.z - 1.5f) < 1e-5f);
+  }
+
+  // Dynamic Tree Tests
+  {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> position(-20.0f, 20.0f);
+    std::uniform_real_distribution<float> size(0.2f, 2.0f);
+
+    auto randomBox = [&]()
+    {
+      vector3 min(position(rng), position(rng), position(rng));
+      return aabb(min, min + vector3(size(rng), size(rng), size(rng)));
+    };
+
+    dynamic_tree tree;
+    std::vector<int> proxies;
+    std::vector<aabb> boxes;
+    for (int i = 0; i < 500; i++)
+    {
+      boxes.push_back(randomBox());
+      proxies.push_back(tree.createProxy(boxes.back(), i));
+    }
+
+    assert(tree.validate());
+
+    // A balanced tree of 500 leaves has a height of 9, and the rotations should keep it close.
+    assert(tree.height() <= 18);
+
+    // Moving and removing proxies should keep the tree consistent.
+    for (int i = 0; i < 500; i += 2)
+    {
+      aabb moved = randomBox();
+      tree.moveProxy(proxies[i], moved, moved.min - boxes[i].min);
+      boxes[i] = moved;
+    }
+
+    for (int i = 1; i < 500; i += 4)
+    {
+      tree.destroyProxy(proxies[i]);
+      proxies[i] = dynamic_tree::nullNode;
+    }
+
+    assert(tree.validate());
+    assert(tree.height() <= 18);
+
+    // Every query should find at least the boxes that actually overlap, and never a proxy whose
+    // fat box doesn't overlap.
+    for (int q = 0; q < 50; q++)
+    {
+      aabb query = randomBox();
+
+      std::vector<int> found;
+      tree.query(query,
+                 [&](int proxy)
+                 {
+                   assert(overlaps(tree.fatBounds(proxy), query));
+                   found.push_back(tree.userData(proxy));
+                   return true;
+                 });
+
+      for (int i = 0; i < 500; i++)
+      {
+        bool expected = proxies[i] != dynamic_tree::nullNode && overlaps(boxes[i], query);
+        if (expected)
+          assert(std::find(found.begin(), found.end(), i) != found.end());
+      }
+    }
+  }
+
+  // Tree Broadphase Tests
+  {
+    tree_broadphase broad;
+    simulateCrowd(broad, false);
+  }
+
+  // Sweep and Prune Tests
+  {
+    for (int axis = 0; axis < 3; axis++)
+    {
+      sap_broadphase broad(axis);
+      simulateCrowd(broad, true);
+    }
+
+    // Boxes that only touch along the sweep axis, or that share a starting point, still overlap.
+    sap_broadphase broad;
+    broad.add(0, aabb(vector3(0.0f), vector3(1.0f)), false);
+    broad.add(1, aabb(vector3(1.0f, 0.0f, 0.0f), vector3(2.0f, 1.0f, 1.0f)), false);
+    broad.add(2, aabb(vector3(0.0f, 5.0f, 0.0f), vector3(1.0f, 6.0f, 1.0f)), false);
+    broad.add(3, aabb(vector3(0.0f, 0.5f, 0.5f), vector3(0.5f)), true);
+    broad.updatePairs();
+    assert(sortedPairs(broad) == std::vector<body_pair>({{0, 1}, {0, 3}}));
+  }
+
+  // Grid Tests
+  {
+    grid_broadphase serial;
+    simulateCrowd(serial, true);
+
+    // The crowd has unit boxes, so a fixed cell size of one works too.
+    grid_broadphase fixed(1.0f);
+    simulateCrowd(fixed, true);
+
+    // More threads than the machine has still gives exactly the same pairs.
+    thread_pool pool(4);
+    grid_broadphase parallel(-1.0f, &pool);
+    simulateCrowd(parallel, true);
+
+    // Boxes that exactly touch across a cell boundary are still paired.
+    grid_broadphase broad;
+    broad.add(0, aabb(vector3(-1.0f), vector3(0.0f)), false);
+    broad.add(1, aabb(vector3(0.0f), vector3(1.0f)), false);
+    broad.add(2, aabb(vector3(2.0f), vector3(3.0f)), false);
+    broad.updatePairs();
+    assert(broad.pairs() == std::vector<body_pair>({{0, 1}}));
+
+    // A packed crowd gives every cell its own bucket instead of hashing them, and the pairs come
+    // out in the same order however many threads find them.
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> position(-10.0f, 10.0f);
+
+    std::vector<aabb> boxes;
+    grid_broadphase single;
+    grid_broadphase multiple(-1.0f, &pool);
+    for (int i = 0; i < 2000; i++)
+    {
+      vector3 center(position(rng), position(rng), position(rng));
+      boxes.push_back(aabb(center - vector3(0.5f), center + vector3(0.5f)));
+      single.add(i, boxes[i], false);
+      multiple.add(i, boxes[i], false);
+    }
+
+    single.updatePairs();
+    multiple.updatePairs();
+    assert(sortedPairs(single) == bruteForcePairs(boxes, std::vector<bool>(2000, false)));
+    assert(single.pairs() == multiple.pairs());
+
+    // A large static floor and a large moving box among small bodies stay out of the grid, so the
+    // cells keep fitting the small bodies, and both still find everything they touch.
+    std::vector<bool> statics(2000, false);
+    boxes.push_back(aabb(vector3(-100.0f, -10.5f, -100.0f), vector3(100.0f, -9.0f, 100.0f)));
+    statics.push_back(true);
+    boxes.push_back(aabb(vector3(-3.0f, -3.0f, -3.0f), vector3(3.0f, 3.0f, 3.0f)));
+    statics.push_back(false);
+
+    for (int i = 2000; i < 2002; i++)
+    {
+      single.add(i, boxes[i], statics[i]);
+      multiple.add(i, boxes[i], statics[i]);
+    }
+
+    single.updatePairs();
+    multiple.updatePairs();
+    assert(single.cellSize() < 1.1f);
+    assert(sortedPairs(single) == bruteForcePairs(boxes, statics));
+    assert(single.pairs() == multiple.pairs());
+  }
+
+  // Engine Tests
+  for (broadphase_type type :
+       {broadphase_type::tree, broadphase_type::sweepAndPrune, broadphase_type::grid})
+  {
+    engine world(type);
+    world.setGravity(vector3(0.0f));
+
+    // Two bodies approach each other along x, and a third is far away.
+    body_def left;
+    left.position = vector3(-2.0f, 0.0f, 0.0f);
+    left.linearVelocity = vector3(1.0f, 0.0f, 0.0f);
+    body_handle a = world.addBody(left);
+
+    body_def right;
+    right.position = vector3(2.0f, 0.0f, 0.0f);
+    right.linearVelocity = vector3(-1.0f, 0.0f, 0.0f);
+    body_handle b = world.addBody(right);
+
+    body_def far;
+    far.position = vector3(0.0f, 100.0f, 0.0f);
+    world.addBody(far);
+
+    world.step(1.0f / 60.0f);
+    assert(world.pairs().empty());
+
+    // After a second and a half, the unit cubes overlap.
+    for (int i = 0; i < 90; i++)
+      world.step(1.0f / 60.0f);
+
+    assert(world.pairs().size() == 1);
+    assert(world.pairs()[0] == body_pair({world.indexOf(a), world.indexOf(b)}));
+  }
+
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,195 @@
+#include <collision/manifold_cache.h>
+#include <math/trig.h>
+using namespace flexor;
+
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+// Finds the contacts between every pair of bodies in the store, the same way the engine does.
+static std::vector<contact_manifold> collideAll(const body_store& bodies,
+                                                const manifold_cache& cache)
+{
+  std::vector<contact_manifold> found;
+  for (int a = 0; a < bodies.size(); a++)
+  {
+    for (int b = a + 1; b < bodies.size(); b++)
+    {
+      contact_manifold manifold;
+      if (!collide(bodies.shapes[a], bodies.worldTransform(a), bodies.shapes[b],
+                   bodies.worldTransform(b), manifold))
+        continue;
+
+      manifold.bodyA = a;
+      manifold.bodyB = b;
+      cache.merge(manifold, bodies);
+      found.push_back(manifold);
+    }
+  }
+
+  return found;
+}
+
+int collision_manifold_cache(int argc, char** argv)
+{
+  // An empty cache finds nothing.
+  manifold_cache cache;
+  assert(cache.find(0, 1) == -1);
+
+  // A row of boxes resting on a floor, each sunk slightly into it.
+  body_store bodies;
+
+  body_def floorDef;
+  floorDef.mass = 0.0f;
+  floorDef.geometry = shape::box(vector3(20.0f, 0.5f, 2.0f));
+  floorDef.position = vector3(0.0f, -0.5f, 0.0f);
+  int floor = bodies.add(floorDef);
+
+  for (int i = 0; i < 8; i++)
+  {
+    body_def boxDef;
+    boxDef.position = vector3(i * 2.0f - 7.0f, 0.49f, 0.0f);
+    bodies.add(boxDef);
+  }
+
+  // Every box is found by its pair, and the pair is ordered.
+  std::vector<contact_manifold> found = collideAll(bodies, cache);
+  assert(found.size() == 8);
+  cache.store(found, bodies);
+
+  assert(cache.manifolds().size() == 8);
+  for (int i = 0; i < 8; i++)
+  {
+    int index = cache.find(floor, i + 1);
+    assert(index >= 0);
+    assert(cache.manifolds()[index].bodyB == i + 1);
+    assert(cache.manifolds()[index].count == 4);
+  }
+  assert(cache.find(1, 2) == -1);
+  assert(cache.find(1, floor) == -1);
+
+  // Give each point an impulse, as the solver would, and nudge the boxes. The points keep their
+  // features, so they pick up the impulses again.
+  for (contact_manifold& manifold : cache.manifolds())
+  {
+    for (int i = 0; i < manifold.count; i++)
+    {
+      manifold.points[i].normalImpulse = manifold.bodyB * 10.0f + i;
+      manifold.points[i].tangentImpulse[0] = 0.5f;
+      manifold.points[i].tangentImpulse[1] = -0.5f;
+    }
+  }
+
+  std::vector<contact_manifold> last = cache.manifolds();
+  for (int i = 1; i < bodies.size(); i++)
+    bodies.positions[i] += vector3(0.003f, -0.002f, 0.001f);
+
+  found = collideAll(bodies, cache);
+  assert(found.size() == 8);
+
+  for (const contact_manifold& manifold : found)
+  {
+    const contact_manifold& previous = last[cache.find(manifold.bodyA, manifold.bodyB)];
+    assert(manifold.count == 4);
+
+    for (int i = 0; i < manifold.count; i++)
+    {
+      const contact_point& point = manifold.points[i];
+      assert(point.id != 0);
+
+      int match = -1;
+      for (int j = 0; j < previous.count; j++)
+        if (previous.points[j].id == point.id)
+          match = j;
+
+      assert(match >= 0);
+      assert(point.normalImpulse == previous.points[match].normalImpulse);
+      assert(point.tangentImpulse[0] == 0.5f && point.tangentImpulse[1] == -0.5f);
+    }
+  }
+  cache.store(found, bodies);
+
+  // A new contact starts from nothing.
+  body_def lateDef;
+  lateDef.position = vector3(0.0f, 0.49f, 1.5f);
+  int late = bodies.add(lateDef);
+
+  found = collideAll(bodies, cache);
+  for (const contact_manifold& manifold : found)
+  {
+    if (manifold.bodyB != late)
+      continue;
+
+    for (int i = 0; i < manifold.count; i++)
+      assert(manifold.points[i].normalImpulse == 0.0f);
+  }
+  cache.store(found, bodies);
+  assert(cache.find(floor, late) >= 0);
+
+  // GJK and EPA only give a single point, so a capsule lying on the floor builds up its manifold
+  // from the points of earlier steps as it rocks.
+  manifold_cache rolling;
+  body_store roller;
+  roller.add(floorDef);
+
+  body_def capsuleDef;
+  capsuleDef.geometry = shape::capsule(1.0f, 0.25f);
+  capsuleDef.orientation = quaternion(vector3(0.0f, 0.0f, 1.0f), radians(90.0f));
+  capsuleDef.position = vector3(0.0f, 0.24f, 0.0f);
+  int capsule = roller.add(capsuleDef);
+
+  int most = 0;
+  for (int i = 0; i < 8; i++)
+  {
+    // Tip the capsule back and forth so that the deepest point moves from end to end.
+    float tilt = i % 2 == 0 ? 0.004f : -0.004f;
+    roller.orientations[capsule] = quaternion(vector3(0.0f, 0.0f, 1.0f), radians(90.0f) + tilt);
+
+    found = collideAll(roller, rolling);
+    assert(found.size() == 1);
+    assert(found[0].count <= contact_manifold::maxPoints);
+    for (int j = 0; j < found[0].count; j++)
+      assert(found[0].points[j].depth > -0.02f);
+
+    most = found[0].count > most ? found[0].count : most;
+    rolling.store(found, roller);
+  }
+  assert(most >= 2);
+
+  // Renaming the bodies so that the capsule comes first turns the manifold around, and its points
+  // carry over to the contacts found the other way around, along with their impulses.
+  manifold_cache turned = rolling;
+  for (contact_point& point : turned.manifolds()[0].points)
+    point.normalImpulse = 1.0f;
+
+  body_store swapped;
+  swapped.add(capsuleDef);
+  swapped.add(floorDef);
+  swapped.orientations[0] = roller.orientations[capsule];
+
+  int renamed[] = {1, 0};
+  turned.remap(renamed);
+  assert(turned.find(0, 1) >= 0);
+  assert(turned.manifolds()[0].bodyA == 0 && turned.manifolds()[0].normal.y < -0.9f);
+
+  // Only the point found this step may be new.
+  found = collideAll(swapped, turned);
+  assert(found.size() == 1 && found[0].count >= 2);
+
+  int carried = 0;
+  for (int j = 0; j < found[0].count; j++)
+    carried += found[0].points[j].normalImpulse == 1.0f;
+  assert(carried >= found[0].count - 1);
+
+  // Lifting the capsule away drops the old points.
+  roller.positions[capsule].y = 1.0f;
+  found = collideAll(roller, rolling);
+  assert(found.empty());
+  rolling.store(found, roller);
+  assert(rolling.find(0, capsule) == -1);
+
+  cache.clear();
+  assert(cache.manifolds().empty() && cache.find(floor, 1) == -1);
+
+  return 0;
+}
\ No newline at end of file
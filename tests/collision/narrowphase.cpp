@@ -0,0 +1,301 @@
+#include <collision/gjk.h>
+#include <collision/narrowphase.h>
+#include <engine.h>
+#include <math/trig.h>
+using namespace flexor;
+
+#include <cassert>
+#include <cmath>
+#include <random>
+#include <set>
+
+static bool near(const vector3& lhs, const vector3& rhs, float tolerance)
+{
+  return magnitude(lhs - rhs) < tolerance;
+}
+
+// Runs GJK between two placed shapes.
+static gjk_output distance(const shape& a, const rigid_transform& transformA, const shape& b,
+                           const rigid_transform& transformB, bool core = false)
+{
+  gjk_simplex simplex;
+  return gjkDistance({&a, transformA, core}, {&b, transformB, core}, simplex);
+}
+
+int collision_narrowphase(int argc, char** argv)
+{
+  vector3 x(1.0f, 0.0f, 0.0f);
+  vector3 y(0.0f, 1.0f, 0.0f);
+  vector3 z(0.0f, 0.0f, 1.0f);
+
+  shape unitBox = shape::box(vector3(0.5f));
+  shape ball = shape::sphere(0.5f);
+  shape pill = shape::capsule(0.5f, 0.25f);
+
+  // The eight corners of the unit box, as a convex hull.
+  vector3 corners[8];
+  for (int i = 0; i < 8; i++)
+    corners[i] = vector3(i & 1 ? 0.5f : -0.5f, i & 2 ? 0.5f : -0.5f, i & 4 ? 0.5f : -0.5f);
+  shape cube = shape::hull(corners);
+
+  // Shape Tests
+  {
+    // Support points include the radius, and core support points don't.
+    assert(near(support(ball, x), vector3(0.5f, 0.0f, 0.0f), 1e-6f));
+    assert(near(coreSupport(ball, x), vector3(0.0f), 1e-6f));
+    assert(near(support(pill, y), vector3(0.0f, 0.75f, 0.0f), 1e-6f));
+    assert(near(support(unitBox, vector3(1.0f, -2.0f, 3.0f)), vector3(0.5f, -0.5f, 0.5f), 1e-6f));
+    assert(near(support(cube, vector3(-1.0f, 2.0f, -3.0f)), vector3(-0.5f, 0.5f, -0.5f), 1e-6f));
+
+    aabb capsuleBounds = bounds(pill);
+    assert(near(capsuleBounds.max, vector3(0.25f, 0.75f, 0.25f), 1e-6f));
+
+    // A transform maps points to the world and back.
+    rigid_transform transform(vector3(1.0f, 2.0f, 3.0f), quaternion(z, radians(90.0f)));
+    assert(near(transform.toWorld(x), vector3(1.0f, 3.0f, 3.0f), 1e-5f));
+    assert(near(transform.toLocal(transform.toWorld(y)), y, 1e-5f));
+  }
+
+  // GJK Tests
+  {
+    // Separated boxes report the gap between them, even when one of them is turned.
+    rigid_transform left(vector3(0.0f), quaternion());
+    rigid_transform right(vector3(2.0f, 0.0f, 0.0f), quaternion());
+    gjk_output output = distance(unitBox, left, unitBox, right);
+    assert(!output.overlap);
+    assert(std::fabs(output.distance - 1.0f) < 1e-4f);
+    assert(std::fabs(output.pointA.x - 0.5f) < 1e-4f && std::fabs(output.pointB.x - 1.5f) < 1e-4f);
+
+    rigid_transform turned(vector3(2.0f, 0.0f, 0.0f), quaternion(z, radians(45.0f)));
+    output = distance(unitBox, left, unitBox, turned);
+    assert(std::fabs(output.distance - (1.5f - std::sqrt(0.5f))) < 1e-4f);
+
+    // The cores of two spheres are their centers.
+    output = distance(ball, left, ball, right, true);
+    assert(std::fabs(output.distance - 2.0f) < 1e-5f);
+
+    // The core of a capsule is a segment, so a sphere beside it is closest to its side.
+    rigid_transform beside(vector3(1.0f, 0.3f, 0.0f), quaternion());
+    output = distance(pill, left, ball, beside, true);
+    assert(std::fabs(output.distance - 1.0f) < 1e-5f);
+    assert(near(output.pointA, vector3(0.0f, 0.3f, 0.0f), 1e-5f));
+
+    // The hull of the box agrees with the box.
+    output = distance(cube, left, unitBox, turned);
+    assert(std::fabs(output.distance - (1.5f - std::sqrt(0.5f))) < 1e-4f);
+
+    // Overlapping shapes are found.
+    rigid_transform close(vector3(0.7f, 0.1f, 0.0f), quaternion(y, 0.3f));
+    assert(distance(unitBox, left, cube, close).overlap);
+    assert(distance(ball, left, pill, close).overlap);
+  }
+
+  // EPA Tests
+  {
+    rigid_transform left(vector3(0.0f), quaternion());
+    rigid_transform right(vector3(0.8f, 0.0f, 0.0f), quaternion());
+
+    gjk_simplex simplex;
+    convex_proxy a = {&unitBox, left, false};
+    convex_proxy b = {&cube, right, false};
+    assert(gjkDistance(a, b, simplex).overlap);
+
+    epa_output output;
+    assert(epaPenetration(a, b, simplex, output));
+    assert(std::fabs(output.depth - 0.2f) < 1e-3f);
+    assert(near(output.normal, x, 1e-3f));
+  }
+
+  // Closed Form Tests
+  {
+    rigid_transform origin(vector3(0.0f), quaternion());
+
+    // Spheres touch along the line between their centers.
+    contact_manifold manifold;
+    assert(collideSpheres(ball, origin, ball, rigid_transform(vector3(0.0f, 0.9f, 0.0f), {}),
+                          manifold));
+    assert(manifold.count == 1);
+    assert(near(manifold.normal, y, 1e-5f));
+    assert(std::fabs(manifold.points[0].depth - 0.1f) < 1e-5f);
+    assert(near(manifold.points[0].position, vector3(0.0f, 0.45f, 0.0f), 1e-5f));
+    assert(!collideSpheres(ball, origin, ball, rigid_transform(vector3(1.1f, 0.0f, 0.0f), {}),
+                           manifold));
+
+    // A sphere resting on a box, and a sphere whose center sunk into the box.
+    assert(collideSphereBox(ball, rigid_transform(vector3(0.2f, 0.9f, 0.0f), {}), unitBox, origin,
+                            manifold));
+    assert(near(manifold.normal, -y, 1e-5f));
+    assert(std::fabs(manifold.points[0].depth - 0.1f) < 1e-5f);
+
+    assert(collideSphereBox(ball, rigid_transform(vector3(0.0f, 0.0f, -0.4f), {}), unitBox,
+                            origin, manifold));
+    assert(near(manifold.normal, z, 1e-5f));
+    assert(std::fabs(manifold.points[0].depth - 0.6f) < 1e-5f);
+
+    // The closed forms agree with GJK and EPA for shapes that overlap, and for shapes that don't.
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> offset(-1.2f, 1.2f);
+    std::uniform_real_distribution<float> angle(-3.14159f, 3.14159f);
+    std::uniform_real_distribution<float> component(-1.0f, 1.0f);
+
+    shape flatBox = shape::box(vector3(0.6f, 0.3f, 0.45f));
+    int hits = 0;
+    for (int i = 0; i < 500; i++)
+    {
+      vector3 axis(component(rng), component(rng), component(rng));
+      rigid_transform placed(vector3(offset(rng), offset(rng), offset(rng)),
+                             quaternion(normalize(axis), angle(rng)));
+
+      contact_manifold closed;
+      contact_manifold generic;
+
+      // Sphere against box.
+      bool closedHit = collideSphereBox(ball, placed, flatBox, origin, closed);
+      bool genericHit = collideConvex(ball, placed, flatBox, origin, generic);
+      assert(closedHit == genericHit);
+      if (closedHit)
+      {
+        assert(std::fabs(closed.points[0].depth - generic.points[0].depth) < 2e-3f);
+        assert(near(closed.normal, generic.normal, 2e-2f) || closed.points[0].depth > 0.3f);
+      }
+
+      // Box against box. The closed form prefers faces over edges and may pick an axis that
+      // overlaps slightly more, but both must find the same contacts.
+      closedHit = collideBoxes(unitBox, origin, flatBox, placed, closed);
+      genericHit = collideConvex(unitBox, origin, flatBox, placed, generic);
+      if (genericHit && generic.points[0].depth < 1e-3f)
+        continue;
+
+      assert(closedHit == genericHit);
+      if (closedHit)
+      {
+        hits++;
+        assert(closed.count >= 1 && closed.count <= contact_manifold::maxPoints);
+        // Deep overlaps can have several axes that overlap almost equally.
+        assert(dot(closed.normal, generic.normal) > 0.0f || generic.points[0].depth > 0.5f);
+
+        // The separating axis of least overlap is the direction EPA finds.
+        float deepest = 0.0f;
+        for (int j = 0; j < closed.count; j++)
+          deepest = std::fmax(deepest, closed.points[j].depth);
+        assert(deepest > 0.0f && deepest < generic.points[0].depth + 0.3f);
+      }
+    }
+    assert(hits > 50);
+  }
+
+  // Box Manifold Tests
+  {
+    // A box resting on a wide floor gets one point under each corner.
+    shape floor = shape::box(vector3(5.0f, 0.5f, 5.0f));
+    rigid_transform ground(vector3(0.0f, -0.5f, 0.0f), quaternion());
+    rigid_transform resting(vector3(0.0f, 0.49f, 0.0f), quaternion());
+
+    contact_manifold manifold;
+    assert(collide(floor, ground, unitBox, resting, manifold));
+    assert(manifold.count == 4);
+    assert(near(manifold.normal, y, 1e-5f));
+
+    std::set<std::uint32_t> ids;
+    for (int i = 0; i < manifold.count; i++)
+    {
+      assert(std::fabs(manifold.points[i].depth - 0.01f) < 1e-4f);
+      assert(std::fabs(std::fabs(manifold.points[i].position.x) - 0.5f) < 1e-4f);
+      ids.insert(manifold.points[i].id);
+    }
+    assert(ids.size() == 4);
+
+    // Nudging the box keeps the same features, and so the same ids.
+    contact_manifold nudged;
+    rigid_transform moved(vector3(0.01f, 0.48f, -0.02f), quaternion(y, 0.01f));
+    assert(collide(floor, ground, unitBox, moved, nudged));
+    assert(nudged.count == 4);
+    for (int i = 0; i < nudged.count; i++)
+      assert(ids.count(nudged.points[i].id) == 1);
+
+    // Swapping the bodies flips the normal.
+    assert(collide(unitBox, resting, floor, ground, manifold));
+    assert(near(manifold.normal, -y, 1e-5f));
+    assert(manifold.count == 4);
+
+    // A box turned on top of another clips to an octagon, which is reduced to four points.
+    rigid_transform turned(vector3(0.0f, 0.99f, 0.0f), quaternion(y, radians(45.0f)));
+    assert(collide(unitBox, rigid_transform(), unitBox, turned, manifold));
+    assert(manifold.count == 4);
+    for (int i = 0; i < manifold.count; i++)
+      assert(std::fabs(manifold.points[i].depth - 0.01f) < 1e-4f);
+
+    // Two boxes turned so that only their edges cross give a single point between the edges.
+    quaternion edgeUp(z, radians(45.0f));
+    quaternion edgeAcross = quaternion(x, radians(45.0f));
+    float reach = std::sqrt(0.5f);
+    rigid_transform lower(vector3(0.0f), edgeUp);
+    rigid_transform upper(vector3(0.0f, 2.0f * reach - 0.05f, 0.0f), edgeAcross);
+    assert(collide(unitBox, lower, unitBox, upper, manifold));
+    assert(manifold.count == 1);
+    assert(near(manifold.normal, y, 1e-4f));
+    assert(std::fabs(manifold.points[0].depth - 0.05f) < 1e-4f);
+    assert(near(manifold.points[0].position, vector3(0.0f, reach - 0.025f, 0.0f), 1e-4f));
+  }
+
+  // Generic Tests
+  {
+    // A capsule lying on a box goes through GJK on the cores, without EPA.
+    rigid_transform lying(vector3(0.0f, 0.7f, 0.0f), quaternion(z, radians(90.0f)));
+    contact_manifold manifold;
+    assert(collide(unitBox, rigid_transform(), pill, lying, manifold));
+    assert(manifold.count == 1);
+    assert(near(manifold.normal, y, 1e-4f));
+    assert(std::fabs(manifold.points[0].depth - 0.05f) < 1e-4f);
+
+    // A capsule sunk deep into a hull needs EPA.
+    rigid_transform sunk(vector3(0.0f, 0.4f, 0.0f), quaternion(z, radians(90.0f)));
+    assert(collide(cube, rigid_transform(), pill, sunk, manifold));
+    assert(near(manifold.normal, y, 1e-3f));
+    assert(std::fabs(manifold.points[0].depth - 0.35f) < 1e-3f);
+
+    // Capsules crossing each other.
+    rigid_transform crossing(vector3(0.45f, 0.0f, 0.0f), quaternion(x, radians(90.0f)));
+    assert(collide(pill, rigid_transform(), pill, crossing, manifold));
+    assert(near(manifold.normal, x, 1e-4f));
+    assert(std::fabs(manifold.points[0].depth - 0.05f) < 1e-4f);
+
+    // A sphere near a hull, and just out of reach.
+    assert(collide(ball, rigid_transform(vector3(0.0f, 0.0f, 0.95f), {}), cube, rigid_transform(),
+                   manifold));
+    assert(near(manifold.normal, -z, 1e-4f));
+    assert(!collide(ball, rigid_transform(vector3(0.0f, 0.0f, 1.05f), {}), cube,
+                    rigid_transform(), manifold));
+  }
+
+  // Engine Tests
+  {
+    engine world;
+
+    // A ball dropped onto a static floor touches it once it gets there.
+    body_def floor;
+    floor.mass = 0.0f;
+    floor.geometry = shape::box(vector3(5.0f, 0.5f, 5.0f));
+    floor.position = vector3(0.0f, -0.5f, 0.0f);
+    body_handle ground = world.addBody(floor);
+
+    body_def drop;
+    drop.geometry = ball;
+    drop.position = vector3(0.0f, 0.6f, 0.0f);
+    body_handle dropped = world.addBody(drop);
+
+    world.step(1.0f / 60.0f);
+    assert(world.contacts().empty());
+
+    for (int i = 0; i < 10; i++)
+      world.step(1.0f / 60.0f);
+
+    assert(world.contacts().size() == 1);
+    const contact_manifold& contact = world.contacts()[0];
+    assert(contact.bodyA == world.indexOf(ground) && contact.bodyB == world.indexOf(dropped));
+    assert(near(contact.normal, y, 1e-4f));
+    assert(contact.points[0].depth > 0.0f);
+  }
+
+  return 0;
+}
\ No newline at end of file
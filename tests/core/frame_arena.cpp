@@ -0,0 +1,59 @@
+#include <core/frame_arena.h>
+using namespace flexor;
+
+#include <cassert>
+#include <cstdint>
+
+struct alignas(32) wide
+{
+  float lanes[8];
+};
+
+int core_frame_arena(int argc, char** argv)
+{
+  frame_arena arena(256);
+  assert(arena.capacity() == 256 && arena.used() == 0);
+
+  // Allocations come out one after another, each aligned for its type.
+  std::span<char> bytes = arena.allocate<char>(3);
+  std::span<wide> lanes = arena.allocate<wide>(2);
+  assert(bytes.size() == 3 && lanes.size() == 2);
+  assert(reinterpret_cast<std::uintptr_t>(lanes.data()) % 32 == 0);
+  assert(reinterpret_cast<char*>(lanes.data()) > bytes.data());
+  assert(arena.used() == 32 + 2 * sizeof(wide));
+
+  // Nothing is allocated for an empty request.
+  assert(arena.allocate<int>(0).empty());
+
+  // Going past the block spills into another one, and everything handed out stays valid.
+  for (std::size_t i = 0; i < lanes.size(); i++)
+    lanes[i].lanes[0] = static_cast<float>(i);
+
+  std::span<int> spilled = arena.allocate<int>(1000);
+  for (int i = 0; i < 1000; i++)
+    spilled[i] = i;
+
+  assert(lanes[1].lanes[0] == 1.0f && spilled[999] == 999);
+  assert(arena.used() >= 32 + 2 * sizeof(wide) + 1000 * sizeof(int));
+
+  // Resetting takes everything back, and folds the blocks into one that fits all of it.
+  std::size_t needed = arena.used();
+  arena.reset();
+  assert(arena.used() == 0 && arena.capacity() >= needed);
+
+  std::size_t capacity = arena.capacity();
+  arena.allocate<char>(3);
+  arena.allocate<wide>(2);
+  arena.allocate<int>(1000);
+  arena.reset();
+  assert(arena.capacity() == capacity);
+
+  // An arena without a block gets one the first time it is used.
+  frame_arena empty;
+  assert(empty.capacity() == 0);
+  assert(empty.allocate<double>(4).size() == 4);
+  empty.reset();
+  assert(empty.capacity() > 0);
+
+  return 0;
+}
\ No newline at end of file
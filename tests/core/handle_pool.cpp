@@ -0,0 +1,63 @@
+#include <core/handle_pool.h>
+using namespace flexor;
+
+#include <cassert>
+#include <vector>
+
+using test_handle = handle<struct test_tag>;
+
+int core_handle_pool(int argc, char** argv)
+{
+  handle_pool<test_tag> pool;
+  assert(pool.size() == 0 && !pool.contains(test_handle()));
+
+  // Objects are added at the end of the dense arrays.
+  std::vector<test_handle> handles;
+  for (int i = 0; i < 5; i++)
+    handles.push_back(pool.add());
+
+  for (int i = 0; i < 5; i++)
+    assert(pool.contains(handles[i]) && pool.indexOf(handles[i]) == i &&
+           pool.handleAt(i) == handles[i]);
+
+  // Removing an object moves the last one into its place, and only the removed handle goes stale.
+  pool.remove(handles[1]);
+  assert(pool.size() == 4 && !pool.contains(handles[1]));
+  assert(pool.indexOf(handles[4]) == 1 && pool.handleAt(1) == handles[4]);
+  assert(pool.indexOf(handles[0]) == 0 && pool.indexOf(handles[3]) == 3);
+
+  // Removing the last object moves nothing.
+  pool.remove(handles[3]);
+  assert(pool.size() == 3 && pool.indexOf(handles[4]) == 1 && pool.indexOf(handles[2]) == 2);
+
+  // A freed slot is reused with a new generation, so the old handle stays stale.
+  test_handle reused = pool.add();
+  assert(reused.slot() == handles[1].slot() && reused.generation() != handles[1].generation());
+  assert(pool.contains(reused) && !pool.contains(handles[1]) && pool.indexOf(reused) == 3);
+
+  // Slots are reused oldest first.
+  test_handle next = pool.add();
+  assert(next.slot() == handles[3].slot());
+
+  // Churning through many objects keeps the pool as small as the most that were alive at once.
+  std::vector<test_handle> live;
+  for (int round = 0; round < 100; round++)
+  {
+    for (int i = 0; i < 50; i++)
+      live.push_back(pool.add());
+
+    for (test_handle object : live)
+      pool.remove(object);
+    live.clear();
+  }
+
+  assert(pool.size() == 5);
+  for (int i = 0; i < pool.size(); i++)
+    assert(pool.indexOf(pool.handleAt(i)) == i);
+
+  // Clearing makes every handle stale.
+  pool.clear();
+  assert(pool.size() == 0 && !pool.contains(handles[0]) && !pool.contains(reused));
+
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include <core/thread_pool.h>
+using namespace flexor;
+
+#include <atomic>
+#include <cassert>
+#include <vector>
+
+int core_thread_pool(int argc, char** argv)
+{
+  // Every iteration runs exactly once, on a valid thread, for pools of any size.
+  for (int threads : {1, 2, 4})
+  {
+    thread_pool pool(threads);
+    assert(pool.size() == threads);
+
+    for (int count : {0, 1, 37, 1000})
+    {
+      std::vector<int> hits(count, 0);
+      std::atomic<int> chunks = 0;
+
+      pool.parallelFor(count, 16,
+                       [&](int begin, int end, int thread)
+                       {
+                         assert(thread >= 0 && thread < pool.size());
+                         assert(begin % 16 == 0 && end - begin <= 16);
+
+                         for (int i = begin; i < end; i++)
+                           hits[i]++;
+                         chunks++;
+                       });
+
+      for (int hit : hits)
+        assert(hit == 1);
+      assert(chunks == (count + 15) / 16);
+    }
+  }
+
+  // Per-thread partial sums can be combined without any locking.
+  {
+    thread_pool pool(3);
+    std::vector<long long> sums(pool.size(), 0);
+
+    for (int repeat = 0; repeat < 20; repeat++)
+      pool.parallelFor(10000, 100,
+                       [&](int begin, int end, int thread)
+                       {
+                         for (int i = begin; i < end; i++)
+                           sums[thread] += i;
+                       });
+
+    long long total = 0;
+    for (long long sum : sums)
+      total += sum;
+
+    assert(total == 20LL * 9999 * 10000 / 2);
+  }
+
+  // Loops can start loops of their own, and picking the grain automatically still covers every
+  // iteration exactly once.
+  {
+    thread_pool pool(4);
+    std::vector<std::atomic<int>> hits(64 * 100);
+
+    pool.parallelFor(64, 1,
+                     [&](int begin, int end, int thread)
+                     {
+                       for (int row = begin; row < end; row++)
+                         pool.parallelFor(100, -1,
+                                          [&](int first, int last, int inner)
+                                          {
+                                            assert(inner >= 0 && inner < pool.size());
+                                            for (int i = first; i < last; i++)
+                                              hits[row * 100 + i]++;
+                                          });
+                     });
+
+    for (const std::atomic<int>& hit : hits)
+      assert(hit == 1);
+  }
+
+  // A task only starts once everything it depends on has finished, and the graph can be run again
+  // and again. Here a task fans out to two loops, which join into a last task.
+  for (int threads : {1, 4})
+  {
+    thread_pool pool(threads);
+    std::vector<int> values(5000, 0);
+    std::atomic<int> order = 0;
+    int stamps[4] = {};
+    long long total = 0;
+
+    task_graph graph;
+    int fill = graph.add(
+      [&](int thread)
+      {
+        stamps[0] = order++;
+        for (int i = 0; i < 5000; i++)
+          values[i] = i;
+      });
+
+    int doubleFront = graph.add(
+      [&](int thread)
+      {
+        stamps[1] = order++;
+        pool.parallelFor(2500, 64,
+                         [&](int begin, int end, int inner)
+                         {
+                           for (int i = begin; i < end; i++)
+                             values[i] *= 2;
+                         });
+      });
+
+    int doubleBack = graph.add(
+      [&](int thread)
+      {
+        stamps[2] = order++;
+        pool.parallelFor(2500, 64,
+                         [&](int begin, int end, int inner)
+                         {
+                           for (int i = 2500 + begin; i < 2500 + end; i++)
+                             values[i] *= 2;
+                         });
+      });
+
+    int sum = graph.add(
+      [&](int thread)
+      {
+        assert(thread >= 0 && thread < pool.size());
+        stamps[3] = order++;
+        for (int value : values)
+          total += value;
+      });
+
+    graph.precede(fill, doubleFront);
+    graph.precede(fill, doubleBack);
+    graph.precede(doubleFront, sum);
+    graph.precede(doubleBack, sum);
+    assert(graph.size() == 4);
+
+    for (int repeat = 0; repeat < 10; repeat++)
+    {
+      order = 0;
+      total = 0;
+      pool.run(graph);
+
+      assert(stamps[0] == 0 && stamps[3] == 3);
+      assert(total == 2LL * 4999 * 5000 / 2);
+    }
+  }
+
+  // A wide graph with more ready tasks than a deque holds still runs every task once.
+  {
+    thread_pool pool(2);
+    std::vector<std::atomic<int>> runs(1000);
+
+    task_graph graph;
+    int root = graph.add([](int thread) {});
+    for (int i = 0; i < 1000; i++)
+      graph.precede(root, graph.add([&runs, i](int thread) { runs[i]++; }));
+
+    pool.run(graph);
+    for (const std::atomic<int>& run : runs)
+      assert(run == 1);
+  }
+
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,127 @@
+#include <collision/narrowphase.h>
+#include <dynamics/contact_solver.h>
+using namespace flexor;
+
+#include <cassert>
+#include <vector>
+
+int dynamics_contact_solver(int argc, char** argv)
+{
+  // A grid of stacks on a floor, so that every box touches the floor or the boxes above and below
+  // it, and the floor touches a great many of them.
+  body_store bodies;
+
+  body_def floorDef;
+  floorDef.mass = 0.0f;
+  floorDef.geometry = shape::box(vector3(20.0f, 0.5f, 20.0f));
+  floorDef.position = vector3(0.0f, -0.5f, 0.0f);
+  bodies.add(floorDef);
+
+  for (int i = 0; i < 5; i++)
+  {
+    for (int j = 0; j < 5; j++)
+    {
+      for (int k = 0; k < 3; k++)
+      {
+        body_def boxDef;
+        boxDef.position = vector3(i * 2.0f - 4.0f, 0.49f + k * 0.99f, j * 2.0f - 4.0f);
+        boxDef.inertia = vector3(1.0f / 6.0f);
+        boxDef.linearVelocity = vector3(0.1f * i, -1.0f, 0.0f);
+        bodies.add(boxDef);
+      }
+    }
+  }
+
+  std::vector<contact_manifold> manifolds;
+  for (int a = 0; a < bodies.size(); a++)
+  {
+    for (int b = a + 1; b < bodies.size(); b++)
+    {
+      contact_manifold manifold;
+      if (!collide(bodies.shapes[a], bodies.worldTransform(a), bodies.shapes[b],
+                   bodies.worldTransform(b), manifold))
+        continue;
+
+      manifold.bodyA = a;
+      manifold.bodyB = b;
+      manifolds.push_back(manifold);
+    }
+  }
+  assert(manifolds.size() == 75);
+
+  solver_settings settings;
+  settings.iterations = 10;
+
+  contact_solver solver;
+  solver.prepare(bodies, manifolds, settings, 1.0f / 60.0f);
+
+  // Every manifold is solved exactly once, and no two lanes of a batch share a dynamic body. The
+  // floor is static, so it can be in every lane.
+  std::vector<int> seen(manifolds.size(), 0);
+  for (int batch = 0; batch < solver.batches(); batch++)
+  {
+    std::vector<int> used;
+    const int* lanes = solver.batchManifolds(batch);
+    for (int lane = 0; lane < contact_solver::lanes; lane++)
+    {
+      if (lanes[lane] < 0)
+        continue;
+
+      seen[lanes[lane]]++;
+      for (int body : {manifolds[lanes[lane]].bodyA, manifolds[lanes[lane]].bodyB})
+      {
+        if (bodies.inverseMasses[body] == 0.0f)
+          continue;
+
+        for (int other : used)
+          assert(other != body);
+        used.push_back(body);
+      }
+    }
+  }
+
+  for (int count : seen)
+    assert(count == 1);
+
+  // A stack needs at least two colors, since the middle box touches both of the others.
+  assert(solver.colors() >= 2 && solver.colors() <= contact_solver::maxColors);
+
+  // The boxes start out falling at a meter per second. Solving all but stops them from moving into
+  // each other and into the floor, and the contacts never pull.
+  solver.warmStart(bodies);
+  for (int i = 0; i < settings.iterations; i++)
+    solver.solve(bodies);
+  solver.storeImpulses(manifolds);
+
+  for (const contact_manifold& manifold : manifolds)
+  {
+    int a = manifold.bodyA;
+    int b = manifold.bodyB;
+
+    float total = 0.0f;
+    for (int i = 0; i < manifold.count; i++)
+    {
+      const contact_point& point = manifold.points[i];
+      assert(point.normalImpulse >= 0.0f);
+      total += point.normalImpulse;
+
+      vector3 velocityA = bodies.linearVelocities[a] +
+                          cross(bodies.angularVelocities[a], point.position - bodies.positions[a]);
+      vector3 velocityB = bodies.linearVelocities[b] +
+                          cross(bodies.angularVelocities[b], point.position - bodies.positions[b]);
+      assert(dot(velocityB - velocityA, manifold.normal) > -0.1f);
+    }
+    assert(total > 0.0f);
+  }
+
+  // The floor never moves.
+  assert(bodies.linearVelocities[0] == vector3(0.0f));
+  assert(bodies.angularVelocities[0] == vector3(0.0f));
+
+  // Without any contacts, there is nothing to solve.
+  solver.prepare(bodies, {}, settings, 1.0f / 60.0f);
+  assert(solver.batches() == 0 && solver.colors() == 0);
+  solver.solve(bodies);
+
+  return 0;
+}
\ No newline at end of file
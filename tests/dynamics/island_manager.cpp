@@ -0,0 +1,114 @@
+#include <dynamics/island_manager.h>
+using namespace flexor;
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+// Makes a manifold with a single point between two bodies.
+static contact_manifold touching(int a, int b)
+{
+  contact_manifold manifold;
+  manifold.bodyA = a;
+  manifold.bodyB = b;
+  manifold.count = 1;
+  manifold.points[0].normalImpulse = 1.0f;
+  return manifold;
+}
+
+int dynamics_island_manager(int argc, char** argv)
+{
+  body_store bodies;
+  island_manager islands;
+
+  body_def floorDef;
+  floorDef.mass = 0.0f;
+  int floor = bodies.add(floorDef);
+  islands.add(floor, true);
+
+  for (int i = 1; i <= 7; i++)
+    islands.add(bodies.add(body_def()), false);
+
+  assert(!islands.awake(floor) && islands.awake(1));
+  assert(islands.pending() && islands.awakeBodies().size() == 7);
+
+  // A chain of 1, 2, and 3, a pair of 4 and 5, and 6 and 7 on their own. Bodies 3 and 7 both rest
+  // on the floor, which doesn't join them.
+  std::vector<contact_manifold> contacts = {touching(1, 2), touching(floor, 3), touching(2, 3),
+                                            touching(4, 5), touching(floor, 7)};
+  manifold_cache cache;
+  cache.store(contacts, bodies);
+
+  sleep_settings settings;
+  settings.frames = 2;
+
+  islands.update(bodies, cache, settings);
+  assert(!islands.pending());
+  assert(islands.islands() == 4);
+
+  // Each island has its own bodies and manifolds, and every awake body is in exactly one island.
+  std::vector<int> islandOf(bodies.size(), -1);
+  int listed = 0;
+  for (int island = 0; island < islands.islands(); island++)
+  {
+    for (int body : islands.islandBodies(island))
+    {
+      assert(islandOf[body] < 0);
+      islandOf[body] = island;
+      listed++;
+    }
+  }
+  assert(listed == 7);
+  assert(islandOf[1] == islandOf[2] && islandOf[2] == islandOf[3]);
+  assert(islandOf[4] == islandOf[5] && islandOf[4] != islandOf[1]);
+  assert(islandOf[6] != islandOf[7] && islandOf[7] != islandOf[3]);
+
+  for (int island = 0; island < islands.islands(); island++)
+  {
+    for (int index : islands.islandManifolds(island, island + 1))
+    {
+      const contact_manifold& manifold = cache.manifolds()[index];
+      int body = manifold.bodyA == floor ? manifold.bodyB : manifold.bodyA;
+      assert(islandOf[body] == island);
+    }
+  }
+
+  std::span<const int> every = islands.islandManifolds(0, islands.islands());
+  assert(every.size() == 5);
+
+  // Body 6 keeps moving, so it stays awake while everything else falls asleep after two steps at
+  // rest. The manifolds of the sleeping islands leave the cache.
+  bodies.linearVelocities[6] = vector3(1.0f, 0.0f, 0.0f);
+  islands.update(bodies, cache, settings);
+  assert(islands.sleepingIslands() == 3);
+  assert(islands.awakeBodies().size() == 1 && islands.awakeBodies()[0] == 6);
+  assert(islands.islands() == 1 && cache.manifolds().empty());
+  assert(!islands.awake(2) && islands.awake(6));
+
+  // Waking any body of an island wakes all of it, and its manifolds come back with their impulses.
+  islands.wake(2);
+  islands.wake(3);
+  assert(islands.pending() && islands.awake(1) && !islands.awake(4));
+
+  islands.refresh(bodies, cache);
+  assert(islands.sleepingIslands() == 2 && islands.islands() == 2);
+  assert(cache.manifolds().size() == 3);
+  assert(cache.find(2, 3) >= 0 && cache.find(floor, 3) >= 0);
+  assert(cache.manifolds()[cache.find(1, 2)].points[0].normalImpulse == 1.0f);
+
+  std::vector<int> awake = islands.awakeBodies();
+  std::sort(awake.begin(), awake.end());
+  assert((awake == std::vector<int>{1, 2, 3, 6}));
+
+  // With sleeping turned off, nothing else falls asleep.
+  settings.enabled = false;
+  bodies.linearVelocities[6] = vector3(0.0f);
+  for (int i = 0; i < 4; i++)
+    islands.update(bodies, cache, settings);
+  assert(islands.sleepingIslands() == 2 && islands.awakeBodies().size() == 4);
+
+  islands.clear();
+  assert(islands.awakeBodies().empty() && islands.islands() == 0);
+
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,92 @@
+#include <engine.h>
+using namespace flexor;
+
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <new>
+
+// Every heap allocation in the test program goes through these, and is counted while counting is
+// turned on. The workers of the pool allocate too, so the counters are atomic. Nothing else is
+// published through them, so relaxed ordering is enough.
+static std::atomic<bool> counting = false;
+static std::atomic<int> allocations = 0;
+
+static void* allocate(std::size_t bytes, std::size_t alignment)
+{
+  if (counting.load(std::memory_order_relaxed))
+    allocations.fetch_add(1, std::memory_order_relaxed);
+
+  bytes = (bytes + alignment - 1) / alignment * alignment;
+  void* memory = alignment > alignof(std::max_align_t) ? std::aligned_alloc(alignment, bytes)
+                                                       : std::malloc(bytes ? bytes : 1);
+  if (!memory)
+    throw std::bad_alloc();
+
+  return memory;
+}
+
+void* operator new(std::size_t bytes)
+{
+  return allocate(bytes, alignof(std::max_align_t));
+}
+
+void* operator new(std::size_t bytes, std::align_val_t alignment)
+{
+  return allocate(bytes, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept { std::free(memory); }
+
+int engine_allocations(int argc, char** argv)
+{
+  // Once a world has settled into steady state, stepping it never touches the heap, whichever
+  // broadphase it uses and however its work is split between threads.
+  for (broadphase_type type :
+       {broadphase_type::tree, broadphase_type::sweepAndPrune, broadphase_type::grid})
+  {
+    thread_pool pool(2);
+    engine world(type, &pool);
+
+    sleep_settings sleep;
+    sleep.enabled = false;
+    world.setSleepSettings(sleep);
+
+    body_def floorDef;
+    floorDef.mass = 0.0f;
+    floorDef.geometry = shape::box(vector3(20.0f, 0.5f, 20.0f));
+    floorDef.position = vector3(0.0f, -0.5f, 0.0f);
+    world.addBody(floorDef);
+
+    for (int i = 0; i < 8; i++)
+    {
+      for (int j = 0; j < 8; j++)
+      {
+        for (int k = 0; k < 3; k++)
+        {
+          body_def boxDef;
+          boxDef.position = vector3(i * 2.0f - 7.0f, 0.49f + k * 0.99f, j * 2.0f - 7.0f);
+          boxDef.inertia = vector3(1.0f / 6.0f);
+          world.addBody(boxDef);
+        }
+      }
+    }
+
+    for (int i = 0; i < 120; i++)
+      world.update(1.0f / 60.0f);
+
+    allocations.store(0, std::memory_order_relaxed);
+    counting.store(true, std::memory_order_relaxed);
+    for (int i = 0; i < 60; i++)
+      world.update(1.0f / 60.0f);
+    counting.store(false, std::memory_order_relaxed);
+
+    assert(world.contacts().size() == 8 * 8 * 3);
+    assert(allocations.load(std::memory_order_relaxed) == 0);
+  }
+
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,371 @@
+#include <engine.h>
+using namespace flexor;
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+// Drops a stack of unit boxes on a floor and lets it settle for five seconds. Returns how far the
+// top box has drifted sideways, and the fastest speed of any box at the end.
+static void settleStack(int height, const solver_settings& settings, float& drift, float& speed)
+{
+  engine world;
+  world.setSolverSettings(settings);
+
+  // The stack would fall asleep once it is still enough, which would hide how still it is.
+  sleep_settings sleeping;
+  sleeping.enabled = false;
+  world.setSleepSettings(sleeping);
+
+  body_def floorDef;
+  floorDef.mass = 0.0f;
+  floorDef.geometry = shape::box(vector3(10.0f, 0.5f, 10.0f));
+  floorDef.position = vector3(0.0f, -0.5f, 0.0f);
+  world.addBody(floorDef);
+
+  body_handle top;
+  for (int i = 0; i < height; i++)
+  {
+    body_def boxDef;
+    boxDef.position = vector3(0.0f, 0.5f + i, 0.0f);
+    boxDef.inertia = vector3(1.0f / 6.0f);
+    top = world.addBody(boxDef);
+  }
+
+  for (int i = 0; i < 300; i++)
+    world.step(1.0f / 60.0f);
+
+  const body_store& bodies = world.bodies();
+  const vector3& position = bodies.positions[world.indexOf(top)];
+  drift = magnitude(vector3(position.x, 0.0f, position.z));
+
+  speed = 0.0f;
+  for (int body = 1; body < bodies.size(); body++)
+    speed = std::max(speed, magnitude(bodies.linearVelocities[body]));
+}
+
+int engine_engine(int argc, char** argv)
+{
+  engine world;
+
+  // A static body should never move, even under gravity. It sits well away from the other bodies,
+  // so nothing touches it.
+  body_def groundDef;
+  groundDef.mass = 0.0f;
+  groundDef.position = vector3(0.0f, -50.0f, 0.0f);
+  body_handle ground = world.addBody(groundDef);
+
+  // A dynamic body falls under gravity.
+  body_def fallingDef;
+  fallingDef.position = vector3(0.0f, 10.0f, 0.0f);
+  body_handle falling = world.addBody(fallingDef);
+
+  // A body in free space keeps its velocity and spins about its axis.
+  body_def spinningDef;
+  spinningDef.linearVelocity = vector3(1.0f, 0.0f, 0.0f);
+  spinningDef.angularVelocity = vector3(0.0f, 0.0f, 1.0f);
+  body_handle spinning = world.addBody(spinningDef);
+
+  assert(world.bodies().size() == 3);
+
+  float dt = 1.0f / 60.0f;
+  for (int i = 0; i < 60; i++)
+  {
+    world.applyForce(spinning, vector3(0.0f, 9.81f, 0.0f));
+    world.step(dt);
+  }
+
+  // Nothing was removed, so every body is still where it was added.
+  assert(world.indexOf(ground) == 0 && world.indexOf(falling) == 1 && world.indexOf(spinning) == 2);
+
+  const body_store& bodies = world.bodies();
+  assert(bodies.positions[0] == groundDef.position);
+  assert(bodies.linearVelocities[0] == vector3(0.0f));
+
+  // After one second, the falling body should be moving at g, and should have fallen about g / 2.
+  assert(magnitude(bodies.linearVelocities[1] - world.gravity()) < 1e-4f);
+  assert(fabs(bodies.positions[1].y - (10.0f - 0.5f * 9.81f)) < 0.1f);
+
+  // The applied force cancels gravity on the spinning body, so it should have only moved along x.
+  assert(magnitude(bodies.positions[2] - vector3(1.0f, 0.0f, 0.0f)) < 1e-4f);
+
+  // Spinning at one radian per second for a second should rotate the x-axis by about one radian
+  // in the xy-plane, and the orientation should still be a unit quaternion.
+  const quaternion& q = bodies.orientations[2];
+  assert(fabs(magnitude(q) - 1.0f) < 1e-5f);
+
+  vector3 rotated = q * vector3(1.0f, 0.0f, 0.0f);
+  assert(magnitude(rotated - vector3(cos(1.0f), sin(1.0f), 0.0f)) < 1e-2f);
+
+  // Starting from the impulses of the last step, a handful of iterations holds a stack still.
+  // Without warm starting, the same iterations let it creep sideways.
+  solver_settings settings;
+  settings.iterations = 4;
+
+  float warmDrift, warmSpeed;
+  settleStack(4, settings, warmDrift, warmSpeed);
+  assert(warmDrift < 0.02f && warmSpeed < 0.01f);
+
+  settings.warmStarting = false;
+  float coldDrift, coldSpeed;
+  settleStack(4, settings, coldDrift, coldSpeed);
+  assert(coldDrift > warmDrift && coldSpeed > warmSpeed);
+
+  // Two stacks far apart are separate islands. Once they come to rest, they fall asleep and
+  // their contacts are put away with them.
+  engine resting;
+
+  body_def floorDef;
+  floorDef.mass = 0.0f;
+  floorDef.geometry = shape::box(vector3(20.0f, 0.5f, 20.0f));
+  floorDef.position = vector3(0.0f, -0.5f, 0.0f);
+  body_handle floor = resting.addBody(floorDef);
+
+  body_handle stacks[2][3];
+  for (int i = 0; i < 2; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      body_def boxDef;
+      boxDef.position = vector3(i * 10.0f - 5.0f, 0.49f + j * 0.99f, 0.0f);
+      boxDef.inertia = vector3(1.0f / 6.0f);
+      stacks[i][j] = resting.addBody(boxDef);
+    }
+  }
+
+  resting.step(dt);
+  assert(resting.islandManager().islands() == 2);
+  assert(resting.islandManager().islandBodies(0).size() == 3);
+  assert(!resting.awake(floor));
+
+  for (int i = 0; i < 120; i++)
+    resting.step(dt);
+
+  assert(resting.islandManager().sleepingIslands() == 2);
+  assert(resting.islandManager().awakeBodies().empty() && resting.contacts().empty());
+  for (int i = 0; i < 2; i++)
+    for (int j = 0; j < 3; j++)
+      assert(!resting.awake(stacks[i][j]) &&
+             resting.bodies().linearVelocities[resting.indexOf(stacks[i][j])] == vector3(0.0f));
+
+  // Sleeping bodies don't fall, even under gravity.
+  vector3 top = resting.bodies().positions[resting.indexOf(stacks[0][2])];
+  for (int i = 0; i < 10; i++)
+    resting.step(dt);
+  assert(resting.bodies().positions[resting.indexOf(stacks[0][2])] == top);
+
+  // Pushing the top of one stack wakes all of it with its contacts, but not the other stack.
+  resting.applyForce(stacks[0][2], vector3(1.0f, 0.0f, 0.0f));
+  resting.step(dt);
+  assert(resting.awake(stacks[0][0]) && resting.awake(stacks[0][1]));
+  assert(!resting.awake(stacks[1][2]));
+  assert(resting.contacts().size() == 3);
+  for (const contact_manifold& manifold : resting.contacts())
+    assert(manifold.points[0].normalImpulse > 0.0f);
+
+  // A box dropped on the other stack wakes it when it lands.
+  body_def droppedDef;
+  droppedDef.position = vector3(5.0f, 4.0f, 0.0f);
+  body_handle dropped = resting.addBody(droppedDef);
+
+  for (int i = 0; i < 30 && !resting.awake(stacks[1][0]); i++)
+    resting.step(dt);
+  assert(resting.awake(stacks[1][0]) && resting.awake(dropped));
+
+  // A world can run on a pool of its own or on one it is given, and the threads only change how
+  // fast a step runs, not what it does.
+  thread_pool serial(1);
+  thread_pool parallel(4);
+  engine serialWorld(broadphase_type::grid, &serial);
+  engine parallelWorld(broadphase_type::grid, &parallel);
+  assert(&parallelWorld.threadPool() == &parallel);
+
+  for (engine* world : {&serialWorld, &parallelWorld})
+  {
+    world->addBody(floorDef);
+    for (int i = 0; i < 400; i++)
+    {
+      body_def boxDef;
+      boxDef.position = vector3((i % 20) * 0.9f - 9.0f, 0.5f + (i / 20) * 0.3f, (i % 7) * 0.2f);
+      boxDef.inertia = vector3(1.0f / 6.0f);
+      world->addBody(boxDef);
+    }
+  }
+
+  for (int i = 0; i < 30; i++)
+  {
+    serialWorld.step(dt);
+    parallelWorld.step(dt);
+  }
+
+  assert(serialWorld.contacts().size() == parallelWorld.contacts().size());
+  for (int body = 0; body < serialWorld.bodies().size(); body++)
+    assert(serialWorld.bodies().positions[body] == parallelWorld.bodies().positions[body]);
+
+  // Updates step in whole fixed steps and carry the rest of the frame over. A fixed step with two
+  // substeps is the same as two half steps.
+  engine fixed;
+  engine manual;
+
+  timestep_settings timestep;
+  timestep.fixedStep = 0.02f;
+  timestep.substeps = 2;
+  timestep.maxSteps = 3;
+  fixed.setTimestepSettings(timestep);
+
+  for (engine* world : {&fixed, &manual})
+  {
+    world->addBody(floorDef);
+
+    body_def boxDef;
+    boxDef.position = vector3(0.0f, 2.0f, 0.0f);
+    boxDef.angularVelocity = vector3(0.0f, 3.0f, 0.0f);
+    world->addBody(boxDef);
+  }
+
+  assert(fixed.update(0.015f) == 0);
+  assert(fixed.interpolationAlpha() > 0.74f && fixed.interpolationAlpha() < 0.76f);
+  assert(fixed.update(0.03f) == 2);
+  assert(fixed.interpolationAlpha() > 0.24f && fixed.interpolationAlpha() < 0.26f);
+
+  manual.step(0.01f);
+  manual.step(0.01f);
+  float before = manual.bodies().positions[1].y;
+  manual.step(0.01f);
+  manual.step(0.01f);
+  assert(fixed.bodies().positions[1] == manual.bodies().positions[1]);
+
+  // Rendering blends between the state before the last fixed step and the current one.
+  std::vector<vector3> positions(fixed.bodies().size());
+  std::vector<quaternion> orientations(fixed.bodies().size());
+  assert(fixed.interpolateTransforms(positions, orientations) == 2);
+
+  float after = fixed.bodies().positions[1].y;
+  assert(positions[1].y < before && positions[1].y > after);
+  assert(std::abs(positions[1].y - (before + (after - before) * fixed.interpolationAlpha())) <
+         1e-3f);
+  assert(positions[0] == fixed.bodies().positions[0]);
+  assert(orientations[1] != fixed.bodies().orientations[1]);
+
+  // A long stall only takes as many steps as allowed, and the time beyond them is dropped.
+  assert(fixed.update(1.0f) == 3);
+  assert(fixed.interpolationAlpha() < 1.0f);
+
+  // A renderer on another thread interpolates while the updates run, and always sees a whole pair
+  // of states: the floor where it is, and a spinning box somewhere between its start and the floor.
+  engine rendered;
+  rendered.addBody(floorDef);
+
+  body_def tumblingDef;
+  tumblingDef.position = vector3(0.0f, 5.0f, 0.0f);
+  tumblingDef.angularVelocity = vector3(0.0f, 2.0f, 1.0f);
+  rendered.addBody(tumblingDef);
+  rendered.update(1.0f / 60.0f);
+
+  std::atomic<bool> rendering = true;
+  std::atomic<int> drawn = 0;
+  std::thread renderer(
+    [&]()
+    {
+      std::vector<vector3> drawnPositions(2);
+      std::vector<quaternion> drawnOrientations(2);
+      while (rendering.load())
+      {
+        assert(rendered.interpolateTransforms(drawnPositions, drawnOrientations) == 2);
+        assert(drawnPositions[0] == floorDef.position);
+        assert(drawnPositions[1].y <= 5.0f && drawnPositions[1].y > 0.0f);
+        assert(std::abs(magnitude(drawnOrientations[1]) - 1.0f) < 1e-3f);
+        drawn++;
+      }
+    });
+
+  for (int i = 0; i < 120 || drawn.load() < 100; i++)
+    rendered.update(1.0f / 90.0f);
+
+  rendering = false;
+  renderer.join();
+
+  // Projectiles come and go every step. The store stays packed, the handles of the projectiles
+  // still flying keep following them as they move around in it, and a box resting on the floor
+  // nearby goes to sleep undisturbed.
+  for (broadphase_type type :
+       {broadphase_type::tree, broadphase_type::sweepAndPrune, broadphase_type::grid})
+  {
+    engine world(type);
+    body_handle floorHandle = world.addBody(floorDef);
+
+    body_def boxDef;
+    boxDef.position = vector3(0.0f, 0.49f, 0.0f);
+    boxDef.inertia = vector3(1.0f / 6.0f);
+    body_handle box = world.addBody(boxDef);
+
+    struct projectile
+    {
+      body_handle body;
+      int launched;
+    };
+
+    std::vector<projectile> flying;
+    std::vector<body_handle> removed;
+    std::vector<body_handle> batch;
+    int launches = 0;
+
+    for (int i = 0; i < 120; i++)
+    {
+      for (int j = 0; j < 10; j++, launches++)
+      {
+        body_def shotDef;
+        shotDef.geometry = shape::sphere(0.1f);
+        shotDef.position = vector3(30.0f + (launches % 50) * 2.0f, 50.0f, (launches / 50) * 2.0f);
+        shotDef.linearVelocity = vector3(0.0f, 5.0f, 0.0f);
+        flying.push_back({world.addBody(shotDef), i});
+      }
+
+      // The oldest projectiles go out together, in no particular order.
+      if (flying.size() > 30)
+      {
+        batch.clear();
+        for (int j = 9; j >= 0; j--)
+          batch.push_back(flying[j].body);
+
+        world.removeBodies(batch);
+        removed.insert(removed.end(), batch.begin(), batch.end());
+        flying.erase(flying.begin(), flying.begin() + 10);
+      }
+
+      world.step(dt);
+
+      const body_store& bodies = world.bodies();
+      assert(bodies.size() == 2 + static_cast<int>(flying.size()));
+      for (const contact_manifold& manifold : world.contacts())
+        assert(manifold.bodyA < bodies.size() && manifold.bodyB < bodies.size());
+
+      // Every projectile has been falling since it was launched, wherever it is in the store now.
+      for (const projectile& shot : flying)
+      {
+        int body = world.indexOf(shot.body);
+        assert(world.handleOf(body) == shot.body);
+
+        float expected = 5.0f - 9.81f * dt * (i + 1 - shot.launched);
+        assert(std::abs(bodies.linearVelocities[body].y - expected) < 1e-3f);
+      }
+    }
+
+    for (body_handle body : removed)
+      assert(!world.contains(body));
+    assert(world.contains(floorHandle) && world.contains(box) && !world.awake(box));
+
+    // Taking the floor away wakes the box, which falls.
+    world.removeBody(floorHandle);
+    assert(!world.contains(floorHandle) && world.awake(box));
+
+    for (int i = 0; i < 30; i++)
+      world.step(dt);
+    assert(world.bodies().positions[world.indexOf(box)].y < -0.5f);
+  }
+
+  return 0;
+}
\ No newline at end of file
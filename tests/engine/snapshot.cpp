@@ -0,0 +1,431 @@
+#include <engine.h>
+using namespace flexor;
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <vector>
+
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// A tetrahedron, which every hull in the world shares.
+static const vector3 tetrahedron[] = {vector3(0.0f, 0.6f, 0.0f), vector3(-0.5f, -0.3f, -0.4f),
+                                      vector3(0.5f, -0.3f, -0.4f), vector3(0.0f, -0.3f, 0.5f)};
+
+// A bipyramid, whose first four vertices make up a tetrahedron of their own.
+static const vector3 bipyramid[] = {vector3(0.0f, 0.6f, 0.0f), vector3(-0.5f, -0.3f, -0.4f),
+                                    vector3(0.5f, -0.3f, -0.4f), vector3(0.0f, -0.3f, 0.5f),
+                                    vector3(0.0f, -0.9f, 0.0f)};
+
+// Fills a world with a floor, two stacks that fall asleep, and a mix of shapes that keep moving.
+static void buildWorld(engine& world)
+{
+  body_def floorDef;
+  floorDef.mass = 0.0f;
+  floorDef.geometry = shape::box(vector3(20.0f, 0.5f, 20.0f));
+  floorDef.position = vector3(0.0f, -0.5f, 0.0f);
+  world.addBody(floorDef);
+
+  for (int i = 0; i < 2; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      body_def boxDef;
+      boxDef.position = vector3(i * 10.0f - 5.0f, 0.49f + j * 0.99f, 0.0f);
+      boxDef.inertia = vector3(1.0f / 6.0f);
+      world.addBody(boxDef);
+    }
+  }
+
+  for (int i = 0; i < 12; i++)
+  {
+    body_def shapeDef;
+    shapeDef.position = vector3((i % 4) * 1.5f - 2.0f, 3.0f + (i / 4) * 1.5f, 4.0f);
+    shapeDef.angularVelocity = vector3(0.0f, 1.0f, 0.5f);
+    shapeDef.inertia = vector3(0.1f);
+
+    if (i % 3 == 0)
+      shapeDef.geometry = shape::sphere(0.4f);
+    else if (i % 3 == 1)
+      shapeDef.geometry = shape::capsule(0.3f, 0.2f);
+    else
+      shapeDef.geometry = shape::hull(tetrahedron);
+
+    world.addBody(shapeDef);
+  }
+}
+
+// A copy of a snapshot in memory of its own, so that single values in it can be damaged.
+struct snapshot_copy
+{
+  explicit snapshot_copy(const world_snapshot& snapshot)
+    : memory(snapshot.bytes().size() + snapshotAlignment), size(snapshot.bytes().size())
+  {
+    std::size_t misalignment = reinterpret_cast<std::uintptr_t>(memory.data()) % snapshotAlignment;
+    aligned = memory.data() + (snapshotAlignment - misalignment);
+    std::memcpy(aligned, snapshot.bytes().data(), size);
+  }
+
+  snapshot_entry& entry(snapshot_section id)
+  {
+    const auto& header = *reinterpret_cast<const snapshot_header*>(aligned);
+    auto table = reinterpret_cast<snapshot_entry*>(aligned + header.tableOffset);
+    for (std::uint32_t i = 0; i < header.sectionCount; i++)
+      if (table[i].id == id)
+        return table[i];
+
+    assert(false);
+    return table[0];
+  }
+
+  template <typename T> T* values(snapshot_section id)
+  {
+    return reinterpret_cast<T*>(aligned + entry(id).offset);
+  }
+
+  snapshot_view view() const { return snapshot_view(std::span<const std::byte>(aligned, size)); }
+
+  std::vector<std::byte> memory;
+  std::byte* aligned;
+  std::size_t size;
+};
+
+// Returns whether two worlds are in exactly the same state, as far as their bodies and contacts
+// go.
+static bool sameState(const engine& a, const engine& b)
+{
+  const body_store& bodiesA = a.bodies();
+  const body_store& bodiesB = b.bodies();
+  if (bodiesA.size() != bodiesB.size() || a.contacts().size() != b.contacts().size())
+    return false;
+
+  for (int body = 0; body < bodiesA.size(); body++)
+  {
+    if (bodiesA.positions[body] != bodiesB.positions[body] ||
+        bodiesA.orientations[body] != bodiesB.orientations[body] ||
+        bodiesA.linearVelocities[body] != bodiesB.linearVelocities[body] ||
+        bodiesA.angularVelocities[body] != bodiesB.angularVelocities[body] ||
+        a.handleOf(body) != b.handleOf(body))
+      return false;
+  }
+
+  for (std::size_t i = 0; i < a.contacts().size(); i++)
+  {
+    const contact_manifold& manifoldA = a.contacts()[i];
+    const contact_manifold& manifoldB = b.contacts()[i];
+    if (manifoldA.bodyA != manifoldB.bodyA || manifoldA.bodyB != manifoldB.bodyB ||
+        manifoldA.count != manifoldB.count ||
+        manifoldA.points[0].normalImpulse != manifoldB.points[0].normalImpulse)
+      return false;
+  }
+
+  return true;
+}
+
+int engine_snapshot(int argc, char** argv)
+{
+  float dt = 1.0f / 60.0f;
+
+  for (broadphase_type type :
+       {broadphase_type::tree, broadphase_type::sweepAndPrune, broadphase_type::grid})
+  {
+    // Two worlds are built the same way. One is saved, and the other simply keeps going.
+    engine world(type);
+    engine twin(type);
+    body_handle spare;
+
+    for (engine* target : {&world, &twin})
+    {
+      buildWorld(*target);
+
+      // Churn through a few bodies, so the handles have history to keep.
+      body_def spareDef;
+      spareDef.position = vector3(0.0f, 30.0f, -8.0f);
+      spare = target->addBody(spareDef);
+      target->removeBody(target->addBody(spareDef));
+
+      for (int i = 0; i < 150; i++)
+        target->update(dt * 1.3f);
+    }
+
+    assert(world.islandManager().sleepingIslands() > 0);
+
+    world_snapshot snapshot;
+    world.save(snapshot);
+
+    // A box dropped on a sleeping stack after the snapshot wakes it, which the rollback has to
+    // undo.
+    body_def droppedDef;
+    droppedDef.position = vector3(5.0f, 4.0f, 0.0f);
+    world.addBody(droppedDef);
+    for (int i = 0; i < 60; i++)
+      world.update(dt * 1.3f);
+
+    // Restoring the snapshot and stepping again takes the world down exactly the same path as the
+    // world that was never saved.
+    engine reference(type);
+    assert(reference.restore(snapshot.view()));
+    for (int i = 0; i < 60; i++)
+    {
+      reference.update(dt * 1.3f);
+      twin.update(dt * 1.3f);
+    }
+    assert(sameState(reference, twin));
+
+    assert(world.restore(snapshot.view()));
+    assert(world.bodies().size() == 20 && world.contains(spare));
+    for (int i = 0; i < 60; i++)
+      world.update(dt * 1.3f);
+    assert(sameState(world, reference));
+
+    // A world made with another broadphase takes on the one of the snapshot.
+    engine other(type == broadphase_type::grid ? broadphase_type::tree : broadphase_type::grid);
+    assert(other.restore(snapshot.view()));
+    for (int i = 0; i < 60; i++)
+      other.update(dt * 1.3f);
+    assert(sameState(other, reference));
+
+    // The bytes of a snapshot work just as well from a file, read in place.
+    const char* path = "flexor_snapshot_test.bin";
+    {
+      std::ofstream file(path, std::ios::binary);
+      std::span<const std::byte> bytes = snapshot.bytes();
+      file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    }
+
+    engine loaded(type);
+#if __has_include(<sys/mman.h>)
+    int descriptor = open(path, O_RDONLY);
+    assert(descriptor >= 0);
+
+    std::size_t size = snapshot.bytes().size();
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    assert(mapped != MAP_FAILED);
+
+    snapshot_view view(std::span<const std::byte>(static_cast<const std::byte*>(mapped), size));
+    assert(loaded.restore(view));
+
+    munmap(mapped, size);
+    close(descriptor);
+#else
+    world_snapshot copy;
+    world.save(copy);
+    assert(loaded.restore(copy.view()));
+#endif
+    std::remove(path);
+
+    for (int i = 0; i < 60; i++)
+      loaded.update(dt * 1.3f);
+    assert(sameState(loaded, reference));
+  }
+
+  // A snapshot that is cut short or from another version is turned away, and the world is left
+  // as it was.
+  engine world;
+  buildWorld(world);
+  world.step(dt);
+
+  world_snapshot snapshot;
+  world.save(snapshot);
+
+  std::span<const std::byte> bytes = snapshot.bytes();
+  assert(!snapshot_view(bytes.first(bytes.size() - 1)).valid());
+  assert(!snapshot_view(bytes.first(16)).valid());
+
+  std::vector<std::byte> altered(bytes.size() + snapshotAlignment);
+  std::byte* aligned = altered.data() + (snapshotAlignment -
+                                         reinterpret_cast<std::uintptr_t>(altered.data()) %
+                                           snapshotAlignment);
+  std::memcpy(aligned, bytes.data(), bytes.size());
+  reinterpret_cast<snapshot_header*>(aligned)->version++;
+
+  engine empty;
+  assert(!empty.restore(snapshot_view(std::span<const std::byte>(aligned, bytes.size()))));
+  assert(!empty.restore(snapshot_view()));
+  assert(empty.bodies().size() == 0);
+
+  // So is a snapshot whose sections don't agree on the bodies, with a section cut one short or
+  // hulls that reach past the saved vertices, and nothing of the world is replaced.
+  engine untouched;
+  assert(untouched.restore(snapshot.view()));
+
+  for (snapshot_section id : {snapshot_section::orientations, snapshot_section::shapes,
+                              snapshot_section::hullVertices, snapshot_section::handleDense,
+                              snapshot_section::islandStates, snapshot_section::islandBodies,
+                              snapshot_section::previousPositions})
+  {
+    std::memcpy(aligned, bytes.data(), bytes.size());
+    const auto& header = *reinterpret_cast<const snapshot_header*>(aligned);
+    auto table = reinterpret_cast<snapshot_entry*>(aligned + header.tableOffset);
+    for (std::uint32_t i = 0; i < header.sectionCount; i++)
+      if (table[i].id == id && table[i].count > 0)
+        table[i].count--;
+
+    snapshot_view damaged(std::span<const std::byte>(aligned, bytes.size()));
+    assert(damaged.valid() && !world.restore(damaged));
+    assert(sameState(world, untouched));
+  }
+
+  // Every index the broadphase keeps is checked as well, along with the types that pick a shape
+  // routine or a broadphase, so that a damaged snapshot can't send the next step out of bounds.
+  for (broadphase_type type :
+       {broadphase_type::tree, broadphase_type::sweepAndPrune, broadphase_type::grid})
+  {
+    engine target(type);
+    buildWorld(target);
+    target.step(dt);
+
+    world_snapshot saved;
+    target.save(saved);
+    engine clean;
+    assert(clean.restore(saved.view()));
+
+    // The type of broadphase comes last in the state of the engine, so it is found by looking back
+    // from the end for where two worlds that only differ in their broadphase hold each type.
+    broadphase_type otherType =
+      type == broadphase_type::tree ? broadphase_type::grid : broadphase_type::tree;
+    engine otherWorld(otherType);
+    buildWorld(otherWorld);
+    otherWorld.step(dt);
+    world_snapshot otherSaved;
+    otherWorld.save(otherSaved);
+
+    snapshot_copy original(saved);
+    snapshot_copy other(otherSaved);
+    auto state = original.values<std::byte>(snapshot_section::engineState);
+    auto otherState = other.values<std::byte>(snapshot_section::engineState);
+    std::size_t typeOffset = original.entry(snapshot_section::engineState).elementSize;
+    broadphase_type held = otherType, otherHeld = type;
+    while (held != type || otherHeld != otherType)
+    {
+      assert(typeOffset >= sizeof(broadphase_type));
+      typeOffset -= sizeof(broadphase_type);
+      std::memcpy(&held, state + typeOffset, sizeof(held));
+      std::memcpy(&otherHeld, otherState + typeOffset, sizeof(otherHeld));
+    }
+
+    int bodies = target.bodies().size();
+    std::vector<std::function<void(snapshot_copy&)>> damages = {
+      // The type of a shape is the first byte of its record.
+      [&](snapshot_copy& copy) { copy.values<std::uint8_t>(snapshot_section::shapes)[0] = 9; },
+      [&](snapshot_copy& copy)
+      {
+        auto unknown = static_cast<broadphase_type>(7);
+        std::memcpy(copy.values<std::byte>(snapshot_section::engineState) + typeOffset, &unknown,
+                    sizeof(unknown));
+      },
+      [&](snapshot_copy& copy)
+      { copy.values<body_pair>(snapshot_section::broadphasePairs)[0].b = bodies; },
+      [&](snapshot_copy& copy) { copy.entry(snapshot_section::broadphaseStatics).count--; }};
+
+    if (type == broadphase_type::tree)
+    {
+      damages.push_back([&](snapshot_copy& copy)
+                        { copy.values<int>(snapshot_section::treeProxies)[1] = 100000; });
+      damages.push_back([&](snapshot_copy& copy)
+                        { copy.values<int>(snapshot_section::treeRoot)[0] = 100000; });
+      damages.push_back([&](snapshot_copy& copy)
+                        { copy.values<int>(snapshot_section::treeRoot)[1] = 100000; });
+      damages.push_back([&](snapshot_copy& copy)
+                        { copy.values<std::uint8_t>(snapshot_section::treeMoved)[0] = 1; });
+      damages.push_back([&](snapshot_copy& copy)
+                        { copy.entry(snapshot_section::treeMoved).count--; });
+
+      // A leaf as the root leaves the rest of the tree unreachable.
+      damages.push_back(
+        [&](snapshot_copy& copy)
+        {
+          int* roots = copy.values<int>(snapshot_section::treeRoot);
+          roots[0] = copy.values<int>(snapshot_section::treeProxies)[0];
+        });
+
+      // Moving the root into the place of the first leaf leaves its children pointing at the old
+      // place as their parent.
+      damages.push_back(
+        [&](snapshot_copy& copy)
+        {
+          std::size_t nodeSize = copy.entry(snapshot_section::treeNodes).elementSize;
+          auto nodes = copy.values<std::byte>(snapshot_section::treeNodes);
+          int root = copy.values<int>(snapshot_section::treeRoot)[0];
+          assert(root != 0);
+          std::swap_ranges(nodes, nodes + nodeSize, nodes + root * nodeSize);
+        });
+    }
+    else if (type == broadphase_type::sweepAndPrune)
+    {
+      // An endpoint is a float followed by the index of its body.
+      damages.push_back([&](snapshot_copy& copy)
+                        { copy.values<int>(snapshot_section::sweepEndpoints)[1] = 100000; });
+      damages.push_back(
+        [&](snapshot_copy& copy)
+        {
+          copy.values<int>(snapshot_section::sweepCounts)[0] =
+            static_cast<int>(copy.entry(snapshot_section::sweepEndpoints).count) + 1;
+        });
+      damages.push_back([&](snapshot_copy& copy)
+                        { copy.values<std::uint8_t>(snapshot_section::sweepListed)[0] = 0; });
+      damages.push_back([&](snapshot_copy& copy)
+                        { copy.values<std::uint8_t>(snapshot_section::broadphaseSlots)[0] = 0; });
+      damages.push_back([&](snapshot_copy& copy)
+                        { copy.entry(snapshot_section::broadphaseBounds).count--; });
+    }
+    else
+    {
+      damages.push_back([&](snapshot_copy& copy)
+                        { copy.values<int>(snapshot_section::gridActive)[0] = 100000; });
+      damages.push_back([&](snapshot_copy& copy)
+                        { copy.values<int>(snapshot_section::gridActiveSlots)[0] = 5; });
+      damages.push_back([&](snapshot_copy& copy)
+                        { copy.values<std::uint8_t>(snapshot_section::broadphaseSlots)[0] = 0; });
+      damages.push_back([&](snapshot_copy& copy)
+                        { copy.entry(snapshot_section::gridActive).count--; });
+    }
+
+    assert(target.restore(original.view()));
+    for (const auto& damage : damages)
+    {
+      snapshot_copy copy(saved);
+      damage(copy);
+      assert(copy.view().valid() && !target.restore(copy.view()));
+      assert(sameState(target, clean));
+    }
+  }
+
+  // Hulls that start at the same vertex but have different counts are kept apart.
+  engine hulls;
+  body_def hullDef;
+  hullDef.geometry = shape::hull(std::span<const vector3>(bipyramid).first(4));
+  hulls.addBody(hullDef);
+  hullDef.position = vector3(3.0f, 0.0f, 0.0f);
+  hullDef.geometry = shape::hull(bipyramid);
+  hulls.addBody(hullDef);
+  hulls.addBody(hullDef);
+
+  world_snapshot hullSnapshot;
+  hulls.save(hullSnapshot);
+  assert(hullSnapshot.view().array<vector3>(snapshot_section::hullVertices).size() == 9);
+
+  engine restoredHulls;
+  assert(restoredHulls.restore(hullSnapshot.view()));
+  for (int body = 0; body < 3; body++)
+  {
+    std::span<const vector3> saved = hulls.bodies().shapes[body].vertices;
+    std::span<const vector3> loaded = restoredHulls.bodies().shapes[body].vertices;
+    assert(std::equal(saved.begin(), saved.end(), loaded.begin(), loaded.end()));
+  }
+
+  // Saving into the same snapshot again reuses its memory.
+  const std::byte* before = snapshot.bytes().data();
+  world.step(dt);
+  world.save(snapshot);
+  assert(snapshot.bytes().data() == before && snapshot.view().valid());
+
+  return 0;
+}
\ No newline at end of file
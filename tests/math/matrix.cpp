@@ -34,6 +34,86 @@ int math_matrix(int argc, char** argv)
     }
   }
 
+  // Small Matrix Factorization Tests
+  {
+    // Builds a symmetric positive definite matrix of any small size as M^T * M + I.
+    auto makeSpd = [](auto mat)
+    {
+      using matType = decltype(mat);
+      for (int c = 0; c < mat.columns(); c++)
+        for (int r = 0; r < mat.rows(); r++)
+          mat[c][r] = static_cast<float>((r * 5 + c * 3) % 7) * 0.25f - 0.75f;
+
+      return transpose(mat) * mat + matType(1.0f);
+    };
+
+    auto near = [](auto lhs, auto rhs, float tolerance)
+    {
+      for (int c = 0; c < lhs.columns(); c++)
+        for (int r = 0; r < lhs.rows(); r++)
+          if (fabs(lhs[c][r] - rhs[c][r]) > tolerance)
+            return false;
+
+      return true;
+    };
+
+    auto check = [&](auto mat)
+    {
+      using matType = decltype(mat);
+      auto spd = makeSpd(mat);
+
+      // The inverse undoes the matrix from either side.
+      matType inv = inverse(spd);
+      assert(near(inv * spd, matType(1.0f), 1e-4f));
+      assert(near(spd * inv, matType(1.0f), 1e-4f));
+
+      // The determinant is the square of the product of the cholesky diagonal.
+      matType lower = cholesky(spd);
+      assert(near(lower * transpose(lower), spd, 1e-4f));
+
+      float product = 1.0f;
+      for (int i = 0; i < mat.columns(); i++)
+        product *= lower[i][i];
+      assert(fabs(determinant(spd) - product * product) < 1e-3f * product * product);
+      assert(fabs(determinant(inv) * determinant(spd) - 1.0f) < 1e-4f);
+
+      // Both factorizations solve the same system.
+      auto b = spd[0];
+      for (int i = 0; i < b.length(); i++)
+        b[i] = static_cast<float>(i) - 1.0f;
+
+      auto fromCholesky = choleskySolve(lower, b);
+      auto fromLdlt = ldltSolve(ldlt(spd), b);
+      auto fromInverse = inv * b;
+      for (int i = 0; i < b.length(); i++)
+      {
+        assert(fabs(fromCholesky[i] - fromInverse[i]) < 1e-4f);
+        assert(fabs(fromLdlt[i] - fromInverse[i]) < 1e-4f);
+        assert(fabs((spd * fromLdlt)[i] - b[i]) < 1e-4f);
+      }
+    };
+
+    check(matrix2(0.0f));
+    check(matrix3(0.0f));
+    check(matrix4(0.0f));
+    check(matrix6(0.0f));
+
+    // Swapping two columns flips the sign of the determinant, and LDL^T handles indefinite
+    // matrices.
+    matrix3 swapped(0.0f);
+    swapped[0] = vector3(0.0f, 2.0f, 0.0f);
+    swapped[1] = vector3(3.0f, 0.0f, 0.0f);
+    swapped[2] = vector3(0.0f, 0.0f, 4.0f);
+    assert(determinant(swapped) == -24.0f);
+    assert(determinant(matrix6(2.0f)) == 64.0f);
+
+    matrix2 indefinite(0.0f);
+    indefinite[0] = vector2(1.0f, 2.0f);
+    indefinite[1] = vector2(2.0f, 1.0f);
+    vector2 solution = ldltSolve(ldlt(indefinite), vector2(3.0f, 3.0f));
+    assert(fabs(solution.x - 1.0f) < 1e-6f && fabs(solution.y - 1.0f) < 1e-6f);
+  }
+
   // Big Matrix Tests
   {
     matrix mat5(5, 5, 2.0f);
@@ -53,5 +133,82 @@ int math_matrix(int argc, char** argv)
     assert(rowVec * colVec == scalar);
   }
 
+  // Matrix Expression Tests
+  {
+    matrix a(8, 6, 1.0f);
+    matrix b(8, 6, 3.0f);
+
+    // Elementwise expressions are evaluated lazily in a single pass.
+    matrix res = a * 2.0f + b - a;
+    assert(res == matrix(8, 6, 4.0f));
+
+    res -= b;
+    res /= 0.5f;
+    assert(res == 2.0f * a);
+    assert(res - a == a);
+
+    // Assigning to an existing matrix evaluates in place.
+    res = -res + b;
+    assert(res == a);
+
+    // Products accept expressions on either side. Only the first six rows have a diagonal entry.
+    vector x(6, 1.0f);
+    vector expected(vector(6, 4.0f), 8);
+    assert((a + b) * (x + x) == expected * 2.0f);
+  }
+
+  // Blocked Product Tests
+  {
+    // Use sizes that don't line up with the register tiles or the cache blocks, and compare against
+    // a naive triple loop.
+    int m = 70, k = 300, n = 37;
+    matrix lhs(m, k, 0.0f);
+    matrix rhs(k, n, 0.0f);
+    for (int j = 0; j < k; j++)
+      for (int i = 0; i < m; i++)
+        lhs[j][i] = static_cast<float>((i * 7 + j * 3) % 11) - 5.0f;
+    for (int j = 0; j < n; j++)
+      for (int i = 0; i < k; i++)
+        rhs[j][i] = static_cast<float>((i * 5 + j * 13) % 7) - 3.0f;
+
+    matrix product = lhs * rhs;
+    assert(product.rows() == m && product.columns() == n);
+    for (int j = 0; j < n; j++)
+    {
+      for (int i = 0; i < m; i++)
+      {
+        float expected = 0.0f;
+        for (int p = 0; p < k; p++)
+          expected += lhs[p][i] * rhs[j][p];
+
+        assert(product[j][i] == expected);
+      }
+    }
+
+    vector x(k, 0.0f);
+    for (int i = 0; i < k; i++)
+      x[i] = static_cast<float>(i % 5) - 2.0f;
+
+    vector y = lhs * x;
+    vector yTrans = transpose(lhs) * vector(m, 1.0f);
+    for (int i = 0; i < m; i++)
+    {
+      float expected = 0.0f;
+      for (int p = 0; p < k; p++)
+        expected += lhs[p][i] * x[p];
+
+      assert(y[i] == expected);
+    }
+
+    for (int j = 0; j < k; j++)
+    {
+      float expected = 0.0f;
+      for (int i = 0; i < m; i++)
+        expected += lhs[j][i];
+
+      assert(yTrans[j] == expected);
+    }
+  }
+
   return 0;
 }
\ No newline at end of file
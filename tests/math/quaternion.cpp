@@ -1,8 +1,11 @@
 #include <math/quaternion.h>
+#include <math/quaternion_soa.h>
 #include <math/trig.h>
 using namespace flexor;
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 
 int math_quaternion(int argc, char** argv)
 {
@@ -30,5 +33,153 @@ int math_quaternion(int argc, char** argv)
   vector3 matrixRotated = qMatrix * z;
   assert(magnitude(quatRotated - matrixRotated) < 1e-5f);
 
+  // The unit quaternion fast path agrees with the general one, which also handles quaternions that
+  // aren't normalized.
+  quaternion r(vector3(1.0f, 2.0f, -0.5f), 0.7f);
+  vector3 v(0.3f, -1.2f, 2.5f);
+  assert(magnitude(rotate(r, v) - r * v) < 1e-5f);
+  assert(magnitude(rotate(r, v) - quaternion::matrix(r) * v) < 1e-5f);
+  quaternion scaled = quaternion::fromSimd(r.toSimd() * simd::splat(3.0f));
+  assert(magnitude(scaled * v - rotate(r, v)) < 1e-5f);
+
+  // Batched rotations give the same results as rotating one at a time, including the leftovers
+  // that don't fill a whole batch.
+  constexpr int count = 11;
+  quaternion quats[count];
+  vector3 vecs[count];
+  vector3 expected[count];
+  for (int i = 0; i < count; i++)
+  {
+    quats[i] = quaternion(vector3(1.0f, static_cast<float>(i), 0.5f), 0.3f * static_cast<float>(i));
+    vecs[i] = vector3(static_cast<float>(i), 1.0f, -2.0f);
+    expected[i] = rotate(quats[i], vecs[i]);
+  }
+
+  rotate(quats, vecs);
+  for (int i = 0; i < count; i++)
+    assert(magnitude(vecs[i] - expected[i]) < 1e-5f);
+
+  // Rotating many vectors by the same quaternion goes through its matrix, four at a time.
+  for (int i = 0; i < count; i++)
+  {
+    vecs[i] = vector3(static_cast<float>(i), 1.0f, -2.0f);
+    expected[i] = rotate(r, vecs[i]);
+  }
+
+  rotate(r, vecs);
+  for (int i = 0; i < count; i++)
+    assert(magnitude(vecs[i] - expected[i]) < 1e-5f);
+
+  // Stream kernels on arrays of quaternions match doing the same math one at a time.
+  auto near = [](const quaternion& lhs, const quaternion& rhs)
+  { return magnitude(quaternion::fromSimd(lhs.toSimd() - rhs.toSimd())) < 1e-5f; };
+
+  quaternion stream[count];
+  quaternion targets[count];
+  vector3 spins[count];
+  for (int i = 0; i < count; i++)
+  {
+    stream[i] = quaternion::fromSimd(quats[i].toSimd() * simd::splat(1.0f + 0.1f * i));
+    targets[i] = quaternion(vector3(0.0f, 1.0f, static_cast<float>(i)), -0.4f * i);
+    spins[i] = vector3(0.5f * i, -1.0f, 2.0f);
+  }
+
+  normalize(stream);
+  for (int i = 0; i < count; i++)
+    assert(near(stream[i], quats[i]));
+
+  float dt = 0.01f;
+  integrate(stream, spins, dt);
+  for (int i = 0; i < count; i++)
+  {
+    quaternion spin = quaternion::multiply(quaternion(0.0f, spins[i].x, spins[i].y, spins[i].z),
+                                           quats[i]);
+    quaternion stepped = normalize(quaternion::fromSimd(
+      quats[i].toSimd() + spin.toSimd() * simd::splat(0.5f * dt)));
+    assert(near(stream[i], stepped));
+  }
+
+  // The ends of an interpolation are its inputs, and at the midpoint nlerp and slerp agree.
+  quaternion blended[count];
+  quaternion linear[count];
+  slerp(quats, targets, 0.0f, blended);
+  for (int i = 0; i < count; i++)
+    assert(near(blended[i], quats[i]));
+
+  slerp(quats, targets, 0.5f, blended);
+  nlerp(quats, targets, 0.5f, linear);
+  for (int i = 0; i < count; i++)
+    assert(near(blended[i], linear[i]));
+
+  // Slerp moves at a constant angular speed, so a quarter of the way covers a quarter of the angle.
+  // The angle is measured between the quaternions as four dimensional vectors.
+  slerp(quats, targets, 0.25f, blended);
+  for (int i = 0; i < count; i++)
+  {
+    float total = simd::sum(quats[i].toSimd() * targets[i].toSimd());
+    float quarter = simd::sum(quats[i].toSimd() * blended[i].toSimd());
+    total = std::acos(std::min(std::fabs(total), 1.0f));
+    quarter = std::acos(std::min(quarter, 1.0f));
+    assert(std::fabs(quarter - 0.25f * total) < 1e-3f);
+  }
+
+  slerp(quats, targets, 1.0f, blended);
+  nlerp(quats, targets, 1.0f, linear);
+  for (int i = 0; i < count; i++)
+  {
+    // The target may come back negated, which is the same rotation.
+    assert(magnitude(rotate(blended[i], x) - rotate(targets[i], x)) < 1e-4f);
+    assert(magnitude(rotate(linear[i], y) - rotate(targets[i], y)) < 1e-4f);
+  }
+
+  // The structure of arrays streams give the same results as the array overloads.
+  float components[4][count];
+  float targetComponents[4][count];
+  float spinComponents[3][count];
+  auto split = [](const quaternion* in, float (&out)[4][count])
+  {
+    for (int i = 0; i < count; i++)
+      for (int c = 0; c < 4; c++)
+        out[c][i] = simd::lane(in[i].toSimd(), c);
+  };
+  auto joined = [&](int i)
+  {
+    return quaternion(components[3][i], components[0][i], components[1][i], components[2][i]);
+  };
+
+  quaternion reference[count];
+  for (int i = 0; i < count; i++)
+  {
+    reference[i] = quaternion::fromSimd(quats[i].toSimd() * simd::splat(2.0f));
+    for (int c = 0; c < 3; c++)
+      spinComponents[c][i] = spins[i][c];
+  }
+
+  split(reference, components);
+  split(targets, targetComponents);
+  quaternion_soa soa = {components[0], components[1], components[2], components[3], count};
+  quaternion_soa soaTargets = {targetComponents[0], targetComponents[1], targetComponents[2],
+                               targetComponents[3], count};
+
+  normalize(soa);
+  normalize(reference);
+  for (int i = 0; i < count; i++)
+    assert(near(joined(i), reference[i]));
+
+  integrate(soa, spinComponents[0], spinComponents[1], spinComponents[2], dt);
+  integrate(reference, spins, dt);
+  for (int i = 0; i < count; i++)
+    assert(near(joined(i), reference[i]));
+
+  nlerp(soa, soaTargets, 0.3f);
+  nlerp(reference, targets, 0.3f, reference);
+  for (int i = 0; i < count; i++)
+    assert(near(joined(i), reference[i]));
+
+  slerp(soa, soaTargets, 0.6f);
+  slerp(reference, targets, 0.6f, reference);
+  for (int i = 0; i < count; i++)
+    assert(near(joined(i), reference[i]));
+
   return 0;
 }
\ No newline at end of file
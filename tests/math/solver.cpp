@@ -3,6 +3,7 @@ using namespace flexor;
 
 #include <cassert>
 #include <iostream>
+#include <vector>
 
 int math_solver(int argc, char** argv)
 {
@@ -25,5 +26,266 @@ int math_solver(int argc, char** argv)
   // Make sure that the computed version is close to the final version.
   assert(magnitude(computedX - trueX) < 1e-5f);
 
+  // Factor A once, and reuse the factorization for several right hand sides.
+  solver::lu factorization(A);
+  assert(!factorization.singular());
+  assert(magnitude(factorization.solve(B) - trueX) < 1e-5f);
+
+  vector otherX = {1.0f, -2.0f, 0.5f, 3.0f};
+  vector otherB = A * otherX;
+  factorization.solveInPlace(otherB);
+  assert(magnitude(otherB - otherX) < 1e-5f);
+
+  // Solve for both right hand sides at once as the columns of a matrix.
+  matrix X = factorization.solve(matrix({B, A * otherX}));
+  assert(magnitude(X[0] - trueX) < 1e-5f);
+  assert(magnitude(X[1] - otherX) < 1e-5f);
+
+  // The determinant of a triangular matrix is the product of its diagonal, and swapping two columns
+  // flips its sign.
+  matrix triangular = {{2.0f, 0.0f, 0.0f}, {1.0f, 3.0f, 0.0f}, {4.0f, 5.0f, 6.0f}};
+  matrix swapped = {{1.0f, 3.0f, 0.0f}, {2.0f, 0.0f, 0.0f}, {4.0f, 5.0f, 6.0f}};
+  assert(fabs(solver::lu(triangular).determinant() - 36.0f) < 1e-4f);
+  assert(fabs(solver::lu(swapped).determinant() + 36.0f) < 1e-4f);
+
+  // A zero on the diagonal forces a pivot, and a tiny one should also be pivoted away from.
+  matrix needsPivot = {{1e-8f, 1.0f}, {1.0f, 1.0f}};
+  vector pivotX = {1.0f, 2.0f};
+  assert(magnitude(solver::lu(needsPivot).solve(needsPivot * pivotX) - pivotX) < 1e-5f);
+  assert(magnitude(solver::gaussJordan(needsPivot, needsPivot * pivotX) - pivotX) < 1e-5f);
+
+  // Singular matrices are reported through the return value rather than an exception.
+  matrix singular = {{1.0f, 2.0f, 3.0f}, {2.0f, 4.0f, 6.0f}, {0.0f, 1.0f, 1.0f}};
+  assert(!factorization.factor(singular));
+  assert(factorization.singular());
+  assert(factorization.determinant() == 0.0f);
+  assert(factorization.factor(A));
+
+  // Projected Gauss-Seidel Tests
+  {
+    // Without bounds, PGS on a diagonally dominant system converges to the direct solution.
+    csr_matrix system(3, 3,
+                      {{0, 0, 4.0f}, {0, 1, 1.0f}, {1, 0, 1.0f}, {1, 1, 5.0f}, {1, 2, 2.0f},
+                       {2, 1, 2.0f}, {2, 2, 6.0f}});
+    float rhs[3] = {1.0f, 2.0f, 3.0f};
+    float lower[3] = {-INFINITY, -INFINITY, -INFINITY};
+    float upper[3] = {INFINITY, INFINITY, INFINITY};
+    float lambda[3] = {0.0f, 0.0f, 0.0f};
+
+    matrix dense = {{4.0f, 1.0f, 0.0f}, {1.0f, 5.0f, 2.0f}, {0.0f, 2.0f, 6.0f}};
+    vector direct = solver::lu(dense).solve(vector({1.0f, 2.0f, 3.0f}));
+
+    solver::pgs_settings settings;
+    settings.iterations = 50;
+    float change = solver::projectedGaussSeidel(system, rhs, {lower, upper}, lambda, settings);
+    assert(change < 1e-5f);
+    for (int i = 0; i < 3; i++)
+      assert(fabs(lambda[i] - direct[i]) < 1e-5f);
+
+    // A body sliding into the ground at (3, -2, 0) has a contact row along the normal, and a
+    // friction row along x that depends on it with a friction coefficient of 0.5.
+    block_jacobian J(1);
+    J.addRow(0, {vector3(0.0f, 1.0f, 0.0f), vector3(0.0f)}, -1, {});
+    J.addRow(0, {vector3(1.0f, 0.0f, 0.0f), vector3(0.0f)}, -1, {});
+
+    float inverseMasses[1] = {1.0f};
+    matrix3 inverseInertias[1] = {matrix3(1.0f)};
+    float target[2] = {0.0f, 0.0f};
+    float contactLower[2] = {0.0f, 0.0f};
+    float contactUpper[2] = {INFINITY, 0.5f};
+    int friction[2] = {-1, 0};
+    solver::lcp_bounds contact = {contactLower, contactUpper, friction};
+
+    vector3 linear[1] = {vector3(3.0f, -2.0f, 0.0f)};
+    vector3 angular[1] = {vector3(0.0f)};
+    float impulses[2] = {0.0f, 0.0f};
+    solver::sequentialImpulse(J, inverseMasses, inverseInertias, target, contact, impulses, linear,
+                              angular);
+
+    // The normal impulse stops the body, and friction can only take 1 off of the sliding speed.
+    assert(fabs(impulses[0] - 2.0f) < 1e-5f && fabs(impulses[1] + 1.0f) < 1e-5f);
+    assert(linear[0] == vector3(2.0f, 0.0f, 0.0f));
+
+    // The assembled form of the same problem gives the same impulses. Its right hand side is the
+    // change in velocity each row asks for.
+    float velocities[2];
+    vector3 initial[1] = {vector3(3.0f, -2.0f, 0.0f)};
+    J.multiply(initial, angular, velocities);
+
+    float bias[2] = {target[0] - velocities[0], target[1] - velocities[1]};
+    float assembled[2] = {0.0f, 0.0f};
+    csr_matrix effectiveMass = assembleSystem(J, inverseMasses, inverseInertias);
+    solver::projectedGaussSeidel(effectiveMass, bias, contact, assembled);
+    assert(fabs(assembled[0] - 2.0f) < 1e-5f && fabs(assembled[1] + 1.0f) < 1e-5f);
+
+    // Warm starting with the previous impulses and no iterations gives the same result.
+    linear[0] = vector3(3.0f, -2.0f, 0.0f);
+    settings.iterations = 0;
+    solver::sequentialImpulse(J, inverseMasses, inverseInertias, target, contact, impulses, linear,
+                              angular, settings);
+    assert(linear[0] == vector3(2.0f, 0.0f, 0.0f));
+
+    // A separating body is left alone, since the contact can only push.
+    linear[0] = vector3(0.0f, 1.0f, 0.0f);
+    impulses[0] = impulses[1] = 0.0f;
+    solver::sequentialImpulse(J, inverseMasses, inverseInertias, target, contact, impulses, linear,
+                              angular);
+    assert(impulses[0] == 0.0f && impulses[1] == 0.0f);
+    assert(linear[0] == vector3(0.0f, 1.0f, 0.0f));
+  }
+
+  // Conjugate Gradient Tests
+  {
+    // The 5 point laplacian on a 12 by 12 grid, shifted slightly to keep it well away from
+    // singular.
+    int side = 12;
+    int n = side * side;
+    std::vector<triplet> entries;
+    for (int y = 0; y < side; y++)
+      for (int x = 0; x < side; x++)
+      {
+        int row = x + y * side;
+        entries.push_back({row, row, 4.1f});
+        if (x > 0)
+          entries.push_back({row, row - 1, -1.0f});
+        if (x < side - 1)
+          entries.push_back({row, row + 1, -1.0f});
+        if (y > 0)
+          entries.push_back({row, row - side, -1.0f});
+        if (y < side - 1)
+          entries.push_back({row, row + side, -1.0f});
+      }
+
+    csr_matrix laplacian(n, n, entries);
+    vector trueSolution(n);
+    for (int i = 0; i < n; i++)
+      trueSolution[i] = static_cast<float>(i % 9) - 4.0f;
+    vector rhs = laplacian * trueSolution;
+
+    solver::cg_settings settings;
+    settings.tolerance = 1e-6f;
+    settings.maxIterations = 500;
+
+    vector plain(n);
+    auto multiply = [&](const float* in, float* out) { laplacian.multiply(in, out); };
+    solver::cg_result plainResult =
+      solver::conjugateGradient(n, multiply, rhs.data(), plain.data(), settings);
+    assert(plainResult.residual <= settings.tolerance);
+    assert(magnitude(plain - trueSolution) < 1e-3f);
+
+    vector jacobi(n);
+    solver::cg_result jacobiResult = solver::conjugateGradient(
+      laplacian, rhs, jacobi, solver::jacobi_preconditioner(laplacian), settings);
+    assert(jacobiResult.residual <= settings.tolerance);
+    assert(magnitude(jacobi - trueSolution) < 1e-3f);
+
+    // Incomplete cholesky should need noticeably fewer iterations than no preconditioner.
+    vector cholesky(n);
+    solver::cg_result choleskyResult = solver::conjugateGradient(
+      laplacian, rhs, cholesky, solver::incomplete_cholesky(laplacian), settings);
+    assert(choleskyResult.residual <= settings.tolerance);
+    assert(choleskyResult.iterations < plainResult.iterations);
+    assert(magnitude(cholesky - trueSolution) < 1e-3f);
+
+    // On a tridiagonal matrix there is no fill-in, so IC(0) is the exact factorization.
+    std::vector<triplet> band;
+    for (int row = 0; row < 4; row++)
+    {
+      band.push_back({row, row, 2.0f});
+      if (row > 0)
+        band.push_back({row, row - 1, -1.0f});
+      if (row < 3)
+        band.push_back({row, row + 1, -1.0f});
+    }
+
+    csr_matrix tridiagonal(4, 4, band);
+    vector exact(4);
+    vector tridiagonalRhs = {1.0f, 0.0f, 0.0f, 1.0f};
+    solver::cg_result exactResult = solver::conjugateGradient(
+      tridiagonal, tridiagonalRhs, exact, solver::incomplete_cholesky(tridiagonal), settings);
+    assert(exactResult.iterations <= 1);
+    assert(magnitude(exact - vector(4, 1.0f)) < 1e-5f);
+
+    // A good initial guess exits right away.
+    solver::cg_result warmResult = solver::conjugateGradient(
+      laplacian, rhs, cholesky, solver::incomplete_cholesky(laplacian), settings);
+    assert(warmResult.iterations <= 1);
+  }
+
+  // Batched Solver Tests
+  {
+    // Use a count that leaves a partial batch on every backend, and make each system symmetric
+    // positive definite as M^T * M + I.
+    constexpr int count = 13;
+    auto entry = [](int k, int r, int c)
+    { return static_cast<float>((k * 7 + r * 3 + c * 5) % 11) - 5.0f; };
+
+    float A3[9 * count], b3[3 * count], x3[3 * count];
+    float A6[36 * count], b6[6 * count], x6[6 * count];
+    matrix3 mats[count];
+    vector3 rhs[count];
+    vector3 sols[count];
+
+    for (int k = 0; k < count; k++)
+    {
+      for (int n : {3, 6})
+      {
+        float* A = n == 3 ? A3 : A6;
+        float* b = n == 3 ? b3 : b6;
+        for (int c = 0; c < n; c++)
+        {
+          for (int r = 0; r < n; r++)
+          {
+            float value = r == c ? 1.0f : 0.0f;
+            for (int i = 0; i < n; i++)
+              value += entry(k, i, r) * entry(k, i, c) * 0.1f;
+
+            A[(c * n + r) * count + k] = value;
+          }
+
+          b[c * count + k] = static_cast<float>(c - k % 3);
+        }
+      }
+
+      for (int c = 0; c < 3; c++)
+      {
+        for (int r = 0; r < 3; r++)
+          mats[k][c][r] = A3[(c * 3 + r) * count + k];
+        rhs[k][c] = b3[c * count + k];
+      }
+    }
+
+    solver::solveBatch<3>(count, A3, b3, x3);
+    solver::solveBatch<6>(count, A6, b6, x6);
+    solver::solveBatch(count, mats, rhs, sols);
+
+    // Compare every system against the LU solve.
+    for (int k = 0; k < count; k++)
+    {
+      for (int n : {3, 6})
+      {
+        const float* A = n == 3 ? A3 : A6;
+        const float* b = n == 3 ? b3 : b6;
+        const float* x = n == 3 ? x3 : x6;
+
+        matrix system(n, n, 0.0f);
+        vector target(n);
+        for (int c = 0; c < n; c++)
+        {
+          for (int r = 0; r < n; r++)
+            system(r, c) = A[(c * n + r) * count + k];
+          target[c] = b[c * count + k];
+        }
+
+        vector expected = solver::lu(system).solve(target);
+        for (int r = 0; r < n; r++)
+          assert(fabs(x[r * count + k] - expected[r]) < 1e-4f);
+      }
+
+      for (int r = 0; r < 3; r++)
+        assert(fabs(sols[k][r] - x3[r * count + k]) < 1e-6f);
+    }
+  }
+
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include <math/sparse.h>
+using namespace flexor;
+
+#include <cassert>
+#include <cmath>
+
+int math_sparse(int argc, char** argv)
+{
+  // CSR Matrix Tests
+  {
+    // Entries are given out of order, and the two at (1, 2) should be summed.
+    csr_matrix mat(3, 4, {{2, 3, 5.0f}, {1, 2, 1.0f}, {0, 0, 2.0f}, {1, 0, -1.0f}, {1, 2, 2.0f}});
+    assert(mat.rows() == 3 && mat.columns() == 4);
+    assert(mat.nonZeros() == 4);
+    assert(mat(0, 0) == 2.0f && mat(1, 0) == -1.0f && mat(1, 2) == 3.0f && mat(2, 3) == 5.0f);
+    assert(mat(0, 1) == 0.0f && mat(2, 2) == 0.0f);
+    assert(mat.diagonal(0) == 2.0f && mat.diagonal(1) == 0.0f);
+
+    vector x = {1.0f, 2.0f, 3.0f, 4.0f};
+    assert(mat * x == vector({2.0f, 8.0f, 20.0f}));
+
+    vector y = {1.0f, 2.0f, 3.0f};
+    assert(multiplyTranspose(mat, y) == vector({0.0f, 0.0f, 6.0f, 15.0f}));
+  }
+
+  // Block Jacobian Tests
+  {
+    // Three bodies, one of which is static, and a row attached to the world.
+    block_jacobian jacobian(3);
+    jacobian.addRow(0, {vector3(1.0f, 0.0f, 0.0f), vector3(0.0f, 1.0f, 2.0f)}, 1,
+                    {vector3(-1.0f, 0.0f, 0.0f), vector3(0.0f, -3.0f, 1.0f)});
+    jacobian.addRow(1, {vector3(0.0f, 1.0f, 0.0f), vector3(1.0f, 0.0f, 0.0f)}, 2,
+                    {vector3(0.0f, -1.0f, 0.0f), vector3(2.0f, 0.0f, 1.0f)});
+    jacobian.addRow(0, {vector3(0.0f, 0.0f, 1.0f), vector3(0.5f, 0.5f, 0.0f)}, -1, {});
+    jacobian.addRow(1, {vector3(1.0f, 1.0f, 0.0f), vector3(0.0f, 0.0f, 1.0f)}, 0,
+                    {vector3(0.0f, 2.0f, 1.0f), vector3(1.0f, 0.0f, 0.0f)});
+
+    assert(jacobian.rows() == 4 && jacobian.columns() == 18);
+
+    csr_matrix csr = jacobian.toCsr();
+    assert(csr.nonZeros() <= 12 * jacobian.rows());
+
+    vector velocities(18);
+    for (int i = 0; i < 18; i++)
+      velocities[i] = static_cast<float>(i % 7) - 3.0f;
+
+    // The block products should agree with the generic sparse products.
+    vector lambda = {1.0f, -2.0f, 0.5f, 3.0f};
+    assert(jacobian * velocities == csr * velocities);
+    assert(multiplyTranspose(jacobian, lambda) == multiplyTranspose(csr, lambda));
+
+    vector3 linear[3];
+    vector3 angular[3];
+    for (int body = 0; body < 3; body++)
+    {
+      const float* v = velocities.data() + 6 * body;
+      linear[body] = vector3(v[0], v[1], v[2]);
+      angular[body] = vector3(v[3], v[4], v[5]);
+    }
+
+    float constraintVelocities[4];
+    jacobian.multiply(linear, angular, constraintVelocities);
+    vector flat = jacobian * velocities;
+    for (int row = 0; row < 4; row++)
+      assert(std::fabs(constraintVelocities[row] - flat[row]) < 1e-5f);
+
+    jacobian.multiplyTranspose(lambda.data(), linear, angular);
+    vector impulses = multiplyTranspose(jacobian, lambda);
+    for (int body = 0; body < 3; body++)
+      for (int k = 0; k < 3; k++)
+      {
+        assert(linear[body][k] == impulses[6 * body + k]);
+        assert(angular[body][k] == impulses[6 * body + 3 + k]);
+      }
+
+    // Compare the assembled system against J * M^-1 * J^T computed densely.
+    float inverseMasses[3] = {1.0f, 0.5f, 0.0f};
+    matrix3 inverseInertias[3] = {matrix3(2.0f), matrix3(1.0f), matrix3(0.0f)};
+    inverseInertias[1][0][1] = 0.25f;
+    inverseInertias[1][1][0] = 0.25f;
+
+    matrix dense(4, 18, 0.0f);
+    for (int row = 0; row < 4; row++)
+      for (int col = 0; col < 18; col++)
+        dense(row, col) = csr(row, col);
+
+    matrix inverseMass(18, 18, 0.0f);
+    for (int body = 0; body < 3; body++)
+      for (int i = 0; i < 3; i++)
+      {
+        inverseMass(6 * body + i, 6 * body + i) = inverseMasses[body];
+        for (int j = 0; j < 3; j++)
+          inverseMass(6 * body + 3 + i, 6 * body + 3 + j) = inverseInertias[body][j][i];
+      }
+
+    matrix expected = dense * inverseMass * transpose(dense);
+    csr_matrix system = assembleSystem(jacobian, inverseMasses, inverseInertias);
+    assert(system.rows() == 4 && system.columns() == 4);
+    for (int row = 0; row < 4; row++)
+      for (int col = 0; col < 4; col++)
+        assert(std::fabs(system(row, col) - expected(row, col)) < 1e-5f);
+
+    // Rows 1 and 2 share no dynamic body, so their entry is never stored.
+    assert(system.nonZeros() < 16);
+  }
+
+  return 0;
+}
\ No newline at end of file
@@ -40,5 +40,28 @@ int math_vector(int argc, char** argv)
     assert(expanded == vec4);
   }
 
+  // Vector Expression Tests
+  {
+    vector a(1000, 1.0f);
+    vector b(1000, 2.0f);
+    vector c(1000, 3.0f);
+
+    // Compound expressions are evaluated lazily in a single pass.
+    vector res = a + b * 2.0f - c;
+    assert(res == vector(1000, 2.0f));
+
+    // Assigning to an existing vector evaluates in place, even when it appears in the expression.
+    res = res / 2.0f + a;
+    assert(res == vector(1000, 2.0f));
+
+    res += -a;
+    res -= a * 0.5f;
+    assert(res == vector(1000, 0.5f));
+
+    // Expressions can be used anywhere that a vector can.
+    assert(dot(a + a, b) == 4000.0f);
+    assert(magnitude(c - a - b) == 0.0f);
+  }
+
   return 0;
 }
\ No newline at end of file